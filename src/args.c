@@ -0,0 +1,715 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#include "fmacros.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#include "args.h"
+#include "zc_defs.h"
+
+/* length modifiers */
+#define ZLOG_ARGS_LEN_NONE 0
+#define ZLOG_ARGS_LEN_HH 1
+#define ZLOG_ARGS_LEN_H 2
+#define ZLOG_ARGS_LEN_L 3
+#define ZLOG_ARGS_LEN_LL 4
+#define ZLOG_ARGS_LEN_J 5
+#define ZLOG_ARGS_LEN_Z 6
+#define ZLOG_ARGS_LEN_T 7
+#define ZLOG_ARGS_LEN_LD 8
+
+/* one conversion of format, from '%' to conversion char */
+typedef struct {
+	size_t len;
+	size_t body_len; /* '%', flags, width and precision */
+	int plain;       /* no flags, width or precision */
+	int width_star;
+	int prec_star;
+	int precision;   /* -1 means not given */
+	int length;
+	char conv;
+} zlog_args_spec_t;
+
+/* string slot, NULL is kept as not a real length */
+#define ZLOG_ARGS_NULL_STR ((size_t)-1)
+
+/*******************************************************************************/
+void zlog_args_profile(zlog_args_t * a_args, int flag)
+{
+	zc_assert(a_args,);
+	zc_profile(flag, "---args[%p][%p][%ld][%ld][%ld]---",
+			a_args, a_args->start, (long)a_args->len,
+			(long)a_args->size, (long)a_args->format_len);
+	return;
+}
+
+void zlog_args_del(zlog_args_t * a_args)
+{
+	zc_assert(a_args,);
+	if (a_args->start) free(a_args->start);
+	free(a_args);
+	zc_debug("zlog_args_del[%p]", a_args);
+	return;
+}
+
+zlog_args_t *zlog_args_new(size_t size)
+{
+	zlog_args_t *a_args;
+
+	a_args = calloc(1, sizeof(zlog_args_t));
+	if (!a_args) {
+		zc_error("calloc fail, errno[%d]", errno);
+		return NULL;
+	}
+
+	a_args->start = malloc(size);
+	if (!a_args->start) {
+		zc_error("malloc fail, errno[%d]", errno);
+		free(a_args);
+		return NULL;
+	}
+	a_args->size = size;
+
+	//zlog_args_profile(a_args, ZC_DEBUG);
+	return a_args;
+}
+
+int zlog_args_reserve(zlog_args_t * a_args, size_t len)
+{
+	size_t new_size;
+	char *p;
+
+	if (a_args->len + len <= a_args->size) return 0;
+
+	for (new_size = a_args->size * 2; new_size < a_args->len + len; new_size *= 2)
+		/*EMPTY*/;
+	p = realloc(a_args->start, new_size);
+	if (!p) {
+		zc_error("realloc fail, errno[%d]", errno);
+		return -1;
+	}
+	a_args->start = p;
+	a_args->size = new_size;
+	return 0;
+}
+
+int zlog_args_append(zlog_args_t * a_args, const void *data, size_t len)
+{
+	if (zlog_args_reserve(a_args, len)) return -1;
+	memcpy(a_args->start + a_args->len, data, len);
+	a_args->len += len;
+	return 0;
+}
+
+int zlog_args_put_varint(zlog_args_t * a_args, unsigned long long v)
+{
+	unsigned char *p;
+
+	if (zlog_args_reserve(a_args, 10)) return -1;
+	p = (unsigned char *)a_args->start + a_args->len;
+	while (v >= 0x80) {
+		*p++ = (unsigned char)(v | 0x80);
+		v >>= 7;
+	}
+	*p++ = (unsigned char)v;
+	a_args->len = (char *)p - a_args->start;
+	return 0;
+}
+
+int zlog_args_get_varint(const char **p, const char *end, unsigned long long *v)
+{
+	const unsigned char *q = (const unsigned char *)*p;
+	int shift = 0;
+
+	*v = 0;
+	while ((const char *)q < end && shift < 64) {
+		*v |= (unsigned long long)(*q & 0x7F) << shift;
+		if (!(*q++ & 0x80)) {
+			*p = (const char *)q;
+			return 0;
+		}
+		shift += 7;
+	}
+	return -1;
+}
+
+#define zlog_args_put(a_args, value) do { \
+	if (zlog_args_reserve(a_args, sizeof(value))) goto err; \
+	memcpy(a_args->start + a_args->len, &(value), sizeof(value)); \
+	a_args->len += sizeof(value); \
+} while (0)
+
+#define zlog_args_get(p, end, value) do { \
+	if ((size_t)((end) - (p)) < sizeof(value)) goto err; \
+	memcpy(&(value), p, sizeof(value)); \
+	p += sizeof(value); \
+} while (0)
+
+/*******************************************************************************/
+/* p points to '%', return -1 if not supported */
+static int zlog_args_parse(const char *p, zlog_args_spec_t * a_spec)
+{
+	const char *q = p + 1;
+
+	memset(a_spec, 0x00, sizeof(*a_spec));
+	a_spec->precision = -1;
+
+	while (*q == '-' || *q == '+' || *q == ' ' || *q == '#' || *q == '0' || *q == '\'') q++;
+
+	if (*q == '*') {
+		a_spec->width_star = 1;
+		q++;
+	} else {
+		while (*q >= '0' && *q <= '9') q++;
+		if (*q == '$') return -1; /* positional args */
+	}
+
+	if (*q == '.') {
+		q++;
+		if (*q == '*') {
+			a_spec->prec_star = 1;
+			q++;
+		} else {
+			a_spec->precision = 0;
+			while (*q >= '0' && *q <= '9') {
+				a_spec->precision = a_spec->precision * 10 + (*q - '0');
+				q++;
+			}
+		}
+	}
+	a_spec->body_len = q - p;
+	a_spec->plain = (a_spec->body_len == 1);
+
+	switch (*q) {
+	case 'h':
+		if (*(q + 1) == 'h') {
+			a_spec->length = ZLOG_ARGS_LEN_HH;
+			q += 2;
+		} else {
+			a_spec->length = ZLOG_ARGS_LEN_H;
+			q++;
+		}
+		break;
+	case 'l':
+		if (*(q + 1) == 'l') {
+			a_spec->length = ZLOG_ARGS_LEN_LL;
+			q += 2;
+		} else {
+			a_spec->length = ZLOG_ARGS_LEN_L;
+			q++;
+		}
+		break;
+	case 'q':
+		a_spec->length = ZLOG_ARGS_LEN_LL;
+		q++;
+		break;
+	case 'j':
+		a_spec->length = ZLOG_ARGS_LEN_J;
+		q++;
+		break;
+	case 'z':
+	case 'Z':
+		a_spec->length = ZLOG_ARGS_LEN_Z;
+		q++;
+		break;
+	case 't':
+		a_spec->length = ZLOG_ARGS_LEN_T;
+		q++;
+		break;
+	case 'L':
+		a_spec->length = ZLOG_ARGS_LEN_LD;
+		q++;
+		break;
+	default:
+		break;
+	}
+
+	a_spec->conv = *q;
+	switch (a_spec->conv) {
+	case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+		if (a_spec->length == ZLOG_ARGS_LEN_LD) a_spec->length = ZLOG_ARGS_LEN_LL;
+		break;
+	case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+		break;
+	case 'c': case 's':
+		if (a_spec->length != ZLOG_ARGS_LEN_NONE) return -1; /* wide chars */
+		break;
+	case 'p':
+		break;
+	default:
+		return -1; /* %n %m %C %S and unknown */
+	}
+
+	a_spec->len = q + 1 - p;
+	return 0;
+}
+
+/*******************************************************************************/
+int zlog_args_pack(zlog_args_t * a_args, const char *format, va_list args)
+{
+	va_list ap;
+	const char *p;
+	zlog_args_spec_t a_spec;
+	int star;
+	long long ll;
+	unsigned long long ull;
+	double d;
+	long double ld;
+	void *ptr;
+	char *s;
+	size_t s_len;
+
+	a_args->len = 0;
+	va_copy(ap, args);
+
+	for (p = format; *p != '\0'; ) {
+		if (*p != '%') {
+			p++;
+			continue;
+		}
+		if (*(p + 1) == '%') {
+			p += 2;
+			continue;
+		}
+		if (zlog_args_parse(p, &a_spec)) {
+			va_end(ap);
+			return 1;
+		}
+		p += a_spec.len;
+
+		if (a_spec.width_star) {
+			star = va_arg(ap, int);
+			zlog_args_put(a_args, star);
+		}
+		if (a_spec.prec_star) {
+			star = va_arg(ap, int);
+			zlog_args_put(a_args, star);
+			a_spec.precision = (star < 0) ? -1 : star;
+		}
+
+		switch (a_spec.conv) {
+		case 'd': case 'i':
+			switch (a_spec.length) {
+			case ZLOG_ARGS_LEN_HH: ll = (signed char) va_arg(ap, int); break;
+			case ZLOG_ARGS_LEN_H: ll = (short) va_arg(ap, int); break;
+			case ZLOG_ARGS_LEN_L: ll = va_arg(ap, long); break;
+			case ZLOG_ARGS_LEN_LL: ll = va_arg(ap, long long); break;
+			case ZLOG_ARGS_LEN_J: ll = va_arg(ap, intmax_t); break;
+			case ZLOG_ARGS_LEN_Z: ll = va_arg(ap, ssize_t); break;
+			case ZLOG_ARGS_LEN_T: ll = va_arg(ap, ptrdiff_t); break;
+			default: ll = va_arg(ap, int); break;
+			}
+			zlog_args_put(a_args, ll);
+			break;
+		case 'o': case 'u': case 'x': case 'X':
+			switch (a_spec.length) {
+			case ZLOG_ARGS_LEN_HH: ull = (unsigned char) va_arg(ap, unsigned int); break;
+			case ZLOG_ARGS_LEN_H: ull = (unsigned short) va_arg(ap, unsigned int); break;
+			case ZLOG_ARGS_LEN_L: ull = va_arg(ap, unsigned long); break;
+			case ZLOG_ARGS_LEN_LL: ull = va_arg(ap, unsigned long long); break;
+			case ZLOG_ARGS_LEN_J: ull = va_arg(ap, uintmax_t); break;
+			case ZLOG_ARGS_LEN_Z: ull = va_arg(ap, size_t); break;
+			case ZLOG_ARGS_LEN_T: ull = (unsigned long long) va_arg(ap, ptrdiff_t); break;
+			default: ull = va_arg(ap, unsigned int); break;
+			}
+			zlog_args_put(a_args, ull);
+			break;
+		case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+			if (a_spec.length == ZLOG_ARGS_LEN_LD) {
+				ld = va_arg(ap, long double);
+				zlog_args_put(a_args, ld);
+			} else {
+				d = va_arg(ap, double);
+				zlog_args_put(a_args, d);
+			}
+			break;
+		case 'c':
+			star = va_arg(ap, int);
+			zlog_args_put(a_args, star);
+			break;
+		case 'p':
+			ptr = va_arg(ap, void *);
+			zlog_args_put(a_args, ptr);
+			break;
+		case 's':
+			s = va_arg(ap, char *);
+			if (!s) {
+				s_len = ZLOG_ARGS_NULL_STR;
+				zlog_args_put(a_args, s_len);
+				break;
+			}
+			/* the string may be not terminated within precision */
+			s_len = (a_spec.precision >= 0) ? strnlen(s, a_spec.precision) : strlen(s);
+			zlog_args_put(a_args, s_len);
+			if (zlog_args_reserve(a_args, s_len + 1)) goto err;
+			memcpy(a_args->start + a_args->len, s, s_len);
+			a_args->start[a_args->len + s_len] = '\0';
+			a_args->len += s_len + 1;
+			break;
+		}
+	}
+
+	va_end(ap);
+	a_args->format_len = p - format;
+	return 0;
+err:
+	va_end(ap);
+	return -1;
+}
+
+/*******************************************************************************/
+#define zlog_args_snprintf(str, size, fmt, a_spec, width, prec, value) \
+	((a_spec)->width_star \
+	 ? ((a_spec)->prec_star \
+		? snprintf(str, size, fmt, width, prec, value) \
+		: snprintf(str, size, fmt, width, value)) \
+	 : ((a_spec)->prec_star \
+		? snprintf(str, size, fmt, prec, value) \
+		: snprintf(str, size, fmt, value)))
+
+/* print one conversion to tmp, or to a heap string if tmp is not enough */
+#define zlog_args_print(value) do { \
+	nwrite = zlog_args_snprintf(tmp, sizeof(tmp), fmt, &a_spec, width, prec, value); \
+	if (nwrite < 0) { \
+		zc_error("snprintf fail, errno[%d], fmt[%s]", errno, fmt); \
+		return -1; \
+	} \
+	if (nwrite >= sizeof(tmp)) { \
+		out = malloc(nwrite + 1); \
+		if (!out) { \
+			zc_error("malloc fail, errno[%d]", errno); \
+			return -1; \
+		} \
+		zlog_args_snprintf(out, nwrite + 1, fmt, &a_spec, width, prec, value); \
+	} \
+} while (0)
+
+int zlog_args_render(zlog_buf_t * a_buf, const char *format, const char *blob, size_t blob_len)
+{
+	int rc;
+	const char *p;
+	const char *q;
+	const char *end = blob + blob_len;
+	zlog_args_spec_t a_spec;
+	char fmt[MAXLEN_CFG_LINE + 1];
+	char tmp[256];
+	char *out;
+	int nwrite = 0;
+	int width = 0;
+	int prec = 0;
+	int c;
+	long long ll;
+	unsigned long long ull;
+	double d;
+	long double ld;
+	void *ptr;
+	const char *str = NULL;
+	size_t s_len;
+
+	for (p = format; *p != '\0'; p = q) {
+		if (*p != '%') {
+			for (q = p; *q != '\0' && *q != '%'; q++)
+				/*EMPTY*/;
+			rc = zlog_buf_append(a_buf, p, q - p);
+			if (rc) return rc;
+			continue;
+		}
+		if (*(p + 1) == '%') {
+			rc = zlog_buf_append(a_buf, "%", 1);
+			if (rc) return rc;
+			q = p + 2;
+			continue;
+		}
+		if (zlog_args_parse(p, &a_spec) || a_spec.body_len + 3 > sizeof(fmt)) {
+			zc_error("format[%s] not packed by zlog_args_pack", format);
+			return -1;
+		}
+		q = p + a_spec.len;
+
+		if (a_spec.width_star) zlog_args_get(blob, end, width);
+		if (a_spec.prec_star) zlog_args_get(blob, end, prec);
+
+		if (a_spec.conv == 's') {
+			zlog_args_get(blob, end, s_len);
+			if (s_len == ZLOG_ARGS_NULL_STR) {
+				str = "(null)";
+				s_len = sizeof("(null)") - 1;
+			} else {
+				if ((size_t)(end - blob) <= s_len) goto err;
+				str = blob;
+				blob += s_len + 1;
+			}
+			if (a_spec.plain) {
+				rc = zlog_buf_append(a_buf, str, s_len);
+				if (rc) return rc;
+				continue;
+			}
+		}
+
+		/* rebuild the conversion with the type the value is kept in */
+		memcpy(fmt, p, a_spec.body_len);
+		out = fmt + a_spec.body_len;
+		switch (a_spec.conv) {
+		case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+			*out++ = 'l';
+			*out++ = 'l';
+			break;
+		case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+			if (a_spec.length == ZLOG_ARGS_LEN_LD) *out++ = 'L';
+			break;
+		}
+		*out++ = a_spec.conv;
+		*out = '\0';
+
+		out = NULL;
+		switch (a_spec.conv) {
+		case 'd': case 'i':
+			zlog_args_get(blob, end, ll);
+			zlog_args_print(ll);
+			break;
+		case 'o': case 'u': case 'x': case 'X':
+			zlog_args_get(blob, end, ull);
+			zlog_args_print(ull);
+			break;
+		case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+			if (a_spec.length == ZLOG_ARGS_LEN_LD) {
+				zlog_args_get(blob, end, ld);
+				zlog_args_print(ld);
+			} else {
+				zlog_args_get(blob, end, d);
+				zlog_args_print(d);
+			}
+			break;
+		case 'c':
+			zlog_args_get(blob, end, c);
+			zlog_args_print(c);
+			break;
+		case 'p':
+			zlog_args_get(blob, end, ptr);
+			zlog_args_print(ptr);
+			break;
+		case 's':
+			zlog_args_print(str);
+			break;
+		}
+
+		if (out) {
+			rc = zlog_buf_append(a_buf, out, nwrite);
+			free(out);
+		} else {
+			rc = zlog_buf_append(a_buf, tmp, nwrite);
+		}
+		if (rc) return rc;
+	}
+
+	return 0;
+err:
+	zc_error("args blob of format[%s] is broken", format);
+	return -1;
+}
+
+/*******************************************************************************/
+int zlog_args_pack_str(zlog_args_t * a_args, const char *str, size_t str_len)
+{
+	a_args->len = 0;
+	zlog_args_put(a_args, str_len);
+	if (zlog_args_reserve(a_args, str_len + 1)) goto err;
+	memcpy(a_args->start + a_args->len, str, str_len);
+	a_args->start[a_args->len + str_len] = '\0';
+	a_args->len += str_len + 1;
+	a_args->format_len = 2;
+	return 0;
+err:
+	return -1;
+}
+
+/*******************************************************************************/
+#define zlog_args_put_zigzag(a_out, v) do { \
+	if (zlog_args_put_varint(a_out, zlog_args_zigzag(v))) goto err; \
+} while (0)
+
+#define zlog_args_put_uvarint(a_out, v) do { \
+	if (zlog_args_put_varint(a_out, v)) goto err; \
+} while (0)
+
+int zlog_args_encode(zlog_args_t * a_out, const char *format, const char *blob, size_t blob_len)
+{
+	const char *p;
+	const char *end = blob + blob_len;
+	zlog_args_spec_t a_spec;
+	int star;
+	long long ll;
+	unsigned long long ull;
+	double d;
+	long double ld;
+	void *ptr;
+	size_t s_len;
+
+	for (p = format; *p != '\0'; ) {
+		if (*p != '%') {
+			p++;
+			continue;
+		}
+		if (*(p + 1) == '%') {
+			p += 2;
+			continue;
+		}
+		if (zlog_args_parse(p, &a_spec)) goto err;
+		p += a_spec.len;
+
+		if (a_spec.width_star) {
+			zlog_args_get(blob, end, star);
+			zlog_args_put_zigzag(a_out, star);
+		}
+		if (a_spec.prec_star) {
+			zlog_args_get(blob, end, star);
+			zlog_args_put_zigzag(a_out, star);
+		}
+
+		switch (a_spec.conv) {
+		case 'd': case 'i':
+			zlog_args_get(blob, end, ll);
+			zlog_args_put_zigzag(a_out, ll);
+			break;
+		case 'o': case 'u': case 'x': case 'X':
+			zlog_args_get(blob, end, ull);
+			zlog_args_put_uvarint(a_out, ull);
+			break;
+		case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+			if (a_spec.length == ZLOG_ARGS_LEN_LD) {
+				zlog_args_get(blob, end, ld);
+				zlog_args_put(a_out, ld);
+			} else {
+				zlog_args_get(blob, end, d);
+				zlog_args_put(a_out, d);
+			}
+			break;
+		case 'c':
+			zlog_args_get(blob, end, star);
+			zlog_args_put_zigzag(a_out, star);
+			break;
+		case 'p':
+			zlog_args_get(blob, end, ptr);
+			zlog_args_put_uvarint(a_out, (uintptr_t)ptr);
+			break;
+		case 's':
+			/* 0 for NULL, else length + 1 */
+			zlog_args_get(blob, end, s_len);
+			if (s_len == ZLOG_ARGS_NULL_STR) {
+				zlog_args_put_uvarint(a_out, 0);
+				break;
+			}
+			if ((size_t)(end - blob) <= s_len) goto err;
+			zlog_args_put_uvarint(a_out, s_len + 1);
+			if (zlog_args_append(a_out, blob, s_len)) goto err;
+			blob += s_len + 1;
+			break;
+		}
+	}
+	return 0;
+err:
+	zc_error("encode args of format[%s] fail", format);
+	return -1;
+}
+
+int zlog_args_decode(zlog_args_t * a_out, const char *format, const char *data, size_t data_len)
+{
+	const char *p;
+	const char *end = data + data_len;
+	zlog_args_spec_t a_spec;
+	int star;
+	long long ll;
+	unsigned long long ull;
+	double d;
+	long double ld;
+	void *ptr;
+	size_t s_len;
+
+	a_out->len = 0;
+	for (p = format; *p != '\0'; ) {
+		if (*p != '%') {
+			p++;
+			continue;
+		}
+		if (*(p + 1) == '%') {
+			p += 2;
+			continue;
+		}
+		if (zlog_args_parse(p, &a_spec)) goto err;
+		p += a_spec.len;
+
+		if (a_spec.width_star) {
+			if (zlog_args_get_varint(&data, end, &ull)) goto err;
+			star = (int)zlog_args_unzigzag(ull);
+			zlog_args_put(a_out, star);
+		}
+		if (a_spec.prec_star) {
+			if (zlog_args_get_varint(&data, end, &ull)) goto err;
+			star = (int)zlog_args_unzigzag(ull);
+			zlog_args_put(a_out, star);
+		}
+
+		switch (a_spec.conv) {
+		case 'd': case 'i':
+			if (zlog_args_get_varint(&data, end, &ull)) goto err;
+			ll = zlog_args_unzigzag(ull);
+			zlog_args_put(a_out, ll);
+			break;
+		case 'o': case 'u': case 'x': case 'X':
+			if (zlog_args_get_varint(&data, end, &ull)) goto err;
+			zlog_args_put(a_out, ull);
+			break;
+		case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+			if (a_spec.length == ZLOG_ARGS_LEN_LD) {
+				zlog_args_get(data, end, ld);
+				zlog_args_put(a_out, ld);
+			} else {
+				zlog_args_get(data, end, d);
+				zlog_args_put(a_out, d);
+			}
+			break;
+		case 'c':
+			if (zlog_args_get_varint(&data, end, &ull)) goto err;
+			star = (int)zlog_args_unzigzag(ull);
+			zlog_args_put(a_out, star);
+			break;
+		case 'p':
+			if (zlog_args_get_varint(&data, end, &ull)) goto err;
+			ptr = (void *)(uintptr_t)ull;
+			zlog_args_put(a_out, ptr);
+			break;
+		case 's':
+			if (zlog_args_get_varint(&data, end, &ull)) goto err;
+			if (ull == 0) {
+				s_len = ZLOG_ARGS_NULL_STR;
+				zlog_args_put(a_out, s_len);
+				break;
+			}
+			s_len = ull - 1;
+			if ((size_t)(end - data) < s_len) goto err;
+			zlog_args_put(a_out, s_len);
+			if (zlog_args_reserve(a_out, s_len + 1)) goto err;
+			memcpy(a_out->start + a_out->len, data, s_len);
+			a_out->start[a_out->len + s_len] = '\0';
+			a_out->len += s_len + 1;
+			data += s_len;
+			break;
+		}
+	}
+	return 0;
+err:
+	zc_error("decode args of format[%s] fail", format);
+	return -1;
+}
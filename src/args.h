@@ -0,0 +1,64 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#ifndef __zlog_args_h
+#define __zlog_args_h
+
+/* deferred format, the caller packs printf args into a blob by reading
+ * the format, and the async writer renders them later.
+ * %s strings are deep copied, so the blob does not point to caller memory.
+ */
+
+#include <stdarg.h>
+#include "zc_defs.h"
+#include "buf.h"
+
+typedef struct zlog_args_s {
+	char *start;
+	size_t len;
+	size_t size;
+	size_t format_len; /* strlen of the last packed format */
+} zlog_args_t;
+
+zlog_args_t *zlog_args_new(size_t size);
+void zlog_args_del(zlog_args_t * a_args);
+void zlog_args_profile(zlog_args_t * a_args, int flag);
+
+/* return 0	packed
+ * return 1	format can not be deferred, like %n %m
+ * return -1	fail
+ */
+int zlog_args_pack(zlog_args_t * a_args, const char *format, va_list args);
+
+/* return 0	success
+ * return 1	buf is full, truncated
+ * return -1	fail
+ */
+int zlog_args_render(zlog_buf_t * a_buf, const char *format, const char *blob, size_t blob_len);
+
+/* pack a string as the only arg of format "%s" */
+int zlog_args_pack_str(zlog_args_t * a_args, const char *str, size_t str_len);
+
+/* compact form of blob for binary output,
+ * integers are varints, strings are length prefixed
+ * return 0 success, -1 fail or broken input
+ */
+int zlog_args_encode(zlog_args_t * a_out, const char *format, const char *blob, size_t blob_len);
+int zlog_args_decode(zlog_args_t * a_out, const char *format, const char *data, size_t data_len);
+
+int zlog_args_reserve(zlog_args_t * a_args, size_t len);
+int zlog_args_append(zlog_args_t * a_args, const void *data, size_t len);
+int zlog_args_put_varint(zlog_args_t * a_args, unsigned long long v);
+int zlog_args_get_varint(const char **p, const char *end, unsigned long long *v);
+
+#define zlog_args_zigzag(v) \
+	(((unsigned long long)(v) << 1) ^ (unsigned long long)((long long)(v) >> 63))
+#define zlog_args_unzigzag(u) \
+	((long long)((u) >> 1) ^ -(long long)((u) & 1))
+
+#endif
@@ -0,0 +1,951 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#include "fmacros.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+
+#include "async.h"
+#include "conf.h"
+#include "buf.h"
+#include "args.h"
+#include "category.h"
+#include "uring.h"
+#include "zc_defs.h"
+
+#define ZLOG_ASYNC_PAD 0  /* skip to the ring end */
+#define ZLOG_ASYNC_MSG 1  /* formatted by caller */
+#define ZLOG_ASYNC_ARGS 2 /* deferred format, render by writer */
+
+typedef struct {
+	int type;
+	size_t len;        /* whole record, aligned */
+} zlog_async_head_t;
+
+/* one msg in ring, followed by msg and path */
+typedef struct {
+	zlog_async_head_t head;
+	zlog_rule_t *rule;
+	const zlog_conf_t *conf; /* of the snapshot, kept till the ring is flushed */
+	size_t msg_len;
+	size_t path_len;
+	int level;
+	struct timeval time_stamp;
+} zlog_async_record_t;
+
+/* one deferred log in ring, followed by format, file, func and packed args */
+typedef struct {
+	zlog_async_head_t head;
+	zlog_category_t *category;
+	const zlog_conf_t *conf;
+	size_t format_len;
+	size_t file_len;
+	size_t func_len;
+	size_t args_len;
+	long line;
+	int level;
+	struct timeval time_stamp;
+	pthread_t tid;
+} zlog_async_event_t;
+
+#define zlog_async_align(n) (((n) + 7) & ~((size_t)7))
+#define ZLOG_ASYNC_IOV_MAX 64
+#define ZLOG_ASYNC_ARGS_SIZE 256
+#define ZLOG_ASYNC_BATCH_SIZE (64 * 1024)
+
+typedef struct {
+	pthread_t tid;
+	int idx;
+	unsigned long passes;
+	zlog_thread_t *a_thread; /* buffers to emit non-batched outputs */
+
+	/* msgs rendered from deferred logs, wait to be written by emitv */
+	zlog_rule_t *batch_rule;
+	char *batch;
+	size_t batch_len;
+
+	zlog_uring_t *uring; /* NULL if not "async io uring", or not supported */
+	zlog_async_ring_t *uring_rings; /* their tails wait for the submit */
+} zlog_async_writer_t;
+
+static pthread_mutex_t zlog_async_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t zlog_async_wake_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t zlog_async_done_cond = PTHREAD_COND_INITIALIZER;
+static pthread_once_t zlog_async_once = PTHREAD_ONCE_INIT;
+static pthread_key_t zlog_async_writer_key;
+
+static zlog_async_ring_t *zlog_async_rings;
+static unsigned long zlog_async_ring_seq;
+
+static zlog_async_writer_t *zlog_async_writers;
+static int zlog_async_writer_count;
+static volatile int zlog_async_running;
+static volatile int zlog_async_stopping;
+static volatile int zlog_async_idle;     /* writers sleeping */
+static volatile int zlog_async_blocked;  /* producers waiting for space */
+static volatile int zlog_async_restart;  /* set in child after fork */
+static int zlog_async_flushing;          /* zlog_async_flush() waiting */
+
+/* for restart in child */
+static size_t zlog_async_buf_size_min;
+static size_t zlog_async_buf_size_max;
+static int zlog_async_time_cache_count;
+static int zlog_async_io_uring;
+static int zlog_async_restart_writers;
+
+/*******************************************************************************/
+static zlog_async_ring_t *zlog_async_ring_new(size_t size)
+{
+	size_t real_size;
+	zlog_async_ring_t *a_ring;
+
+	for (real_size = 4096; real_size < size; real_size <<= 1)
+		/*EMPTY*/;
+
+	a_ring = calloc(1, sizeof(zlog_async_ring_t));
+	if (!a_ring) {
+		zc_error("calloc fail, errno[%d]", errno);
+		return NULL;
+	}
+
+	a_ring->buf = malloc(real_size);
+	if (!a_ring->buf) {
+		zc_error("malloc fail, errno[%d]", errno);
+		free(a_ring);
+		return NULL;
+	}
+	a_ring->size = real_size;
+
+	pthread_mutex_lock(&zlog_async_mutex);
+	a_ring->seq = zlog_async_ring_seq++;
+	a_ring->next = zlog_async_rings;
+	if (zlog_async_rings) zlog_async_rings->prev = a_ring;
+	zlog_async_rings = a_ring;
+	pthread_mutex_unlock(&zlog_async_mutex);
+
+	zc_debug("zlog_async_ring_new[%p], size[%ld]", a_ring, (long)real_size);
+	return a_ring;
+}
+
+/* under zlog_async_mutex */
+static void zlog_async_ring_del(zlog_async_ring_t * a_ring)
+{
+	if (a_ring->prev) {
+		a_ring->prev->next = a_ring->next;
+	} else {
+		zlog_async_rings = a_ring->next;
+	}
+	if (a_ring->next) a_ring->next->prev = a_ring->prev;
+
+	free(a_ring->buf);
+	free(a_ring);
+	zc_debug("zlog_async_ring_del[%p]", a_ring);
+	return;
+}
+
+/* owner thread exits, the writer frees the ring after drain it */
+void zlog_async_ring_release(zlog_async_ring_t * a_ring)
+{
+	zc_assert(a_ring,);
+
+	pthread_mutex_lock(&zlog_async_mutex);
+	if (!zlog_async_running && a_ring->head == a_ring->tail) {
+		zlog_async_ring_del(a_ring);
+	} else {
+		a_ring->orphan = 1;
+	}
+	pthread_mutex_unlock(&zlog_async_mutex);
+	return;
+}
+
+/*******************************************************************************/
+static void zlog_async_wait_space(void)
+{
+	struct timeval now;
+	struct timespec deadline;
+
+	gettimeofday(&now, NULL);
+	deadline.tv_sec = now.tv_sec;
+	deadline.tv_nsec = (now.tv_usec + 10000) * 1000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock(&zlog_async_mutex);
+	zlog_async_blocked++;
+	pthread_cond_broadcast(&zlog_async_wake_cond);
+	pthread_cond_timedwait(&zlog_async_done_cond, &zlog_async_mutex, &deadline);
+	zlog_async_blocked--;
+	pthread_mutex_unlock(&zlog_async_mutex);
+	return;
+}
+
+static int zlog_async_try_restart(void)
+{
+	int rc = 0;
+
+	pthread_mutex_lock(&zlog_async_mutex);
+	if (zlog_async_restart) {
+		zlog_async_restart = 0;
+		pthread_mutex_unlock(&zlog_async_mutex);
+		rc = zlog_async_start(zlog_async_buf_size_min, zlog_async_buf_size_max,
+				zlog_async_time_cache_count, zlog_async_restart_writers,
+				zlog_async_io_uring);
+		return rc;
+	}
+	pthread_mutex_unlock(&zlog_async_mutex);
+	return 0;
+}
+
+static void zlog_async_batch_flush(zlog_async_writer_t * a_writer)
+{
+	struct iovec iov;
+
+	if (!a_writer->batch_len) return;
+	iov.iov_base = a_writer->batch;
+	iov.iov_len = a_writer->batch_len;
+	a_writer->batch_rule->emitv(a_writer->batch_rule, &iov, 1);
+	a_writer->batch_rule = NULL;
+	a_writer->batch_len = 0;
+	return;
+}
+
+/* in writer thread, gather msgs of the same rule to write them at once */
+static int zlog_async_stage(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
+{
+	zlog_async_writer_t *a_writer;
+	size_t msg_len;
+
+	a_writer = pthread_getspecific(zlog_async_writer_key);
+	if (!a_writer) return a_rule->emit(a_rule, a_thread);
+
+	msg_len = zlog_buf_len(a_thread->msg_buf);
+	if (a_writer->batch_rule != a_rule
+		|| a_writer->batch_len + msg_len > ZLOG_ASYNC_BATCH_SIZE) {
+		zlog_async_batch_flush(a_writer);
+	}
+	if (!a_rule->emitv || a_rule->dynamic_specs || msg_len > ZLOG_ASYNC_BATCH_SIZE) {
+		return a_rule->emit(a_rule, a_thread);
+	}
+
+	memcpy(a_writer->batch + a_writer->batch_len, zlog_buf_str(a_thread->msg_buf), msg_len);
+	a_writer->batch_len += msg_len;
+	a_writer->batch_rule = a_rule;
+	return 0;
+}
+
+/* a_conf is of the snapshot the caller logs in, not zlog_env_conf,
+ * which zlog_reload() replaces without waiting for loggers */
+static zlog_async_ring_t *zlog_async_fetch_ring(zlog_thread_t * a_thread, const zlog_conf_t * a_conf)
+{
+	zlog_async_ring_t *a_ring;
+
+	a_ring = a_thread->async_ring;
+	if (a_ring && a_ring->size < a_conf->async_ring_size && a_ring->head == a_ring->tail) {
+		/* ring size is changed by zlog_reload() */
+		zlog_async_ring_release(a_ring);
+		a_ring = a_thread->async_ring = NULL;
+	}
+	if (!a_ring) {
+		a_ring = a_thread->async_ring = zlog_async_ring_new(a_conf->async_ring_size);
+		if (!a_ring) {
+			zc_error("zlog_async_ring_new fail");
+			return NULL;
+		}
+	}
+	return a_ring;
+}
+
+/* wait for len bytes in ring, *head is where the record starts
+ * return 0	success
+ * return 1	dropped by async full policy
+ * return -1	writers stopped, the caller should write itself
+ */
+static int zlog_async_reserve(zlog_async_ring_t * a_ring, const zlog_conf_t * a_conf,
+		size_t len, int level, size_t *head)
+{
+	size_t pos;
+	size_t contig;
+	size_t need;
+	zlog_async_head_t *a_head;
+
+	*head = a_ring->head;
+	pos = *head & (a_ring->size - 1);
+	contig = a_ring->size - pos;
+	need = (contig < len) ? contig + len : len; /* record never cross the ring end */
+
+	while (a_ring->size - (*head - zc_load_acquire(&a_ring->tail)) < need) {
+		if (!zlog_async_running) return -1;
+
+		switch (a_conf->async_full_policy) {
+		case ZLOG_ASYNC_DROP_BELOW:
+			if (level >= a_conf->async_drop_level) {
+				zlog_async_wait_space();
+				break;
+			}
+			/* fall through */
+		case ZLOG_ASYNC_DROP:
+			a_ring->dropped++;
+			return 1;
+		default:
+			zlog_async_wait_space();
+			break;
+		}
+	}
+
+	if (contig < len) {
+		if (contig >= sizeof(zlog_async_head_t)) {
+			a_head = (zlog_async_head_t *) (a_ring->buf + pos);
+			a_head->type = ZLOG_ASYNC_PAD;
+			a_head->len = contig;
+		} /* else writer skips the short end itself */
+		*head += contig;
+	}
+	return 0;
+}
+
+static void zlog_async_commit(zlog_async_ring_t * a_ring, size_t head)
+{
+	zc_store_release(&a_ring->head, head);
+
+	/* pair with the recheck in zlog_async_writer_sleep() */
+	zc_mb();
+	if (zlog_async_idle) {
+		pthread_mutex_lock(&zlog_async_mutex);
+		pthread_cond_broadcast(&zlog_async_wake_cond);
+		pthread_mutex_unlock(&zlog_async_mutex);
+	}
+	return;
+}
+
+#define zlog_async_ptr(a_ring, head) \
+	((a_ring)->buf + ((head) & ((a_ring)->size - 1)))
+
+/* copy path_buf and msg_buf made by zlog_rule_output_async() to ring */
+int zlog_async_push(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
+{
+	int rc;
+	zlog_async_ring_t *a_ring;
+	zlog_async_record_t *a_record;
+	size_t msg_len;
+	size_t path_len;
+	size_t len;
+	size_t head;
+
+	if (!zlog_async_running && (!zlog_async_restart || zlog_async_try_restart())) {
+		/* writers are being restarted by zlog_reload() or failed, write here */
+		return a_rule->emit(a_rule, a_thread);
+	}
+
+	/* a writer renders deferred logs, or logs in user record function,
+	 * never wait for itself */
+	if (a_thread->async_writer) return zlog_async_stage(a_rule, a_thread);
+
+	a_ring = zlog_async_fetch_ring(a_thread, a_thread->conf);
+	if (!a_ring) return a_rule->emit(a_rule, a_thread);
+
+	msg_len = zlog_buf_len(a_thread->msg_buf);
+	path_len = a_rule->dynamic_specs ? zlog_buf_len(a_thread->path_buf) : 0;
+	len = zlog_async_align(sizeof(zlog_async_record_t) + msg_len + path_len);
+	if (len > a_ring->size / 2) {
+		zc_debug("msg len[%ld] too big for ring, write here", (long)msg_len);
+		return a_rule->emit(a_rule, a_thread);
+	}
+
+	rc = zlog_async_reserve(a_ring, a_thread->conf, len, a_thread->event->level, &head);
+	if (rc > 0) return 0;
+	if (rc < 0) return a_rule->emit(a_rule, a_thread);
+
+	a_record = (zlog_async_record_t *) zlog_async_ptr(a_ring, head);
+	a_record->head.type = ZLOG_ASYNC_MSG;
+	a_record->head.len = len;
+	a_record->rule = a_rule;
+	a_record->conf = a_thread->conf;
+	a_record->msg_len = msg_len;
+	a_record->path_len = path_len;
+	a_record->level = a_thread->event->level;
+	a_record->time_stamp = a_thread->event->time_stamp;
+	memcpy(a_record + 1, zlog_buf_str(a_thread->msg_buf), msg_len);
+	if (path_len) {
+		memcpy((char *)(a_record + 1) + msg_len, zlog_buf_str(a_thread->path_buf), path_len);
+	}
+
+	zlog_async_commit(a_ring, head + len);
+	return 0;
+}
+
+/* pack args and callsite to ring, writer formats them
+ * return 0	pushed or dropped
+ * return 1	can not defer, the caller should format itself
+ */
+int zlog_async_defer(const zlog_conf_t * a_conf, zlog_category_t * a_category, zlog_thread_t * a_thread,
+		const char *file, size_t file_len, const char *func, size_t func_len,
+		long line, int level, const char *format, va_list args)
+{
+	int rc;
+	zlog_async_ring_t *a_ring;
+	zlog_async_event_t *a_event;
+	zlog_args_t *a_args;
+	struct timeval time_stamp;
+	size_t len;
+	size_t head;
+	char *p;
+
+	if (!zlog_async_running && (!zlog_async_restart || zlog_async_try_restart())) return 1;
+	if (a_thread->async_writer) return 1;
+	if (!format || !file || !func) return 1;
+
+	if (!a_thread->args) {
+		a_thread->args = zlog_args_new(ZLOG_ASYNC_ARGS_SIZE);
+		if (!a_thread->args) {
+			zc_error("zlog_args_new fail");
+			return 1;
+		}
+	}
+	a_args = a_thread->args;
+	if (zlog_args_pack(a_args, format, args)) return 1;
+
+	a_ring = zlog_async_fetch_ring(a_thread, a_conf);
+	if (!a_ring) return 1;
+
+	len = zlog_async_align(sizeof(zlog_async_event_t)
+		+ a_args->format_len + file_len + func_len + 3 + a_args->len);
+	if (len > a_ring->size / 2) return 1;
+
+	/* time of the call, not of the render */
+	gettimeofday(&time_stamp, NULL);
+
+	rc = zlog_async_reserve(a_ring, a_conf, len, level, &head);
+	if (rc > 0) return 0;
+	if (rc < 0) return 1;
+
+	a_event = (zlog_async_event_t *) zlog_async_ptr(a_ring, head);
+	a_event->head.type = ZLOG_ASYNC_ARGS;
+	a_event->head.len = len;
+	a_event->category = a_category;
+	a_event->conf = a_conf;
+	a_event->format_len = a_args->format_len;
+	a_event->file_len = file_len;
+	a_event->func_len = func_len;
+	a_event->args_len = a_args->len;
+	a_event->line = line;
+	a_event->level = level;
+	a_event->time_stamp = time_stamp;
+	a_event->tid = a_thread->event->tid;
+
+	/* format, file and func may be not literal, so copy them */
+	p = (char *)(a_event + 1);
+	memcpy(p, format, a_args->format_len);
+	p += a_args->format_len;
+	*p++ = '\0';
+	memcpy(p, file, file_len);
+	p += file_len;
+	*p++ = '\0';
+	memcpy(p, func, func_len);
+	p += func_len;
+	*p++ = '\0';
+	memcpy(p, a_args->start, a_args->len);
+
+	zlog_async_commit(a_ring, head + len);
+	return 0;
+}
+
+/*******************************************************************************/
+static int zlog_async_emit(zlog_async_writer_t * a_writer, zlog_async_record_t * a_record)
+{
+	zlog_thread_t *a_thread = a_writer->a_thread;
+
+	zlog_buf_restart(a_thread->msg_buf);
+	zlog_buf_append(a_thread->msg_buf, (char *)(a_record + 1), a_record->msg_len);
+	if (a_record->path_len) {
+		zlog_buf_restart(a_thread->path_buf);
+		zlog_buf_append(a_thread->path_buf,
+			(char *)(a_record + 1) + a_record->msg_len, a_record->path_len);
+		zlog_buf_seal(a_thread->path_buf);
+	}
+
+	a_thread->event->level = a_record->level;
+	a_thread->event->time_stamp = a_record->time_stamp;
+	a_thread->event->pid = (pid_t) 0;
+	/* rotater and levels of the conf it is logged in */
+	a_thread->conf = a_record->conf;
+
+	return a_record->rule->emit(a_record->rule, a_thread);
+}
+
+static int zlog_async_render(zlog_async_writer_t * a_writer, zlog_async_event_t * a_event)
+{
+	zlog_thread_t *a_thread = a_writer->a_thread;
+	char *format = (char *)(a_event + 1);
+	char *file = format + a_event->format_len + 1;
+	char *func = file + a_event->file_len + 1;
+	char *blob = func + a_event->func_len + 1;
+
+	zlog_event_set_args(a_thread->event,
+		a_event->category->name, a_event->category->name_len,
+		file, a_event->file_len, func, a_event->func_len,
+		a_event->line, a_event->level,
+		format, blob, a_event->args_len);
+	a_thread->event->time_stamp = a_event->time_stamp;
+	a_thread->conf = a_event->conf;
+	if (!pthread_equal(a_thread->event->tid, a_event->tid)) {
+		zlog_event_set_tid(a_thread->event, a_event->tid);
+	}
+
+	/* rules output in writer thread, see zlog_async_push() */
+	return zlog_category_output(a_event->category, a_thread);
+}
+
+/* wait for queued writes, before their msgs leave the ring */
+static void zlog_async_uring_submit(zlog_async_writer_t * a_writer)
+{
+	unsigned idx = 0;
+	struct iovec *iov;
+	int iovcnt;
+	zlog_rule_t *a_rule;
+	zlog_async_ring_t *a_ring;
+
+	if (a_writer->uring && zlog_uring_queued(a_writer->uring)
+		&& zlog_uring_submit(a_writer->uring)) {
+		zc_error("zlog_uring_submit fail, write as before");
+		/* msgs of writes left are still in rings */
+		while ((a_rule = zlog_uring_undone(a_writer->uring, &idx, &iov, &iovcnt))) {
+			a_rule->emitv(a_rule, iov, iovcnt);
+		}
+		zlog_uring_del(a_writer->uring);
+		a_writer->uring = NULL;
+	}
+
+	for (a_ring = a_writer->uring_rings; a_ring; a_ring = a_ring->uring_next) {
+		zc_store_release(&a_ring->tail, a_ring->uring_tail);
+	}
+	a_writer->uring_rings = NULL;
+	return;
+}
+
+/* return 0	queued, the ring keeps the msgs till submitted
+ * return 1	queued, the ones queued before are written
+ * return -1	not for io_uring, the ones queued before are written
+ */
+static int zlog_async_uring_writev(zlog_async_writer_t * a_writer, zlog_rule_t * a_rule,
+		struct iovec *iov, int iovcnt)
+{
+	int fd;
+	volatile int *dirty;
+
+	if (!a_writer->uring) return -1;
+	fd = zlog_rule_uring_fd(a_rule, &dirty);
+	if (fd < 0) {
+		zlog_async_uring_submit(a_writer);
+		return -1;
+	}
+
+	if (!zlog_uring_writev(a_writer->uring, fd, iov, iovcnt, dirty, a_rule)) return 0;
+
+	zlog_async_uring_submit(a_writer);
+	if (!a_writer->uring || zlog_uring_writev(a_writer->uring, fd, iov, iovcnt, dirty, a_rule)) return -1;
+	return 1;
+}
+
+/* return how many records written */
+static size_t zlog_async_drain(zlog_async_writer_t * a_writer, zlog_async_ring_t * a_ring)
+{
+	size_t head;
+	size_t tail;
+	size_t pos;
+	size_t group_tail;
+	size_t count = 0;
+	zlog_async_record_t *a_record;
+	zlog_rule_t *a_rule;
+	struct iovec iov[ZLOG_ASYNC_IOV_MAX];
+	int iovcnt;
+	int rc;
+
+	tail = a_ring->tail;
+	head = zc_load_acquire(&a_ring->head);
+	while (tail != head) {
+		pos = tail & (a_ring->size - 1);
+		if (a_ring->size - pos < sizeof(zlog_async_head_t)) {
+			tail += a_ring->size - pos;
+			continue;
+		}
+
+		a_record = (zlog_async_record_t *) (a_ring->buf + pos);
+		if (a_record->head.type == ZLOG_ASYNC_PAD) {
+			tail += a_record->head.len;
+			continue;
+		}
+
+		a_rule = a_record->rule;
+		if (a_record->head.type == ZLOG_ASYNC_ARGS) {
+			zlog_async_uring_submit(a_writer);
+			zlog_async_render(a_writer, (zlog_async_event_t *) a_record);
+			tail += a_record->head.len;
+			count++;
+		} else if (!a_rule->emitv) {
+			zlog_async_uring_submit(a_writer);
+			zlog_async_batch_flush(a_writer);
+			zlog_async_emit(a_writer, a_record);
+			tail += a_record->head.len;
+			count++;
+		} else {
+			/* gather msgs of the same rule, till ring end */
+			zlog_async_batch_flush(a_writer);
+			group_tail = tail;
+			iovcnt = 0;
+			do {
+				iov[iovcnt].iov_base = a_record + 1;
+				iov[iovcnt].iov_len = a_record->msg_len;
+				iovcnt++;
+				tail += a_record->head.len;
+				pos = tail & (a_ring->size - 1);
+				a_record = (zlog_async_record_t *) (a_ring->buf + pos);
+			} while (tail != head && iovcnt < ZLOG_ASYNC_IOV_MAX && pos != 0
+				&& a_ring->size - pos >= sizeof(zlog_async_head_t)
+				&& a_record->head.type == ZLOG_ASYNC_MSG
+				&& a_record->rule == a_rule);
+
+			count += iovcnt;
+			rc = zlog_async_uring_writev(a_writer, a_rule, iov, iovcnt);
+			if (rc >= 0) {
+				if (rc) zc_store_release(&a_ring->tail, group_tail);
+				if (tail == head) head = zc_load_acquire(&a_ring->head);
+				continue;
+			}
+			a_rule->emitv(a_rule, iov, iovcnt);
+		}
+
+		zc_store_release(&a_ring->tail, tail);
+		if (tail == head) head = zc_load_acquire(&a_ring->head);
+	}
+	zlog_async_batch_flush(a_writer);
+	if (a_ring->tail != tail && a_writer->uring && zlog_uring_queued(a_writer->uring)) {
+		/* queued to io_uring, submitted with those of other rings */
+		a_ring->uring_tail = tail;
+		a_ring->uring_next = a_writer->uring_rings;
+		a_writer->uring_rings = a_ring;
+	} else {
+		zc_store_release(&a_ring->tail, tail);
+	}
+
+	if (a_ring->dropped != a_ring->dropped_reported) {
+		zc_warn("async ring[%p] full, [%ld] msgs dropped", a_ring,
+			(long)(a_ring->dropped - a_ring->dropped_reported));
+		a_ring->dropped_reported = a_ring->dropped;
+	}
+
+	return count;
+}
+
+/* drain all rings of this writer once */
+static size_t zlog_async_pass(zlog_async_writer_t * a_writer)
+{
+	size_t count = 0;
+	zlog_async_ring_t *a_ring;
+	zlog_async_ring_t *next;
+
+	pthread_mutex_lock(&zlog_async_mutex);
+	for (a_ring = zlog_async_rings; a_ring; a_ring = next) {
+		if (a_ring->seq % zlog_async_writer_count != a_writer->idx) {
+			next = a_ring->next;
+			continue;
+		}
+
+		/* only this writer unlinks this ring, so it is safe to unlock */
+		pthread_mutex_unlock(&zlog_async_mutex);
+		count += zlog_async_drain(a_writer, a_ring);
+		pthread_mutex_lock(&zlog_async_mutex);
+
+		next = a_ring->next;
+		if (a_ring->orphan && a_ring->head == a_ring->tail) {
+			zlog_async_ring_del(a_ring);
+		}
+		if (zlog_async_blocked) pthread_cond_broadcast(&zlog_async_done_cond);
+	}
+	pthread_mutex_unlock(&zlog_async_mutex);
+
+	/* msgs of all rings to io_uring by one enter, before the pass counts */
+	zlog_async_uring_submit(a_writer);
+
+	pthread_mutex_lock(&zlog_async_mutex);
+	a_writer->passes++;
+	pthread_cond_broadcast(&zlog_async_done_cond);
+	pthread_mutex_unlock(&zlog_async_mutex);
+
+	return count;
+}
+
+/* under zlog_async_mutex */
+static int zlog_async_has_work(zlog_async_writer_t * a_writer)
+{
+	zlog_async_ring_t *a_ring;
+
+	for (a_ring = zlog_async_rings; a_ring; a_ring = a_ring->next) {
+		if (a_ring->seq % zlog_async_writer_count == a_writer->idx
+			&& zc_load_acquire(&a_ring->head) != a_ring->tail) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void zlog_async_writer_sleep(zlog_async_writer_t * a_writer)
+{
+	struct timeval now;
+	struct timespec deadline;
+
+	gettimeofday(&now, NULL);
+	deadline.tv_sec = now.tv_sec + 1;
+	deadline.tv_nsec = now.tv_usec * 1000;
+
+	pthread_mutex_lock(&zlog_async_mutex);
+	zlog_async_idle++;
+	zc_mb();
+	if (!zlog_async_stopping && !zlog_async_flushing && !zlog_async_has_work(a_writer)) {
+		pthread_cond_timedwait(&zlog_async_wake_cond, &zlog_async_mutex, &deadline);
+	}
+	zlog_async_idle--;
+	pthread_mutex_unlock(&zlog_async_mutex);
+	return;
+}
+
+static void *zlog_async_writer_run(void *arg)
+{
+	zlog_async_writer_t *a_writer = arg;
+	int stopping;
+
+	pthread_setspecific(zlog_async_writer_key, a_writer);
+
+	while (1) {
+		stopping = zlog_async_stopping;
+		if (zlog_async_pass(a_writer) == 0) {
+			if (stopping) break; /* a whole pass after stop is seen */
+			zlog_async_writer_sleep(a_writer);
+		}
+	}
+
+	return NULL;
+}
+
+/*******************************************************************************/
+static void zlog_async_atfork_prepare(void)
+{
+	pthread_mutex_lock(&zlog_async_mutex);
+}
+
+static void zlog_async_atfork_parent(void)
+{
+	pthread_mutex_unlock(&zlog_async_mutex);
+}
+
+static void zlog_async_atfork_child(void)
+{
+	int i;
+	zlog_async_ring_t *a_ring;
+
+	/* writers are gone, msgs in rings belong to parent */
+	for (a_ring = zlog_async_rings; a_ring; a_ring = a_ring->next) {
+		a_ring->tail = a_ring->head;
+	}
+	if (zlog_async_running) {
+		zlog_async_running = 0;
+		zlog_async_restart = 1;
+		for (i = 0; i < zlog_async_writer_count; i++) {
+			if (zlog_async_writers[i].uring) zlog_uring_del(zlog_async_writers[i].uring);
+		}
+		free(zlog_async_writers);
+		zlog_async_writers = NULL;
+		zlog_async_writer_count = 0;
+	}
+	zlog_async_idle = 0;
+	zlog_async_blocked = 0;
+	zlog_async_flushing = 0;
+	pthread_mutex_init(&zlog_async_mutex, NULL);
+	pthread_cond_init(&zlog_async_wake_cond, NULL);
+	pthread_cond_init(&zlog_async_done_cond, NULL);
+}
+
+static void zlog_async_atexit(void)
+{
+	zlog_async_stop();
+}
+
+static void zlog_async_init_once(void)
+{
+	int rc;
+
+	rc = pthread_key_create(&zlog_async_writer_key, NULL);
+	if (rc) zc_error("pthread_key_create fail, rc[%d]", rc);
+
+	rc = pthread_atfork(zlog_async_atfork_prepare,
+			zlog_async_atfork_parent, zlog_async_atfork_child);
+	if (rc) zc_error("pthread_atfork fail, rc[%d]", rc);
+
+	/* registered after zlog_clean_rest_thread(), so run before it */
+	rc = atexit(zlog_async_atexit);
+	if (rc) zc_error("atexit fail, rc[%d]", rc);
+}
+
+int zlog_async_is_writer(void)
+{
+	if (!zlog_async_writer_count && !zlog_async_restart) return 0;
+	return pthread_getspecific(zlog_async_writer_key) != NULL;
+}
+
+int zlog_async_start(size_t buf_size_min, size_t buf_size_max,
+		int time_cache_count, int writers, int io_uring)
+{
+	int i;
+	int rc;
+	zlog_async_writer_t *a_writer;
+
+	pthread_once(&zlog_async_once, zlog_async_init_once);
+
+	if (zlog_async_running) {
+		zc_error("async writers already running");
+		return -1;
+	}
+
+	zlog_async_writers = calloc(writers, sizeof(zlog_async_writer_t));
+	if (!zlog_async_writers) {
+		zc_error("calloc fail, errno[%d]", errno);
+		return -1;
+	}
+
+	for (i = 0; i < writers; i++) {
+		a_writer = &zlog_async_writers[i];
+		a_writer->idx = i;
+		a_writer->a_thread = zlog_thread_new(0, buf_size_min, buf_size_max, time_cache_count);
+		if (!a_writer->a_thread) {
+			zc_error("zlog_thread_new fail");
+			goto err;
+		}
+		a_writer->a_thread->async_writer = 1;
+
+		a_writer->batch = malloc(ZLOG_ASYNC_BATCH_SIZE);
+		if (!a_writer->batch) {
+			zc_error("malloc fail, errno[%d]", errno);
+			goto err;
+		}
+
+		/* NULL if not supported, emitv then */
+		if (io_uring) a_writer->uring = zlog_uring_new();
+	}
+
+	zlog_async_buf_size_min = buf_size_min;
+	zlog_async_buf_size_max = buf_size_max;
+	zlog_async_time_cache_count = time_cache_count;
+	zlog_async_io_uring = io_uring;
+	zlog_async_restart_writers = writers;
+	zlog_async_writer_count = writers;
+	zlog_async_stopping = 0;
+
+	for (i = 0; i < writers; i++) {
+		a_writer = &zlog_async_writers[i];
+		rc = pthread_create(&a_writer->tid, NULL, zlog_async_writer_run, a_writer);
+		if (rc) {
+			zc_error("pthread_create fail, rc[%d]", rc);
+			zlog_async_writer_count = i;
+			zlog_async_running = 1;
+			zlog_async_stop();
+			return -1;
+		}
+	}
+
+	zc_store_release(&zlog_async_running, 1);
+	zc_debug("zlog_async_start, writers[%d]", writers);
+	return 0;
+err:
+	for (i = 0; i < writers; i++) {
+		if (zlog_async_writers[i].a_thread) zlog_thread_del(zlog_async_writers[i].a_thread);
+		if (zlog_async_writers[i].batch) free(zlog_async_writers[i].batch);
+		if (zlog_async_writers[i].uring) zlog_uring_del(zlog_async_writers[i].uring);
+	}
+	free(zlog_async_writers);
+	zlog_async_writers = NULL;
+	return -1;
+}
+
+/* drain all rings and join writers */
+void zlog_async_stop(void)
+{
+	int i;
+
+	if (!zlog_async_running) return;
+
+	pthread_mutex_lock(&zlog_async_mutex);
+	zlog_async_stopping = 1;
+	pthread_cond_broadcast(&zlog_async_wake_cond);
+	pthread_mutex_unlock(&zlog_async_mutex);
+
+	for (i = 0; i < zlog_async_writer_count; i++) {
+		pthread_join(zlog_async_writers[i].tid, NULL);
+	}
+
+	pthread_mutex_lock(&zlog_async_mutex);
+	zlog_async_running = 0;
+	zlog_async_stopping = 0;
+	pthread_cond_broadcast(&zlog_async_done_cond);
+	pthread_mutex_unlock(&zlog_async_mutex);
+
+	for (i = 0; i < zlog_async_writer_count; i++) {
+		if (zlog_async_writers[i].a_thread) zlog_thread_del(zlog_async_writers[i].a_thread);
+		if (zlog_async_writers[i].batch) free(zlog_async_writers[i].batch);
+		if (zlog_async_writers[i].uring) {
+			zlog_uring_profile(zlog_async_writers[i].uring, ZC_DEBUG);
+			zlog_uring_del(zlog_async_writers[i].uring);
+		}
+	}
+	free(zlog_async_writers);
+	zlog_async_writers = NULL;
+	zlog_async_writer_count = 0;
+
+	zc_debug("zlog_async_stop");
+	return;
+}
+
+/* wait every writer finish a whole pass started after now */
+void zlog_async_flush(void)
+{
+	int i;
+	unsigned long *targets;
+
+	if (!zlog_async_running) return;
+
+	pthread_mutex_lock(&zlog_async_mutex);
+	targets = calloc(zlog_async_writer_count, sizeof(unsigned long));
+	if (!targets) {
+		zc_error("calloc fail, errno[%d]", errno);
+		pthread_mutex_unlock(&zlog_async_mutex);
+		return;
+	}
+	for (i = 0; i < zlog_async_writer_count; i++) {
+		targets[i] = zlog_async_writers[i].passes + 2;
+	}
+	zlog_async_flushing++;
+	pthread_cond_broadcast(&zlog_async_wake_cond);
+
+	for (i = 0; zlog_async_running && i < zlog_async_writer_count; ) {
+		if (zlog_async_writers[i].passes >= targets[i]) {
+			i++;
+			continue;
+		}
+		pthread_cond_wait(&zlog_async_done_cond, &zlog_async_mutex);
+	}
+	zlog_async_flushing--;
+	pthread_mutex_unlock(&zlog_async_mutex);
+
+	free(targets);
+	return;
+}
@@ -0,0 +1,67 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#ifndef __zlog_async_h
+#define __zlog_async_h
+
+/* async, the caller formats msg into its own ring,
+ * writer threads drain the rings and emit msgs to outputs.
+ * with deferred format, the caller only packs args into ring,
+ * and writer threads format them.
+ * each ring has one producer(owner thread) and one consumer(writer),
+ * so no lock is needed to push.
+ */
+
+#include "zc_defs.h"
+#include "thread.h"
+#include "rule.h"
+#include "category.h"
+#include "conf.h"
+
+/* what to do when the ring is full */
+#define ZLOG_ASYNC_BLOCK 0
+#define ZLOG_ASYNC_DROP 1
+#define ZLOG_ASYNC_DROP_BELOW 2 /* drop below async drop level, block others */
+
+typedef struct zlog_async_ring_s {
+	char *buf;
+	size_t size; /* power of 2 */
+
+	/* free-running offsets, head is written by owner, tail by writer */
+	volatile size_t head;
+	char pad[64];
+	volatile size_t tail;
+
+	size_t dropped;
+	size_t dropped_reported;
+	unsigned long seq; /* which writer to drain it */
+	int orphan; /* owner thread exited */
+
+	/* msgs till uring_tail are queued to io_uring of the writer,
+	 * tail moves there after they are written */
+	size_t uring_tail;
+	struct zlog_async_ring_s *uring_next;
+
+	struct zlog_async_ring_s *prev;
+	struct zlog_async_ring_s *next;
+} zlog_async_ring_t;
+
+/* ring size and full policy are of a_thread->conf */
+int zlog_async_push(zlog_rule_t * a_rule, zlog_thread_t * a_thread);
+int zlog_async_defer(const zlog_conf_t * a_conf, zlog_category_t * a_category, zlog_thread_t * a_thread,
+		const char *file, size_t file_len, const char *func, size_t func_len,
+		long line, int level, const char *format, va_list args);
+void zlog_async_ring_release(zlog_async_ring_t * a_ring);
+
+int zlog_async_start(size_t buf_size_min, size_t buf_size_max,
+		int time_cache_count, int writers, int io_uring);
+void zlog_async_stop(void);
+void zlog_async_flush(void);
+int zlog_async_is_writer(void);
+
+#endif
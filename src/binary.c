@@ -0,0 +1,396 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#include "fmacros.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "binary.h"
+#include "event.h"
+#include "buf.h"
+#include "zc_defs.h"
+
+/* what zlog_binary_gen() leaves in msg_buf,
+ * followed by category, file, func, format each ends with '\0', and args */
+typedef struct {
+	int level;
+	struct timeval time_stamp;
+	unsigned long tid;
+	long line;
+	size_t category_len;
+	size_t file_len;
+	size_t func_len;
+	size_t format_len;
+	size_t args_len;
+} zlog_binary_event_t;
+
+#define ZLOG_BINARY_BUF_SIZE 1024
+
+/*******************************************************************************/
+void zlog_binary_profile(zlog_binary_t * a_binary, int flag)
+{
+	zc_assert(a_binary,);
+	zc_profile(flag, "---binary[%p][%s][%d][%ld][%ld,%ld][%ld,%ld]---",
+		a_binary, a_binary->path, a_binary->refs, (long)a_binary->pid,
+		(long)a_binary->dev, (long)a_binary->ino,
+		(long)a_binary->category_count, (long)a_binary->callsite_count);
+	return;
+}
+
+/* binaries of one path are shared by rules, and by confs around reload,
+ * as ids of all records in a file must be in one session */
+static zlog_binary_t *zlog_binary_list;
+static pthread_mutex_t zlog_binary_list_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void zlog_binary_free(zlog_binary_t * a_binary)
+{
+	if (a_binary->categories) zc_hashtable_del(a_binary->categories);
+	if (a_binary->callsites) zc_hashtable_del(a_binary->callsites);
+	if (a_binary->frames) zlog_args_del(a_binary->frames);
+	if (a_binary->payload) zlog_args_del(a_binary->payload);
+	if (a_binary->key) zlog_args_del(a_binary->key);
+	if (a_binary->msg_format) zlog_format_del(a_binary->msg_format);
+	pthread_mutex_destroy(&a_binary->lock);
+	free(a_binary);
+	return;
+}
+
+void zlog_binary_del(zlog_binary_t * a_binary)
+{
+	zlog_binary_t **p;
+
+	zc_assert(a_binary,);
+	pthread_mutex_lock(&zlog_binary_list_lock);
+	if (--a_binary->refs > 0) {
+		pthread_mutex_unlock(&zlog_binary_list_lock);
+		return;
+	}
+	for (p = &zlog_binary_list; *p; p = &(*p)->next) {
+		if (*p == a_binary) {
+			*p = a_binary->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&zlog_binary_list_lock);
+
+	zlog_binary_free(a_binary);
+	zc_debug("zlog_binary_del[%p]", a_binary);
+	return;
+}
+
+zlog_binary_t *zlog_binary_new(const char *path, int *time_cache_count)
+{
+	zlog_binary_t *a_binary;
+	char line[] = "binary_msg = \"%m\"";
+
+	pthread_mutex_lock(&zlog_binary_list_lock);
+	for (a_binary = zlog_binary_list; a_binary; a_binary = a_binary->next) {
+		if (STRCMP(a_binary->path, ==, path)) {
+			a_binary->refs++;
+			pthread_mutex_unlock(&zlog_binary_list_lock);
+			return a_binary;
+		}
+	}
+
+	a_binary = calloc(1, sizeof(zlog_binary_t));
+	if (!a_binary) {
+		zc_error("calloc fail, errno[%d]", errno);
+		goto err_unlock;
+	}
+
+	if (pthread_mutex_init(&a_binary->lock, NULL)) {
+		zc_error("pthread_mutex_init fail, errno[%d]", errno);
+		free(a_binary);
+		goto err_unlock;
+	}
+
+	a_binary->categories = zc_hashtable_new(64,
+			zc_hashtable_str_hash, zc_hashtable_str_equal, free, NULL);
+	a_binary->callsites = zc_hashtable_new(256,
+			zc_hashtable_str_hash, zc_hashtable_str_equal, free, NULL);
+	if (!a_binary->categories || !a_binary->callsites) {
+		zc_error("zc_hashtable_new fail");
+		goto err;
+	}
+
+	a_binary->frames = zlog_args_new(ZLOG_BINARY_BUF_SIZE);
+	a_binary->payload = zlog_args_new(ZLOG_BINARY_BUF_SIZE);
+	a_binary->key = zlog_args_new(ZLOG_BINARY_BUF_SIZE);
+	if (!a_binary->frames || !a_binary->payload || !a_binary->key) {
+		zc_error("zlog_args_new fail");
+		goto err;
+	}
+
+	/* %m has no time spec, time_cache_count is not changed */
+	a_binary->msg_format = zlog_format_new(line, time_cache_count);
+	if (!a_binary->msg_format) {
+		zc_error("zlog_format_new fail");
+		goto err;
+	}
+
+	snprintf(a_binary->path, sizeof(a_binary->path), "%s", path);
+	a_binary->refs = 1;
+	a_binary->next = zlog_binary_list;
+	zlog_binary_list = a_binary;
+	pthread_mutex_unlock(&zlog_binary_list_lock);
+
+	//zlog_binary_profile(a_binary, ZC_DEBUG);
+	return a_binary;
+err:
+	zlog_binary_free(a_binary);
+err_unlock:
+	pthread_mutex_unlock(&zlog_binary_list_lock);
+	return NULL;
+}
+
+/*******************************************************************************/
+#define zlog_binary_append(a_buf, str, len) do { \
+	if (zlog_buf_append(a_buf, str, len)) goto err; \
+} while (0)
+
+int zlog_binary_gen(zlog_binary_t * a_binary, zlog_thread_t * a_thread)
+{
+	zlog_event_t *a_event = a_thread->event;
+	zlog_binary_event_t head;
+	const char *format = NULL;
+	const char *blob = NULL;
+	size_t blob_len = 0;
+
+	if (!a_thread->args) {
+		a_thread->args = zlog_args_new(ZLOG_BINARY_BUF_SIZE);
+		if (!a_thread->args) {
+			zc_error("zlog_args_new fail");
+			return -1;
+		}
+	}
+
+	if (a_event->generate_cmd == ZLOG_ARGS) {
+		format = a_event->str_format;
+		blob = a_event->args_blob;
+		blob_len = a_event->args_blob_len;
+	} else if (a_event->generate_cmd == ZLOG_FMT && a_event->str_format
+		&& zlog_args_pack(a_thread->args, a_event->str_format, a_event->str_args) == 0) {
+		format = a_event->str_format;
+		blob = a_thread->args->start;
+		blob_len = a_thread->args->len;
+	}
+
+	if (!format) {
+		/* hex, or args can not be packed, keep the text as "%s" */
+		if (zlog_format_gen_msg(a_binary->msg_format, a_thread)) {
+			zc_error("zlog_format_gen_msg fail");
+			return -1;
+		}
+		if (zlog_args_pack_str(a_thread->args,
+			zlog_buf_str(a_thread->msg_buf), zlog_buf_len(a_thread->msg_buf))) {
+			zc_error("zlog_args_pack_str fail");
+			return -1;
+		}
+		format = "%s";
+		blob = a_thread->args->start;
+		blob_len = a_thread->args->len;
+	}
+
+	/* same as time spec, other rules of this event share it */
+	if (!a_event->time_stamp.tv_sec) gettimeofday(&(a_event->time_stamp), NULL);
+
+	memset(&head, 0x00, sizeof(head));
+	head.level = a_event->level;
+	head.time_stamp = a_event->time_stamp;
+	head.tid = (unsigned long)a_event->tid;
+	head.line = a_event->line;
+	head.category_len = a_event->category_name_len;
+	head.file_len = a_event->file ? a_event->file_len : 0;
+	head.func_len = a_event->func ? a_event->func_len : 0;
+	head.format_len = strlen(format);
+	head.args_len = blob_len;
+
+	zlog_buf_restart(a_thread->msg_buf);
+	zlog_binary_append(a_thread->msg_buf, (char *)&head, sizeof(head));
+	zlog_binary_append(a_thread->msg_buf, a_event->category_name, head.category_len);
+	zlog_binary_append(a_thread->msg_buf, "", 1);
+	zlog_binary_append(a_thread->msg_buf, a_event->file, head.file_len);
+	zlog_binary_append(a_thread->msg_buf, "", 1);
+	zlog_binary_append(a_thread->msg_buf, a_event->func, head.func_len);
+	zlog_binary_append(a_thread->msg_buf, "", 1);
+	zlog_binary_append(a_thread->msg_buf, format, head.format_len);
+	zlog_binary_append(a_thread->msg_buf, "", 1);
+	zlog_binary_append(a_thread->msg_buf, blob, blob_len);
+	return 0;
+err:
+	zc_error("binary record is longer than buffer max, srcfile[%s], srcline[%ld]",
+		a_event->file, a_event->line);
+	return -1;
+}
+
+/*******************************************************************************/
+static int zlog_binary_put_frame(zlog_binary_t * a_binary, char type)
+{
+	if (zlog_args_append(a_binary->frames, &type, 1)
+		|| zlog_args_put_varint(a_binary->frames, a_binary->payload->len)
+		|| zlog_args_append(a_binary->frames, a_binary->payload->start, a_binary->payload->len)) {
+		zc_error("put frame[%c] fail", type);
+		return -1;
+	}
+	a_binary->payload->len = 0;
+	return 0;
+}
+
+#define zlog_binary_put_varint(a_binary, v) do { \
+	if (zlog_args_put_varint((a_binary)->payload, v)) goto err; \
+} while (0)
+
+#define zlog_binary_put_str(a_binary, str, len) do { \
+	zlog_binary_put_varint(a_binary, len); \
+	if (zlog_args_append((a_binary)->payload, str, len)) goto err; \
+} while (0)
+
+static int zlog_binary_start_session(zlog_binary_t * a_binary, pid_t pid, dev_t dev, ino_t ino,
+		struct timeval *time_stamp)
+{
+	char host_name[256 + 1];
+
+	zc_hashtable_clean(a_binary->categories);
+	zc_hashtable_clean(a_binary->callsites);
+	a_binary->category_count = 0;
+	a_binary->callsite_count = 0;
+	a_binary->pid = pid;
+	a_binary->dev = dev;
+	a_binary->ino = ino;
+	a_binary->last_time = (long long)time_stamp->tv_sec * 1000000 + time_stamp->tv_usec;
+
+	memset(host_name, 0x00, sizeof(host_name));
+	if (gethostname(host_name, sizeof(host_name) - 1)) {
+		zc_error("gethostname fail, errno[%d]", errno);
+	}
+
+	a_binary->payload->len = 0;
+	if (zlog_args_append(a_binary->payload, ZLOG_BINARY_MAGIC, sizeof(ZLOG_BINARY_MAGIC) - 1)) goto err;
+	zlog_binary_put_varint(a_binary, ZLOG_BINARY_VERSION);
+	zlog_binary_put_varint(a_binary, time_stamp->tv_sec);
+	zlog_binary_put_varint(a_binary, time_stamp->tv_usec);
+	zlog_binary_put_varint(a_binary, pid);
+	zlog_binary_put_str(a_binary, host_name, strlen(host_name));
+	return zlog_binary_put_frame(a_binary, ZLOG_BINARY_HEAD);
+err:
+	zc_error("put head frame fail");
+	return -1;
+}
+
+/* return id of key in table, define it by a frame if new */
+static long zlog_binary_lookup(zlog_binary_t * a_binary, zc_hashtable_t * a_table,
+		const char *key, size_t *count)
+{
+	void *value;
+	char *key_copy;
+
+	value = zc_hashtable_get(a_table, key);
+	if (value) return (long)((uintptr_t)value - 1);
+
+	key_copy = strdup(key);
+	if (!key_copy) {
+		zc_error("strdup fail, errno[%d]", errno);
+		return -1;
+	}
+	if (zc_hashtable_put(a_table, key_copy, (void *)(uintptr_t)(*count + 1))) {
+		zc_error("zc_hashtable_put fail");
+		free(key_copy);
+		return -1;
+	}
+	return (long)(*count)++;
+}
+
+int zlog_binary_encode(zlog_binary_t * a_binary, dev_t dev, ino_t ino,
+		const char *msg, size_t msg_len)
+{
+	zlog_binary_event_t head;
+	const char *category;
+	const char *file;
+	const char *func;
+	const char *format;
+	const char *args;
+	long category_id;
+	long callsite_id;
+	size_t count;
+	long long now;
+	pid_t pid;
+	char line[30 + 1];
+
+	if (msg_len < sizeof(head)) goto err;
+	memcpy(&head, msg, sizeof(head));
+	if (msg_len != sizeof(head) + head.category_len + head.file_len + head.func_len
+			+ head.format_len + 4 + head.args_len) goto err;
+	category = msg + sizeof(head);
+	file = category + head.category_len + 1;
+	func = file + head.file_len + 1;
+	format = func + head.func_len + 1;
+	args = format + head.format_len + 1;
+
+	a_binary->frames->len = 0;
+	a_binary->payload->len = 0;
+
+	pid = getpid();
+	if (pid != a_binary->pid || dev != a_binary->dev || ino != a_binary->ino) {
+		if (zlog_binary_start_session(a_binary, pid, dev, ino, &head.time_stamp)) return -1;
+	}
+
+	count = a_binary->category_count;
+	category_id = zlog_binary_lookup(a_binary, a_binary->categories, category,
+			&a_binary->category_count);
+	if (category_id < 0) return -1;
+	if (count != a_binary->category_count) {
+		zlog_binary_put_varint(a_binary, category_id);
+		if (zlog_args_append(a_binary->payload, category, head.category_len)) goto err;
+		if (zlog_binary_put_frame(a_binary, ZLOG_BINARY_CATEGORY)) return -1;
+	}
+
+	/* file and func never have '\n', format is the last */
+	a_binary->key->len = 0;
+	sprintf(line, "%ld\n", head.line);
+	if (zlog_args_append(a_binary->key, line, strlen(line))
+		|| zlog_args_append(a_binary->key, file, head.file_len)
+		|| zlog_args_append(a_binary->key, "\n", 1)
+		|| zlog_args_append(a_binary->key, func, head.func_len)
+		|| zlog_args_append(a_binary->key, "\n", 1)
+		|| zlog_args_append(a_binary->key, format, head.format_len + 1)) goto err;
+
+	count = a_binary->callsite_count;
+	callsite_id = zlog_binary_lookup(a_binary, a_binary->callsites, a_binary->key->start,
+			&a_binary->callsite_count);
+	if (callsite_id < 0) return -1;
+	if (count != a_binary->callsite_count) {
+		zlog_binary_put_varint(a_binary, callsite_id);
+		zlog_binary_put_varint(a_binary, zlog_args_zigzag(head.line));
+		zlog_binary_put_str(a_binary, file, head.file_len);
+		zlog_binary_put_str(a_binary, func, head.func_len);
+		if (zlog_args_append(a_binary->payload, format, head.format_len)) goto err;
+		if (zlog_binary_put_frame(a_binary, ZLOG_BINARY_CALLSITE)) return -1;
+	}
+
+	now = (long long)head.time_stamp.tv_sec * 1000000 + head.time_stamp.tv_usec;
+	zlog_binary_put_varint(a_binary, callsite_id);
+	zlog_binary_put_varint(a_binary, category_id);
+	zlog_binary_put_varint(a_binary, head.level);
+	zlog_binary_put_varint(a_binary, zlog_args_zigzag(now - a_binary->last_time));
+	zlog_binary_put_varint(a_binary, head.tid);
+	if (zlog_args_encode(a_binary->payload, format, args, head.args_len)) goto err;
+	if (zlog_binary_put_frame(a_binary, ZLOG_BINARY_RECORD)) return -1;
+	a_binary->last_time = now;
+
+	return 0;
+err:
+	zc_error("encode binary record fail");
+	return -1;
+}
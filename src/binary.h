@@ -0,0 +1,84 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#ifndef __zlog_binary_h
+#define __zlog_binary_h
+
+/* binary output, rule [>binary, "path"]
+ *
+ * file is a stream of frames, [type:1][len:varint][payload:len]
+ * H	session head, "ZLOG", version, base time sec and usec, pid, host name
+ * C	category, id, name
+ * S	callsite, id, line, file, func, format
+ * R	record, callsite id, category id, level, time delta in usec, tid, args
+ *
+ * ids are numbered in a session, a new session starts when the file is
+ * reopened or the process forks. as sessions can not interleave, a file
+ * is written by only one process. args are encoded by zlog_args_encode().
+ * see zlog-decode.c for the reader.
+ */
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "zc_defs.h"
+#include "thread.h"
+#include "format.h"
+#include "args.h"
+
+#define ZLOG_BINARY_MAGIC "ZLOG"
+#define ZLOG_BINARY_VERSION 1
+
+#define ZLOG_BINARY_HEAD 'H'
+#define ZLOG_BINARY_CATEGORY 'C'
+#define ZLOG_BINARY_CALLSITE 'S'
+#define ZLOG_BINARY_RECORD 'R'
+
+typedef struct zlog_binary_s {
+	char path[MAXLEN_PATH + 1];
+	int refs;
+	struct zlog_binary_s *next;
+
+	pthread_mutex_t lock;
+
+	/* session */
+	pid_t pid;
+	dev_t dev;
+	ino_t ino;
+	zc_hashtable_t *categories; /* name -> id + 1 */
+	zc_hashtable_t *callsites;  /* line, file, func, format -> id + 1 */
+	size_t category_count;
+	size_t callsite_count;
+	long long last_time;
+
+	zlog_args_t *frames;  /* to write out */
+	zlog_args_t *payload; /* of the frame being made */
+	zlog_args_t *key;
+	zlog_format_t *msg_format; /* for logs can not be packed, %m */
+} zlog_binary_t;
+
+/* one per path in process, zlog_binary_del() drops a reference */
+zlog_binary_t *zlog_binary_new(const char *path, int *time_cache_count);
+void zlog_binary_del(zlog_binary_t * a_binary);
+void zlog_binary_profile(zlog_binary_t * a_binary, int flag);
+
+/* put the event of a_thread into msg_buf, in caller */
+int zlog_binary_gen(zlog_binary_t * a_binary, zlog_thread_t * a_thread);
+
+/* turn msg made by zlog_binary_gen() into a_binary->frames, under lock,
+ * if the frames are not written out, call zlog_binary_reset() */
+int zlog_binary_encode(zlog_binary_t * a_binary, dev_t dev, ino_t ino,
+		const char *msg, size_t msg_len);
+
+/* start a new session at next encode */
+#define zlog_binary_reset(a_binary) ((a_binary)->pid = 0)
+
+#define zlog_binary_lock(a_binary) pthread_mutex_lock(&(a_binary)->lock)
+#define zlog_binary_unlock(a_binary) pthread_mutex_unlock(&(a_binary)->lock)
+
+#endif
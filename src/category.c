@@ -23,20 +23,99 @@ void zlog_category_profile(zlog_category_t *a_category, int flag)
 	zc_profile(flag, "--category[%p][%s][%p]--",
 			a_category,
 			a_category->name,
-			a_category->fit_rules);
-	if (a_category->fit_rules) {
-		zc_arraylist_foreach(a_category->fit_rules, i, a_rule) {
+			a_category->plan);
+	if (a_category->plan) {
+		zc_arraylist_foreach(a_category->plan->fit_rules, i, a_rule) {
 			zlog_rule_profile(a_rule, flag);
 		}
 	}
 	return;
 }
 
+/*******************************************************************************/
+static void zlog_category_plan_del(zlog_category_plan_t * a_plan)
+{
+	size_t i;
+
+	for (i = 0; i < a_plan->ncalls; i++) {
+		if (a_plan->calls[i].path) free(a_plan->calls[i].path);
+	}
+	if (a_plan->fit_rules) zc_arraylist_del(a_plan->fit_rules);
+	free(a_plan);
+	return;
+}
+
+#define zlog_category_rule_fit_level(a_rule, lv) \
+	(((a_rule)->level_bitmap[(lv) / 8] >> (7 - (lv) % 8)) & 0x01)
+
+/* whether level lv is output by the same rules as lv - 1 */
+static int zlog_category_plan_same(zc_arraylist_t * fit_rules, int lv)
+{
+	int i;
+	zlog_rule_t *a_rule;
+
+	zc_arraylist_foreach(fit_rules, i, a_rule) {
+		if (zlog_category_rule_fit_level(a_rule, lv)
+			!= zlog_category_rule_fit_level(a_rule, lv - 1)) return 0;
+	}
+	return 1;
+}
+
+/* flat calls for each level, so output does not compare levels of rules */
+static zlog_category_plan_t *zlog_category_plan_new(zc_arraylist_t * fit_rules)
+{
+	int i;
+	int lv;
+	size_t ncalls = 0;
+	zlog_rule_t *a_rule;
+	zlog_category_plan_t *a_plan;
+	zlog_category_call_t *a_call;
+
+	/* 1st, count calls of levels which are not the same as last one */
+	for (lv = 0; lv < 256; lv++) {
+		if (lv && zlog_category_plan_same(fit_rules, lv)) continue;
+		zc_arraylist_foreach(fit_rules, i, a_rule) {
+			if (zlog_category_rule_fit_level(a_rule, lv)) ncalls++;
+		}
+		ncalls++;
+	}
+
+	a_plan = calloc(1, sizeof(zlog_category_plan_t) + ncalls * sizeof(zlog_category_call_t));
+	if (!a_plan) {
+		zc_error("calloc fail, errno[%d]", errno);
+		return NULL;
+	}
+
+	/* 2nd, fill them, in order of rules */
+	a_call = a_plan->calls;
+	for (lv = 0; lv < 256; lv++) {
+		if (lv && zlog_category_plan_same(fit_rules, lv)) {
+			a_plan->levels[lv] = a_plan->levels[lv - 1];
+			continue;
+		}
+		a_plan->levels[lv] = a_call;
+		zc_arraylist_foreach(fit_rules, i, a_rule) {
+			if (zlog_category_rule_fit_level(a_rule, lv)) {
+				a_call->output = a_rule->output;
+				a_call->rule = a_rule;
+				a_call++;
+			}
+		}
+		if (a_call == a_plan->levels[lv]) a_plan->levels[lv] = NULL;
+		a_call++; /* NULL end */
+	}
+
+	a_plan->fit_rules = fit_rules;
+	a_plan->ncalls = ncalls;
+	return a_plan;
+}
+
 /*******************************************************************************/
 void zlog_category_del(zlog_category_t * a_category)
 {
 	zc_assert(a_category,);
-	if (a_category->fit_rules) zc_arraylist_del(a_category->fit_rules);
+	if (a_category->plan) zlog_category_plan_del(a_category->plan);
+	if (a_category->plan_backup) zlog_category_plan_del(a_category->plan_backup);
 	free(a_category);
 	zc_debug("zlog_category_del[%p]", a_category);
 	return;
@@ -46,29 +125,29 @@ void zlog_category_del(zlog_category_t * a_category)
  * so category can judge whether a log level will be output by itself
  * It is safe when configure is reloaded, when rule will be released an recreated
  */
-static void zlog_cateogry_overlap_bitmap(zlog_category_t * a_category, zlog_rule_t *a_rule)
+static void zlog_cateogry_overlap_bitmap(unsigned char *level_bitmap, zlog_rule_t *a_rule)
 {
 	int i;
 	for(i = 0; i < sizeof(a_rule->level_bitmap); i++) {
-		a_category->level_bitmap[i] |= a_rule->level_bitmap[i];
+		level_bitmap[i] |= a_rule->level_bitmap[i];
 	}
 }
 
-static int zlog_category_obtain_rules(zlog_category_t * a_category, zc_arraylist_t * rules)
+/* build fit rules and bitmap aside, loggers may still be reading the category */
+static int zlog_category_obtain_rules(zlog_category_t * a_category, zc_arraylist_t * rules,
+		zlog_category_plan_t ** plan, unsigned char *level_bitmap)
 {
 	int i;
 	int count = 0;
 	int fit = 0;
 	zlog_rule_t *a_rule;
 	zlog_rule_t *wastebin_rule = NULL;
+	zc_arraylist_t *new_fit_rules;
 
-	/* before set, clean last fit rules first */
-	if (a_category->fit_rules) zc_arraylist_del(a_category->fit_rules);
-
-	memset(a_category->level_bitmap, 0x00, sizeof(a_category->level_bitmap));
+	memset(level_bitmap, 0x00, sizeof(a_category->level_bitmap));
 
-	a_category->fit_rules = zc_arraylist_new(NULL);
-	if (!(a_category->fit_rules)) {
+	new_fit_rules = zc_arraylist_new(NULL);
+	if (!new_fit_rules) {
 		zc_error("zc_arraylist_new fail");
 		return -1;
 	}
@@ -77,11 +156,11 @@ static int zlog_category_obtain_rules(zlog_category_t * a_category, zc_arraylist
 	zc_arraylist_foreach(rules, i, a_rule) {
 		fit = zlog_rule_match_category(a_rule, a_category->name);
 		if (fit) {
-			if (zc_arraylist_add(a_category->fit_rules, a_rule)) {
+			if (zc_arraylist_add(new_fit_rules, a_rule)) {
 				zc_error("zc_arrylist_add fail");
 				goto err;
 			}
-			zlog_cateogry_overlap_bitmap(a_category, a_rule);
+			zlog_cateogry_overlap_bitmap(level_bitmap, a_rule);
 			count++;
 		}
 
@@ -93,21 +172,25 @@ static int zlog_category_obtain_rules(zlog_category_t * a_category, zc_arraylist
 	if (count == 0) {
 		if (wastebin_rule) {
 			zc_debug("category[%s], no match rules, use wastebin_rule", a_category->name);
-			if (zc_arraylist_add(a_category->fit_rules, wastebin_rule)) {
+			if (zc_arraylist_add(new_fit_rules, wastebin_rule)) {
 				zc_error("zc_arrylist_add fail");
 				goto err;
 			}
-			zlog_cateogry_overlap_bitmap(a_category, wastebin_rule);
+			zlog_cateogry_overlap_bitmap(level_bitmap, wastebin_rule);
 			count++;
 		} else {
 			zc_debug("category[%s], no match rules & no wastebin_rule", a_category->name);
 		}
 	}
 
+	*plan = zlog_category_plan_new(new_fit_rules);
+	if (!*plan) {
+		zc_error("zlog_category_plan_new fail");
+		goto err;
+	}
 	return 0;
 err:
-	zc_arraylist_del(a_category->fit_rules);
-	a_category->fit_rules = NULL;
+	zc_arraylist_del(new_fit_rules);
 	return -1;
 }
 
@@ -131,7 +214,8 @@ zlog_category_t *zlog_category_new(const char *name, zc_arraylist_t * rules)
 	}
 	strcpy(a_category->name, name);
 	a_category->name_len = len;
-	if (zlog_category_obtain_rules(a_category, rules)) {
+	if (zlog_category_obtain_rules(a_category, rules,
+			&a_category->plan, a_category->level_bitmap)) {
 		zc_error("zlog_category_fit_rules fail");
 		goto err;
 	}
@@ -143,76 +227,73 @@ err:
 	return NULL;
 }
 /*******************************************************************************/
-/* update success: fit_rules 1, fit_rules_backup 1 */
-/* update fail: fit_rules 0, fit_rules_backup 1 */
+/* loggers read plan without lock, so the old plan is only moved to
+ * plan_backup here, and freed by commit after zlog_thread_synchronize() */
+
+/* update success: plan new, plan_backup old */
+/* update fail: nothing changed */
 int zlog_category_update_rules(zlog_category_t * a_category, zc_arraylist_t * new_rules)
 {
+	zlog_category_plan_t *new_plan = NULL;
+	unsigned char new_level_bitmap[sizeof(a_category->level_bitmap)];
+
 	zc_assert(a_category, -1);
 	zc_assert(new_rules, -1);
 
-	/* 1st, mv fit_rules fit_rules_backup */
-	if (a_category->fit_rules_backup) zc_arraylist_del(a_category->fit_rules_backup);
-	a_category->fit_rules_backup = a_category->fit_rules;
-	a_category->fit_rules = NULL;
-
-	memcpy(a_category->level_bitmap_backup, a_category->level_bitmap,
-			sizeof(a_category->level_bitmap));
-	
-	/* 2nd, obtain new_rules to fit_rules */
-	if (zlog_category_obtain_rules(a_category, new_rules)) {
+	/* 1st, obtain new_rules aside */
+	if (zlog_category_obtain_rules(a_category, new_rules,
+			&new_plan, new_level_bitmap)) {
 		zc_error("zlog_category_obtain_rules fail");
-		a_category->fit_rules = NULL;
 		return -1;
 	}
 
-	/* keep the fit_rules_backup not change, return */
+	/* 2nd, mv plan plan_backup, and publish new one */
+	if (a_category->plan_backup) zlog_category_plan_del(a_category->plan_backup);
+	a_category->plan_backup = a_category->plan;
+	memcpy(a_category->level_bitmap_backup, a_category->level_bitmap,
+			sizeof(a_category->level_bitmap));
+
+	memcpy(a_category->level_bitmap, new_level_bitmap,
+			sizeof(a_category->level_bitmap));
+	zc_store_release(&a_category->plan, new_plan);
+
 	return 0;
 }
 
-/* commit fail: fit_rules_backup != 0 */
-/* commit success: fit_rules 1, fit_rules_backup 0 */
+/* commit: free plan_backup, must after zlog_thread_synchronize() */
 void zlog_category_commit_rules(zlog_category_t * a_category)
 {
 	zc_assert(a_category,);
-	if (!a_category->fit_rules_backup) {
-		zc_warn("a_category->fit_rules_backup is NULL, never update before");
+	if (!a_category->plan_backup) {
+		zc_debug("a_category->plan_backup is NULL, never update before");
 		return;
 	}
 
-	zc_arraylist_del(a_category->fit_rules_backup);
-	a_category->fit_rules_backup = NULL;
+	zlog_category_plan_del(a_category->plan_backup);
+	a_category->plan_backup = NULL;
 	memset(a_category->level_bitmap_backup, 0x00,
 			sizeof(a_category->level_bitmap_backup));
 	return;
 }
 
-/* rollback fail: fit_rules_backup != 0 */
-/* rollback success: fit_rules 1, fit_rules_backup 0 */
-/* so whether update succes or not, make things back to old */
+/* rollback: swap back, the new plan is left in plan_backup,
+ * and freed by commit after zlog_thread_synchronize() */
 void zlog_category_rollback_rules(zlog_category_t * a_category)
 {
+	zlog_category_plan_t *new_plan;
+
 	zc_assert(a_category,);
-	if (!a_category->fit_rules_backup) {
-		zc_warn("a_category->fit_rules_backup in NULL, never update before");
+	if (!a_category->plan_backup) {
+		zc_debug("a_category->plan_backup in NULL, never update before");
 		return;
 	}
 
-	if (a_category->fit_rules) {
-		/* update success, rm new and backup */
-		zc_arraylist_del(a_category->fit_rules);
-		a_category->fit_rules = a_category->fit_rules_backup;
-		a_category->fit_rules_backup = NULL;
-	} else {
-		/* update fail, just backup */
-		a_category->fit_rules = a_category->fit_rules_backup;
-		a_category->fit_rules_backup = NULL;
-	}
-
+	new_plan = a_category->plan;
 	memcpy(a_category->level_bitmap, a_category->level_bitmap_backup,
 			sizeof(a_category->level_bitmap));
-	memset(a_category->level_bitmap_backup, 0x00,
-			sizeof(a_category->level_bitmap_backup));
-	
+	zc_store_release(&a_category->plan, a_category->plan_backup);
+	a_category->plan_backup = new_plan;
+
 	return; /* always success */
 }
 
@@ -220,14 +301,21 @@ void zlog_category_rollback_rules(zlog_category_t * a_category)
 
 int zlog_category_output(zlog_category_t * a_category, zlog_thread_t * a_thread)
 {
-	int i;
 	int rc = 0;
-	zlog_rule_t *a_rule;
+	zlog_category_plan_t *a_plan;
+	zlog_category_call_t *a_call;
+
+	/* go through calls of rules which output this level */
+	a_plan = zc_load_acquire(&a_category->plan);
+	a_call = a_plan->levels[a_thread->event->level & 0xFF];
+	if (!a_call) return 0;
 
-	/* go through all match rules to output */
-	zc_arraylist_foreach(a_category->fit_rules, i, a_rule) {
-		rc = zlog_rule_output(a_rule, a_thread);
+	zlog_thread_msg_restart(a_thread);
+	for (; a_call->output; a_call++) {
+		a_thread->call = a_call;
+		rc = a_call->output(a_call->rule, a_thread);
 	}
+	a_thread->call = NULL;
 
 	return rc;
 }
@@ -12,13 +12,45 @@
 #include "zc_defs.h"
 #include "thread.h"
 
+struct zlog_rule_s;
+
+/* leading part of the rule's path, the same in all events of the category
+ * until expire if it has time. it is changed in place, seq is odd meanwhile,
+ * readers copy str and read seq again */
+typedef struct zlog_category_path_s {
+	unsigned long seq;
+	time_t since;
+	time_t expire;
+	size_t len;
+	size_t size;
+	char str[];
+} zlog_category_path_t;
+
+/* one output of a rule, rule->output(rule, thread) */
+typedef struct zlog_category_call_s {
+	int (*output) (struct zlog_rule_s * a_rule, zlog_thread_t * a_thread);
+	struct zlog_rule_s *rule;
+	zlog_category_path_t *path; /* made by the first event, see zlog_rule_gen() */
+} zlog_category_call_t;
+
+/* fit rules, and for each level the calls of rules that output it,
+ * ends with a NULL output, or NULL if no rule outputs the level.
+ * levels with the same rules share calls */
+typedef struct zlog_category_plan_s {
+	zc_arraylist_t *fit_rules;
+	size_t ncalls;
+	zlog_category_call_t *levels[256];
+	zlog_category_call_t calls[];
+} zlog_category_plan_t;
+
 typedef struct zlog_category_s {
+	/* must be the first, zlog_level_enabled() in zlog.h reads it */
+	unsigned char level_bitmap[32];
 	char name[MAXLEN_PATH + 1];
 	size_t name_len;
-	unsigned char level_bitmap[32];
 	unsigned char level_bitmap_backup[32];
-	zc_arraylist_t *fit_rules;
-	zc_arraylist_t *fit_rules_backup;
+	zlog_category_plan_t *plan;
+	zlog_category_plan_t *plan_backup;
 } zlog_category_t;
 
 zlog_category_t *zlog_category_new(const char *name, zc_arraylist_t * rules);
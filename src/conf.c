@@ -22,6 +22,8 @@
 #include "format.h"
 #include "level_list.h"
 #include "rotater.h"
+#include "async.h"
+#include "wbuf.h"
 #include "zc_defs.h"
 
 /*******************************************************************************/
@@ -33,6 +35,10 @@
 #define ZLOG_CONF_DEFAULT_RELOAD_CONF_PERIOD 0
 #define ZLOG_CONF_DEFAULT_FSYNC_PERIOD 0
 #define ZLOG_CONF_BACKUP_ROTATE_LOCK_FILE "/tmp/zlog.lock"
+#define ZLOG_CONF_DEFAULT_ASYNC_RING_SIZE (1024 * 1024)
+#define ZLOG_CONF_DEFAULT_ASYNC_DROP_LEVEL "WARN"
+#define ZLOG_CONF_DEFAULT_ASYNC_WRITERS 1
+#define ZLOG_CONF_DEFAULT_WRITE_FLUSH 50
 /*******************************************************************************/
 
 void zlog_conf_profile(zlog_conf_t * a_conf, int flag)
@@ -53,10 +59,18 @@ void zlog_conf_profile(zlog_conf_t * a_conf, int flag)
 		zlog_format_profile(a_conf->default_format, flag);
 	}
 	zc_profile(flag, "---file perms[0%o]---", a_conf->file_perms);
-	zc_profile(flag, "---reload conf period[%ld]---", a_conf->reload_conf_period);
-	zc_profile(flag, "---fsync period[%ld]---", a_conf->fsync_period);
-
-	zc_profile(flag, "---rotate lock file[%s]---", a_conf->rotate_lock_file);
+	zc_profile(flag, "---reload conf period[%ld], watch[%d]---",
+		a_conf->reload_conf_period, a_conf->reload_conf_watch);
+	zc_profile(flag, "---fsync period[%ld], interval[%ldms], wait level[%d]---",
+		a_conf->fsync_period, a_conf->fsync_interval, a_conf->fsync_wait_level);
+	zc_profile(flag, "---write buffer[%ld], flush[%ldms]---", a_conf->write_buffer, a_conf->write_flush);
+	zc_profile(flag, "---async[%d], ring size[%ld], full policy[%d], drop level[%d], writers[%d], deferred format[%d], io uring[%d]---",
+		a_conf->async, a_conf->async_ring_size, a_conf->async_full_policy,
+		a_conf->async_drop_level, a_conf->async_writers, a_conf->async_deferred_format,
+		a_conf->async_io_uring);
+
+	zc_profile(flag, "---rotate lock file[%s], background[%d], index file[%d]---",
+		a_conf->rotate_lock_file, a_conf->rotate_background, a_conf->rotate_index_file);
 	if (a_conf->rotater) zlog_rotater_profile(a_conf->rotater, flag);
 
 	if (a_conf->levels) zlog_level_list_profile(a_conf->levels, flag);
@@ -81,6 +95,8 @@ void zlog_conf_profile(zlog_conf_t * a_conf, int flag)
 void zlog_conf_del(zlog_conf_t * a_conf)
 {
 	zc_assert(a_conf,);
+	/* msgs of its rules may wait in wbufs of threads */
+	if (a_conf->rules) zlog_wbuf_detach(a_conf->rules);
 	if (a_conf->rotater) zlog_rotater_del(a_conf->rotater);
 	if (a_conf->levels) zlog_level_list_del(a_conf->levels);
 	if (a_conf->default_format) zlog_format_del(a_conf->default_format);
@@ -91,10 +107,34 @@ void zlog_conf_del(zlog_conf_t * a_conf)
 	return;
 }
 
+void zlog_conf_del_from(zlog_conf_t * a_conf, zlog_conf_t * a_keep)
+{
+	int i;
+	zlog_rule_t *a_rule;
+
+	zc_assert(a_conf,);
+	if (a_keep) {
+		/* rules of a_conf sharing files still have file_shared set */
+		if (a_keep->rules) {
+			zc_arraylist_foreach(a_keep->rules, i, a_rule) {
+				a_rule->file_shared = 0;
+			}
+		}
+		if (a_conf->rotater && a_conf->rotater == a_keep->rotater) {
+			/* it points to the lock file path of the conf which made it */
+			a_keep->rotater->lock_file = a_keep->rotate_lock_file;
+			a_conf->rotater = NULL;
+		}
+	}
+	zlog_conf_del(a_conf);
+	return;
+}
+
 static int zlog_conf_build_without_file(zlog_conf_t * a_conf);
 static int zlog_conf_build_with_file(zlog_conf_t * a_conf);
+static void zlog_conf_check_deferred(zlog_conf_t * a_conf);
 
-zlog_conf_t *zlog_conf_new(const char *confpath)
+static zlog_conf_t *zlog_conf_new_inner(const char *confpath, int no_rules, zlog_conf_t * a_from)
 {
 	int nwrite = 0;
 	int has_conf_file = 0;
@@ -105,6 +145,8 @@ zlog_conf_t *zlog_conf_new(const char *confpath)
 		zc_error("calloc fail, errno[%d]", errno);
 		return NULL;
 	}
+	a_conf->no_rules = no_rules;
+	a_conf->from = a_from;
 
 	if (confpath && confpath[0] != '\0') {
 		nwrite = snprintf(a_conf->file, sizeof(a_conf->file), "%s", confpath);
@@ -131,10 +173,25 @@ zlog_conf_t *zlog_conf_new(const char *confpath)
 	} else {
 		strcpy(a_conf->rotate_lock_file, ZLOG_CONF_BACKUP_ROTATE_LOCK_FILE);
 	}
+	a_conf->rotate_background = 0;
+	a_conf->rotate_index_file = 0;
 	strcpy(a_conf->default_format_line, ZLOG_CONF_DEFAULT_FORMAT);
 	a_conf->file_perms = ZLOG_CONF_DEFAULT_FILE_PERMS;
 	a_conf->reload_conf_period = ZLOG_CONF_DEFAULT_RELOAD_CONF_PERIOD;
+	a_conf->reload_conf_watch = 0;
 	a_conf->fsync_period = ZLOG_CONF_DEFAULT_FSYNC_PERIOD;
+	a_conf->fsync_interval = 0;
+	a_conf->fsync_wait_level_str[0] = '\0';
+	a_conf->fsync_wait_level = 0;
+	a_conf->async = 0;
+	a_conf->async_ring_size = ZLOG_CONF_DEFAULT_ASYNC_RING_SIZE;
+	a_conf->async_full_policy = ZLOG_ASYNC_BLOCK;
+	strcpy(a_conf->async_drop_level_str, ZLOG_CONF_DEFAULT_ASYNC_DROP_LEVEL);
+	a_conf->async_writers = ZLOG_CONF_DEFAULT_ASYNC_WRITERS;
+	a_conf->async_deferred_format = 0;
+	a_conf->async_io_uring = 0;
+	a_conf->write_buffer = 0;
+	a_conf->write_flush = ZLOG_CONF_DEFAULT_WRITE_FLUSH;
 	/* set default configuration end */
 
 	a_conf->levels = zlog_level_list_new();
@@ -167,12 +224,124 @@ zlog_conf_t *zlog_conf_new(const char *confpath)
 		}
 	}
 
+	if (a_conf->async_deferred_format) zlog_conf_check_deferred(a_conf);
+	if (a_conf->async_io_uring && !a_conf->async) {
+		zc_warn("async io uring needs async = true, ignore it");
+		a_conf->async_io_uring = 0;
+	}
+
+	a_conf->from = NULL;
 	zlog_conf_profile(a_conf, ZC_DEBUG);
 	return a_conf;
 err:
-	zlog_conf_del(a_conf);
+	a_conf->from = NULL;
+	zlog_conf_del_from(a_conf, a_from);
 	return NULL;
 }
+
+zlog_conf_t *zlog_conf_new(const char *confpath)
+{
+	return zlog_conf_new_inner(confpath, 0, NULL);
+}
+
+zlog_conf_t *zlog_conf_new_from(const char *confpath, zlog_conf_t * a_from)
+{
+	return zlog_conf_new_inner(confpath, 0, a_from);
+}
+
+/* only global, levels and formats, for tools which do not output */
+zlog_conf_t *zlog_conf_new_without_rules(const char *confpath)
+{
+	return zlog_conf_new_inner(confpath, 1, NULL);
+}
+/*******************************************************************************/
+/* args are formatted in async writer, where mdc of the caller is not there */
+static void zlog_conf_check_deferred(zlog_conf_t * a_conf)
+{
+	int i;
+	zlog_rule_t *a_rule;
+
+	if (!a_conf->async) {
+		zc_warn("async deferred format needs async = true, ignore it");
+		a_conf->async_deferred_format = 0;
+		return;
+	}
+
+	zc_arraylist_foreach(a_conf->rules, i, a_rule) {
+		if (zlog_rule_use_mdc(a_rule)) {
+			zc_warn("rule[%s] uses %%M, async deferred format is off", a_rule->category);
+			a_conf->async_deferred_format = 0;
+			return;
+		}
+	}
+	return;
+}
+
+/*******************************************************************************/
+/* stat of the file linked to, as it is what is read */
+static int zlog_conf_stat(const char *path, struct zlog_stat *a_stat)
+{
+	if (stat(path, a_stat)) {
+		zc_error("stat conf file[%s] fail, errno[%d]", path, errno);
+		return -1;
+	}
+	return 0;
+}
+
+/* fnv-1a of content */
+static int zlog_conf_digest(const char *path, unsigned long *digest)
+{
+	FILE *fp;
+	unsigned char buf[4096];
+	size_t nread;
+	size_t i;
+	unsigned long hash = 2166136261UL;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		zc_error("fopen conf file[%s] fail, errno[%d]", path, errno);
+		return -1;
+	}
+	while ((nread = fread(buf, 1, sizeof(buf), fp)) > 0) {
+		for (i = 0; i < nread; i++) {
+			hash ^= buf[i];
+			hash *= 16777619UL;
+		}
+	}
+	fclose(fp);
+
+	*digest = hash;
+	return 0;
+}
+
+int zlog_conf_changed(zlog_conf_t * a_conf, int force)
+{
+	struct zlog_stat a_stat;
+	unsigned long digest;
+
+	zc_assert(a_conf, 0);
+	if (a_conf->file[0] == '\0') return 0;
+
+	/* moved away for a while, or being replaced */
+	if (zlog_conf_stat(a_conf->file, &a_stat)) return 0;
+
+	if (!force
+		&& a_stat.st_dev == a_conf->dev
+		&& a_stat.st_ino == a_conf->ino
+		&& a_stat.st_size == a_conf->size
+		&& a_stat.st_mtime == a_conf->mtime_sec
+		&& zlog_stat_mtime_nsec(&a_stat) == a_conf->mtime_nsec) {
+		return 0;
+	}
+
+	if (zlog_conf_digest(a_conf->file, &digest)) return 0;
+	if (digest == a_conf->digest) {
+		zc_debug("conf file[%s] is touched, but not changed", a_conf->file);
+		return 0;
+	}
+	return 1;
+}
+
 /*******************************************************************************/
 static int zlog_conf_build_without_file(zlog_conf_t * a_conf)
 {
@@ -190,6 +359,8 @@ static int zlog_conf_build_without_file(zlog_conf_t * a_conf)
 		return -1;
 	}
 
+	if (a_conf->no_rules) return 0;
+
 	default_rule = zlog_rule_new(
 			ZLOG_CONF_DEFAULT_RULE,
 			a_conf->levels,
@@ -197,7 +368,11 @@ static int zlog_conf_build_without_file(zlog_conf_t * a_conf)
 			a_conf->formats,
 			a_conf->file_perms,
 			a_conf->fsync_period,
-			&(a_conf->time_cache_count));
+			a_conf->fsync_wait_level,
+			a_conf->async,
+			a_conf->write_buffer,
+			&(a_conf->time_cache_count),
+			a_conf->from ? a_conf->from->rules : NULL);
 	if (!default_rule) {
 		zc_error("zlog_rule_new fail");
 		return -1;
@@ -241,6 +416,15 @@ static int zlog_conf_build_with_file(zlog_conf_t * a_conf)
 	localtime_r(&(a_stat.st_mtime), &local_time);
 	strftime(a_conf->mtime, sizeof(a_conf->mtime), "%F %T", &local_time);
 
+	/* before reading, a change while parsing is seen next time */
+	if (zlog_conf_stat(a_conf->file, &a_stat)) return -1;
+	a_conf->dev = a_stat.st_dev;
+	a_conf->ino = a_stat.st_ino;
+	a_conf->size = a_stat.st_size;
+	a_conf->mtime_sec = a_stat.st_mtime;
+	a_conf->mtime_nsec = zlog_stat_mtime_nsec(&a_stat);
+	if (zlog_conf_digest(a_conf->file, &a_conf->digest)) return -1;
+
 	if ((fp = fopen(a_conf->file, "r")) == NULL) {
 		zc_error("open configure file[%s] fail", a_conf->file);
 		return -1;
@@ -328,6 +512,19 @@ exit:
 	return rc;
 }
 
+/* 50ms, 1s, or 50 as ms, -1 if wrong */
+static long zlog_conf_parse_ms(const char *value)
+{
+	long n;
+	char *p;
+
+	n = strtol(value, &p, 10);
+	if (p == value || n < 0) return -1;
+	if (*p == '\0' || STRICMP(p, ==, "ms")) return n;
+	if (STRICMP(p, ==, "s")) return n * 1000;
+	return -1;
+}
+
 /* section [global:1] [levels:2] [formats:3] [rules:4] */
 static int zlog_conf_parse_line(zlog_conf_t * a_conf, char *line, int *section)
 {
@@ -370,26 +567,23 @@ static int zlog_conf_parse_line(zlog_conf_t * a_conf, char *line, int *section)
 		}
 
 		if (*section == 4) {
-			if (a_conf->reload_conf_period != 0
-				&& a_conf->fsync_period >= a_conf->reload_conf_period) {
-				/* as all rule will be rebuilt when conf is reload,
-				 * so fsync_period > reload_conf_period will never
-				 * cause rule to fsync it's file.
-				 * fsync_period will be meaningless and down speed,
-				 * so make it zero.
-				 */
-				zc_warn("fsync_period[%ld] >= reload_conf_period[%ld],"
-					"set fsync_period to zero");
-				a_conf->fsync_period = 0;
-			}
-
 			/* now build rotater and default_format
 			 * from the unchanging global setting,
 			 * for zlog_rule_new() */
-			a_conf->rotater = zlog_rotater_new(a_conf->rotate_lock_file);	
-			if (!a_conf->rotater) {
-				zc_error("zlog_rotater_new fail");
-				return -1;
+			if (a_conf->from && a_conf->from->rotater
+				&& STRCMP(a_conf->from->rotater->lock_file, ==, a_conf->rotate_lock_file)
+				&& a_conf->from->rotater->background == a_conf->rotate_background
+				&& a_conf->from->rotater->index_file == a_conf->rotate_index_file) {
+				/* keep the lock fd, see zlog_conf_del_from() */
+				a_conf->rotater = a_conf->from->rotater;
+			} else {
+				a_conf->rotater = zlog_rotater_new(a_conf->rotate_lock_file);
+				if (!a_conf->rotater) {
+					zc_error("zlog_rotater_new fail");
+					return -1;
+				}
+				a_conf->rotater->background = a_conf->rotate_background;
+				a_conf->rotater->index_file = a_conf->rotate_index_file;
 			}
 
 			a_conf->default_format = zlog_format_new(a_conf->default_format_line,
@@ -398,6 +592,22 @@ static int zlog_conf_parse_line(zlog_conf_t * a_conf, char *line, int *section)
 				zc_error("zlog_format_new fail");
 				return -1;
 			}
+
+			/* levels are all set now */
+			a_conf->async_drop_level = zlog_level_list_atoi(a_conf->levels,
+							a_conf->async_drop_level_str);
+			if (a_conf->async_drop_level == -1) {
+				zc_error("async drop level[%s] is not defined", a_conf->async_drop_level_str);
+				return -1;
+			}
+			if (a_conf->fsync_wait_level_str[0] != '\0') {
+				a_conf->fsync_wait_level = zlog_level_list_atoi(a_conf->levels,
+								a_conf->fsync_wait_level_str);
+				if (a_conf->fsync_wait_level == -1) {
+					zc_error("fsync wait level[%s] is not defined", a_conf->fsync_wait_level_str);
+					return -1;
+				}
+			}
 		}
 		return 0;
 	}
@@ -442,14 +652,72 @@ static int zlog_conf_parse_line(zlog_conf_t * a_conf, char *line, int *section)
 			} else {
 				strcpy(a_conf->rotate_lock_file, value);
 			}
+		} else if (STRCMP(word_1, ==, "rotate") && STRCMP(word_2, ==, "background")) {
+			a_conf->rotate_background = STRICMP(value, ==, "true");
+		} else if (STRCMP(word_1, ==, "rotate") &&
+				STRCMP(word_2, ==, "index") && STRCMP(word_3, ==, "file")) {
+			a_conf->rotate_index_file = STRICMP(value, ==, "true");
 		} else if (STRCMP(word_1, ==, "default") && STRCMP(word_2, ==, "format")) {
 			/* so the input now is [format = "xxyy"], fit format's style */
 			strcpy(a_conf->default_format_line, line + nread);
 		} else if (STRCMP(word_1, ==, "reload") &&
 				STRCMP(word_2, ==, "conf") && STRCMP(word_3, ==, "period")) {
 			a_conf->reload_conf_period = zc_parse_byte_size(value);
+		} else if (STRCMP(word_1, ==, "reload") &&
+				STRCMP(word_2, ==, "conf") && STRCMP(word_3, ==, "watch")) {
+			a_conf->reload_conf_watch = STRICMP(value, ==, "true");
 		} else if (STRCMP(word_1, ==, "fsync") && STRCMP(word_2, ==, "period")) {
-			a_conf->fsync_period = zc_parse_byte_size(value);
+			/* 1s or 200ms is time, 10K is msgs of a thread */
+			if (value[0] != '\0' && tolower(value[strlen(value) - 1]) == 's') {
+				a_conf->fsync_interval = zlog_conf_parse_ms(value);
+				if (a_conf->fsync_interval <= 0) {
+					zc_error("fsync period[%s] is not like 200ms or 1s", value);
+					return -1;
+				}
+				a_conf->fsync_period = 0;
+			} else {
+				a_conf->fsync_period = zc_parse_byte_size(value);
+				a_conf->fsync_interval = 0;
+			}
+		} else if (STRCMP(word_1, ==, "fsync") && STRCMP(word_2, ==, "wait")) {
+			strcpy(a_conf->fsync_wait_level_str, value);
+		} else if (STRCMP(word_1, ==, "write") && STRCMP(word_2, ==, "buffer")) {
+			a_conf->write_buffer = zc_parse_byte_size(value);
+		} else if (STRCMP(word_1, ==, "write") && STRCMP(word_2, ==, "flush")) {
+			a_conf->write_flush = zlog_conf_parse_ms(value);
+			if (a_conf->write_flush <= 0) {
+				zc_error("write flush[%s] is not like 50ms or 1s", value);
+				return -1;
+			}
+		} else if (STRCMP(word_1, ==, "async") && STRCMP(word_2, ==, "")) {
+			a_conf->async = STRICMP(value, ==, "true");
+		} else if (STRCMP(word_1, ==, "async") &&
+				STRCMP(word_2, ==, "ring") && STRCMP(word_3, ==, "size")) {
+			a_conf->async_ring_size = zc_parse_byte_size(value);
+		} else if (STRCMP(word_1, ==, "async") &&
+				STRCMP(word_2, ==, "full") && STRCMP(word_3, ==, "policy")) {
+			if (STRICMP(value, ==, "block")) {
+				a_conf->async_full_policy = ZLOG_ASYNC_BLOCK;
+			} else if (STRICMP(value, ==, "drop")) {
+				a_conf->async_full_policy = ZLOG_ASYNC_DROP;
+			} else if (STRICMP(value, ==, "drop_below")) {
+				a_conf->async_full_policy = ZLOG_ASYNC_DROP_BELOW;
+			} else {
+				zc_error("async full policy[%s] is not block, drop or drop_below", value);
+				if (a_conf->strict_init) return -1;
+			}
+		} else if (STRCMP(word_1, ==, "async") &&
+				STRCMP(word_2, ==, "drop") && STRCMP(word_3, ==, "level")) {
+			strcpy(a_conf->async_drop_level_str, value);
+		} else if (STRCMP(word_1, ==, "async") && STRCMP(word_2, ==, "writers")) {
+			a_conf->async_writers = atoi(value);
+			if (a_conf->async_writers < 1) a_conf->async_writers = 1;
+		} else if (STRCMP(word_1, ==, "async") &&
+				STRCMP(word_2, ==, "deferred") && STRCMP(word_3, ==, "format")) {
+			a_conf->async_deferred_format = STRICMP(value, ==, "true");
+		} else if (STRCMP(word_1, ==, "async") &&
+				STRCMP(word_2, ==, "io") && STRCMP(word_3, ==, "uring")) {
+			a_conf->async_io_uring = STRICMP(value, ==, "true");
 		} else {
 			zc_error("name[%s] is not any one of global options", name);
 			if (a_conf->strict_init) return -1;
@@ -475,13 +743,19 @@ static int zlog_conf_parse_line(zlog_conf_t * a_conf, char *line, int *section)
 		}
 		break;
 	case 4:
+		if (a_conf->no_rules) break;
+
 		a_rule = zlog_rule_new(line,
 			a_conf->levels,
 			a_conf->default_format,
 			a_conf->formats,
 			a_conf->file_perms,
 			a_conf->fsync_period,
-			&(a_conf->time_cache_count));
+			a_conf->fsync_wait_level,
+			a_conf->async,
+			a_conf->write_buffer,
+			&(a_conf->time_cache_count),
+			a_conf->from ? a_conf->from->rules : NULL);
 
 		if (!a_rule) {
 			zc_error("zlog_rule_new fail [%s]", line);
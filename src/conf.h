@@ -9,6 +9,9 @@
 #ifndef __zlog_conf_h
 #define __zlog_conf_h
 
+#include <sys/types.h>
+#include <time.h>
+
 #include "zc_defs.h"
 #include "format.h"
 #include "rotater.h"
@@ -16,31 +19,69 @@
 typedef struct zlog_conf_s {
 	char file[MAXLEN_PATH + 1];
 	char mtime[20 + 1];
+	/* of the file parsed, to tell if it is changed */
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	time_t mtime_sec;
+	long mtime_nsec;
+	unsigned long digest;
 
 	int strict_init;
 	size_t buf_size_min;
 	size_t buf_size_max;
 
 	char rotate_lock_file[MAXLEN_CFG_LINE + 1];
+	int rotate_background;
+	int rotate_index_file;
 	zlog_rotater_t *rotater;
 
 	char default_format_line[MAXLEN_CFG_LINE + 1];
 	zlog_format_t *default_format;
 
 	unsigned int file_perms;
-	size_t fsync_period;
+	size_t fsync_period; /* msgs of a thread */
+	long fsync_interval; /* ms */
+	char fsync_wait_level_str[MAXLEN_CFG_LINE + 1];
+	int fsync_wait_level;
+	size_t write_buffer;
+	long write_flush; /* ms */
 	size_t reload_conf_period;
+	int reload_conf_watch;
 
 	zc_arraylist_t *levels;
 	zc_arraylist_t *formats;
 	zc_arraylist_t *rules;
 	int time_cache_count;
+
+	int async;
+	size_t async_ring_size;
+	int async_full_policy;
+	char async_drop_level_str[MAXLEN_CFG_LINE + 1];
+	int async_drop_level;
+	int async_writers;
+	int async_deferred_format;
+	int async_io_uring;
+
+	int no_rules;
+	/* while it is built, open files of unchanged outputs are taken from */
+	struct zlog_conf_s *from;
 } zlog_conf_t;
 
 extern zlog_conf_t * zlog_env_conf;
 
 zlog_conf_t *zlog_conf_new(const char *confpath);
+/* at reload, rules writing the same files or pipes as rules of a_from
+ * share their fds, and the rotater is shared if its settings are the same */
+zlog_conf_t *zlog_conf_new_from(const char *confpath, zlog_conf_t * a_from);
+zlog_conf_t *zlog_conf_new_without_rules(const char *confpath);
 void zlog_conf_del(zlog_conf_t * a_conf);
+/* del a_conf, leave what it shares with a_keep to a_keep, a_keep may be NULL */
+void zlog_conf_del_from(zlog_conf_t * a_conf, zlog_conf_t * a_keep);
 void zlog_conf_profile(zlog_conf_t * a_conf, int flag);
 
+/* 1 if content of the file is not what a_conf is built from, 0 if not or fail.
+ * only stat is looked at if not force, a file read is needed to be sure */
+int zlog_conf_changed(zlog_conf_t * a_conf, int force);
+
 #endif
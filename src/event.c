@@ -79,10 +79,7 @@ zlog_event_t *zlog_event_new(int time_cache_count)
 	 * as in whole lifecycle event persists
 	 * even fork to oth pid, tid not change
 	 */
-	a_event->tid = pthread_self();
-
-	a_event->tid_str_len = sprintf(a_event->tid_str, "%lu", (unsigned long)a_event->tid);
-	a_event->tid_hex_str_len = sprintf(a_event->tid_hex_str, "0x%x", (unsigned int)a_event->tid);
+	zlog_event_set_tid(a_event, pthread_self());
 
 	//zlog_event_profile(a_event, ZC_DEBUG);
 	return a_event;
@@ -91,6 +88,15 @@ err:
 	return NULL;
 }
 
+/* async writer renders events of other threads */
+void zlog_event_set_tid(zlog_event_t * a_event, pthread_t tid)
+{
+	a_event->tid = tid;
+	a_event->tid_str_len = sprintf(a_event->tid_str, "%lu", (unsigned long)a_event->tid);
+	a_event->tid_hex_str_len = sprintf(a_event->tid_hex_str, "0x%x", (unsigned int)a_event->tid);
+	return;
+}
+
 /*******************************************************************************/
 void zlog_event_set_fmt(zlog_event_t * a_event,
 			char *category_name, size_t category_name_len,
@@ -105,6 +111,7 @@ void zlog_event_set_fmt(zlog_event_t * a_event,
 
 	a_event->file = (char *) file;
 	a_event->file_len = file_len;
+	a_event->file_base = NULL;
 	a_event->func = (char *) func;
 	a_event->func_len = func_len;
 	a_event->line = line;
@@ -141,6 +148,7 @@ void zlog_event_set_hex(zlog_event_t * a_event,
 
 	a_event->file = (char *) file;
 	a_event->file_len = file_len;
+	a_event->file_base = NULL;
 	a_event->func = (char *) func;
 	a_event->func_len = func_len;
 	a_event->line = line;
@@ -162,3 +170,32 @@ void zlog_event_set_hex(zlog_event_t * a_event,
 	a_event->time_stamp.tv_sec = 0;
 	return;
 }
+
+void zlog_event_set_args(zlog_event_t * a_event,
+			char *category_name, size_t category_name_len,
+			const char *file, size_t file_len, const char *func, size_t func_len,  long line, int level,
+			const char *str_format, const char *args_blob, size_t args_blob_len)
+{
+	a_event->category_name = category_name;
+	a_event->category_name_len = category_name_len;
+
+	a_event->file = (char *) file;
+	a_event->file_len = file_len;
+	a_event->file_base = NULL;
+	a_event->func = (char *) func;
+	a_event->func_len = func_len;
+	a_event->line = line;
+	a_event->level = level;
+
+	a_event->generate_cmd = ZLOG_ARGS;
+	a_event->str_format = str_format;
+	a_event->args_blob = args_blob;
+	a_event->args_blob_len = args_blob_len;
+
+	/* the caller of zlog is in the same process,
+	 * its time_stamp and tid are set by async writer after here
+	 */
+	a_event->pid = (pid_t) 0;
+	a_event->time_stamp.tv_sec = 0;
+	return;
+}
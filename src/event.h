@@ -18,8 +18,20 @@
 typedef enum {
 	ZLOG_FMT = 0,
 	ZLOG_HEX = 1,
+	ZLOG_ARGS = 2, /* args packed by zlog_args_pack, render at async writer */
 } zlog_event_cmd;
 
+/* same as in zlog.h, static in the macros of each log statement */
+typedef struct zlog_callsite_s {
+	const char *file;
+	size_t file_len;
+	const char *func;
+	size_t func_len;
+	long line;
+	int level;
+	const char *file_base;
+} zlog_callsite_t;
+
 typedef struct zlog_time_cache_s {
 	char str[MAXLEN_CFG_LINE + 1];
 	size_t len;
@@ -34,6 +46,7 @@ typedef struct {
 
 	const char *file;
 	size_t file_len;
+	const char *file_base; /* of callsite, or NULL */
 	const char *func;
 	size_t func_len;
 	long line;
@@ -43,6 +56,8 @@ typedef struct {
 	size_t hex_buf_len;
 	const char *str_format;
 	va_list str_args;
+	const char *args_blob;
+	size_t args_blob_len;
 	zlog_event_cmd generate_cmd;
 
 	struct timeval time_stamp;
@@ -81,4 +96,11 @@ void zlog_event_set_hex(zlog_event_t * a_event,
 			const char *file, size_t file_len, const char *func, size_t func_len, long line, int level,
 			const void *hex_buf, size_t hex_buf_len);
 
+void zlog_event_set_args(zlog_event_t * a_event,
+			char *category_name, size_t category_name_len,
+			const char *file, size_t file_len, const char *func, size_t func_len, long line, int level,
+			const char *str_format, const char *args_blob, size_t args_blob_len);
+
+void zlog_event_set_tid(zlog_event_t * a_event, pthread_t tid);
+
 #endif
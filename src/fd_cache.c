@@ -0,0 +1,345 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#include "fmacros.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "fd_cache.h"
+#include "zc_defs.h"
+
+static pthread_mutex_t zlog_fd_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t zlog_fd_cache_once = PTHREAD_ONCE_INIT;
+static zc_hashtable_t *zlog_fd_cache_table; /* path -> zlog_fd_t */
+static zlog_fd_t *zlog_fd_cache_head;       /* most recently used */
+static zlog_fd_t *zlog_fd_cache_tail;
+static int zlog_fd_cache_count;
+
+/*******************************************************************************/
+static void zlog_fd_profile(zlog_fd_t * a_fd, int flag)
+{
+	zc_profile(flag, "---fd[%p][%s][%d][%ld,%ld][%ld][%d]---",
+		a_fd, a_fd->path, a_fd->fd,
+		(long)a_fd->dev, (long)a_fd->ino, a_fd->size, a_fd->refs);
+	return;
+}
+
+void zlog_fd_cache_profile(int flag)
+{
+	zlog_fd_t *a_fd;
+
+	pthread_mutex_lock(&zlog_fd_cache_mutex);
+	zc_profile(flag, "--fd_cache[%d/%d]--", zlog_fd_cache_count, ZLOG_FD_CACHE_MAX);
+	for (a_fd = zlog_fd_cache_head; a_fd; a_fd = a_fd->next) {
+		zlog_fd_profile(a_fd, flag);
+	}
+	pthread_mutex_unlock(&zlog_fd_cache_mutex);
+	return;
+}
+
+/*******************************************************************************/
+static void zlog_fd_unref(zlog_fd_t * a_fd)
+{
+	if (--a_fd->refs > 0) return;
+	/* evicted before the sync thread comes, callers may wait for it */
+	if (a_fd->dirty && zlog_fsync(a_fd->fd)) {
+		zc_error("fsync [%s] fail, errno[%d]", a_fd->path, errno);
+	}
+	if (close(a_fd->fd)) zc_error("close [%s] fail, errno[%d]", a_fd->path, errno);
+	free(a_fd);
+	return;
+}
+
+static void zlog_fd_unlink(zlog_fd_t * a_fd)
+{
+	if (a_fd->prev) a_fd->prev->next = a_fd->next;
+	else zlog_fd_cache_head = a_fd->next;
+	if (a_fd->next) a_fd->next->prev = a_fd->prev;
+	else zlog_fd_cache_tail = a_fd->prev;
+	a_fd->prev = a_fd->next = NULL;
+	return;
+}
+
+static void zlog_fd_link(zlog_fd_t * a_fd)
+{
+	a_fd->prev = NULL;
+	a_fd->next = zlog_fd_cache_head;
+	if (zlog_fd_cache_head) zlog_fd_cache_head->prev = a_fd;
+	else zlog_fd_cache_tail = a_fd;
+	zlog_fd_cache_head = a_fd;
+	return;
+}
+
+/* the fd is closed when the last writer puts it */
+static void zlog_fd_evict(zlog_fd_t * a_fd)
+{
+	zlog_fd_unlink(a_fd);
+	zc_hashtable_remove(zlog_fd_cache_table, a_fd->path);
+	zlog_fd_cache_count--;
+	zlog_fd_unref(a_fd);
+	return;
+}
+
+/*******************************************************************************/
+static void zlog_fd_cache_atfork_prepare(void)
+{
+	pthread_mutex_lock(&zlog_fd_cache_mutex);
+}
+
+static void zlog_fd_cache_atfork_parent(void)
+{
+	pthread_mutex_unlock(&zlog_fd_cache_mutex);
+}
+
+static void zlog_fd_cache_atfork_child(void)
+{
+	zlog_fd_t *a_fd;
+
+	/* fds are inherited, writers of other threads are gone */
+	for (a_fd = zlog_fd_cache_head; a_fd; a_fd = a_fd->next) {
+		a_fd->refs = 1;
+	}
+	pthread_mutex_init(&zlog_fd_cache_mutex, NULL);
+}
+
+static void zlog_fd_cache_init_once(void)
+{
+	int rc;
+
+	rc = pthread_atfork(zlog_fd_cache_atfork_prepare,
+			zlog_fd_cache_atfork_parent, zlog_fd_cache_atfork_child);
+	if (rc) zc_error("pthread_atfork fail, rc[%d]", rc);
+}
+
+/*******************************************************************************/
+static zlog_fd_t *zlog_fd_new(const char *path, int flags, unsigned int perms)
+{
+	zlog_fd_t *a_fd;
+	struct stat stb;
+	size_t len;
+
+	len = strlen(path);
+	if (len > sizeof(a_fd->path) - 1) {
+		zc_error("path[%s] is too long", path);
+		return NULL;
+	}
+
+	a_fd = calloc(1, sizeof(zlog_fd_t));
+	if (!a_fd) {
+		zc_error("calloc fail, errno[%d]", errno);
+		return NULL;
+	}
+	memcpy(a_fd->path, path, len + 1);
+
+	a_fd->fd = open(path, flags | O_WRONLY | O_APPEND | O_CREAT, perms);
+	if (a_fd->fd < 0) {
+		zc_error("open file[%s] fail, errno[%d]", path, errno);
+		free(a_fd);
+		return NULL;
+	}
+
+	if (fstat(a_fd->fd, &stb)) {
+		zc_error("fstat [%s] fail, errno[%d]", path, errno);
+		close(a_fd->fd);
+		free(a_fd);
+		return NULL;
+	}
+	a_fd->dev = stb.st_dev;
+	a_fd->ino = stb.st_ino;
+	a_fd->size = stb.st_size;
+	a_fd->check_time = time(NULL);
+	a_fd->refs = 1;
+	return a_fd;
+}
+
+/* the path may be moved by rotation, here or in other processes,
+ * go on with the new file. a_fd->fd is replaced in place,
+ * so other threads writing it go to the old file or the new one */
+static int zlog_fd_reopen(zlog_fd_t * a_fd, int flags, unsigned int perms)
+{
+	struct stat stb;
+	int fd;
+
+	if (stat(a_fd->path, &stb)) {
+		if (errno != ENOENT) {
+			zc_error("stat fail on [%s], errno[%d]", a_fd->path, errno);
+			return -1;
+		}
+	} else if (stb.st_ino == a_fd->ino && stb.st_dev == a_fd->dev) {
+		return 0;
+	}
+
+	fd = open(a_fd->path, flags | O_WRONLY | O_APPEND | O_CREAT, perms);
+	if (fd < 0) {
+		zc_error("open file[%s] fail, errno[%d]", a_fd->path, errno);
+		return -1;
+	}
+	if (dup2(fd, a_fd->fd) < 0) {
+		zc_error("dup2 fail, errno[%d]", errno);
+		close(fd);
+		return -1;
+	}
+	close(fd);
+
+	if (fstat(a_fd->fd, &stb)) {
+		zc_error("fstat [%s] fail, errno[%d]", a_fd->path, errno);
+		return -1;
+	}
+	a_fd->dev = stb.st_dev;
+	a_fd->ino = stb.st_ino;
+	a_fd->size = stb.st_size;
+	return 0;
+}
+
+int zlog_fd_cache_sync_size(zlog_fd_t * a_fd)
+{
+	struct stat stb;
+
+	if (fstat(a_fd->fd, &stb)) {
+		zc_warn("fstat [%s] fail, errno[%d]", a_fd->path, errno);
+		return -1;
+	}
+	a_fd->size = stb.st_size;
+	return 0;
+}
+
+/*******************************************************************************/
+zlog_fd_t *zlog_fd_cache_get(const char *path, int flags, unsigned int perms)
+{
+	zlog_fd_t *a_fd;
+	zlog_fd_t *a_new;
+	time_t now;
+
+	pthread_once(&zlog_fd_cache_once, zlog_fd_cache_init_once);
+
+	pthread_mutex_lock(&zlog_fd_cache_mutex);
+	a_fd = zlog_fd_cache_table ? zc_hashtable_get(zlog_fd_cache_table, path) : NULL;
+	if (a_fd) {
+		if (a_fd != zlog_fd_cache_head) {
+			zlog_fd_unlink(a_fd);
+			zlog_fd_link(a_fd);
+		}
+		a_fd->refs++;
+		pthread_mutex_unlock(&zlog_fd_cache_mutex);
+
+		now = time(NULL);
+		if (now != a_fd->check_time) {
+			a_fd->check_time = now;
+			if (zlog_fd_reopen(a_fd, flags, perms)) {
+				zc_error("zlog_fd_reopen fail");
+				zlog_fd_cache_put(a_fd);
+				return NULL;
+			}
+		}
+		return a_fd;
+	}
+	pthread_mutex_unlock(&zlog_fd_cache_mutex);
+
+	/* open without lock, other paths are not held up */
+	a_new = zlog_fd_new(path, flags, perms);
+	if (!a_new) {
+		zc_error("zlog_fd_new fail");
+		return NULL;
+	}
+
+	pthread_mutex_lock(&zlog_fd_cache_mutex);
+	if (!zlog_fd_cache_table) {
+		zlog_fd_cache_table = zc_hashtable_new(ZLOG_FD_CACHE_MAX * 2,
+				zc_hashtable_str_hash, zc_hashtable_str_equal, NULL, NULL);
+		if (!zlog_fd_cache_table) {
+			zc_error("zc_hashtable_new fail");
+			goto err;
+		}
+	}
+
+	/* opened by other thread meanwhile */
+	a_fd = zc_hashtable_get(zlog_fd_cache_table, path);
+	if (a_fd) {
+		a_fd->refs++;
+		pthread_mutex_unlock(&zlog_fd_cache_mutex);
+		zlog_fd_unref(a_new);
+		return a_fd;
+	}
+
+	if (zc_hashtable_put(zlog_fd_cache_table, a_new->path, a_new)) {
+		zc_error("zc_hashtable_put fail");
+		goto err;
+	}
+	zlog_fd_link(a_new);
+	if (++zlog_fd_cache_count > ZLOG_FD_CACHE_MAX) {
+		zlog_fd_evict(zlog_fd_cache_tail);
+	}
+	a_new->refs++;
+	pthread_mutex_unlock(&zlog_fd_cache_mutex);
+	return a_new;
+err:
+	pthread_mutex_unlock(&zlog_fd_cache_mutex);
+	zlog_fd_unref(a_new);
+	return NULL;
+}
+
+void zlog_fd_cache_put(zlog_fd_t * a_fd)
+{
+	pthread_mutex_lock(&zlog_fd_cache_mutex);
+	zlog_fd_unref(a_fd);
+	pthread_mutex_unlock(&zlog_fd_cache_mutex);
+	return;
+}
+
+void zlog_fd_cache_sync(void)
+{
+	int i;
+	int count = 0;
+	zlog_fd_t *a_fd;
+	zlog_fd_t *dirty[ZLOG_FD_CACHE_MAX + 1];
+
+	/* hold them, so they are not closed while syncing without lock */
+	pthread_mutex_lock(&zlog_fd_cache_mutex);
+	for (a_fd = zlog_fd_cache_head; a_fd && count < ZLOG_FD_CACHE_MAX + 1; a_fd = a_fd->next) {
+		if (!a_fd->dirty) continue;
+		a_fd->dirty = 0;
+		a_fd->refs++;
+		dirty[count++] = a_fd;
+	}
+	pthread_mutex_unlock(&zlog_fd_cache_mutex);
+
+	for (i = 0; i < count; i++) {
+		if (zlog_fsync(dirty[i]->fd)) {
+			zc_error("fsync [%s] fail, errno[%d]", dirty[i]->path, errno);
+		}
+	}
+
+	if (!count) return;
+	pthread_mutex_lock(&zlog_fd_cache_mutex);
+	for (i = 0; i < count; i++) {
+		zlog_fd_unref(dirty[i]);
+	}
+	pthread_mutex_unlock(&zlog_fd_cache_mutex);
+	return;
+}
+
+void zlog_fd_cache_clean(void)
+{
+	pthread_mutex_lock(&zlog_fd_cache_mutex);
+	while (zlog_fd_cache_head) {
+		zlog_fd_evict(zlog_fd_cache_head);
+	}
+	if (zlog_fd_cache_table) {
+		zc_hashtable_del(zlog_fd_cache_table);
+		zlog_fd_cache_table = NULL;
+	}
+	pthread_mutex_unlock(&zlog_fd_cache_mutex);
+	return;
+}
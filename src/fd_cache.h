@@ -0,0 +1,63 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#ifndef __zlog_fd_cache_h
+#define __zlog_fd_cache_h
+
+/* open fds of dynamic file rules, like "%c.log", keyed by the generated path.
+ * one per process, shared by rules and by confs around reload.
+ * at most ZLOG_FD_CACHE_MAX fds are kept, least recently used is closed.
+ * the path is checked once a second, a moved or removed file is reopened.
+ */
+
+#include <time.h>
+#include <sys/types.h>
+
+#include "zc_defs.h"
+
+#define ZLOG_FD_CACHE_MAX 64
+
+typedef struct zlog_fd_s {
+	char path[MAXLEN_PATH + 1];
+	int fd;
+	dev_t dev;
+	ino_t ino;
+	long size;		/* bytes written, set by fstat now and then */
+	time_t check_time;
+	time_t archive_time;	/* of rule rotating it by time */
+	int refs;		/* one by the cache, one by each writer */
+	volatile int dirty;	/* written since last sync, see syncer.h */
+
+	struct zlog_fd_s *prev;	/* more recently used */
+	struct zlog_fd_s *next;
+} zlog_fd_t;
+
+/* return a referenced fd of path, opened with flags | O_WRONLY | O_APPEND | O_CREAT
+ * when not cached, give it back by zlog_fd_cache_put() after writing */
+zlog_fd_t *zlog_fd_cache_get(const char *path, int flags, unsigned int perms);
+void zlog_fd_cache_put(zlog_fd_t * a_fd);
+
+/* a_fd->size = real size of the file, return 0 success, -1 fail */
+int zlog_fd_cache_sync_size(zlog_fd_t * a_fd);
+
+/* look at the path at next get, after it is rotated */
+#define zlog_fd_cache_expire(a_fd) ((a_fd)->check_time = 0)
+
+/* after each write, only a read when it is dirty already */
+#define zlog_fd_cache_dirty(a_fd) do { \
+	if (!(a_fd)->dirty) (a_fd)->dirty = 1; \
+} while (0)
+
+/* fdatasync dirty fds, by the sync thread */
+void zlog_fd_cache_sync(void);
+
+/* close fds not being written, at fini */
+void zlog_fd_cache_clean(void);
+void zlog_fd_cache_profile(int flag);
+
+#endif
@@ -132,6 +132,8 @@ zlog_format_t *zlog_format_new(char *line, int * time_cache_count)
 			zc_error("zc_arraylist_add fail");
 			goto err;
 		}
+
+		if (a_spec->usrmsg && !a_format->usrmsg_spec) a_format->usrmsg_spec = a_spec;
 	}
 
 	zlog_format_profile(a_format, ZC_DEBUG);
@@ -162,3 +164,64 @@ int zlog_format_gen_msg(zlog_format_t * a_format, zlog_thread_t * a_thread)
 
 	return 0;
 }
+
+int zlog_format_gen_msgv(zlog_format_t * a_format, zlog_thread_t * a_thread, struct iovec *iov)
+{
+	int i;
+	zlog_spec_t *a_spec;
+	zlog_event_t *a_event = a_thread->event;
+	zlog_buf_t *a_buf = a_thread->msg_buf;
+	const char *usrmsg;
+	size_t usrmsg_len;
+	size_t head_len = 0;
+	va_list args;
+
+	if (!a_format->usrmsg_spec) return 0;
+	if (a_event->generate_cmd != ZLOG_FMT || !a_event->str_format) return 0;
+
+	if (STRCMP(a_event->str_format, ==, "%s")) {
+		va_copy(args, a_event->str_args);
+		usrmsg = va_arg(args, const char *);
+		va_end(args);
+		if (!usrmsg) return 0;
+	} else if (!strchr(a_event->str_format, '%')) {
+		usrmsg = a_event->str_format;
+	} else {
+		return 0;
+	}
+
+	usrmsg_len = strlen(usrmsg);
+	if (usrmsg_len < ZLOG_FORMAT_GATHER_MIN) return 0;
+
+	zlog_buf_restart(a_buf);
+	zc_arraylist_foreach(a_format->pattern_specs, i, a_spec) {
+		if (a_spec == a_format->usrmsg_spec) {
+			head_len = zlog_buf_len(a_buf);
+			continue;
+		}
+		if (zlog_spec_gen_msg(a_spec, a_thread)) return -1;
+	}
+
+	/* too long, let zlog_format_gen_msg() truncate it */
+	if (a_buf->size_max && zlog_buf_len(a_buf) + usrmsg_len > a_buf->size_max) return 0;
+
+	iov[0].iov_base = zlog_buf_str(a_buf);
+	iov[0].iov_len = head_len;
+	iov[1].iov_base = (void *)usrmsg;
+	iov[1].iov_len = usrmsg_len;
+	iov[2].iov_base = zlog_buf_str(a_buf) + head_len;
+	iov[2].iov_len = zlog_buf_len(a_buf) - head_len;
+	return 3;
+}
+
+/*******************************************************************************/
+int zlog_format_use_mdc(zlog_format_t * a_format)
+{
+	int i;
+	zlog_spec_t *a_spec;
+
+	zc_arraylist_foreach(a_format->pattern_specs, i, a_spec) {
+		if (zlog_spec_use_mdc(a_spec)) return 1;
+	}
+	return 0;
+}
@@ -9,6 +9,8 @@
 #ifndef __zlog_format_h
 #define __zlog_format_h
 
+#include <sys/uio.h>
+
 #include "thread.h"
 #include "zc_defs.h"
 
@@ -18,14 +20,29 @@ struct zlog_format_s {
 	char name[MAXLEN_CFG_LINE + 1];	
 	char pattern[MAXLEN_CFG_LINE + 1];
 	zc_arraylist_t *pattern_specs;
+	struct zlog_spec_s *usrmsg_spec; /* the 1st plain %m, NULL if none */
 };
 
+/* a user msg at least this long is not copied into msg_buf */
+#define ZLOG_FORMAT_GATHER_MIN 1024
+
 zlog_format_t *zlog_format_new(char *line, int * time_cache_count);
 void zlog_format_del(zlog_format_t * a_format);
 void zlog_format_profile(zlog_format_t * a_format, int flag);
 
 int zlog_format_gen_msg(zlog_format_t * a_format, zlog_thread_t * a_thread);
 
+/* make the msg as iov[0] what comes before %m, iov[1] the user msg
+ * referenced in place, iov[2] what comes after, for one writev().
+ * only a long msg of zlog_info(c, "%s", str) or a format without
+ * conversion is referenced, others are left to zlog_format_gen_msg()
+ * return 3	iovcnt, iov[0] and iov[2] are in msg_buf
+ * return 0	not fit
+ * return -1	fail
+ */
+int zlog_format_gen_msgv(zlog_format_t * a_format, zlog_thread_t * a_thread, struct iovec *iov);
+int zlog_format_use_mdc(zlog_format_t * a_format);
+
 #define zlog_format_has_name(a_format, fname) \
 	STRCMP(a_format->name, ==, fname)
 
@@ -0,0 +1,374 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#include "fmacros.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef ZLOG_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "gzip.h"
+#include "zc_defs.h"
+
+#define ZLOG_GZIP_BUF_SIZE (64 * 1024)
+
+static int zlog_gzip_write(int fd, const unsigned char *buf, size_t len)
+{
+	ssize_t nwrite;
+
+	while (len > 0) {
+		nwrite = write(fd, buf, len);
+		if (nwrite < 0) {
+			if (errno == EINTR) continue;
+			zc_error("write fail, errno[%d]", errno);
+			return -1;
+		}
+		buf += nwrite;
+		len -= nwrite;
+	}
+	return 0;
+}
+
+static ssize_t zlog_gzip_read(int fd, unsigned char *buf, size_t len)
+{
+	ssize_t nread;
+
+	do {
+		nread = read(fd, buf, len);
+	} while (nread < 0 && errno == EINTR);
+	if (nread < 0) zc_error("read fail, errno[%d]", errno);
+	return nread;
+}
+
+#ifdef ZLOG_HAVE_ZLIB
+/*******************************************************************************/
+int zlog_gzip(int in_fd, int out_fd)
+{
+	int rc = -1;
+	int flush;
+	ssize_t nread;
+	z_stream strm;
+	unsigned char *in;
+	unsigned char *out;
+
+	in = malloc(ZLOG_GZIP_BUF_SIZE);
+	out = malloc(ZLOG_GZIP_BUF_SIZE);
+	if (!in || !out) {
+		zc_error("malloc fail, errno[%d]", errno);
+		goto exit;
+	}
+
+	/* fastest level, 16 for gzip wrapper */
+	memset(&strm, 0x00, sizeof(strm));
+	if (deflateInit2(&strm, 1, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		zc_error("deflateInit2 fail");
+		goto exit;
+	}
+
+	do {
+		nread = zlog_gzip_read(in_fd, in, ZLOG_GZIP_BUF_SIZE);
+		if (nread < 0) goto end;
+		strm.next_in = in;
+		strm.avail_in = nread;
+		flush = nread ? Z_NO_FLUSH : Z_FINISH;
+
+		do {
+			strm.next_out = out;
+			strm.avail_out = ZLOG_GZIP_BUF_SIZE;
+			if (deflate(&strm, flush) == Z_STREAM_ERROR) {
+				zc_error("deflate fail");
+				goto end;
+			}
+			if (zlog_gzip_write(out_fd, out, ZLOG_GZIP_BUF_SIZE - strm.avail_out)) goto end;
+		} while (strm.avail_out == 0);
+	} while (flush != Z_FINISH);
+
+	rc = 0;
+end:
+	deflateEnd(&strm);
+exit:
+	free(in);
+	free(out);
+	return rc;
+}
+
+#else
+/*******************************************************************************/
+#define ZLOG_GZIP_WSIZE 32768
+#define ZLOG_GZIP_HASH_BITS 15
+#define ZLOG_GZIP_HASH_SIZE (1 << ZLOG_GZIP_HASH_BITS)
+#define ZLOG_GZIP_MIN_MATCH 3
+#define ZLOG_GZIP_MAX_MATCH 258
+
+#define zlog_gzip_hash(p) \
+	((((unsigned long)(p)[0] << 16 | (p)[1] << 8 | (p)[2]) * 2654435761UL \
+		& 0xffffffffUL) >> (32 - ZLOG_GZIP_HASH_BITS))
+
+static const unsigned short zlog_gzip_len_base[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char zlog_gzip_len_extra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short zlog_gzip_dist_base[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned char zlog_gzip_dist_extra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+typedef struct {
+	int out_fd;
+	unsigned char out[ZLOG_GZIP_BUF_SIZE];
+	size_t out_len;
+	unsigned long bits;
+	int nbits;
+	int error;
+
+	/* fixed huffman codes, bit reversed as deflate puts them from msb */
+	unsigned short lit_code[288];
+	unsigned char lit_len[288];
+	unsigned char dist_code[30];
+	unsigned char len_sym[ZLOG_GZIP_MAX_MATCH + 1];
+	unsigned char dist_sym[512];	/* dist - 1 < 256, or 256 + (dist - 1) >> 7 */
+	unsigned long crc_table[256];
+
+	unsigned char win[2 * ZLOG_GZIP_WSIZE];
+	int head[ZLOG_GZIP_HASH_SIZE];	/* last position of a hash in win */
+} zlog_gzip_t;
+
+static unsigned int zlog_gzip_reverse(unsigned int code, int len)
+{
+	unsigned int r = 0;
+
+	while (len-- > 0) {
+		r = (r << 1) | (code & 1);
+		code >>= 1;
+	}
+	return r;
+}
+
+static void zlog_gzip_init(zlog_gzip_t * a_gz)
+{
+	int i;
+	int d;
+	unsigned int code;
+	int len;
+	unsigned long c;
+
+	for (i = 0; i < 288; i++) {
+		if (i < 144) {
+			code = 0x30 + i;
+			len = 8;
+		} else if (i < 256) {
+			code = 0x190 + i - 144;
+			len = 9;
+		} else if (i < 280) {
+			code = i - 256;
+			len = 7;
+		} else {
+			code = 0xc0 + i - 280;
+			len = 8;
+		}
+		a_gz->lit_code[i] = zlog_gzip_reverse(code, len);
+		a_gz->lit_len[i] = len;
+	}
+
+	/* 258 is in both 284 and 285, the later wins */
+	for (i = 0; i < 29; i++) {
+		for (len = zlog_gzip_len_base[i];
+			len < zlog_gzip_len_base[i] + (1 << zlog_gzip_len_extra[i])
+			&& len <= ZLOG_GZIP_MAX_MATCH; len++) {
+			a_gz->len_sym[len] = i;
+		}
+	}
+
+	for (i = 0; i < 30; i++) {
+		a_gz->dist_code[i] = zlog_gzip_reverse(i, 5);
+		for (d = zlog_gzip_dist_base[i] - 1;
+			d < zlog_gzip_dist_base[i] - 1 + (1 << zlog_gzip_dist_extra[i]); d++) {
+			a_gz->dist_sym[d < 256 ? d : 256 + (d >> 7)] = i;
+		}
+	}
+
+	for (i = 0; i < 256; i++) {
+		c = i;
+		for (len = 0; len < 8; len++) c = (c & 1) ? 0xedb88320UL ^ (c >> 1) : c >> 1;
+		a_gz->crc_table[i] = c;
+	}
+
+	for (i = 0; i < ZLOG_GZIP_HASH_SIZE; i++) a_gz->head[i] = -1;
+	return;
+}
+
+static void zlog_gzip_flush(zlog_gzip_t * a_gz)
+{
+	if (!a_gz->error && zlog_gzip_write(a_gz->out_fd, a_gz->out, a_gz->out_len)) {
+		a_gz->error = 1;
+	}
+	a_gz->out_len = 0;
+	return;
+}
+
+static void zlog_gzip_byte(zlog_gzip_t * a_gz, unsigned char c)
+{
+	a_gz->out[a_gz->out_len++] = c;
+	if (a_gz->out_len == sizeof(a_gz->out)) zlog_gzip_flush(a_gz);
+	return;
+}
+
+/* at most 16 bits a time, from lsb */
+static void zlog_gzip_put(zlog_gzip_t * a_gz, unsigned long value, int n)
+{
+	a_gz->bits |= value << a_gz->nbits;
+	a_gz->nbits += n;
+	while (a_gz->nbits >= 8) {
+		zlog_gzip_byte(a_gz, a_gz->bits & 0xff);
+		a_gz->bits >>= 8;
+		a_gz->nbits -= 8;
+	}
+	return;
+}
+
+static void zlog_gzip_literal(zlog_gzip_t * a_gz, int c)
+{
+	zlog_gzip_put(a_gz, a_gz->lit_code[c], a_gz->lit_len[c]);
+	return;
+}
+
+static void zlog_gzip_match(zlog_gzip_t * a_gz, int len, int dist)
+{
+	int s;
+
+	s = a_gz->len_sym[len];
+	zlog_gzip_literal(a_gz, 257 + s);
+	if (zlog_gzip_len_extra[s]) {
+		zlog_gzip_put(a_gz, len - zlog_gzip_len_base[s], zlog_gzip_len_extra[s]);
+	}
+
+	dist--;
+	s = a_gz->dist_sym[dist < 256 ? dist : 256 + (dist >> 7)];
+	zlog_gzip_put(a_gz, a_gz->dist_code[s], 5);
+	if (zlog_gzip_dist_extra[s]) {
+		zlog_gzip_put(a_gz, dist + 1 - zlog_gzip_dist_base[s], zlog_gzip_dist_extra[s]);
+	}
+	return;
+}
+
+/* one fixed huffman block for all, an empty final block at end */
+int zlog_gzip(int in_fd, int out_fd)
+{
+	static const unsigned char head[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3 };
+	zlog_gzip_t *a_gz;
+	unsigned char *win;
+	unsigned long crc = 0xffffffffUL;
+	unsigned long total = 0;
+	ssize_t nread;
+	int pos = 0;
+	int end = 0;
+	int eof = 0;
+	int cand;
+	int len;
+	int max;
+	int i;
+	unsigned long h;
+
+	a_gz = malloc(sizeof(zlog_gzip_t));
+	if (!a_gz) {
+		zc_error("malloc fail, errno[%d]", errno);
+		return -1;
+	}
+	a_gz->out_fd = out_fd;
+	a_gz->out_len = 0;
+	a_gz->bits = 0;
+	a_gz->nbits = 0;
+	a_gz->error = 0;
+	zlog_gzip_init(a_gz);
+	win = a_gz->win;
+
+	for (i = 0; i < sizeof(head); i++) zlog_gzip_byte(a_gz, head[i]);
+	zlog_gzip_put(a_gz, 0, 1);	/* not final */
+	zlog_gzip_put(a_gz, 1, 2);	/* fixed huffman */
+
+	for (;;) {
+		/* keep a max match ahead */
+		if (!eof && end - pos < ZLOG_GZIP_MAX_MATCH) {
+			if (end == sizeof(a_gz->win)) {
+				memmove(win, win + ZLOG_GZIP_WSIZE, ZLOG_GZIP_WSIZE);
+				pos -= ZLOG_GZIP_WSIZE;
+				end -= ZLOG_GZIP_WSIZE;
+				for (i = 0; i < ZLOG_GZIP_HASH_SIZE; i++) {
+					a_gz->head[i] = a_gz->head[i] >= ZLOG_GZIP_WSIZE ?
+						a_gz->head[i] - ZLOG_GZIP_WSIZE : -1;
+				}
+			}
+
+			nread = zlog_gzip_read(in_fd, win + end, sizeof(a_gz->win) - end);
+			if (nread < 0) goto err;
+			if (nread == 0) eof = 1;
+			for (i = end; i < end + nread; i++) {
+				crc = a_gz->crc_table[(crc ^ win[i]) & 0xff] ^ (crc >> 8);
+			}
+			total += nread;
+			end += nread;
+			continue;
+		}
+		if (pos >= end) break;
+
+		len = 0;
+		cand = -1;
+		if (end - pos >= ZLOG_GZIP_MIN_MATCH) {
+			h = zlog_gzip_hash(win + pos);
+			cand = a_gz->head[h];
+			a_gz->head[h] = pos;
+			if (cand >= 0 && pos - cand <= ZLOG_GZIP_WSIZE
+				&& win[cand] == win[pos] && win[cand + 1] == win[pos + 1]
+				&& win[cand + 2] == win[pos + 2]) {
+				max = zc_min(ZLOG_GZIP_MAX_MATCH, end - pos);
+				for (len = ZLOG_GZIP_MIN_MATCH;
+					len < max && win[cand + len] == win[pos + len]; len++);
+			}
+		}
+
+		if (len >= ZLOG_GZIP_MIN_MATCH) {
+			zlog_gzip_match(a_gz, len, pos - cand);
+			for (i = pos + 1; i < pos + len && i + ZLOG_GZIP_MIN_MATCH <= end; i++) {
+				a_gz->head[zlog_gzip_hash(win + i)] = i;
+			}
+			pos += len;
+		} else {
+			zlog_gzip_literal(a_gz, win[pos]);
+			pos++;
+		}
+		if (a_gz->error) goto err;
+	}
+
+	zlog_gzip_literal(a_gz, 256);
+	zlog_gzip_put(a_gz, 1, 1);	/* final */
+	zlog_gzip_put(a_gz, 1, 2);
+	zlog_gzip_literal(a_gz, 256);
+	if (a_gz->nbits) zlog_gzip_put(a_gz, 0, 8 - a_gz->nbits);
+
+	crc ^= 0xffffffffUL;
+	for (i = 0; i < 4; i++) zlog_gzip_byte(a_gz, (crc >> (8 * i)) & 0xff);
+	for (i = 0; i < 4; i++) zlog_gzip_byte(a_gz, (total >> (8 * i)) & 0xff);
+	zlog_gzip_flush(a_gz);
+	if (a_gz->error) goto err;
+
+	free(a_gz);
+	return 0;
+err:
+	free(a_gz);
+	return -1;
+}
+#endif
@@ -0,0 +1,24 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#ifndef __zlog_gzip_h
+#define __zlog_gzip_h
+
+/* gzip streams for archives, like "aa.#r.log.gz".
+ * zlib is used if built with ZLOG_HAVE_ZLIB, else a built-in codec,
+ * lz77 in a 32KB window with fixed huffman codes of deflate,
+ * the output can be read by gzip -d either way.
+ * memory is bounded, about 400KB with zlib and 256KB without.
+ */
+
+#define ZLOG_GZIP_SUFFIX ".gz"
+
+/* compress all of in_fd to out_fd, return 0 success, -1 fail */
+int zlog_gzip(int in_fd, int out_fd);
+
+#endif
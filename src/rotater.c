@@ -6,6 +6,8 @@
  * Licensed under the LGPL v2.1, see the file COPYING in base directory.
  */
 
+#include "fmacros.h"
+
 #include <string.h>
 #include <glob.h>
 #include <stdio.h>
@@ -17,20 +19,73 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 
 #include "zc_defs.h"
 #include "rotater.h"
+#include "gzip.h"
 
 #define ROLLING  1     /* aa.02->aa.03, aa.01->aa.02, aa->aa.01 */
 #define SEQUENCE 2     /* aa->aa.03 */
 
+#define ZLOG_ROTATER_INDEX_HEAD "zlog archive index 1"
+#define ZLOG_ROTATER_NICE 10	/* of the rotate thread when compressing */
+#define ZLOG_ROTATER_JOBS_MAX 8	/* staged files of a rotater */
+
 typedef struct {
 	int index;
 	char path[MAXLEN_PATH + 1];
 } zlog_file_t;
 
+/* a dir of archives or base files, mtime is as we saw it after our moves */
+typedef struct {
+	char path[MAXLEN_PATH + 1];
+	time_t mtime;
+	long mtime_nsec;
+	unsigned long gen;	/* increased when it is changed by others */
+} zlog_rotater_dir_t;
+
+/* archives of a glob_path, good while gen is the same as of its dir */
+typedef struct zlog_rotater_index_s {
+	char glob_path[MAXLEN_PATH + 1];
+	char file[MAXLEN_PATH + 1];	/* dir/.aa.log.index */
+	zlog_rotater_dir_t *dir;
+	unsigned long gen;
+	zc_arraylist_t *files;
+	int busy;			/* files are being moved */
+} zlog_rotater_index_t;
+
+/* a staged file for the rotate thread */
+typedef struct zlog_rotater_job_s {
+	zlog_rotater_t *rotater;
+	char base_path[MAXLEN_PATH + 1];
+	char staged_path[MAXLEN_PATH + 1];
+	char archive_path[MAXLEN_PATH + 1];
+	int archive_max_count;
+	unsigned int file_perms;
+	int gzip;			/* archive_path ends with .gz */
+	struct zlog_rotater_job_s *next;
+} zlog_rotater_job_t;
+
+/* indexes are shared by rotaters of the process, as confs come and go */
+static pthread_mutex_t zlog_rotater_index_mutex = PTHREAD_MUTEX_INITIALIZER;
+static zc_hashtable_t *zlog_rotater_dirs;	/* dir -> zlog_rotater_dir_t */
+static zc_hashtable_t *zlog_rotater_indexes;	/* glob_path -> zlog_rotater_index_t */
+static pthread_once_t zlog_rotater_once = PTHREAD_ONCE_INIT;
+
+static void zlog_rotater_init_once(void);
+
+static int zlog_rotater_busy(zlog_rotater_t *a_rotater);
+static void zlog_rotater_index_del(zlog_rotater_index_t *a_index);
+
 void zlog_rotater_profile(zlog_rotater_t * a_rotater, int flag)
 {
+	zc_hashtable_entry_t *a_entry;
+	zlog_rotater_index_t *a_index;
+
 	zc_assert(a_rotater,);
 	zc_profile(flag, "--rotater[%p][%p,%s,%d][%s,%s,%s,%ld,%ld,%d,%d,%d]--",
 		a_rotater,
@@ -55,14 +110,23 @@ void zlog_rotater_profile(zlog_rotater_t * a_rotater, int flag)
 			zc_profile(flag, "[%s,%d]->", a_file->path, a_file->index);
 		}
 	}
+	pthread_mutex_lock(&zlog_rotater_index_mutex);
+	if (zlog_rotater_indexes) {
+		zc_hashtable_foreach(zlog_rotater_indexes, a_entry) {
+			a_index = a_entry->value;
+			zc_profile(flag, "---index[%s][%s][%lu,%lu][%d]---",
+				a_index->glob_path, a_index->file,
+				a_index->gen, a_index->dir->gen,
+				a_index->files ? zc_arraylist_len(a_index->files) : -1);
+		}
+	}
+	pthread_mutex_unlock(&zlog_rotater_index_mutex);
 	return;
 }
 
 /*******************************************************************************/
-void zlog_rotater_del(zlog_rotater_t *a_rotater)
+static void zlog_rotater_free(zlog_rotater_t *a_rotater)
 {
-	zc_assert(a_rotater,);
-
 	if (a_rotater->lock_fd) {
 		if (close(a_rotater->lock_fd)) {
 			zc_error("close fail, errno[%d]", errno);
@@ -78,6 +142,17 @@ void zlog_rotater_del(zlog_rotater_t *a_rotater)
 	return;
 }
 
+void zlog_rotater_del(zlog_rotater_t *a_rotater)
+{
+	zc_assert(a_rotater,);
+
+	/* staged files of it are moved before the lock fd is closed,
+	 * the rotate thread frees it after its last job */
+	if (zlog_rotater_busy(a_rotater)) return;
+	zlog_rotater_free(a_rotater);
+	return;
+}
+
 zlog_rotater_t *zlog_rotater_new(char *lock_file)
 {
 	int fd = 0;
@@ -229,11 +304,61 @@ err:
 	return -1;
 }
 
+/* files[start, end) are left after moves, path is the new archive,
+ * first in list when ROLLING, last when SEQUENCE */
+static int zlog_rotater_relist(zlog_rotater_t * a_rotater,
+		int start, int end, int index, const char *path)
+{
+	int i;
+	zc_arraylist_t *files;
+	zlog_file_t *a_file;
+	zlog_file_t *a_new;
+
+	files = zc_arraylist_new((zc_arraylist_del_fn)zlog_file_del);
+	if (!files) {
+		zc_error("zc_arraylist_new fail");
+		return -1;
+	}
+
+	a_new = calloc(1, sizeof(zlog_file_t));
+	if (!a_new) {
+		zc_error("calloc fail, errno[%d]", errno);
+		zc_arraylist_del(files);
+		return -1;
+	}
+	a_new->index = index;
+	strcpy(a_new->path, path);
+
+	/* files are not owned by the new list till all are in */
+	files->del = NULL;
+	if (a_rotater->mv_type == ROLLING && zc_arraylist_add(files, a_new)) goto err;
+	for (i = start; i < end; i++) {
+		if (zc_arraylist_add(files, zc_arraylist_get(a_rotater->files, i))) goto err;
+	}
+	if (a_rotater->mv_type != ROLLING && zc_arraylist_add(files, a_new)) goto err;
+	files->del = (zc_arraylist_del_fn)zlog_file_del;
+
+	/* the removed ones */
+	zc_arraylist_foreach(a_rotater->files, i, a_file) {
+		if (i < start || i >= end) zlog_file_del(a_file);
+	}
+	a_rotater->files->del = NULL;
+	zc_arraylist_del(a_rotater->files);
+	a_rotater->files = files;
+	return 0;
+err:
+	zc_error("zc_arraylist_add fail");
+	zc_arraylist_del(files);
+	free(a_new);
+	return -1;
+}
+
 static int zlog_rotater_seq_files(zlog_rotater_t * a_rotater)
 {
 	int rc = 0;
 	int nwrite = 0;
 	int i, j;
+	int start = 0;
 	zlog_file_t *a_file;
 	char new_path[MAXLEN_PATH + 1];
 
@@ -246,6 +371,7 @@ static int zlog_rotater_seq_files(zlog_rotater_t * a_rotater)
 				zc_error("unlink[%s] fail, errno[%d]",a_file->path , errno);
 				return -1;
 			}
+			start = i + 1;
 			continue;
 		}
 	}
@@ -273,12 +399,12 @@ static int zlog_rotater_seq_files(zlog_rotater_t * a_rotater)
 		return -1;
 	}
 
-	if (rename(a_rotater->base_path, new_path)) {
-		zc_error("rename[%s]->[%s] fail, errno[%d]", a_rotater->base_path, new_path, errno);
+	if (rename(a_rotater->from_path, new_path)) {
+		zc_error("rename[%s]->[%s] fail, errno[%d]", a_rotater->from_path, new_path, errno);
 		return -1;
 	}
 
-	return 0;
+	return zlog_rotater_relist(a_rotater, start, zc_arraylist_len(a_rotater->files), j, new_path);
 }
 
 
@@ -287,9 +413,11 @@ static int zlog_rotater_roll_files(zlog_rotater_t * a_rotater)
 	int i;
 	int rc = 0;
 	int nwrite;
+	int end;
 	char new_path[MAXLEN_PATH + 1];
 	zlog_file_t *a_file;
 
+	end = zc_arraylist_len(a_rotater->files);
 	/* now in the list, aa.0 aa.1 aa.2 aa.02... */
 	for (i = zc_arraylist_len(a_rotater->files) - 1; i > -1; i--) {
 		a_file = zc_arraylist_get(a_rotater->files, i);
@@ -305,6 +433,7 @@ static int zlog_rotater_roll_files(zlog_rotater_t * a_rotater)
 				zc_error("unlink[%s] fail, errno[%d]",a_file->path , errno);
 				return -1;
 			}
+			end = i;
 			continue;
 		}
 
@@ -323,6 +452,8 @@ static int zlog_rotater_roll_files(zlog_rotater_t * a_rotater)
 			zc_error("rename[%s]->[%s] fail, errno[%d]", a_file->path, new_path, errno);
 			return -1;
 		}
+		a_file->index = i + 1;
+		strcpy(a_file->path, new_path);
 	}
 
 	/* do the base_path mv  */
@@ -336,12 +467,12 @@ static int zlog_rotater_roll_files(zlog_rotater_t * a_rotater)
 		return -1;
 	}
 
-	if (rename(a_rotater->base_path, new_path)) {
-		zc_error("rename[%s]->[%s] fail, errno[%d]", a_rotater->base_path, new_path, errno);
+	if (rename(a_rotater->from_path, new_path)) {
+		zc_error("rename[%s]->[%s] fail, errno[%d]", a_rotater->from_path, new_path, errno);
 		return -1;
 	}
 
-	return 0;
+	return zlog_rotater_relist(a_rotater, 0, end, 0, new_path);
 }
 
 
@@ -409,38 +540,398 @@ static int zlog_rotater_parse_archive_path(zlog_rotater_t * a_rotater)
 	return 0;
 }
 
+/*******************************************************************************/
+/* dir part of path, "." if none */
+static int zlog_rotater_dirname(const char *path, char *dir, size_t size)
+{
+	const char *p;
+	size_t len;
+
+	p = strrchr(path, '/');
+	if (!p) {
+		path = ".";
+		len = 1;
+	} else if (p == path) {
+		len = 1;
+	} else {
+		len = p - path;
+	}
+	if (len > size - 1) {
+		zc_error("dir of [%s] is too long", path);
+		return -1;
+	}
+	memcpy(dir, path, len);
+	dir[len] = '\0';
+	return 0;
+}
+
+/* under index_mutex */
+static zlog_rotater_dir_t *zlog_rotater_get_dir(const char *path, int create)
+{
+	char dir[MAXLEN_PATH + 1];
+	zlog_rotater_dir_t *a_dir;
+
+	if (zlog_rotater_dirname(path, dir, sizeof(dir))) return NULL;
+
+	if (!zlog_rotater_dirs) {
+		if (!create) return NULL;
+		zlog_rotater_dirs = zc_hashtable_new(8,
+				zc_hashtable_str_hash, zc_hashtable_str_equal,
+				NULL, (zc_hashtable_del_fn) free);
+		if (!zlog_rotater_dirs) {
+			zc_error("zc_hashtable_new fail");
+			return NULL;
+		}
+	}
+
+	a_dir = zc_hashtable_get(zlog_rotater_dirs, dir);
+	if (a_dir || !create) return a_dir;
+
+	a_dir = calloc(1, sizeof(zlog_rotater_dir_t));
+	if (!a_dir) {
+		zc_error("calloc fail, errno[%d]", errno);
+		return NULL;
+	}
+	strcpy(a_dir->path, dir);
+	a_dir->gen = 1;
+	if (zc_hashtable_put(zlog_rotater_dirs, a_dir->path, a_dir)) {
+		zc_error("zc_hashtable_put fail");
+		free(a_dir);
+		return NULL;
+	}
+	return a_dir;
+}
+
+/* catch up with mtime of the dir, under index_mutex.
+ * if it is changed not by us, indexes of it are stale */
+static void zlog_rotater_sync_dir(zlog_rotater_dir_t *a_dir, int by_us)
+{
+	struct zlog_stat info;
+	time_t mtime = 0;
+	long mtime_nsec = 0;
+
+	if (zlog_stat(a_dir->path, &info)) {
+		zc_warn("stat [%s] fail, errno[%d]", a_dir->path, errno);
+		by_us = 0;
+	} else {
+		mtime = info.st_mtime;
+		mtime_nsec = zlog_stat_mtime_nsec(&info);
+	}
+
+	if (!by_us && (mtime != a_dir->mtime || mtime_nsec != a_dir->mtime_nsec)) {
+		a_dir->gen++;
+	}
+	a_dir->mtime = mtime;
+	a_dir->mtime_nsec = mtime_nsec;
+	return;
+}
+
+/* moves of ours in the dir of path are taken in by its record.
+ * index_mutex is only tried, writers are not held up */
+static zlog_rotater_dir_t *zlog_rotater_hold_dir(const char *path)
+{
+	zlog_rotater_dir_t *a_dir;
+
+	pthread_once(&zlog_rotater_once, zlog_rotater_init_once);
+	if (pthread_mutex_trylock(&zlog_rotater_index_mutex)) return NULL;
+	a_dir = zlog_rotater_get_dir(path, 0);
+	if (!a_dir) {
+		pthread_mutex_unlock(&zlog_rotater_index_mutex);
+		return NULL;
+	}
+	zlog_rotater_sync_dir(a_dir, 0);
+	return a_dir;
+}
+
+static void zlog_rotater_release_dir(zlog_rotater_dir_t *a_dir)
+{
+	if (!a_dir) return;
+	zlog_rotater_sync_dir(a_dir, 1);
+	pthread_mutex_unlock(&zlog_rotater_index_mutex);
+	return;
+}
+
+static void zlog_rotater_index_del(zlog_rotater_index_t *a_index)
+{
+	if (a_index->files) zc_arraylist_del(a_index->files);
+	free(a_index);
+	return;
+}
+
+/* under index_mutex, NULL if glob_path can not be indexed */
+static zlog_rotater_index_t *zlog_rotater_get_index(zlog_rotater_t *a_rotater)
+{
+	int nwrite;
+	char *p;
+	char *q;
+	zlog_rotater_index_t *a_index;
+
+	if (!zlog_rotater_indexes) {
+		zlog_rotater_indexes = zc_hashtable_new(8,
+				zc_hashtable_str_hash, zc_hashtable_str_equal,
+				NULL, (zc_hashtable_del_fn) zlog_rotater_index_del);
+		if (!zlog_rotater_indexes) {
+			zc_error("zc_hashtable_new fail");
+			return NULL;
+		}
+	}
+
+	a_index = zc_hashtable_get(zlog_rotater_indexes, a_rotater->glob_path);
+	if (a_index) return a_index;
+
+	/* only the file name part may be wild */
+	p = strrchr(a_rotater->glob_path, '/');
+	q = strpbrk(a_rotater->glob_path, "*?[\\");
+	if (p && q && q < p) return NULL;
+
+	a_index = calloc(1, sizeof(zlog_rotater_index_t));
+	if (!a_index) {
+		zc_error("calloc fail, errno[%d]", errno);
+		return NULL;
+	}
+	strcpy(a_index->glob_path, a_rotater->glob_path);
+
+	a_index->dir = zlog_rotater_get_dir(a_rotater->glob_path, 1);
+	if (!a_index->dir) {
+		zc_error("zlog_rotater_get_dir fail");
+		goto err;
+	}
+
+	p = strrchr(a_rotater->base_path, '/');
+	p = p ? p + 1 : a_rotater->base_path;
+	nwrite = snprintf(a_index->file, sizeof(a_index->file), "%s/.%s.index",
+			a_index->dir->path, p);
+	if (nwrite < 0 || nwrite >= sizeof(a_index->file)) {
+		zc_error("nwrite[%d], overflow or errno[%d]", nwrite, errno);
+		goto err;
+	}
+
+	if (zc_hashtable_put(zlog_rotater_indexes, a_index->glob_path, a_index)) {
+		zc_error("zc_hashtable_put fail");
+		goto err;
+	}
+	return a_index;
+err:
+	free(a_index);
+	return NULL;
+}
+
+/* read files from index file, if it is written after the last change of dir */
+static int zlog_rotater_load_index(zlog_rotater_index_t *a_index)
+{
+	FILE *fp;
+	char line[MAXLEN_PATH + 32];
+	size_t len;
+	long mtime;
+	long mtime_nsec;
+	int nread;
+	zlog_file_t *a_file;
+	zc_arraylist_t *files = NULL;
+
+	fp = fopen(a_index->file, "r");
+	if (!fp) return -1;
+
+	if (!fgets(line, sizeof(line), fp) || STRCMP(line, !=, ZLOG_ROTATER_INDEX_HEAD "\n")) goto err;
+	if (!fgets(line, sizeof(line), fp) || STRNCMP(line, !=, "glob ", 5)
+		|| STRNCMP(line + 5, !=, a_index->glob_path, strlen(a_index->glob_path))
+		|| STRCMP(line + 5 + strlen(a_index->glob_path), !=, "\n")) goto err;
+	if (!fgets(line, sizeof(line), fp)
+		|| sscanf(line, "mtime %ld %ld", &mtime, &mtime_nsec) != 2
+		|| mtime != a_index->dir->mtime || mtime_nsec != a_index->dir->mtime_nsec) goto err;
+
+	files = zc_arraylist_new((zc_arraylist_del_fn)zlog_file_del);
+	if (!files) {
+		zc_error("zc_arraylist_new fail");
+		goto err;
+	}
+
+	while (fgets(line, sizeof(line), fp)) {
+		len = strlen(line);
+		if (len == 0 || line[len - 1] != '\n') goto err;
+		line[len - 1] = '\0';
+
+		a_file = calloc(1, sizeof(zlog_file_t));
+		if (!a_file) {
+			zc_error("calloc fail, errno[%d]", errno);
+			goto err;
+		}
+		nread = 0;
+		if (sscanf(line, "%d %n", &(a_file->index), &nread) != 1 || nread == 0
+			|| strlen(line + nread) > sizeof(a_file->path) - 1) {
+			free(a_file);
+			goto err;
+		}
+		strcpy(a_file->path, line + nread);
+
+		if (zc_arraylist_add(files, a_file)) {
+			zc_error("zc_arraylist_add fail");
+			free(a_file);
+			goto err;
+		}
+	}
+
+	fclose(fp);
+	a_index->files = files;
+	return 0;
+err:
+	zc_debug("index file[%s] is out of date", a_index->file);
+	if (files) zc_arraylist_del(files);
+	fclose(fp);
+	return -1;
+}
+
+/* list again next time */
+static void zlog_rotater_drop_index(zlog_rotater_index_t *a_index)
+{
+	pthread_mutex_lock(&zlog_rotater_index_mutex);
+	if (a_index->files) zc_arraylist_del(a_index->files);
+	a_index->files = NULL;
+	a_index->gen = 0;
+	a_index->busy = 0;
+	pthread_mutex_unlock(&zlog_rotater_index_mutex);
+	return;
+}
+
+/* find archives from index, or glob them */
+static int zlog_rotater_list_files(zlog_rotater_t * a_rotater)
+{
+	unsigned long gen = 0;
+	zlog_rotater_index_t *a_index;
+	zlog_rotater_dir_t *a_dir;
+
+	pthread_once(&zlog_rotater_once, zlog_rotater_init_once);
+
+	pthread_mutex_lock(&zlog_rotater_index_mutex);
+	a_index = zlog_rotater_get_index(a_rotater);
+	if (a_index && a_index->busy) {
+		/* taken by other rotater */
+		a_index = NULL;
+	}
+	if (a_index) {
+		a_index->busy = 1;
+		zlog_rotater_sync_dir(a_index->dir, 0);
+		gen = a_index->dir->gen;
+		if (a_index->gen != gen) {
+			if (a_index->files) zc_arraylist_del(a_index->files);
+			a_index->files = NULL;
+			if (a_rotater->index_file && zlog_rotater_load_index(a_index) == 0) {
+				a_index->gen = gen;
+			}
+		}
+	}
+	/* base_path is moved too */
+	a_dir = zlog_rotater_get_dir(a_rotater->base_path, 0);
+	if (a_dir && (!a_index || a_dir != a_index->dir)) zlog_rotater_sync_dir(a_dir, 0);
+	pthread_mutex_unlock(&zlog_rotater_index_mutex);
+
+	if (a_index && a_index->files) {
+		a_rotater->files = a_index->files;
+		a_rotater->index = a_index;
+		return 0;
+	}
+
+	if (zlog_rotater_add_archive_files(a_rotater)) {
+		zc_error("zlog_rotater_add_archive_files fail");
+		if (a_index) zlog_rotater_drop_index(a_index);
+		return -1;
+	}
+	if (a_index) {
+		a_index->files = a_rotater->files;
+		a_index->gen = gen;
+		a_rotater->index = a_index;
+	}
+	return 0;
+}
+
+/* record the dirs as changed by us, so the index is good next time */
+static void zlog_rotater_keep_index(zlog_rotater_t * a_rotater)
+{
+	int i;
+	int fd;
+	FILE *fp = NULL;
+	zlog_file_t *a_file;
+	zlog_rotater_index_t *a_index = a_rotater->index;
+	zlog_rotater_dir_t *a_dir;
+
+	/* writers will find base_path, not create it */
+	fd = open(a_rotater->base_path, O_WRONLY | O_APPEND | O_CREAT, a_rotater->file_perms);
+	if (fd < 0) {
+		zc_warn("open file[%s] fail, errno[%d]", a_rotater->base_path, errno);
+	} else {
+		close(fd);
+	}
+
+	/* created before dir is seen, written after */
+	if (a_rotater->index_file) {
+		fp = fopen(a_index->file, "w");
+		if (!fp) zc_warn("fopen[%s] fail, errno[%d]", a_index->file, errno);
+	}
+
+	pthread_mutex_lock(&zlog_rotater_index_mutex);
+	zlog_rotater_sync_dir(a_index->dir, 1);
+	a_dir = zlog_rotater_get_dir(a_rotater->base_path, 0);
+	if (a_dir && a_dir != a_index->dir) zlog_rotater_sync_dir(a_dir, 1);
+	if (fp) {
+		fprintf(fp, ZLOG_ROTATER_INDEX_HEAD "\nglob %s\nmtime %ld %ld\n",
+			a_index->glob_path, (long)a_index->dir->mtime, a_index->dir->mtime_nsec);
+	}
+	pthread_mutex_unlock(&zlog_rotater_index_mutex);
+
+	if (fp) {
+		zc_arraylist_foreach(a_index->files, i, a_file) {
+			fprintf(fp, "%d %s\n", a_file->index, a_file->path);
+		}
+		if (fclose(fp)) {
+			zc_warn("fclose[%s] fail, errno[%d]", a_index->file, errno);
+			unlink(a_index->file);
+		}
+	}
+
+	pthread_mutex_lock(&zlog_rotater_index_mutex);
+	a_index->busy = 0;
+	pthread_mutex_unlock(&zlog_rotater_index_mutex);
+	return;
+}
+
 static void zlog_rotater_clean(zlog_rotater_t *a_rotater)
 {
 	a_rotater->base_path = NULL;
+	a_rotater->from_path = NULL;
 	a_rotater->archive_path = NULL;
 	a_rotater->max_count = 0;
+	a_rotater->file_perms = 0;
 	a_rotater->mv_type = 0;
 	a_rotater->num_width = 0;
 	a_rotater->num_start_len = 0;
 	a_rotater->num_end_len = 0;
 	memset(a_rotater->glob_path, 0x00, sizeof(a_rotater->glob_path));
 
-	if (a_rotater->files) zc_arraylist_del(a_rotater->files);
+	/* files of index are kept */
+	if (a_rotater->files && !a_rotater->index) zc_arraylist_del(a_rotater->files);
 	a_rotater->files = NULL;
+	a_rotater->index = NULL;
 }
 
 static int zlog_rotater_lsmv(zlog_rotater_t *a_rotater, 
-		char *base_path, char *archive_path, int archive_max_count)
+		char *base_path, char *from_path, char *archive_path, int archive_max_count,
+		unsigned int file_perms)
 {
 	int rc = 0;
 
 	a_rotater->base_path = base_path;
+	a_rotater->from_path = from_path;
 	a_rotater->archive_path = archive_path;
 	a_rotater->max_count = archive_max_count;
+	a_rotater->file_perms = file_perms;
 	rc = zlog_rotater_parse_archive_path(a_rotater);
 	if (rc) {
 		zc_error("zlog_rotater_parse_archive_path fail");
 		goto err;
 	}
 
-	rc = zlog_rotater_add_archive_files(a_rotater);
+	rc = zlog_rotater_list_files(a_rotater);
 	if (rc) {
-		zc_error("zlog_rotater_add_archive_files fail");
+		zc_error("zlog_rotater_list_files fail");
 		goto err;
 	}
 
@@ -448,16 +939,25 @@ static int zlog_rotater_lsmv(zlog_rotater_t *a_rotater,
 		rc = zlog_rotater_roll_files(a_rotater);
 		if (rc) {
 			zc_error("zlog_rotater_roll_files fail");
-			goto err;
 		}
 	} else if (a_rotater->mv_type == SEQUENCE) {
 		rc = zlog_rotater_seq_files(a_rotater);
 		if (rc) {
 			zc_error("zlog_rotater_seq_files fail");
-			goto err;
 		}
 	}
 
+	if (a_rotater->index) {
+		/* files are relisted by moves */
+		a_rotater->index->files = a_rotater->files;
+		if (rc) {
+			zlog_rotater_drop_index(a_rotater->index);
+		} else {
+			zlog_rotater_keep_index(a_rotater);
+		}
+	}
+	if (rc) goto err;
+
 	zlog_rotater_clean(a_rotater);
 	return 0;
 err:
@@ -526,15 +1026,426 @@ static int zlog_rotater_unlock(zlog_rotater_t *a_rotater)
 	return rc;
 }
 
+/*******************************************************************************/
+/* jobs in order of staging, the head one is being done */
+static pthread_mutex_t zlog_rotater_jobs_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t zlog_rotater_jobs_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t zlog_rotater_done_cond = PTHREAD_COND_INITIALIZER;
+static zlog_rotater_job_t *zlog_rotater_jobs_head;
+static zlog_rotater_job_t *zlog_rotater_jobs_tail;
+static int zlog_rotater_running;
+static unsigned long zlog_rotater_staged_count;
+
+/* mark it deleted if it has jobs */
+static int zlog_rotater_busy(zlog_rotater_t *a_rotater)
+{
+	int busy;
+
+	pthread_mutex_lock(&zlog_rotater_jobs_mutex);
+	busy = a_rotater->jobs > 0;
+	if (busy) a_rotater->deleted = 1;
+	pthread_mutex_unlock(&zlog_rotater_jobs_mutex);
+	return busy;
+}
+
+static void zlog_rotater_drain(void)
+{
+	pthread_mutex_lock(&zlog_rotater_jobs_mutex);
+	while (zlog_rotater_jobs_head) {
+		pthread_cond_wait(&zlog_rotater_done_cond, &zlog_rotater_jobs_mutex);
+	}
+	pthread_mutex_unlock(&zlog_rotater_jobs_mutex);
+	return;
+}
+
+void zlog_rotater_fini(void)
+{
+	zlog_rotater_drain();
+
+	pthread_mutex_lock(&zlog_rotater_index_mutex);
+	if (zlog_rotater_indexes) zc_hashtable_del(zlog_rotater_indexes);
+	zlog_rotater_indexes = NULL;
+	if (zlog_rotater_dirs) zc_hashtable_del(zlog_rotater_dirs);
+	zlog_rotater_dirs = NULL;
+	pthread_mutex_unlock(&zlog_rotater_index_mutex);
+	return;
+}
+
+static int zlog_rotater_is_gzip(const char *archive_path)
+{
+	size_t len = strlen(archive_path);
+	size_t suffix_len = sizeof(ZLOG_GZIP_SUFFIX) - 1;
+
+	return len > suffix_len && STRCMP(archive_path + len - suffix_len, ==, ZLOG_GZIP_SUFFIX);
+}
+
+/* compress the staged file to a hidden gz_path by its side, out of the lock.
+ * gz_path is renamed to archive when done, no one sees it half written */
+static int zlog_rotater_compress(zlog_rotater_job_t *a_job, char *gz_path, size_t size)
+{
+	int nwrite;
+	int in_fd;
+	int out_fd;
+	zlog_rotater_dir_t *a_dir;
+
+	nwrite = snprintf(gz_path, size, "%s" ZLOG_GZIP_SUFFIX, a_job->staged_path);
+	if (nwrite < 0 || nwrite >= size) {
+		zc_error("nwrite[%d], overflow or errno[%d]", nwrite, errno);
+		return -1;
+	}
+
+	in_fd = open(a_job->staged_path, O_RDONLY);
+	if (in_fd < 0) {
+		zc_error("open file[%s] fail, errno[%d]", a_job->staged_path, errno);
+		return -1;
+	}
+
+	a_dir = zlog_rotater_hold_dir(gz_path);
+	out_fd = open(gz_path, O_WRONLY | O_CREAT | O_TRUNC, a_job->file_perms);
+	zlog_rotater_release_dir(a_dir);
+	if (out_fd < 0) {
+		zc_error("open file[%s] fail, errno[%d]", gz_path, errno);
+		close(in_fd);
+		return -1;
+	}
+
+	if (zlog_gzip(in_fd, out_fd)) {
+		zc_error("zlog_gzip [%s] fail", a_job->staged_path);
+		goto err;
+	}
+	/* on disk before it is an archive */
+	if (zlog_fsync(out_fd)) {
+		zc_error("fsync [%s] fail, errno[%d]", gz_path, errno);
+		goto err;
+	}
+
+	close(in_fd);
+	if (close(out_fd)) {
+		zc_error("close [%s] fail, errno[%d]", gz_path, errno);
+		out_fd = -1;
+		goto err;
+	}
+	return 0;
+err:
+	close(in_fd);
+	if (out_fd >= 0) close(out_fd);
+	a_dir = zlog_rotater_hold_dir(gz_path);
+	unlink(gz_path);
+	zlog_rotater_release_dir(a_dir);
+	return -1;
+}
+
+static void zlog_rotater_do(zlog_rotater_job_t *a_job)
+{
+	zlog_rotater_t *a_rotater = a_job->rotater;
+	struct flock fl;
+	char gz_path[MAXLEN_PATH + 1];
+	char *from_path = a_job->staged_path;
+	zlog_rotater_dir_t *a_dir;
+	int rc;
+
+	if (a_job->gzip) {
+		if (zlog_rotater_compress(a_job, gz_path, sizeof(gz_path))) {
+			zc_error("zlog_rotater_compress fail, staged file[%s] is left",
+				a_job->staged_path);
+			return;
+		}
+		from_path = gz_path;
+	}
+
+	fl.l_start = 0;
+	fl.l_whence = SEEK_SET;
+	fl.l_len = 0;
+
+	/* wait for other processes, writers of this process
+	 * do not take the file lock in background */
+	fl.l_type = F_WRLCK;
+	while (fcntl(a_rotater->lock_fd, F_SETLKW, &fl)) {
+		if (errno != EINTR) {
+			zc_error("lock fd[%d] fail, errno[%d]", a_rotater->lock_fd, errno);
+			break;
+		}
+	}
+
+	rc = zlog_rotater_lsmv(a_rotater, a_job->base_path, from_path,
+			a_job->archive_path, a_job->archive_max_count, a_job->file_perms);
+	if (rc) {
+		zc_error("zlog_rotater_lsmv [%s] fail, staged file[%s] is left",
+			a_job->base_path, a_job->staged_path);
+	}
+
+	fl.l_type = F_UNLCK;
+	if (fcntl(a_rotater->lock_fd, F_SETLK, &fl)) {
+		zc_error("unlock fd[%d] fail, errno[%d]", a_rotater->lock_fd, errno);
+	}
+
+	/* the plain one is done with, or the compressed one on fail */
+	if (from_path == gz_path) {
+		a_dir = zlog_rotater_hold_dir(gz_path);
+		if (unlink(rc ? gz_path : a_job->staged_path)) {
+			zc_error("unlink[%s] fail, errno[%d]", rc ? gz_path : a_job->staged_path, errno);
+		}
+		zlog_rotater_release_dir(a_dir);
+	}
+	return;
+}
+
+/* compressing is heavy, the rotate thread gives way to writers.
+ * nice is per thread on linux, it is not done elsewhere */
+static void zlog_rotater_nice(void)
+{
+#ifdef __linux__
+	if (setpriority(PRIO_PROCESS, syscall(SYS_gettid), ZLOG_ROTATER_NICE)) {
+		zc_warn("setpriority fail, errno[%d]", errno);
+	}
+#endif
+	return;
+}
+
+static void *zlog_rotater_run(void *arg)
+{
+	zlog_rotater_job_t *a_job;
+	zlog_rotater_t *a_rotater;
+	int niced = 0;
+
+	pthread_mutex_lock(&zlog_rotater_jobs_mutex);
+	for (;;) {
+		while (!zlog_rotater_jobs_head) {
+			pthread_cond_wait(&zlog_rotater_jobs_cond, &zlog_rotater_jobs_mutex);
+		}
+		a_job = zlog_rotater_jobs_head;
+		pthread_mutex_unlock(&zlog_rotater_jobs_mutex);
+
+		if (a_job->gzip && !niced) {
+			zlog_rotater_nice();
+			niced = 1;
+		}
+		zlog_rotater_do(a_job);
+
+		pthread_mutex_lock(&zlog_rotater_jobs_mutex);
+		zlog_rotater_jobs_head = a_job->next;
+		if (!zlog_rotater_jobs_head) zlog_rotater_jobs_tail = NULL;
+		a_rotater = a_job->rotater;
+		free(a_job);
+		if (--a_rotater->jobs == 0 && a_rotater->deleted) {
+			zlog_rotater_free(a_rotater);
+		}
+		pthread_cond_broadcast(&zlog_rotater_done_cond);
+	}
+
+	return NULL;
+}
+
+static void zlog_rotater_atfork_prepare(void)
+{
+	pthread_mutex_lock(&zlog_rotater_jobs_mutex);
+	pthread_mutex_lock(&zlog_rotater_index_mutex);
+}
+
+static void zlog_rotater_atfork_parent(void)
+{
+	pthread_mutex_unlock(&zlog_rotater_index_mutex);
+	pthread_mutex_unlock(&zlog_rotater_jobs_mutex);
+}
+
+static void zlog_rotater_atfork_child(void)
+{
+	zlog_rotater_job_t *a_job;
+	zlog_rotater_t *a_rotater;
+	zc_hashtable_entry_t *a_entry;
+	zlog_rotater_index_t *a_index;
+
+	/* files of a busy index are in the hands of a thread of parent, leak them */
+	if (zlog_rotater_indexes) {
+		zc_hashtable_foreach(zlog_rotater_indexes, a_entry) {
+			a_index = a_entry->value;
+			if (!a_index->busy) continue;
+			a_index->files = NULL;
+			a_index->gen = 0;
+			a_index->busy = 0;
+		}
+	}
+	pthread_mutex_init(&zlog_rotater_index_mutex, NULL);
+
+	/* staged files belong to the thread of parent */
+	while (zlog_rotater_jobs_head) {
+		a_job = zlog_rotater_jobs_head;
+		zlog_rotater_jobs_head = a_job->next;
+		a_rotater = a_job->rotater;
+		free(a_job);
+		if (--a_rotater->jobs == 0 && a_rotater->deleted) {
+			zlog_rotater_free(a_rotater);
+		}
+	}
+	zlog_rotater_jobs_tail = NULL;
+	zlog_rotater_running = 0;
+	pthread_mutex_init(&zlog_rotater_jobs_mutex, NULL);
+	pthread_cond_init(&zlog_rotater_jobs_cond, NULL);
+	pthread_cond_init(&zlog_rotater_done_cond, NULL);
+}
+
+static void zlog_rotater_init_once(void)
+{
+	int rc;
+
+	rc = pthread_atfork(zlog_rotater_atfork_prepare,
+			zlog_rotater_atfork_parent, zlog_rotater_atfork_child);
+	if (rc) zc_error("pthread_atfork fail, rc[%d]", rc);
+
+	/* do not leave staged files at exit */
+	rc = atexit(zlog_rotater_drain);
+	if (rc) zc_error("atexit fail, rc[%d]", rc);
+}
+
+static int zlog_rotater_push(zlog_rotater_job_t *a_job)
+{
+	int rc;
+	pthread_t tid;
+
+	pthread_once(&zlog_rotater_once, zlog_rotater_init_once);
+
+	pthread_mutex_lock(&zlog_rotater_jobs_mutex);
+	if (!zlog_rotater_running) {
+		rc = pthread_create(&tid, NULL, zlog_rotater_run, NULL);
+		if (rc) {
+			zc_error("pthread_create fail, rc[%d]", rc);
+			pthread_mutex_unlock(&zlog_rotater_jobs_mutex);
+			return -1;
+		}
+		pthread_detach(tid);
+		zlog_rotater_running = 1;
+	}
+
+	if (zlog_rotater_jobs_tail) zlog_rotater_jobs_tail->next = a_job;
+	else zlog_rotater_jobs_head = a_job;
+	zlog_rotater_jobs_tail = a_job;
+	a_job->rotater->jobs++;
+	pthread_cond_signal(&zlog_rotater_jobs_cond);
+	pthread_mutex_unlock(&zlog_rotater_jobs_mutex);
+	return 0;
+}
+
+/* move base_path away to a hidden file by its side, out of glob of archives,
+ * so writers go on with a new base_path at once */
+/* by size, or by time if archive_time is set.
+ * base_path made after archive_time is moved by others already */
+static int zlog_rotater_due(struct zlog_stat *info, size_t msg_len,
+		long archive_max_size, time_t archive_time)
+{
+	if (archive_time) return info->st_size > 0 && info->st_mtime < archive_time;
+	return info->st_size + msg_len > archive_max_size;
+}
+
+static int zlog_rotater_stage(zlog_rotater_t *a_rotater,
+		char *base_path, size_t msg_len,
+		char *archive_path, long archive_max_size, int archive_max_count,
+		time_t archive_time, unsigned int file_perms)
+{
+	int rc = 0;
+	int nwrite;
+	int fd;
+	char *p;
+	struct zlog_stat info;
+	zlog_rotater_job_t *a_job;
+	zlog_rotater_dir_t *a_dir;
+
+	/* the rotate thread is behind, base_path goes on growing till it catches up */
+	if (a_rotater->jobs >= ZLOG_ROTATER_JOBS_MAX) return 0;
+
+	rc = pthread_mutex_trylock(&(a_rotater->lock_mutex));
+	if (rc == EBUSY) {
+		/* other thread is moving it */
+		return 0;
+	} else if (rc != 0) {
+		zc_error("pthread_mutex_trylock fail, rc[%d]", rc);
+		return -1;
+	}
+
+	if (stat(base_path, &info)) {
+		if (errno == ENOENT) goto exit; /* moved by other process */
+		zc_error("stat [%s] fail, errno[%d]", base_path, errno);
+		rc = -1;
+		goto exit;
+	}
+	if (!zlog_rotater_due(&info, msg_len, archive_max_size, archive_time)) goto exit;
+
+	a_job = calloc(1, sizeof(zlog_rotater_job_t));
+	if (!a_job) {
+		zc_error("calloc fail, errno[%d]", errno);
+		rc = -1;
+		goto exit;
+	}
+	a_job->rotater = a_rotater;
+	a_job->archive_max_count = archive_max_count;
+	a_job->file_perms = file_perms;
+	a_job->gzip = zlog_rotater_is_gzip(archive_path);
+
+	p = strrchr(base_path, '/');
+	p = p ? p + 1 : base_path;
+	nwrite = snprintf(a_job->staged_path, sizeof(a_job->staged_path), "%.*s.%s.%ld.%lu",
+		(int)(p - base_path), base_path, p, (long)getpid(),
+		zc_atomic_add(&zlog_rotater_staged_count, 1));
+	if (nwrite < 0 || nwrite >= sizeof(a_job->staged_path)
+		|| strlen(base_path) >= sizeof(a_job->base_path)
+		|| strlen(archive_path) >= sizeof(a_job->archive_path)) {
+		zc_error("path of [%s] is too long to stage", base_path);
+		free(a_job);
+		rc = -1;
+		goto exit;
+	}
+	strcpy(a_job->base_path, base_path);
+	strcpy(a_job->archive_path, archive_path);
+
+	a_dir = zlog_rotater_hold_dir(base_path);
+	if (rename(base_path, a_job->staged_path)) {
+		if (errno != ENOENT) {
+			zc_error("rename[%s]->[%s] fail, errno[%d]", base_path, a_job->staged_path, errno);
+			rc = -1;
+		}
+		free(a_job);
+		zlog_rotater_release_dir(a_dir);
+		goto exit;
+	}
+
+	/* writers will find base_path, not create it */
+	fd = open(base_path, O_WRONLY | O_APPEND | O_CREAT, file_perms);
+	if (fd < 0) {
+		zc_warn("open file[%s] fail, errno[%d]", base_path, errno);
+	} else {
+		close(fd);
+	}
+	zlog_rotater_release_dir(a_dir);
+
+	if (zlog_rotater_push(a_job)) {
+		zc_error("zlog_rotater_push fail, do it here");
+		zlog_rotater_do(a_job);
+		free(a_job);
+	}
+
+exit:
+	if (pthread_mutex_unlock(&(a_rotater->lock_mutex))) {
+		zc_error("pthread_mutex_unlock fail, errno[%d]", errno);
+	}
+	return rc;
+}
+
 int zlog_rotater_rotate(zlog_rotater_t *a_rotater,
 		char *base_path, size_t msg_len,
-		char *archive_path, long archive_max_size, int archive_max_count)
+		char *archive_path, long archive_max_size, int archive_max_count,
+		time_t archive_time, unsigned int file_perms)
 {
 	int rc = 0;
 	struct zlog_stat info;
 
 	zc_assert(base_path, -1);
 
+	/* compressing is always done by the rotate thread */
+	if (a_rotater->background || zlog_rotater_is_gzip(archive_path)) {
+		return zlog_rotater_stage(a_rotater, base_path, msg_len,
+				archive_path, archive_max_size, archive_max_count,
+				archive_time, file_perms);
+	}
+
 	if (zlog_rotater_trylock(a_rotater)) {
 		zc_warn("zlog_rotater_trylock fail, maybe lock by other process or threads");
 		return 0;
@@ -546,8 +1457,8 @@ int zlog_rotater_rotate(zlog_rotater_t *a_rotater,
 		goto exit;
 	}
 
-	if (info.st_size + msg_len <= archive_max_size) {
-		/* file not so big,
+	if (!zlog_rotater_due(&info, msg_len, archive_max_size, archive_time)) {
+		/* file not so big or new,
 		 * may alread rotate by oth process or thread,
 		 * return */
 		rc = 0;
@@ -555,7 +1466,8 @@ int zlog_rotater_rotate(zlog_rotater_t *a_rotater,
 	}
 
 	/* begin list and move files */
-	rc = zlog_rotater_lsmv(a_rotater, base_path, archive_path, archive_max_count);
+	rc = zlog_rotater_lsmv(a_rotater, base_path, base_path, archive_path,
+			archive_max_count, file_perms);
 	if (rc) {
 		zc_error("zlog_rotater_lsmv [%s] fail, return", base_path);
 		rc = -1;
@@ -9,6 +9,8 @@
 #ifndef __zlog_rotater_h
 #define __zlog_rotater_h
 
+#include <time.h>
+
 #include "zc_defs.h"
 
 typedef struct zlog_rotater_s {
@@ -16,8 +18,19 @@ typedef struct zlog_rotater_s {
 	char *lock_file;
 	int lock_fd;
 
+	/* writers only move base_path away to a staged file,
+	 * the rotate thread moves it to archives */
+	int background;
+	int jobs; /* staged and not moved yet, under zlog_rotater_jobs_mutex */
+	int deleted; /* freed by the rotate thread when jobs are done */
+
+	/* archives are listed once into an index shared by all rotaters,
+	 * kept up to date by moves, listed again when their dir is changed by others */
+	int index_file;				/* keep a copy in .aa.log.index */
+
 	/* single-use members */
 	char *base_path;			/* aa.log */
+	char *from_path;			/* aa.log or staged .aa.log.pid.n */
 	char *archive_path;			/* aa.#5i.log */
 	char glob_path[MAXLEN_PATH + 1];	/* aa.*.log */
 	size_t num_start_len;			/* 3, offset to glob_path */
@@ -25,20 +38,29 @@ typedef struct zlog_rotater_s {
 	int num_width;				/* 5 */
 	int mv_type;				/* ROLLING or SEQUENCE */
 	int max_count;
+	unsigned int file_perms;
 	zc_arraylist_t *files;
+	struct zlog_rotater_index_s *index;	/* owns files if set */
 } zlog_rotater_t;
 
 zlog_rotater_t *zlog_rotater_new(char *lock_file);
 void zlog_rotater_del(zlog_rotater_t *a_rotater);
 
+/* wait till all staged files are moved, and drop indexes of archives */
+void zlog_rotater_fini(void);
+
 /*
+ * base_path is rotated when it is bigger than archive_max_size,
+ * or if archive_time is set, when it is not empty and modified before archive_time
+ *
  * return
  * -1	fail
- * 0	no rotate, or rotate and success
+ * 0	no rotate, or rotate and success, or staged if background
  */
 int zlog_rotater_rotate(zlog_rotater_t *a_rotater,
 		char *base_path, size_t msg_len,
-		char *archive_path, long archive_max_size, int archive_max_count);
+		char *archive_path, long archive_max_size, int archive_max_count,
+		time_t archive_time, unsigned int file_perms);
 
 void zlog_rotater_profile(zlog_rotater_t *a_rotater, int flag);
 
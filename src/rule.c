@@ -17,6 +17,9 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/uio.h>
 #include <pthread.h>
 
 #include "rule.h"
@@ -25,8 +28,12 @@
 #include "thread.h"
 #include "level_list.h"
 #include "rotater.h"
+#include "fd_cache.h"
+#include "category.h"
 #include "spec.h"
 #include "conf.h"
+#include "async.h"
+#include "wbuf.h"
 
 #include "zc_defs.h"
 
@@ -37,7 +44,7 @@ void zlog_rule_profile(zlog_rule_t * a_rule, int flag)
 	zlog_spec_t *a_spec;
 
 	zc_assert(a_rule,);
-	zc_profile(flag, "---rule:[%p][%s%c%d]-[%d,%d][%s,%p,%d:%ld*%d~%s][%d][%d][%s:%s:%p];[%p]---",
+	zc_profile(flag, "---rule:[%p][%s%c%d]-[%d,%d][%s,%p,%d:%ld/%d.%d*%d~%s][%d][%d][%s:%s:%p];[%p]---",
 		a_rule,
 
 		a_rule->category,
@@ -52,6 +59,8 @@ void zlog_rule_profile(zlog_rule_t * a_rule, int flag)
 		a_rule->static_fd,
 
 		a_rule->archive_max_size,
+		a_rule->archive_period,
+		a_rule->archive_period_unit,
 		a_rule->archive_max_count,
 		a_rule->archive_path,
 
@@ -74,49 +83,141 @@ void zlog_rule_profile(zlog_rule_t * a_rule, int flag)
 
 /*******************************************************************************/
 
-static int zlog_rule_output_static_file_single(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
+/* check if the output file was changed by an external tool,
+ * by comparing the inode to our saved off one, reopen if so */
+static int zlog_rule_reopen_static_file(zlog_rule_t * a_rule)
 {
 	struct stat stb;
-	int do_file_reload = 0;
-	int redo_inode_stat = 0;
-
-	if (zlog_format_gen_msg(a_rule->format, a_thread)) {
-		zc_error("zlog_format_gen_msg fail");
-		return -1;
-	}
+	int fd;
 
-	/* check if the output file was changed by an external tool by comparing the inode to our saved off one */
 	if (stat(a_rule->file_path, &stb)) {
 		if (errno != ENOENT) {
 			zc_error("stat fail on [%s], errno[%d]", a_rule->file_path, errno);
 			return -1;
-		} else {
-			do_file_reload = 1;
-			redo_inode_stat = 1; /* we'll have to restat the newly created file to get the inode info */
 		}
-	} else {
-		do_file_reload = (stb.st_ino != a_rule->static_ino || stb.st_dev != a_rule->static_dev);
+	} else if (stb.st_ino == a_rule->static_ino && stb.st_dev == a_rule->static_dev) {
+		return 0;
 	}
 
-	if (do_file_reload) {
-		close(a_rule->static_fd);
-		a_rule->static_fd = open(a_rule->file_path,
-			O_WRONLY | O_APPEND | O_CREAT | a_rule->file_open_flags,
-			a_rule->file_perms);
-		if (a_rule->static_fd < 0) {
-			zc_error("open file[%s] fail, errno[%d]", a_rule->file_path, errno);
-			return -1;
-		}
+	fd = open(a_rule->file_path,
+		O_WRONLY | O_APPEND | O_CREAT | a_rule->file_open_flags,
+		a_rule->file_perms);
+	if (fd < 0) {
+		zc_error("open file[%s] fail, errno[%d]", a_rule->file_path, errno);
+		return -1;
+	}
 
-		/* save off the new dev/inode info from the stat call we already did */
-		if (redo_inode_stat) {
-			if (stat(a_rule->file_path, &stb)) {
-				zc_error("stat fail on new file[%s], errno[%d]", a_rule->file_path, errno);
-				return -1;
-			}
-		}
-		a_rule->static_dev = stb.st_dev;
-		a_rule->static_ino = stb.st_ino;
+	/* replace static_fd in place, so other threads writing it
+	 * go to the old file or the new one, never to a closed fd */
+	if (dup2(fd, a_rule->static_fd) < 0) {
+		zc_error("dup2 fail, errno[%d]", errno);
+		close(fd);
+		return -1;
+	}
+	close(fd);
+
+	if (fstat(a_rule->static_fd, &stb)) {
+		zc_error("stat fail on new file[%s], errno[%d]", a_rule->file_path, errno);
+		return -1;
+	}
+	a_rule->static_dev = stb.st_dev;
+	a_rule->static_ino = stb.st_ino;
+	a_rule->static_size = stb.st_size;
+
+	return 0;
+}
+
+/* other processes may write the file too, get the real size */
+static int zlog_rule_sync_static_size(zlog_rule_t * a_rule)
+{
+	struct stat stb;
+
+	if (fstat(a_rule->static_fd, &stb)) {
+		zc_warn("fstat [%s] fail, errno[%d]", a_rule->file_path, errno);
+		return -1;
+	}
+	a_rule->static_size = stb.st_size;
+	return 0;
+}
+
+static int zlog_rule_open_static_file(zlog_rule_t * a_rule)
+{
+	struct stat stb;
+
+	a_rule->static_fd = open(a_rule->file_path,
+		O_WRONLY | O_APPEND | O_CREAT | a_rule->file_open_flags,
+		a_rule->file_perms);
+	if (a_rule->static_fd < 0) {
+		zc_error("open file[%s] fail, errno[%d]", a_rule->file_path, errno);
+		return -1;
+	}
+
+	/* save off the inode information for checking for a changed file later on */
+	if (fstat(a_rule->static_fd, &stb)) {
+		zc_error("stat [%s] fail, errno[%d], failing to open static_fd", a_rule->file_path, errno);
+		return -1;
+	}
+	a_rule->static_dev = stb.st_dev;
+	a_rule->static_ino = stb.st_ino;
+	a_rule->static_size = stb.st_size;
+
+	zlog_syncer_add(&a_rule->sync_file, &a_rule->static_fd);
+	return 0;
+}
+
+/* at reload, a rule of the last conf writing the same file gives its fd,
+ * instead of opening it again. both of them keep it till one conf is
+ * deleted by zlog_conf_del_from(), return 0 if taken, 1 if not found */
+static int zlog_rule_take_static_file(zlog_rule_t * a_rule, zc_arraylist_t * from_rules)
+{
+	int i;
+	zlog_rule_t *a_from;
+
+	if (!from_rules) return 1;
+	zc_arraylist_foreach(from_rules, i, a_from) {
+		if (a_from->file_shared || !a_from->static_fd || a_from->dynamic_specs) continue;
+		if ((a_from->binary != NULL) != (a_rule->binary != NULL)) continue;
+		if (a_from->file_open_flags != a_rule->file_open_flags
+			|| a_from->file_perms != a_rule->file_perms
+			|| STRCMP(a_from->file_path, !=, a_rule->file_path)) continue;
+
+		a_rule->static_fd = a_from->static_fd;
+		a_rule->static_dev = a_from->static_dev;
+		a_rule->static_ino = a_from->static_ino;
+		a_rule->static_size = a_from->static_size;
+		a_rule->file_shared = a_from->file_shared = 1;
+		zlog_syncer_add(&a_rule->sync_file, &a_rule->static_fd);
+		zc_debug("fd[%d] of [%s] is taken from the last conf", a_rule->static_fd, a_rule->file_path);
+		return 0;
+	}
+	return 1;
+}
+
+/* the command is kept in file_path, 0 if taken, 1 if not found */
+static int zlog_rule_take_pipe(zlog_rule_t * a_rule, zc_arraylist_t * from_rules)
+{
+	int i;
+	zlog_rule_t *a_from;
+
+	if (!from_rules || a_rule->file_path[0] == '\0') return 1;
+	zc_arraylist_foreach(from_rules, i, a_from) {
+		if (a_from->file_shared || !a_from->pipe_fp) continue;
+		if (STRCMP(a_from->file_path, !=, a_rule->file_path)) continue;
+
+		a_rule->pipe_fp = a_from->pipe_fp;
+		a_rule->pipe_fd = a_from->pipe_fd;
+		a_rule->file_shared = a_from->file_shared = 1;
+		zc_debug("pipe[%s] is taken from the last conf", a_rule->file_path);
+		return 0;
+	}
+	return 1;
+}
+
+static int zlog_rule_emit_static_file_single(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
+{
+	if (zlog_rule_reopen_static_file(a_rule)) {
+		zc_error("zlog_rule_reopen_static_file fail");
+		return -1;
 	}
 
 	if (write(a_rule->static_fd,
@@ -126,17 +227,62 @@ static int zlog_rule_output_static_file_single(zlog_rule_t * a_rule, zlog_thread
 		return -1;
 	}
 
-	/* not so thread safe here, as multiple thread may ++fsync_count at the same time */
-	if (a_rule->fsync_period && ++a_rule->fsync_count >= a_rule->fsync_period) {
-		a_rule->fsync_count = 0;
-		if (fsync(a_rule->static_fd)) {
-			zc_error("fsync[%d] fail, errno[%d]", a_rule->static_fd, errno);
-		}
+	zlog_syncer_dirty(&a_rule->sync_file);
+	return 0;
+}
+
+static int zlog_rule_emitv_static_file_single(zlog_rule_t * a_rule, struct iovec *iov, int iovcnt)
+{
+	if (zlog_rule_reopen_static_file(a_rule)) {
+		zc_error("zlog_rule_reopen_static_file fail");
+		return -1;
+	}
+
+	if (writev(a_rule->static_fd, iov, iovcnt) < 0) {
+		zc_error("writev fail, errno[%d]", errno);
+		return -1;
 	}
 
+	zlog_syncer_dirty(&a_rule->sync_file);
 	return 0;
 }
 
+static int zlog_rule_emit_binary(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
+{
+	int rc = 0;
+	zlog_binary_t *a_binary = a_rule->binary;
+
+	/* frames of one file must be in order of ids */
+	zlog_binary_lock(a_binary);
+
+	if (zlog_rule_reopen_static_file(a_rule)) {
+		zc_error("zlog_rule_reopen_static_file fail");
+		rc = -1;
+		goto exit;
+	}
+
+	if (zlog_binary_encode(a_binary, a_rule->static_dev, a_rule->static_ino,
+			zlog_buf_str(a_thread->msg_buf), zlog_buf_len(a_thread->msg_buf))) {
+		zc_error("zlog_binary_encode fail");
+		zlog_binary_reset(a_binary);
+		rc = -1;
+		goto exit;
+	}
+
+	if (write(a_rule->static_fd, a_binary->frames->start, a_binary->frames->len) < 0) {
+		zc_error("write fail, errno[%d]", errno);
+		zlog_binary_reset(a_binary);
+		rc = -1;
+		goto exit;
+	}
+
+	zlog_syncer_dirty(&a_rule->sync_file);
+
+exit:
+	zlog_binary_unlock(a_binary);
+	return rc;
+}
+
 static char * zlog_rule_gen_archive_path(zlog_rule_t *a_rule, zlog_thread_t *a_thread)
 {
 	int i;
@@ -157,47 +303,176 @@ static char * zlog_rule_gen_archive_path(zlog_rule_t *a_rule, zlog_thread_t *a_t
 	return zlog_buf_str(a_thread->archive_path_buf);
 }
 
-static int zlog_rule_output_static_file_rotate(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
+/*******************************************************************************/
+/* mktime of tm with the field of unit set to value */
+static time_t zlog_rule_period_mktime(struct tm tm, int unit, int value)
 {
-	size_t len;
-	struct zlog_stat info;
-	int fd;
+	switch (unit) {
+	case ZLOG_SPEC_TIME_SEC:
+		tm.tm_sec = value;
+		break;
+	case ZLOG_SPEC_TIME_MIN:
+		tm.tm_min = value;
+		break;
+	case ZLOG_SPEC_TIME_HOUR:
+		tm.tm_hour = value;
+		break;
+	default:
+		tm.tm_mday = value;
+		break;
+	}
+	tm.tm_isdst = -1;
+	return mktime(&tm);
+}
 
-	if (zlog_format_gen_msg(a_rule->format, a_thread)) {
-		zc_error("zlog_format_gen_msg fail");
-		return -1;
+/* move archive_time on to the start of the period now is in, local time.
+ * steps as cron does, 6hour starts at 0, 6, 12, 18 o'clock,
+ * and over again at the next bigger unit */
+static void zlog_rule_archive_period(zlog_rule_t * a_rule, time_t now)
+{
+	struct tm tm;
+	struct tm month_end;
+	int unit = a_rule->archive_period_unit;
+	int value;
+	int first = 0;
+	int end;
+	time_t start;
+	time_t next;
+
+	localtime_r(&now, &tm);
+	switch (unit) {
+	case ZLOG_SPEC_TIME_SEC:
+		value = tm.tm_sec;
+		end = 60;
+		break;
+	case ZLOG_SPEC_TIME_MIN:
+		value = tm.tm_min;
+		end = 60;
+		tm.tm_sec = 0;
+		break;
+	case ZLOG_SPEC_TIME_HOUR:
+		value = tm.tm_hour;
+		end = 24;
+		tm.tm_sec = 0;
+		tm.tm_min = 0;
+		break;
+	default:
+		value = tm.tm_mday;
+		first = 1;
+		tm.tm_sec = 0;
+		tm.tm_min = 0;
+		tm.tm_hour = 0;
+		/* day 0 of next month is the last day of this one */
+		month_end = tm;
+		month_end.tm_mon++;
+		month_end.tm_mday = 0;
+		month_end.tm_isdst = -1;
+		mktime(&month_end);
+		end = month_end.tm_mday + 1;
+		break;
 	}
 
-	fd = open(a_rule->file_path, 
-		a_rule->file_open_flags | O_WRONLY | O_APPEND | O_CREAT, a_rule->file_perms);
-	if (fd < 0) {
-		zc_error("open file[%s] fail, errno[%d]", a_rule->file_path, errno);
-		return -1;
+	value -= (value - first) % a_rule->archive_period;
+	start = zlog_rule_period_mktime(tm, unit, value);
+	value += a_rule->archive_period;
+	next = zlog_rule_period_mktime(tm, unit, value < end ? value : end);
+
+	/* gaps of dst */
+	if (start > now) start = now;
+	if (next <= now) next = now + 1;
+
+	/* other threads may be late with an older now */
+	if (start <= a_rule->archive_time) return;
+	a_rule->archive_time = start;
+	zc_store_release(&a_rule->archive_next_time, next);
+	return;
+}
+
+/* archive_time to rotate the file by, once in a period.
+ * checked is where the file keeps the archive_time it is rotated by,
+ * 0 if it is done already */
+static time_t zlog_rule_archive_due(zlog_rule_t * a_rule, zlog_thread_t * a_thread, time_t *checked)
+{
+	time_t archive_time;
+
+	if (!a_thread->event->time_stamp.tv_sec) {
+		gettimeofday(&(a_thread->event->time_stamp), NULL);
+	}
+	if (a_thread->event->time_stamp.tv_sec >= zc_load_acquire(&a_rule->archive_next_time)) {
+		zlog_rule_archive_period(a_rule, a_thread->event->time_stamp.tv_sec);
 	}
 
-	len = zlog_buf_len(a_thread->msg_buf);
-	if (write(fd, zlog_buf_str(a_thread->msg_buf), len) < 0) {
-		zc_error("write fail, errno[%d]", errno);
-		close(fd);
-		return -1;
+	archive_time = a_rule->archive_time;
+	if (*checked == archive_time) return 0;
+	*checked = archive_time;
+	return archive_time;
+}
+
+/* rotate base_path by time, archives are named at the last second of the period */
+static int zlog_rule_rotate_by_time(zlog_rule_t * a_rule, zlog_thread_t * a_thread,
+		char *base_path, time_t archive_time)
+{
+	int rc;
+	char *archive_path;
+	time_t now_sec = a_thread->event->time_stamp.tv_sec;
+
+	a_thread->event->time_stamp.tv_sec = archive_time - 1;
+	archive_path = zlog_rule_gen_archive_path(a_rule, a_thread);
+	a_thread->event->time_stamp.tv_sec = now_sec;
+	if (!archive_path) return -1;
+
+	rc = zlog_rotater_rotate(a_thread->conf->rotater,
+		base_path, 0, archive_path,
+		0, a_rule->archive_max_count,
+		archive_time, a_rule->file_perms);
+	if (rc) zc_error("zlog_rotater_rotate fail");
+	return rc;
+}
+
+static int zlog_rule_emit_static_file_rotate(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
+{
+	size_t len;
+	ssize_t nwrite;
+	long size;
+	time_t now;
+	time_t archive_time;
+
+	/* other processes may rotate or write the file,
+	 * look at the path and the size once a second */
+	now = time(NULL);
+	if (now != a_rule->static_check_time) {
+		a_rule->static_check_time = now;
+		if (zlog_rule_reopen_static_file(a_rule)) {
+			zc_error("zlog_rule_reopen_static_file fail");
+			return -1;
+		}
+		zlog_rule_sync_static_size(a_rule);
 	}
 
-	if (a_rule->fsync_period && ++a_rule->fsync_count >= a_rule->fsync_period) {
-		a_rule->fsync_count = 0;
-		if (fsync(fd)) zc_error("fsync[%d] fail, errno[%d]", fd, errno);
+	/* by time, the file of last period is moved away before writing */
+	if (a_rule->archive_period_unit) {
+		archive_time = zlog_rule_archive_due(a_rule, a_thread, &a_rule->static_archive_time);
+		if (archive_time) {
+			if (zlog_rule_rotate_by_time(a_rule, a_thread, a_rule->file_path, archive_time)) {
+				return -1;
+			}
+			if (zlog_rule_reopen_static_file(a_rule)) {
+				zc_error("zlog_rule_reopen_static_file fail");
+				return -1;
+			}
+		}
 	}
 
-	if (close(fd) < 0) {
-		zc_error("close fail, maybe cause by write, errno[%d]", errno);
+	len = zlog_buf_len(a_thread->msg_buf);
+	nwrite = write(a_rule->static_fd, zlog_buf_str(a_thread->msg_buf), len);
+	if (nwrite < 0) {
+		zc_error("write fail, errno[%d]", errno);
 		return -1;
 	}
+	size = zc_atomic_add(&a_rule->static_size, (long)nwrite);
+	zlog_syncer_dirty(&a_rule->sync_file);
 
-	if (a_rule->fsync_period && ++a_rule->fsync_count >= a_rule->fsync_period) {
-		a_rule->fsync_count = 0;
-		if (fsync(a_rule->static_fd)) {
-			zc_error("fsync[%d] fail, errno[%d]", a_rule->static_fd, errno);
-		}
-	}
+	if (a_rule->archive_period_unit) return 0;
 
 	if (len > a_rule->archive_max_size) {
 		zc_debug("one msg's len[%ld] > archive_max_size[%ld], no rotate",
@@ -205,154 +480,135 @@ static int zlog_rule_output_static_file_rotate(zlog_rule_t * a_rule, zlog_thread
 		return 0;
 	}
 
-	if (stat(a_rule->file_path, &info)) {
-		zc_warn("stat [%s] fail, errno[%d], maybe in rotating", a_rule->file_path, errno);
-		return 0;
-	}
-
 	/* file not so big, return */
-	if (info.st_size + len < a_rule->archive_max_size) return 0;
+	if (size + len < a_rule->archive_max_size) return 0;
 
-	if (zlog_rotater_rotate(zlog_env_conf->rotater, 
+	/* near the threshold, make sure by the real size */
+	if (zlog_rule_sync_static_size(a_rule)) return 0;
+	if (a_rule->static_size + len < a_rule->archive_max_size) return 0;
+
+	if (zlog_rotater_rotate(a_thread->conf->rotater, 
 		a_rule->file_path, len,
 		zlog_rule_gen_archive_path(a_rule, a_thread),
-		a_rule->archive_max_size, a_rule->archive_max_count)
+		a_rule->archive_max_size, a_rule->archive_max_count,
+		0, a_rule->file_perms)
 		) {
 		zc_error("zlog_rotater_rotate fail");
 		return -1;
 	} /* success or no rotation do nothing */
 
+	/* the file may be moved away, by us or others, go on with the new one */
+	if (zlog_rule_reopen_static_file(a_rule)) {
+		zc_error("zlog_rule_reopen_static_file fail");
+		return -1;
+	}
+
 	return 0;
 }
 
-/* return path	success
- * return NULL	fail
- */
-#define zlog_rule_gen_path(a_rule, a_thread) do {    \
-	int i;    \
-	zlog_spec_t *a_spec;    \
-    \
-	zlog_buf_restart(a_thread->path_buf);    \
-    \
-	zc_arraylist_foreach(a_rule->dynamic_specs, i, a_spec) {    \
-		if (zlog_spec_gen_path(a_spec, a_thread)) {    \
-			zc_error("zlog_spec_gen_path fail");    \
-			return -1;    \
-		}    \
-	}    \
-    \
-	zlog_buf_seal(a_thread->path_buf);    \
-} while(0)
-
-
-static int zlog_rule_output_dynamic_file_single(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
+static int zlog_rule_emit_dynamic_file_single(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
 {
-	int fd;
-
-	zlog_rule_gen_path(a_rule, a_thread);
-
-	if (zlog_format_gen_msg(a_rule->format, a_thread)) {
-		zc_error("zlog_format_output fail");
-		return -1;
-	}
+	zlog_fd_t *a_fd;
+	int rc = 0;
 
-	fd = open(zlog_buf_str(a_thread->path_buf),
-		a_rule->file_open_flags | O_WRONLY | O_APPEND | O_CREAT, a_rule->file_perms);
-	if (fd < 0) {
-		zc_error("open file[%s] fail, errno[%d]", zlog_buf_str(a_thread->path_buf), errno);
+	a_fd = zlog_fd_cache_get(zlog_buf_str(a_thread->path_buf),
+		a_rule->file_open_flags, a_rule->file_perms);
+	if (!a_fd) {
+		zc_error("zlog_fd_cache_get fail");
 		return -1;
 	}
 
-	if (write(fd, zlog_buf_str(a_thread->msg_buf), zlog_buf_len(a_thread->msg_buf)) < 0) {
+	if (write(a_fd->fd, zlog_buf_str(a_thread->msg_buf), zlog_buf_len(a_thread->msg_buf)) < 0) {
 		zc_error("write fail, errno[%d]", errno);
-		close(fd);
-		return -1;
-	}
-
-	if (a_rule->fsync_period && ++a_rule->fsync_count >= a_rule->fsync_period) {
-		a_rule->fsync_count = 0;
-		if (fsync(fd)) zc_error("fsync[%d] fail, errno[%d]", fd, errno);
-	}
-
-	if (close(fd) < 0) {
-		zc_error("close fail, maybe cause by write, errno[%d]", errno);
-		return -1;
+		rc = -1;
+	} else {
+		zlog_fd_cache_dirty(a_fd);
 	}
 
-	return 0;
+	zlog_fd_cache_put(a_fd);
+	return rc;
 }
 
-static int zlog_rule_output_dynamic_file_rotate(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
+static int zlog_rule_emit_dynamic_file_rotate(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
 {
-	int fd;
+	zlog_fd_t *a_fd;
 	char *path;
 	size_t len;
-	struct zlog_stat info;
-
-	zlog_rule_gen_path(a_rule, a_thread);
+	ssize_t nwrite;
+	long size;
+	time_t archive_time;
+	int rc = 0;
 
-	if (zlog_format_gen_msg(a_rule->format, a_thread)) {
-		zc_error("zlog_format_output fail");
+	path = zlog_buf_str(a_thread->path_buf);
+	a_fd = zlog_fd_cache_get(path, a_rule->file_open_flags, a_rule->file_perms);
+	if (!a_fd) {
+		zc_error("zlog_fd_cache_get fail");
 		return -1;
 	}
 
-	path = zlog_buf_str(a_thread->path_buf);
-	fd = open(path, a_rule->file_open_flags | O_WRONLY | O_APPEND | O_CREAT, a_rule->file_perms);
-	if (fd < 0) {
-		zc_error("open file[%s] fail, errno[%d]", zlog_buf_str(a_thread->path_buf), errno);
-		return -1;
+	/* by time, the file of last period is moved away before writing */
+	if (a_rule->archive_period_unit) {
+		archive_time = zlog_rule_archive_due(a_rule, a_thread, &a_fd->archive_time);
+		if (archive_time) {
+			if (zlog_rule_rotate_by_time(a_rule, a_thread, path, archive_time)) {
+				rc = -1;
+				goto exit;
+			}
+			zlog_fd_cache_expire(a_fd);
+			zlog_fd_cache_put(a_fd);
+			a_fd = zlog_fd_cache_get(path, a_rule->file_open_flags, a_rule->file_perms);
+			if (!a_fd) {
+				zc_error("zlog_fd_cache_get fail");
+				return -1;
+			}
+		}
 	}
 
 	len = zlog_buf_len(a_thread->msg_buf);
-	if (write(fd, zlog_buf_str(a_thread->msg_buf), len) < 0) {
+	nwrite = write(a_fd->fd, zlog_buf_str(a_thread->msg_buf), len);
+	if (nwrite < 0) {
 		zc_error("write fail, errno[%d]", errno);
-		close(fd);
-		return -1;
-	}
-
-	if (a_rule->fsync_period && ++a_rule->fsync_count >= a_rule->fsync_period) {
-		a_rule->fsync_count = 0;
-		if (fsync(fd)) zc_error("fsync[%d] fail, errno[%d]", fd, errno);
+		rc = -1;
+		goto exit;
 	}
+	size = zc_atomic_add(&a_fd->size, (long)nwrite);
+	zlog_fd_cache_dirty(a_fd);
 
-	if (close(fd) < 0) {
-		zc_error("write fail, maybe cause by write, errno[%d]", errno);
-		return -1;
-	}
+	if (a_rule->archive_period_unit) goto exit;
 
 	if (len > a_rule->archive_max_size) {
 		zc_debug("one msg's len[%ld] > archive_max_size[%ld], no rotate",
 			 (long)len, (long) a_rule->archive_max_size);
-		return 0;
-	}
-
-	if (stat(path, &info)) {
-		zc_warn("stat [%s] fail, errno[%d], maybe in rotating", path, errno);
-		return 0;
+		goto exit;
 	}
 
 	/* file not so big, return */
-	if (info.st_size + len < a_rule->archive_max_size) return 0;
+	if (size + len < a_rule->archive_max_size) goto exit;
+
+	/* near the threshold, make sure by the real size */
+	if (zlog_fd_cache_sync_size(a_fd)) goto exit;
+	if (a_fd->size + len < a_rule->archive_max_size) goto exit;
 
-	if (zlog_rotater_rotate(zlog_env_conf->rotater, 
+	if (zlog_rotater_rotate(a_thread->conf->rotater, 
 		path, len,
 		zlog_rule_gen_archive_path(a_rule, a_thread),
-		a_rule->archive_max_size, a_rule->archive_max_count)
+		a_rule->archive_max_size, a_rule->archive_max_count,
+		0, a_rule->file_perms)
 		) {
 		zc_error("zlog_rotater_rotate fail");
-		return -1;
+		rc = -1;
+		goto exit;
 	} /* success or no rotation do nothing */
 
-	return 0;
+	/* the file may be moved away, look at the path next time */
+	zlog_fd_cache_expire(a_fd);
+exit:
+	zlog_fd_cache_put(a_fd);
+	return rc;
 }
 
-static int zlog_rule_output_pipe(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
+static int zlog_rule_emit_pipe(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
 {
-	if (zlog_format_gen_msg(a_rule->format, a_thread)) {
-		zc_error("zlog_format_gen_msg fail");
-		return -1;
-	}
-
 	if (write(a_rule->pipe_fd,
 			zlog_buf_str(a_thread->msg_buf),
 			zlog_buf_len(a_thread->msg_buf)) < 0) {
@@ -363,93 +619,90 @@ static int zlog_rule_output_pipe(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
 	return 0;
 }
 
-static int zlog_rule_output_syslog(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
+static int zlog_rule_emit_syslog(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
 {
 	zlog_level_t *a_level;
 
-	if (zlog_format_gen_msg(a_rule->format, a_thread)) {
-		zc_error("zlog_format_gen_msg fail");
-		return -1;
-	}
-
 	/*
 	msg = a_thread->msg_buf->start;
 	msg_len = a_thread->msg_buf->end - a_thread->msg_buf->start;
 	 */
 
-	a_level = zlog_level_list_get(zlog_env_conf->levels, a_thread->event->level);
+	a_level = zlog_level_list_get(a_thread->conf->levels, a_thread->event->level);
 	zlog_buf_seal(a_thread->msg_buf);
 	syslog(a_rule->syslog_facility | a_level->syslog_level,
 		"%s",  zlog_buf_str(a_thread->msg_buf));
 	return 0;
 }
 
-static int zlog_rule_output_static_record(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
+static int zlog_rule_emit_static_record(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
 {
 	zlog_msg_t msg;
+	zlog_record_fn record_func;
 
-	if (!a_rule->record_func) {
+	/* set by zlog_set_record() while logging */
+	record_func = zc_load_acquire(&a_rule->record_func);
+	if (!record_func) {
 		zc_error("user defined record funcion for [%s] not set, no output",
 			a_rule->record_name);
 		return -1;
 	}
 
-	if (zlog_format_gen_msg(a_rule->format, a_thread)) {
-		zc_error("zlog_format_gen_msg fail");
-		return -1;
-	}
 	zlog_buf_seal(a_thread->msg_buf);
 
 	msg.buf = zlog_buf_str(a_thread->msg_buf);
 	msg.len = zlog_buf_len(a_thread->msg_buf);
 	msg.path = a_rule->record_path;
 
-	if (a_rule->record_func(&msg)) {
+	if (record_func(&msg)) {
 		zc_error("a_rule->record fail");
 		return -1;
 	}
 	return 0;
 }
 
-static int zlog_rule_output_dynamic_record(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
+static int zlog_rule_emit_dynamic_record(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
 {
 	zlog_msg_t msg;
+	zlog_record_fn record_func;
 
-	if (!a_rule->record_func) {
+	/* set by zlog_set_record() while logging */
+	record_func = zc_load_acquire(&a_rule->record_func);
+	if (!record_func) {
 		zc_error("user defined record funcion for [%s] not set, no output",
 			a_rule->record_name);
 		return -1;
 	}
 
-	zlog_rule_gen_path(a_rule, a_thread);
-
-	if (zlog_format_gen_msg(a_rule->format, a_thread)) {
-		zc_error("zlog_format_gen_msg fail");
-		return -1;
-	}
 	zlog_buf_seal(a_thread->msg_buf);
 
 	msg.buf = zlog_buf_str(a_thread->msg_buf);
 	msg.len = zlog_buf_len(a_thread->msg_buf);
 	msg.path = zlog_buf_str(a_thread->path_buf);
 
-	if (a_rule->record_func(&msg)) {
+	if (record_func(&msg)) {
 		zc_error("a_rule->record fail");
 		return -1;
 	}
 	return 0;
 }
 
-static int zlog_rule_output_stdout(zlog_rule_t * a_rule,
+static int zlog_rule_emit_stdout(zlog_rule_t * a_rule,
 				   zlog_thread_t * a_thread)
 {
-
-	if (zlog_format_gen_msg(a_rule->format, a_thread)) {
-		zc_error("zlog_format_gen_msg fail");
+	if (write(STDOUT_FILENO,
+		zlog_buf_str(a_thread->msg_buf), zlog_buf_len(a_thread->msg_buf)) < 0) {
+		zc_error("write fail, errno[%d]", errno);
 		return -1;
 	}
 
-	if (write(STDOUT_FILENO,
+	return 0;
+}
+
+static int zlog_rule_emit_stderr(zlog_rule_t * a_rule,
+				   zlog_thread_t * a_thread)
+{
+	if (write(STDERR_FILENO,
 		zlog_buf_str(a_thread->msg_buf), zlog_buf_len(a_thread->msg_buf)) < 0) {
 		zc_error("write fail, errno[%d]", errno);
 		return -1;
@@ -458,23 +711,272 @@ static int zlog_rule_output_stdout(zlog_rule_t * a_rule,
 	return 0;
 }
 
-static int zlog_rule_output_stderr(zlog_rule_t * a_rule,
-				   zlog_thread_t * a_thread)
+static int zlog_rule_emitv_pipe(zlog_rule_t * a_rule, struct iovec *iov, int iovcnt)
 {
+	if (writev(a_rule->pipe_fd, iov, iovcnt) < 0) {
+		zc_error("writev fail, errno[%d]", errno);
+		return -1;
+	}
+	return 0;
+}
 
-	if (zlog_format_gen_msg(a_rule->format, a_thread)) {
-		zc_error("zlog_format_gen_msg fail");
+static int zlog_rule_emitv_stdout(zlog_rule_t * a_rule, struct iovec *iov, int iovcnt)
+{
+	if (writev(STDOUT_FILENO, iov, iovcnt) < 0) {
+		zc_error("writev fail, errno[%d]", errno);
 		return -1;
 	}
+	return 0;
+}
 
-	if (write(STDERR_FILENO,
-		zlog_buf_str(a_thread->msg_buf), zlog_buf_len(a_thread->msg_buf)) < 0) {
-		zc_error("write fail, errno[%d]", errno);
+static int zlog_rule_emitv_stderr(zlog_rule_t * a_rule, struct iovec *iov, int iovcnt)
+{
+	if (writev(STDERR_FILENO, iov, iovcnt) < 0) {
+		zc_error("writev fail, errno[%d]", errno);
 		return -1;
 	}
+	return 0;
+}
+
+/*******************************************************************************/
+/* the first time after now the leading part of path changes */
+static time_t zlog_rule_path_expire(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
+{
+	time_t now_sec = a_thread->event->time_stamp.tv_sec;
+	struct tm tm;
+	struct tm tm_dst;
+	time_t t;
+	time_t t_dst;
+
+	if (a_rule->path_time_unit == ZLOG_SPEC_TIME_SEC) return now_sec + 1;
+
+	/* made by the time spec just now */
+	tm = a_thread->event->time_local;
+	tm.tm_sec = 0;
+	if (a_rule->path_time_unit == ZLOG_SPEC_TIME_MIN) {
+		tm.tm_min++;
+	} else {
+		tm.tm_min = 0;
+		if (a_rule->path_time_unit == ZLOG_SPEC_TIME_HOUR) {
+			tm.tm_hour++;
+		} else {
+			tm.tm_hour = 0;
+			tm.tm_mday++;
+		}
+	}
+	/* over a DST change the next wall time is ambiguous or missing,
+	 * take it in both offsets and keep the earlier, a late one would put
+	 * lines of the next time in this path */
+	tm_dst = tm;
+	tm.tm_isdst = -1;
+	t = mktime(&tm);
+	t_dst = mktime(&tm_dst);
+	if (t_dst != (time_t)-1 && (t == (time_t)-1 || t_dst < t)) t = t_dst;
+	if (t <= now_sec) t = now_sec + 1;
+	return t;
+}
 
+/* keep the leading part just made in path_buf in the call of category.
+ * the first one is published by cas, then it is changed in place when
+ * its time passes, by the thread which makes seq odd */
+static void zlog_rule_keep_path(zlog_rule_t * a_rule, zlog_thread_t * a_thread,
+		zlog_category_path_t * a_path)
+{
+	size_t len;
+	time_t expire = 0;
+	unsigned long seq;
+
+	len = zlog_buf_len(a_thread->path_buf);
+	if (a_rule->path_time_unit) expire = zlog_rule_path_expire(a_rule, a_thread);
+
+	if (!a_path) {
+		/* some room for paths of later time */
+		a_path = malloc(sizeof(zlog_category_path_t) + len + 64);
+		if (!a_path) {
+			zc_error("malloc fail, errno[%d]", errno);
+			return;
+		}
+		a_path->seq = 0;
+		a_path->since = a_thread->event->time_stamp.tv_sec;
+		a_path->expire = expire;
+		a_path->len = len;
+		a_path->size = len + 64;
+		memcpy(a_path->str, zlog_buf_str(a_thread->path_buf), len);
+		if (!zc_cas(&a_thread->call->path, NULL, a_path)) free(a_path);
+		return;
+	}
+
+	seq = a_path->seq;
+	if ((seq & 1) || len >= a_path->size) return;
+	if (!zc_cas(&a_path->seq, seq, seq + 1)) return;
+	memcpy(a_path->str, zlog_buf_str(a_thread->path_buf), len);
+	a_path->len = len;
+	a_path->since = a_thread->event->time_stamp.tv_sec;
+	a_path->expire = expire;
+	zc_store_release(&a_path->seq, seq + 2);
+	return;
+}
+
+static int zlog_rule_gen_path(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
+{
+	int i = 0;
+	unsigned long seq;
+	zlog_spec_t *a_spec;
+	zlog_category_path_t *a_path = NULL;
+
+	zlog_buf_restart(a_thread->path_buf);
+
+	/* leading specs depend only on category, process or time,
+	 * copy them while they are not changed */
+	if (a_rule->path_const_count && a_thread->call) {
+		a_path = zc_load_acquire(&a_thread->call->path);
+		if (a_path) {
+			if (a_rule->path_time_unit && !a_thread->event->time_stamp.tv_sec) {
+				gettimeofday(&(a_thread->event->time_stamp), NULL);
+			}
+			seq = zc_load_acquire(&a_path->seq);
+			/* a thread late with an older time makes its own */
+			if (!(seq & 1) && (!a_rule->path_time_unit
+				|| (a_thread->event->time_stamp.tv_sec >= a_path->since
+				&& a_thread->event->time_stamp.tv_sec < a_path->expire))) {
+				zlog_buf_append(a_thread->path_buf, a_path->str, a_path->len);
+				zc_mb();
+				if (a_path->seq == seq) {
+					i = a_rule->path_const_count;
+				} else {
+					zlog_buf_restart(a_thread->path_buf);
+				}
+			}
+		}
+
+		if (i == 0) {
+			for (; i < a_rule->path_const_count; i++) {
+				a_spec = zc_arraylist_get(a_rule->dynamic_specs, i);
+				if (zlog_spec_gen_path(a_spec, a_thread)) {
+					zc_error("zlog_spec_gen_path fail");
+					return -1;
+				}
+			}
+			zlog_rule_keep_path(a_rule, a_thread, a_path);
+		}
+	}
+
+	for (; i < zc_arraylist_len(a_rule->dynamic_specs); i++) {
+		a_spec = zc_arraylist_get(a_rule->dynamic_specs, i);
+		if (zlog_spec_gen_path(a_spec, a_thread)) {
+			zc_error("zlog_spec_gen_path fail");
+			return -1;
+		}
+	}
+
+	zlog_buf_seal(a_thread->path_buf);
 	return 0;
 }
+
+/* generate path and msg in a_thread, then a_rule->emit() writes them out */
+static int zlog_rule_gen(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
+{
+	int rc;
+
+	/* binary output takes the event itself, not the formatted msg */
+	if (a_rule->binary) {
+		if (zlog_thread_msg_buf(a_thread, NULL) < 0) return -1;
+		return zlog_binary_gen(a_rule->binary, a_thread);
+	}
+
+	if (a_rule->dynamic_specs && zlog_rule_gen_path(a_rule, a_thread)) {
+		zc_error("zlog_rule_gen_path fail");
+		return -1;
+	}
+
+	/* an earlier rule of the same format made it in this event */
+	rc = zlog_thread_msg_buf(a_thread, a_rule->format);
+	if (rc) return rc < 0 ? -1 : 0;
+
+	if (zlog_format_gen_msg(a_rule->format, a_thread)) {
+		zc_error("zlog_format_gen_msg fail");
+		return -1;
+	}
+	zlog_thread_msg_done(a_thread, a_rule->format);
+
+	return 0;
+}
+
+static int zlog_rule_output_direct(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
+{
+	if (zlog_rule_gen(a_rule, a_thread)) return -1;
+	return a_rule->emit(a_rule, a_thread);
+}
+
+/* a long user msg goes out in place with the rest of the msg by one writev(),
+ * which is appended as a whole like write(), see zlog_format_gen_msgv() */
+static int zlog_rule_output_gather(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
+{
+	int rc;
+	struct iovec iov[3];
+
+	/* an earlier rule of the same format made it in this event */
+	rc = zlog_thread_msg_buf(a_thread, a_rule->format);
+	if (rc < 0) return -1;
+	if (rc == 0) {
+		/* not marked done, msg_buf has only the head and the tail */
+		rc = zlog_format_gen_msgv(a_rule->format, a_thread, iov);
+		if (rc < 0) {
+			zc_error("zlog_format_gen_msgv fail");
+			return -1;
+		} else if (rc > 0) {
+			return a_rule->emitv(a_rule, iov, rc);
+		}
+
+		if (zlog_format_gen_msg(a_rule->format, a_thread)) {
+			zc_error("zlog_format_gen_msg fail");
+			return -1;
+		}
+		zlog_thread_msg_done(a_thread, a_rule->format);
+	}
+
+	return a_rule->emit(a_rule, a_thread);
+}
+
+/* gather msgs in wbuf of the caller, ERROR and above are written at once */
+static int zlog_rule_output_buffered(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
+{
+	if (zlog_rule_gen(a_rule, a_thread)) return -1;
+	return zlog_wbuf_write(a_thread, a_rule,
+		zlog_buf_str(a_thread->msg_buf), zlog_buf_len(a_thread->msg_buf),
+		a_thread->event->level >= a_rule->write_flush_level);
+}
+
+/* format in the caller, let writer thread emit */
+static int zlog_rule_output_async(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
+{
+	if (zlog_rule_gen(a_rule, a_thread)) return -1;
+	return zlog_async_push(a_rule, a_thread);
+}
+
+/* the sync thread syncs files, a logger only asks for it, see syncer.h */
+static int zlog_rule_output_sync(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
+{
+	int rc;
+
+	rc = a_rule->sync_output(a_rule, a_thread);
+
+	/* counted in thread, not a shared write for each msg */
+	if (a_rule->fsync_period && ++a_thread->fsync_count >= a_rule->fsync_period) {
+		a_thread->fsync_count = 0;
+		zlog_syncer_request();
+	}
+
+	/* writers of async rules do not wait, their callers do */
+	if (a_rule->fsync_wait_level && a_thread->event->level >= a_rule->fsync_wait_level
+		&& !a_thread->async_writer) {
+		if (a_rule->sync_output == zlog_rule_output_async) zlog_async_flush();
+		zlog_syncer_wait();
+	}
+
+	return rc;
+}
+
 /*******************************************************************************/
 static int syslog_facility_atoi(char *facility)
 {
@@ -568,13 +1070,53 @@ err:
 	return -1;
 }
 
+/* period of time rotation, like hourly, daily or 6hour, 30min.
+ * return 1 if it is, 0 if not, then it is a size, -1 if wrong */
+static int zlog_rule_parse_period(zlog_rule_t * a_rule, char *limit)
+{
+	int i;
+	long n = 1;
+	char *p = limit;
+	static const struct {
+		const char *name;
+		int unit;
+		int max;
+	} periods[] = {
+		{ "sec", ZLOG_SPEC_TIME_SEC, 59 },
+		{ "min", ZLOG_SPEC_TIME_MIN, 59 },
+		{ "hour", ZLOG_SPEC_TIME_HOUR, 23 },
+		{ "day", ZLOG_SPEC_TIME_DAY, 31 },
+		{ "minutely", ZLOG_SPEC_TIME_MIN, 1 },
+		{ "hourly", ZLOG_SPEC_TIME_HOUR, 1 },
+		{ "daily", ZLOG_SPEC_TIME_DAY, 1 }
+	};
+
+	if (isdigit(*p)) n = strtol(limit, &p, 10);
+
+	for (i = 0; i < sizeof(periods) / sizeof(periods[0]); i++) {
+		if (STRICMP(p, !=, periods[i].name)) continue;
+		if (n < 1 || n > periods[i].max) {
+			zc_error("period[%s] is out of 1~%d %s", limit, periods[i].max, periods[i].name);
+			return -1;
+		}
+		a_rule->archive_period_unit = periods[i].unit;
+		a_rule->archive_period = n;
+		return 1;
+	}
+	return 0;
+}
+
 zlog_rule_t *zlog_rule_new(char *line,
 		zc_arraylist_t *levels,
 		zlog_format_t * default_format,
 		zc_arraylist_t * formats,
 		unsigned int file_perms,
 		size_t fsync_period,
-		int * time_cache_count)
+		int fsync_wait_level,
+		int async,
+		size_t write_buffer,
+		int * time_cache_count,
+		zc_arraylist_t * from_rules)
 {
 	int rc = 0;
 	int nscan = 0;
@@ -595,6 +1137,8 @@ zlog_rule_t *zlog_rule_new(char *line,
 	char *p;
 	char *q;
 	size_t len;
+	int i;
+	zlog_spec_t *a_spec;
 
 	zc_assert(line, NULL);
 	zc_assert(default_format, NULL);
@@ -608,6 +1152,7 @@ zlog_rule_t *zlog_rule_new(char *line,
 
 	a_rule->file_perms = file_perms;
 	a_rule->fsync_period = fsync_period;
+	a_rule->fsync_wait_level = fsync_wait_level;
 
 	/* line         [f.INFO "%H/log/aa.log", 20MB * 12; MyTemplate]
 	 * selector     [f.INFO]
@@ -763,6 +1308,7 @@ zlog_rule_t *zlog_rule_new(char *line,
 
 		/* no need to fsync, as file is opened by O_SYNC, write immediately */
 		a_rule->fsync_period = 0;
+		a_rule->fsync_wait_level = 0;
 
 		p = file_path + 1;
 		a_rule->file_open_flags = O_SYNC;
@@ -779,10 +1325,16 @@ zlog_rule_t *zlog_rule_new(char *line,
 
 		if (file_limit) {
 			memset(archive_max_size, 0x00, sizeof(archive_max_size));
-			nscan = sscanf(file_limit, " %[0-9MmKkBb] * %d ~",
+			nscan = sscanf(file_limit, " %[0-9A-Za-z] * %d ~",
 					archive_max_size, &(a_rule->archive_max_count));
 			if (nscan) {
-				a_rule->archive_max_size = zc_parse_byte_size(archive_max_size);
+				rc = zlog_rule_parse_period(a_rule, archive_max_size);
+				if (rc < 0) {
+					zc_error("zlog_rule_parse_period fail");
+					goto err;
+				} else if (rc == 0) {
+					a_rule->archive_max_size = zc_parse_byte_size(archive_max_size);
+				}
 			}
 			p = strchr(file_limit, '"');
 			if (p) { /* archive file path exist */
@@ -804,50 +1356,54 @@ zlog_rule_t *zlog_rule_new(char *line,
 
 		/* try to figure out if the log file path is dynamic or static */
 		if (a_rule->dynamic_specs) {
-			if (a_rule->archive_max_size <= 0) {
-				a_rule->output = zlog_rule_output_dynamic_file_single;
+			/* leading specs whose output is kept per category,
+			 * till the smallest time unit in them passes */
+			zc_arraylist_foreach(a_rule->dynamic_specs, i, a_spec) {
+				if (a_spec->time_unit) {
+					if (!a_rule->path_time_unit || a_spec->time_unit < a_rule->path_time_unit) {
+						a_rule->path_time_unit = a_spec->time_unit;
+					}
+				} else if (!a_spec->per_category) {
+					break;
+				}
+			}
+			a_rule->path_const_count = i;
+
+			if (a_rule->archive_max_size <= 0 && !a_rule->archive_period_unit) {
+				a_rule->emit = zlog_rule_emit_dynamic_file_single;
 			} else {
-				a_rule->output = zlog_rule_output_dynamic_file_rotate;
+				a_rule->emit = zlog_rule_emit_dynamic_file_rotate;
 			}
 		} else {
-			struct stat stb;
-
-			if (a_rule->archive_max_size <= 0) {
-				a_rule->output = zlog_rule_output_static_file_single;
+			if (a_rule->archive_max_size <= 0 && !a_rule->archive_period_unit) {
+				a_rule->emit = zlog_rule_emit_static_file_single;
+				a_rule->emitv = zlog_rule_emitv_static_file_single;
 			} else {
 				/* as rotate, so need to reopen everytime */
-				a_rule->output = zlog_rule_output_static_file_rotate;
+				a_rule->emit = zlog_rule_emit_static_file_rotate;
 			}
 
-			a_rule->static_fd = open(a_rule->file_path,
-				O_WRONLY | O_APPEND | O_CREAT | a_rule->file_open_flags,
-				a_rule->file_perms);
-			if (a_rule->static_fd < 0) {
-				zc_error("open file[%s] fail, errno[%d]", a_rule->file_path, errno);
+			if (zlog_rule_take_static_file(a_rule, from_rules)
+				&& zlog_rule_open_static_file(a_rule)) goto err;
+		}
+		break;
+	case '|' :
+		/* to be found by the next conf, if not too long */
+		if (strlen(output + 1) < sizeof(a_rule->file_path)) strcpy(a_rule->file_path, output + 1);
+		if (zlog_rule_take_pipe(a_rule, from_rules)) {
+			a_rule->pipe_fp = popen(output + 1, "w");
+			if (!a_rule->pipe_fp) {
+				zc_error("popen fail, errno[%d]", errno);
 				goto err;
 			}
-
-			/* save off the inode information for checking for a changed file later on */
-			if (fstat(a_rule->static_fd, &stb)) {
-				zc_error("stat [%s] fail, errno[%d], failing to open static_fd", a_rule->file_path, errno);
+			a_rule->pipe_fd = fileno(a_rule->pipe_fp);
+			if (a_rule->pipe_fd < 0 ) {
+				zc_error("fileno fail, errno[%d]", errno);
 				goto err;
 			}
-			a_rule->static_dev = stb.st_dev;
-			a_rule->static_ino = stb.st_ino;
-		}
-		break;
-	case '|' :
-		a_rule->pipe_fp = popen(output + 1, "w");
-		if (!a_rule->pipe_fp) {
-			zc_error("popen fail, errno[%d]", errno);
-			goto err;
 		}
-		a_rule->pipe_fd = fileno(a_rule->pipe_fp);
-		if (a_rule->pipe_fd < 0 ) {
-			zc_error("fileno fail, errno[%d]", errno);
-			goto err;
-		}
-		a_rule->output = zlog_rule_output_pipe;
+		a_rule->emit = zlog_rule_emit_pipe;
+		a_rule->emitv = zlog_rule_emitv_pipe;
 		break;
 	case '>' :
 		if (STRNCMP(file_path + 1, ==, "syslog", 6)) {
@@ -856,15 +1412,43 @@ zlog_rule_t *zlog_rule_new(char *line,
 				zc_error("-187 get");
 				goto err;
 			}
-			a_rule->output = zlog_rule_output_syslog;
+			a_rule->emit = zlog_rule_emit_syslog;
 			openlog(NULL, LOG_NDELAY | LOG_NOWAIT | LOG_PID, LOG_USER);
 		} else if (STRNCMP(file_path + 1, ==, "stdout", 6)) {
-			a_rule->output = zlog_rule_output_stdout;
+			a_rule->emit = zlog_rule_emit_stdout;
+			a_rule->emitv = zlog_rule_emitv_stdout;
 		} else if (STRNCMP(file_path + 1, ==, "stderr", 6)) {
-			a_rule->output = zlog_rule_output_stderr;
+			a_rule->emit = zlog_rule_emit_stderr;
+			a_rule->emitv = zlog_rule_emitv_stderr;
+		} else if (STRNCMP(file_path + 1, ==, "binary", 6)) {
+			/* >binary, "path", ids in file depend on order, so no rotate */
+			if (!file_limit || *file_limit != '"') {
+				zc_error("binary path not start with \", [%s]", output);
+				goto err;
+			}
+			rc = zlog_rule_parse_path(file_limit, a_rule->file_path, sizeof(a_rule->file_path),
+					&(a_rule->dynamic_specs), time_cache_count);
+			if (rc) {
+				zc_error("zlog_rule_parse_path fail");
+				goto err;
+			}
+			if (a_rule->dynamic_specs) {
+				zc_error("binary path[%s] must be static", a_rule->file_path);
+				goto err;
+			}
+
+			a_rule->binary = zlog_binary_new(a_rule->file_path, time_cache_count);
+			if (!a_rule->binary) {
+				zc_error("zlog_binary_new fail");
+				goto err;
+			}
+			a_rule->emit = zlog_rule_emit_binary;
+
+			if (zlog_rule_take_static_file(a_rule, from_rules)
+				&& zlog_rule_open_static_file(a_rule)) goto err;
 		} else {
 			zc_error
-			    ("[%s]the string after is not syslog, stdout or stderr", output);
+			    ("[%s]the string after is not syslog, stdout, stderr or binary", output);
 			goto err;
 		}
 		break;
@@ -901,11 +1485,11 @@ zlog_rule_t *zlog_rule_new(char *line,
 
 		/* try to figure out if the log file path is dynamic or static */
 		if (strchr(a_rule->record_path, '%') == NULL) {
-			a_rule->output = zlog_rule_output_static_record;
+			a_rule->emit = zlog_rule_emit_static_record;
 		} else {
 			zlog_spec_t *a_spec;
 
-			a_rule->output = zlog_rule_output_dynamic_record;
+			a_rule->emit = zlog_rule_emit_dynamic_record;
 
 			a_rule->dynamic_specs = zc_arraylist_new((zc_arraylist_del_fn)zlog_spec_del);
 			if (!(a_rule->dynamic_specs)) {
@@ -934,6 +1518,43 @@ zlog_rule_t *zlog_rule_new(char *line,
 		goto err;
 	}
 
+	/* only files are synced */
+	if (!a_rule->sync_file.linked
+		&& a_rule->emit != zlog_rule_emit_dynamic_file_single
+		&& a_rule->emit != zlog_rule_emit_dynamic_file_rotate) {
+		a_rule->fsync_period = 0;
+		a_rule->fsync_wait_level = 0;
+	}
+
+	if (async) {
+		a_rule->output = zlog_rule_output_async;
+	} else if (write_buffer && a_rule->emitv) {
+		/* writes to pipes are atomic up to PIPE_BUF */
+		if (a_rule->emitv != zlog_rule_emitv_static_file_single && write_buffer > PIPE_BUF) {
+			write_buffer = PIPE_BUF;
+		}
+		a_rule->write_buffer = write_buffer;
+		a_rule->write_flush_level = zlog_level_list_atoi(levels, "ERROR");
+		/* msgs waiting to be on disk must be written first */
+		if (a_rule->fsync_wait_level && a_rule->fsync_wait_level < a_rule->write_flush_level) {
+			a_rule->write_flush_level = a_rule->fsync_wait_level;
+		}
+		a_rule->output = zlog_rule_output_buffered;
+	} else if (a_rule->emitv) {
+		a_rule->output = zlog_rule_output_gather;
+	} else {
+		if (write_buffer) {
+			zc_warn("write buffer does not cover rule[%s], rotating or dynamic files, "
+				"syslog and records are written msg by msg", selector);
+		}
+		a_rule->output = zlog_rule_output_direct;
+	}
+
+	if (a_rule->fsync_period || a_rule->fsync_wait_level) {
+		a_rule->sync_output = a_rule->output;
+		a_rule->output = zlog_rule_output_sync;
+	}
+
 	//zlog_rule_profile(a_rule, ZC_DEBUG);
 	return a_rule;
 err:
@@ -948,6 +1569,12 @@ void zlog_rule_del(zlog_rule_t * a_rule)
 		zc_arraylist_del(a_rule->dynamic_specs);
 		a_rule->dynamic_specs = NULL;
 	}
+	zlog_syncer_remove(&a_rule->sync_file);
+	/* the rule of the other conf keeps writing it */
+	if (a_rule->file_shared) {
+		a_rule->static_fd = 0;
+		a_rule->pipe_fp = NULL;
+	}
 	if (a_rule->static_fd) {
 		if (close(a_rule->static_fd)) {
 			zc_error("close fail, maybe cause by write, errno[%d]", errno);
@@ -962,42 +1589,30 @@ void zlog_rule_del(zlog_rule_t * a_rule)
 		zc_arraylist_del(a_rule->archive_specs);
 		a_rule->archive_specs = NULL;
 	}
+	if (a_rule->binary) {
+		zlog_binary_del(a_rule->binary);
+		a_rule->binary = NULL;
+	}
 	free(a_rule);
 	zc_debug("zlog_rule_del[%p]", a_rule);
 	return;
 }
 
 /*******************************************************************************/
-int zlog_rule_output(zlog_rule_t * a_rule, zlog_thread_t * a_thread)
+int zlog_rule_uring_fd(zlog_rule_t * a_rule, volatile int **dirty)
 {
-	switch (a_rule->compare_char) {
-	case '*' :
-		return a_rule->output(a_rule, a_thread);
-		break;
-	case '.' :
-		if (a_thread->event->level >= a_rule->level) {
-			return a_rule->output(a_rule, a_thread);
-		} else {
-			return 0;
-		}
-		break;
-	case '=' :
-		if (a_thread->event->level == a_rule->level) {
-			return a_rule->output(a_rule, a_thread);
-		} else {
-			return 0;
-		}
-		break;
-	case '!' :
-		if (a_thread->event->level != a_rule->level) {
-			return a_rule->output(a_rule, a_thread);
-		} else {
-			return 0;
-		}
-		break;
+	if (a_rule->emitv != zlog_rule_emitv_static_file_single) return -1;
+
+	if (zlog_rule_reopen_static_file(a_rule)) {
+		zc_error("zlog_rule_reopen_static_file fail");
+		return -1;
 	}
 
-	return 0;
+	/* marked when the write is done, a round between would miss it */
+	*dirty = &a_rule->sync_file.dirty;
+
+	/* static_fd is replaced in place by reopen, the number stays valid */
+	return a_rule->static_fd;
 }
 
 /*******************************************************************************/
@@ -1012,6 +1627,27 @@ int zlog_rule_is_wastebin(zlog_rule_t * a_rule)
 	return 0;
 }
 
+/*******************************************************************************/
+/* whether msg or path of the rule reads mdc */
+int zlog_rule_use_mdc(zlog_rule_t * a_rule)
+{
+	int i;
+	zlog_spec_t *a_spec;
+
+	if (!a_rule->binary && a_rule->format && zlog_format_use_mdc(a_rule->format)) return 1;
+	if (a_rule->dynamic_specs) {
+		zc_arraylist_foreach(a_rule->dynamic_specs, i, a_spec) {
+			if (zlog_spec_use_mdc(a_spec)) return 1;
+		}
+	}
+	if (a_rule->archive_specs) {
+		zc_arraylist_foreach(a_rule->archive_specs, i, a_spec) {
+			if (zlog_spec_use_mdc(a_spec)) return 1;
+		}
+	}
+	return 0;
+}
+
 /*******************************************************************************/
 int zlog_rule_match_category(zlog_rule_t * a_rule, char *category)
 {
@@ -1049,14 +1685,15 @@ int zlog_rule_set_record(zlog_rule_t * a_rule, zc_hashtable_t *records)
 {
 	zlog_record_t *a_record;
 
-	if (a_rule->output != zlog_rule_output_static_record 
-	&&  a_rule->output != zlog_rule_output_dynamic_record) {
+	if (a_rule->emit != zlog_rule_emit_static_record
+	&&  a_rule->emit != zlog_rule_emit_dynamic_record) {
 		return 0; /* fliter, may go through not record rule */
 	}
 
 	a_record = zc_hashtable_get(records, a_rule->record_name);
 	if (a_record) {
-		a_rule->record_func = a_record->output;
+		/* loggers call it without lock */
+		zc_store_release(&a_rule->record_func, a_record->output);
 	}
 	return 0;
 }
@@ -16,16 +16,20 @@
 
 #include <stdio.h>
 #include <pthread.h>
+#include <sys/uio.h>
 
 #include "zc_defs.h"
 #include "format.h"
 #include "thread.h"
 #include "rotater.h"
 #include "record.h"
+#include "syncer.h"
+#include "binary.h"
 
 typedef struct zlog_rule_s zlog_rule_t;
 
 typedef int (*zlog_rule_output_fn) (zlog_rule_t * a_rule, zlog_thread_t * a_thread);
+typedef int (*zlog_rule_emitv_fn) (zlog_rule_t * a_rule, struct iovec *iov, int iovcnt);
 
 struct zlog_rule_s {
 	char category[MAXLEN_CFG_LINE + 1];
@@ -44,30 +48,54 @@ struct zlog_rule_s {
 
 	char file_path[MAXLEN_PATH + 1];
 	zc_arraylist_t *dynamic_specs;
+	int path_const_count; /* leading dynamic_specs of the same path in a category */
+	int path_time_unit;   /* smallest time unit in them, 0 if none */
 	int static_fd;
 	dev_t static_dev;
 	ino_t static_ino;
+	time_t static_check_time; /* of file_path, by rotate rule */
+	long static_size; /* counted by writes, synced by fstat() now and then */
 
 	long archive_max_size;
 	int archive_max_count;
+	/* rotate by time, like 6hour, on boundaries of local time as cron does */
+	int archive_period_unit;  /* ZLOG_SPEC_TIME_xxx, 0 if by size */
+	int archive_period;       /* 6 */
+	time_t archive_time;      /* start of this period, files older go to archives */
+	time_t archive_next_time; /* end of it, archive_time moves on after */
+	time_t static_archive_time; /* archive_time file_path is checked with */
 	char archive_path[MAXLEN_PATH + 1];
 	zc_arraylist_t *archive_specs;
 
 	FILE *pipe_fp;
 	int pipe_fd;
+	/* static_fd or pipe_fp is shared with a rule of the other conf at reload,
+	 * the conf deleted leaves it open, see zlog_conf_del_from() */
+	int file_shared;
 
-	size_t fsync_period;
-	size_t fsync_count;
+	zlog_syncer_file_t sync_file; /* of static_fd */
+	size_t fsync_period; /* msgs of a thread between syncs */
+	int fsync_wait_level; /* callers wait for msgs on disk, 0 if not */
+
+	size_t write_buffer; /* msgs are gathered in wbuf of thread if not 0 */
+	int write_flush_level; /* ERROR, written at once from it */
 
 	zc_arraylist_t *levels;
 	int syslog_facility;
 
 	zlog_format_t *format;
 	zlog_rule_output_fn output;
+	zlog_rule_output_fn sync_output; /* wrapped by output, if synced */
+	/* write out path_buf and msg_buf made by output, in caller or async writer */
+	zlog_rule_output_fn emit;
+	/* batch write of many msgs, or of one msg in pieces, NULL if output not support */
+	zlog_rule_emitv_fn emitv;
+
+	zlog_binary_t *binary;
 
 	char record_name[MAXLEN_PATH + 1];
 	char record_path[MAXLEN_PATH + 1];
-	zlog_record_fn record_func;
+	zlog_record_fn record_func; /* published by zc_store_release, rules are live */
 };
 
 zlog_rule_t *zlog_rule_new(char * line,
@@ -76,13 +104,21 @@ zlog_rule_t *zlog_rule_new(char * line,
 		zc_arraylist_t * formats,
 		unsigned int file_perms,
 		size_t fsync_period,
-		int * time_cache_count);
+		int fsync_wait_level,
+		int async,
+		size_t write_buffer,
+		int * time_cache_count,
+		zc_arraylist_t * from_rules);
 
 void zlog_rule_del(zlog_rule_t * a_rule);
 void zlog_rule_profile(zlog_rule_t * a_rule, int flag);
 int zlog_rule_match_category(zlog_rule_t * a_rule, char *category);
 int zlog_rule_is_wastebin(zlog_rule_t * a_rule);
+int zlog_rule_use_mdc(zlog_rule_t * a_rule);
 int zlog_rule_set_record(zlog_rule_t * a_rule, zc_hashtable_t *records);
-int zlog_rule_output(zlog_rule_t * a_rule, zlog_thread_t * a_thread);
+
+/* fd to write msgs of a_rule by io_uring, -1 if it is not a single static file,
+ * *dirty is to be set when the write is done */
+int zlog_rule_uring_fd(zlog_rule_t * a_rule, volatile int **dirty);
 
 #endif
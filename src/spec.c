@@ -21,6 +21,7 @@
 #include "conf.h"
 #include "spec.h"
 #include "level_list.h"
+#include "args.h"
 #include "zc_defs.h"
 
 
@@ -148,9 +149,13 @@ static int zlog_spec_write_srcfile(zlog_spec_t * a_spec, zlog_thread_t * a_threa
 
 static int zlog_spec_write_srcfile_neat(zlog_spec_t * a_spec, zlog_thread_t * a_thread, zlog_buf_t * a_buf)
 {
-	char *p;
+	const char *p;
 
-	if ((p = strrchr(a_thread->event->file, '/')) != NULL) {
+	if (a_thread->event->file_base) {
+		p = a_thread->event->file_base;
+		return zlog_buf_append(a_buf, p,
+			a_thread->event->file + a_thread->event->file_len - p);
+	} else if ((p = strrchr(a_thread->event->file, '/')) != NULL) {
 		return zlog_buf_append(a_buf, p + 1,
 			(char*)a_thread->event->file + a_thread->event->file_len - p - 1);
 	} else {
@@ -230,7 +235,7 @@ static int zlog_spec_write_level_lowercase(zlog_spec_t * a_spec, zlog_thread_t *
 {
 	zlog_level_t *a_level;
 
-	a_level = zlog_level_list_get(zlog_env_conf->levels, a_thread->event->level);
+	a_level = zlog_level_list_get(a_thread->conf->levels, a_thread->event->level);
 	return zlog_buf_append(a_buf, a_level->str_lowercase, a_level->str_len);
 }
 
@@ -238,7 +243,7 @@ static int zlog_spec_write_level_uppercase(zlog_spec_t * a_spec, zlog_thread_t *
 {
 	zlog_level_t *a_level;
 
-	a_level = zlog_level_list_get(zlog_env_conf->levels, a_thread->event->level);
+	a_level = zlog_level_list_get(a_thread->conf->levels, a_thread->event->level);
 	return zlog_buf_append(a_buf, a_level->str_uppercase, a_level->str_len);
 }
 
@@ -252,6 +257,11 @@ static int zlog_spec_write_usrmsg(zlog_spec_t * a_spec, zlog_thread_t * a_thread
 		} else {
 			return zlog_buf_append(a_buf, "format=(null)", sizeof("format=(null)")-1);
 		}
+	} else if (a_thread->event->generate_cmd == ZLOG_ARGS) {
+		return zlog_args_render(a_buf,
+				a_thread->event->str_format,
+				a_thread->event->args_blob,
+				a_thread->event->args_blob_len);
 	} else if (a_thread->event->generate_cmd == ZLOG_HEX) {
 		int rc;
 		long line_offset;
@@ -338,6 +348,35 @@ static int zlog_spec_write_usrmsg(zlog_spec_t * a_spec, zlog_thread_t * a_thread
 	return 0;
 }
 
+/*******************************************************************************/
+/* the largest unit all conversions of strftime format keep the same in,
+ * unknown ones change every second */
+static int zlog_spec_parse_time_unit(const char *time_fmt)
+{
+	const char *p;
+	int unit = ZLOG_SPEC_TIME_DAY;
+
+	for (p = strchr(time_fmt, '%'); p; p = strchr(p, '%')) {
+		p++;
+		while (*p && strchr("_-0^#", *p)) p++; /* flags */
+		while (isdigit((unsigned char)*p)) p++; /* width */
+		if (*p == 'E' || *p == 'O') p++;
+		if (!*p) break;
+
+		if (strchr("aAbBCdDeFgGhjmuUVwWxyY%nt", *p)) {
+			/* day */
+		} else if (strchr("HIklpP", *p)) {
+			if (unit > ZLOG_SPEC_TIME_HOUR) unit = ZLOG_SPEC_TIME_HOUR;
+		} else if (strchr("MR", *p)) {
+			if (unit > ZLOG_SPEC_TIME_MIN) unit = ZLOG_SPEC_TIME_MIN;
+		} else {
+			return ZLOG_SPEC_TIME_SEC;
+		}
+		p++;
+	}
+	return unit;
+}
+
 /*******************************************************************************/
 /* implementation of gen function */
 
@@ -523,6 +562,7 @@ zlog_spec_t *zlog_spec_new(char *pattern_start, char **pattern_next, int *time_c
 			a_spec->time_cache_index = *time_cache_count;
 			(*time_cache_count)++;
 			a_spec->write_buf = zlog_spec_write_time;
+			a_spec->time_unit = zlog_spec_parse_time_unit(a_spec->time_fmt);
 
 			*pattern_next = p;
 			a_spec->len = p - a_spec->str;
@@ -570,12 +610,14 @@ zlog_spec_t *zlog_spec_new(char *pattern_start, char **pattern_next, int *time_c
 		switch (*p) {
 		case 'c':
 			a_spec->write_buf = zlog_spec_write_category;
+			a_spec->per_category = 1;
 			break;
 		case 'D':
 			strcpy(a_spec->time_fmt, ZLOG_DEFAULT_TIME_FMT);
 			a_spec->time_cache_index = *time_cache_count;
 			(*time_cache_count)++;
 			a_spec->write_buf = zlog_spec_write_time;
+			a_spec->time_unit = ZLOG_SPEC_TIME_SEC;
 			break;
 		case 'F':
 			a_spec->write_buf = zlog_spec_write_srcfile;
@@ -585,12 +627,14 @@ zlog_spec_t *zlog_spec_new(char *pattern_start, char **pattern_next, int *time_c
 			break;
 		case 'H':
 			a_spec->write_buf = zlog_spec_write_hostname;
+			a_spec->per_category = 1;
 			break;
 		case 'L':
 			a_spec->write_buf = zlog_spec_write_srcline;
 			break;
 		case 'm':
 			a_spec->write_buf = zlog_spec_write_usrmsg;
+			a_spec->usrmsg = (a_spec->gen_msg == zlog_spec_gen_msg_direct);
 			break;
 		case 'n':
 			a_spec->write_buf = zlog_spec_write_newline;
@@ -615,6 +659,7 @@ zlog_spec_t *zlog_spec_new(char *pattern_start, char **pattern_next, int *time_c
 			break;
 		case '%':
 			a_spec->write_buf = zlog_spec_write_percent;
+			a_spec->per_category = 1;
 			break;
 		default:
 			zc_error("str[%s] in wrong format, p[%c]", a_spec->str, *p);
@@ -631,6 +676,7 @@ zlog_spec_t *zlog_spec_new(char *pattern_start, char **pattern_next, int *time_c
 			*pattern_next = p + a_spec->len;
 		}
 		a_spec->write_buf = zlog_spec_write_str;
+		a_spec->per_category = 1;
 		a_spec->gen_msg = zlog_spec_gen_msg_direct;
 		a_spec->gen_path = zlog_spec_gen_path_direct;
 		a_spec->gen_archive_path = zlog_spec_gen_archive_path_direct;
@@ -15,6 +15,12 @@
 
 typedef struct zlog_spec_s zlog_spec_t;
 
+/* time_unit, the output of time spec is the same within it, local time */
+#define ZLOG_SPEC_TIME_SEC 1
+#define ZLOG_SPEC_TIME_MIN 2
+#define ZLOG_SPEC_TIME_HOUR 3
+#define ZLOG_SPEC_TIME_DAY 4
+
 /* write buf, according to each spec's Conversion Characters */
 typedef int (*zlog_spec_write_fn) (zlog_spec_t * a_spec,
 			 	zlog_thread_t * a_thread,
@@ -37,6 +43,10 @@ struct zlog_spec_s {
 	size_t max_width;
 	size_t min_width;
 
+	int per_category; /* writes the same in all events of a category */
+	int time_unit;    /* of time spec, ZLOG_SPEC_TIME_xxx the output changes in */
+	int usrmsg;       /* a plain %m, may be referenced in place, see format.h */
+
 	zlog_spec_write_fn write_buf;
 	zlog_spec_gen_fn gen_msg;
 	zlog_spec_gen_fn gen_path;
@@ -47,6 +57,9 @@ zlog_spec_t *zlog_spec_new(char *pattern_start, char **pattern_end, int * time_c
 void zlog_spec_del(zlog_spec_t * a_spec);
 void zlog_spec_profile(zlog_spec_t * a_spec, int flag);
 
+#define zlog_spec_use_mdc(a_spec) \
+	((a_spec)->mdc_key[0] != '\0')
+
 #define zlog_spec_gen_msg(a_spec, a_thread) \
 	a_spec->gen_msg(a_spec, a_thread)
 
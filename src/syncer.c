@@ -0,0 +1,287 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#include "fmacros.h"
+
+#include <pthread.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "zc_defs.h"
+#include "fd_cache.h"
+#include "syncer.h"
+
+/*******************************************************************************/
+/* static files, held while a round syncs them */
+static pthread_mutex_t zlog_syncer_list_mutex = PTHREAD_MUTEX_INITIALIZER;
+static zlog_syncer_file_t *zlog_syncer_files;
+
+/* rounds, a waiter wants the first round started after its writes */
+static pthread_mutex_t zlog_syncer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t zlog_syncer_wake_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t zlog_syncer_done_cond = PTHREAD_COND_INITIALIZER;
+static unsigned long zlog_syncer_started;
+static unsigned long zlog_syncer_done;
+static int zlog_syncer_requested;
+static long zlog_syncer_period; /* ms */
+static int zlog_syncer_running; /* thread exists, to be joined */
+static int zlog_syncer_stopping;
+static int zlog_syncer_on; /* a thread was started, files are synced at close and exit */
+static pthread_t zlog_syncer_tid;
+static pthread_once_t zlog_syncer_once = PTHREAD_ONCE_INIT;
+
+void zlog_syncer_profile(int flag)
+{
+	int count = 0;
+	zlog_syncer_file_t *a_file;
+
+	pthread_mutex_lock(&zlog_syncer_list_mutex);
+	for (a_file = zlog_syncer_files; a_file; a_file = a_file->next) count++;
+	pthread_mutex_unlock(&zlog_syncer_list_mutex);
+
+	pthread_mutex_lock(&zlog_syncer_mutex);
+	zc_profile(flag, "---syncer period[%ld], running[%d], rounds[%lu/%lu], files[%d]---",
+		zlog_syncer_period, zlog_syncer_running,
+		zlog_syncer_done, zlog_syncer_started, count);
+	pthread_mutex_unlock(&zlog_syncer_mutex);
+	return;
+}
+
+/*******************************************************************************/
+static void zlog_syncer_sync_all(void)
+{
+	zlog_syncer_file_t *a_file;
+
+	pthread_mutex_lock(&zlog_syncer_list_mutex);
+	for (a_file = zlog_syncer_files; a_file; a_file = a_file->next) {
+		if (!a_file->dirty) continue;
+		/* written after this, dirty again for next round */
+		a_file->dirty = 0;
+		zc_mb();
+		if (zlog_fsync(*a_file->fd)) {
+			zc_error("fsync[%d] fail, errno[%d]", *a_file->fd, errno);
+		}
+	}
+	pthread_mutex_unlock(&zlog_syncer_list_mutex);
+
+	zlog_fd_cache_sync();
+	return;
+}
+
+static void *zlog_syncer_run(void *arg)
+{
+	unsigned long round;
+	struct timeval now;
+	struct timespec deadline;
+
+	pthread_mutex_lock(&zlog_syncer_mutex);
+	while (1) {
+		if (!zlog_syncer_requested) {
+			if (zlog_syncer_stopping) break;
+			if (zlog_syncer_period) {
+				gettimeofday(&now, NULL);
+				deadline.tv_sec = now.tv_sec + zlog_syncer_period / 1000;
+				deadline.tv_nsec = now.tv_usec * 1000L + (zlog_syncer_period % 1000) * 1000000L;
+				if (deadline.tv_nsec >= 1000000000L) {
+					deadline.tv_sec++;
+					deadline.tv_nsec -= 1000000000L;
+				}
+				pthread_cond_timedwait(&zlog_syncer_wake_cond, &zlog_syncer_mutex, &deadline);
+			} else {
+				pthread_cond_wait(&zlog_syncer_wake_cond, &zlog_syncer_mutex);
+			}
+			/* woken to stop, a last round only if one is requested */
+			if (zlog_syncer_stopping) continue;
+		}
+
+		round = ++zlog_syncer_started;
+		zlog_syncer_requested = 0;
+		pthread_mutex_unlock(&zlog_syncer_mutex);
+
+		zlog_syncer_sync_all();
+
+		pthread_mutex_lock(&zlog_syncer_mutex);
+		zlog_syncer_done = round;
+		pthread_cond_broadcast(&zlog_syncer_done_cond);
+	}
+
+	/* a caller coming after starts a new one */
+	zlog_syncer_running = 0;
+	zlog_syncer_stopping = 0;
+	pthread_mutex_unlock(&zlog_syncer_mutex);
+	return NULL;
+}
+
+/* under zlog_syncer_mutex */
+static int zlog_syncer_start(void)
+{
+	int rc;
+
+	if (zlog_syncer_running) return 0;
+	rc = pthread_create(&zlog_syncer_tid, NULL, zlog_syncer_run, NULL);
+	if (rc) {
+		zc_error("pthread_create fail, rc[%d]", rc);
+		return -1;
+	}
+	zlog_syncer_running = 1;
+	zlog_syncer_on = 1;
+	return 0;
+}
+
+/*******************************************************************************/
+/* the child starts its own sync thread when it needs one */
+static void zlog_syncer_atfork_prepare(void)
+{
+	pthread_mutex_lock(&zlog_syncer_mutex);
+	pthread_mutex_lock(&zlog_syncer_list_mutex);
+}
+
+static void zlog_syncer_atfork_parent(void)
+{
+	pthread_mutex_unlock(&zlog_syncer_list_mutex);
+	pthread_mutex_unlock(&zlog_syncer_mutex);
+}
+
+static void zlog_syncer_atfork_child(void)
+{
+	zlog_syncer_running = 0;
+	zlog_syncer_stopping = 0;
+	zlog_syncer_requested = 0;
+	zlog_syncer_done = zlog_syncer_started;
+	pthread_mutex_init(&zlog_syncer_list_mutex, NULL);
+	pthread_mutex_init(&zlog_syncer_mutex, NULL);
+	pthread_cond_init(&zlog_syncer_wake_cond, NULL);
+	pthread_cond_init(&zlog_syncer_done_cond, NULL);
+}
+
+/* msgs of the last period are on disk at exit, if syncing is on */
+static void zlog_syncer_atexit(void)
+{
+	if (zlog_syncer_on) zlog_syncer_sync_all();
+	return;
+}
+
+static void zlog_syncer_init_once(void)
+{
+	int rc;
+
+	rc = pthread_atfork(zlog_syncer_atfork_prepare,
+			zlog_syncer_atfork_parent, zlog_syncer_atfork_child);
+	if (rc) zc_error("pthread_atfork fail, rc[%d]", rc);
+
+	rc = atexit(zlog_syncer_atexit);
+	if (rc) zc_error("atexit fail, rc[%d]", rc);
+}
+
+/*******************************************************************************/
+void zlog_syncer_add(zlog_syncer_file_t * a_file, int *fd)
+{
+	pthread_once(&zlog_syncer_once, zlog_syncer_init_once);
+
+	a_file->fd = fd;
+	a_file->dirty = 0;
+
+	pthread_mutex_lock(&zlog_syncer_list_mutex);
+	a_file->prev = NULL;
+	a_file->next = zlog_syncer_files;
+	if (zlog_syncer_files) zlog_syncer_files->prev = a_file;
+	zlog_syncer_files = a_file;
+	a_file->linked = 1;
+	pthread_mutex_unlock(&zlog_syncer_list_mutex);
+	return;
+}
+
+void zlog_syncer_remove(zlog_syncer_file_t * a_file)
+{
+	if (!a_file->linked) return;
+
+	pthread_mutex_lock(&zlog_syncer_list_mutex);
+	if (a_file->prev) a_file->prev->next = a_file->next;
+	else zlog_syncer_files = a_file->next;
+	if (a_file->next) a_file->next->prev = a_file->prev;
+	a_file->prev = a_file->next = NULL;
+	a_file->linked = 0;
+	pthread_mutex_unlock(&zlog_syncer_list_mutex);
+
+	/* the fd is closed right after, keep what is written */
+	if (a_file->dirty && zlog_syncer_on && zlog_fsync(*a_file->fd)) {
+		zc_error("fsync[%d] fail, errno[%d]", *a_file->fd, errno);
+	}
+	return;
+}
+
+void zlog_syncer_request(void)
+{
+	pthread_once(&zlog_syncer_once, zlog_syncer_init_once);
+
+	pthread_mutex_lock(&zlog_syncer_mutex);
+	if (zlog_syncer_start() == 0) {
+		zlog_syncer_requested = 1;
+		pthread_cond_signal(&zlog_syncer_wake_cond);
+	}
+	pthread_mutex_unlock(&zlog_syncer_mutex);
+	return;
+}
+
+void zlog_syncer_wait(void)
+{
+	unsigned long round;
+
+	pthread_once(&zlog_syncer_once, zlog_syncer_init_once);
+
+	pthread_mutex_lock(&zlog_syncer_mutex);
+	if (zlog_syncer_start()) {
+		/* no thread, sync in the caller */
+		pthread_mutex_unlock(&zlog_syncer_mutex);
+		zlog_syncer_sync_all();
+		return;
+	}
+
+	/* the round running now may have passed our files */
+	round = zlog_syncer_started + 1;
+	zlog_syncer_requested = 1;
+	pthread_cond_signal(&zlog_syncer_wake_cond);
+	while (zlog_syncer_done < round) {
+		pthread_cond_wait(&zlog_syncer_done_cond, &zlog_syncer_mutex);
+	}
+	pthread_mutex_unlock(&zlog_syncer_mutex);
+	return;
+}
+
+void zlog_syncer_set_period(long period)
+{
+	pthread_once(&zlog_syncer_once, zlog_syncer_init_once);
+
+	pthread_mutex_lock(&zlog_syncer_mutex);
+	zlog_syncer_period = period;
+	if (period) zlog_syncer_start();
+	pthread_cond_signal(&zlog_syncer_wake_cond);
+	pthread_mutex_unlock(&zlog_syncer_mutex);
+	return;
+}
+
+void zlog_syncer_stop(void)
+{
+	pthread_t tid;
+
+	pthread_mutex_lock(&zlog_syncer_mutex);
+	zlog_syncer_period = 0;
+	if (!zlog_syncer_running) {
+		pthread_mutex_unlock(&zlog_syncer_mutex);
+		return;
+	}
+	zlog_syncer_stopping = 1;
+	tid = zlog_syncer_tid;
+	pthread_cond_signal(&zlog_syncer_wake_cond);
+	pthread_mutex_unlock(&zlog_syncer_mutex);
+
+	pthread_join(tid, NULL);
+	return;
+}
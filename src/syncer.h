@@ -0,0 +1,56 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#ifndef __zlog_syncer_h
+#define __zlog_syncer_h
+
+/* durability of log files, "fsync period" and "fsync wait".
+ * writers only mark files dirty, the sync thread fdatasync()s dirty files
+ * in rounds, no caller pays for a sync it did not ask for. a round runs
+ *	every period, "fsync period = 1s"
+ *	when a thread has written so many msgs, "fsync period = 10K"
+ *	when a caller waits for its msgs to be on disk, "fsync wait = ERROR"
+ * callers waiting at the same time share one round, as group commit.
+ */
+
+#include "zc_defs.h"
+
+/* a static file of a rule, dynamic files are marked in fd_cache */
+typedef struct zlog_syncer_file_s {
+	int *fd; /* replaced in place by reopen, the number stays valid */
+	volatile int dirty;
+	int linked;
+
+	struct zlog_syncer_file_s *prev;
+	struct zlog_syncer_file_s *next;
+} zlog_syncer_file_t;
+
+void zlog_syncer_add(zlog_syncer_file_t * a_file, int *fd);
+/* waits for the round syncing it, before the fd is closed */
+void zlog_syncer_remove(zlog_syncer_file_t * a_file);
+
+/* after each write, only a read when it is dirty already */
+#define zlog_syncer_dirty(a_file) do { \
+	if (!(a_file)->dirty) (a_file)->dirty = 1; \
+} while (0)
+
+/* run a round soon, without waiting */
+void zlog_syncer_request(void);
+
+/* run a round and wait till it is done, files written before are on disk */
+void zlog_syncer_wait(void);
+
+/* ms between rounds, 0 runs rounds only on request */
+void zlog_syncer_set_period(long period);
+
+/* period to 0, the thread ends after the round requested, and is joined */
+void zlog_syncer_stop(void);
+
+void zlog_syncer_profile(int flag);
+
+#endif
@@ -7,6 +7,7 @@
  */
 
 #include <pthread.h>
+#include <sched.h>
 #include <errno.h>
 
 #include "zc_defs.h"
@@ -14,6 +15,9 @@
 #include "buf.h"
 #include "thread.h"
 #include "mdc.h"
+#include "async.h"
+#include "args.h"
+#include "wbuf.h"
 
 void zlog_thread_profile(zlog_thread_t * a_thread, int flag)
 {
@@ -37,10 +41,112 @@ void zlog_thread_profile(zlog_thread_t * a_thread, int flag)
 	zlog_buf_profile(a_thread->msg_buf, flag);
 	return;
 }
+/*******************************************************************************/
+/* all live threads, scanned by zlog_thread_synchronize() */
+static pthread_mutex_t zlog_thread_list_mutex = PTHREAD_MUTEX_INITIALIZER;
+static zlog_thread_t *zlog_thread_list;
+volatile unsigned long zlog_thread_epoch = 1;
+
+static void zlog_thread_link(zlog_thread_t * a_thread)
+{
+	pthread_mutex_lock(&zlog_thread_list_mutex);
+	a_thread->prev = NULL;
+	a_thread->next = zlog_thread_list;
+	if (zlog_thread_list) zlog_thread_list->prev = a_thread;
+	zlog_thread_list = a_thread;
+	pthread_mutex_unlock(&zlog_thread_list_mutex);
+	return;
+}
+
+static void zlog_thread_unlink(zlog_thread_t * a_thread)
+{
+	pthread_mutex_lock(&zlog_thread_list_mutex);
+	if (a_thread->prev) {
+		a_thread->prev->next = a_thread->next;
+	} else if (zlog_thread_list == a_thread) {
+		zlog_thread_list = a_thread->next;
+	} else {
+		/* never linked */
+		pthread_mutex_unlock(&zlog_thread_list_mutex);
+		return;
+	}
+	if (a_thread->next) a_thread->next->prev = a_thread->prev;
+	a_thread->prev = a_thread->next = NULL;
+	pthread_mutex_unlock(&zlog_thread_list_mutex);
+	return;
+}
+
+/* wait until every thread inside zlog has left the epoch it was in,
+ * so anything unpublished before this call can be freed after it */
+void zlog_thread_synchronize(void)
+{
+	unsigned long target;
+	unsigned long epoch;
+	zlog_thread_t *a_thread;
+
+	target = __sync_add_and_fetch(&zlog_thread_epoch, 1);
+	zc_mb();
+
+again:
+	pthread_mutex_lock(&zlog_thread_list_mutex);
+	for (a_thread = zlog_thread_list; a_thread; a_thread = a_thread->next) {
+		epoch = zc_load_acquire(&a_thread->epoch);
+		if (epoch && epoch < target) {
+			pthread_mutex_unlock(&zlog_thread_list_mutex);
+			sched_yield();
+			goto again;
+		}
+	}
+	pthread_mutex_unlock(&zlog_thread_list_mutex);
+	return;
+}
+
+static void zlog_thread_atfork_prepare(void)
+{
+	pthread_mutex_lock(&zlog_thread_list_mutex);
+}
+
+static void zlog_thread_atfork_parent(void)
+{
+	pthread_mutex_unlock(&zlog_thread_list_mutex);
+}
+
+static void zlog_thread_atfork_child(void)
+{
+	zlog_thread_t *a_thread;
+
+	/* other threads are gone in the child, never wait for them */
+	for (a_thread = zlog_thread_list; a_thread; a_thread = a_thread->next) {
+		a_thread->epoch = 0;
+	}
+	pthread_mutex_init(&zlog_thread_list_mutex, NULL);
+}
+
+int zlog_thread_atfork(void)
+{
+	int rc;
+
+	rc = pthread_atfork(zlog_thread_atfork_prepare,
+			zlog_thread_atfork_parent, zlog_thread_atfork_child);
+	if (rc) {
+		zc_error("pthread_atfork fail, rc[%d]", rc);
+		return -1;
+	}
+	return 0;
+}
+
 /*******************************************************************************/
 void zlog_thread_del(zlog_thread_t * a_thread)
 {
+	int i;
+
 	zc_assert(a_thread,);
+	zlog_thread_unlink(a_thread);
+	zlog_wbuf_release(a_thread);
+	if (a_thread->async_ring)
+		zlog_async_ring_release(a_thread->async_ring);
+	if (a_thread->args)
+		zlog_args_del(a_thread->args);
 	if (a_thread->mdc)
 		zlog_mdc_del(a_thread->mdc);
 	if (a_thread->event)
@@ -53,8 +159,10 @@ void zlog_thread_del(zlog_thread_t * a_thread)
 		zlog_buf_del(a_thread->archive_path_buf);
 	if (a_thread->pre_msg_buf)
 		zlog_buf_del(a_thread->pre_msg_buf);
-	if (a_thread->msg_buf)
-		zlog_buf_del(a_thread->msg_buf);
+	for (i = 0; i < ZLOG_THREAD_MSG_BUFS; i++) {
+		if (a_thread->msg_bufs[i])
+			zlog_buf_del(a_thread->msg_bufs[i]);
+	}
 
 	free(a_thread);
 	zc_debug("zlog_thread_del[%p]", a_thread);
@@ -109,12 +217,14 @@ zlog_thread_t *zlog_thread_new(int init_version, size_t buf_size_min, size_t buf
 		goto err;
 	}
 
-	a_thread->msg_buf = zlog_buf_new(buf_size_min, buf_size_max, "..." FILE_NEWLINE);
-	if (!a_thread->msg_buf) {
+	a_thread->msg_bufs[0] = zlog_buf_new(buf_size_min, buf_size_max, "..." FILE_NEWLINE);
+	if (!a_thread->msg_bufs[0]) {
 		zc_error("zlog_buf_new fail");
 		goto err;
 	}
+	a_thread->msg_buf = a_thread->msg_bufs[0];
 
+	zlog_thread_link(a_thread);
 
 	//zlog_thread_profile(a_thread, ZC_DEBUG);
 	return a_thread;
@@ -124,8 +234,37 @@ err:
 }
 
 /*******************************************************************************/
+int zlog_thread_msg_buf(zlog_thread_t * a_thread, const struct zlog_format_s * a_format)
+{
+	int i;
+
+	for (i = 0; i < a_thread->msg_count; i++) {
+		if (a_format && a_thread->msg_formats[i] == a_format) {
+			a_thread->msg_buf = a_thread->msg_bufs[i];
+			return 1;
+		}
+	}
+
+	/* reuse the last one when all are taken */
+	i = a_thread->msg_count < ZLOG_THREAD_MSG_BUFS ? a_thread->msg_count++ : ZLOG_THREAD_MSG_BUFS - 1;
+	if (!a_thread->msg_bufs[i]) {
+		a_thread->msg_bufs[i] = zlog_buf_new(a_thread->msg_bufs[0]->size_min,
+			a_thread->msg_bufs[0]->size_max, "..." FILE_NEWLINE);
+		if (!a_thread->msg_bufs[i]) {
+			zc_error("zlog_buf_new fail");
+			a_thread->msg_count = i;
+			return -1;
+		}
+	}
+	a_thread->msg_formats[i] = NULL;
+	a_thread->msg_slot = i;
+	a_thread->msg_buf = a_thread->msg_bufs[i];
+	return 0;
+}
+
 int zlog_thread_rebuild_msg_buf(zlog_thread_t * a_thread, size_t buf_size_min, size_t buf_size_max)
 {
+	int i;
 	zlog_buf_t *pre_msg_buf_new = NULL;
 	zlog_buf_t *msg_buf_new = NULL;
 	zc_assert(a_thread, -1);
@@ -151,8 +290,15 @@ int zlog_thread_rebuild_msg_buf(zlog_thread_t * a_thread, size_t buf_size_min, s
 	zlog_buf_del(a_thread->pre_msg_buf);
 	a_thread->pre_msg_buf = pre_msg_buf_new;
 
-	zlog_buf_del(a_thread->msg_buf);
+	for (i = 0; i < ZLOG_THREAD_MSG_BUFS; i++) {
+		if (a_thread->msg_bufs[i]) {
+			zlog_buf_del(a_thread->msg_bufs[i]);
+			a_thread->msg_bufs[i] = NULL;
+		}
+	}
+	a_thread->msg_bufs[0] = msg_buf_new;
 	a_thread->msg_buf = msg_buf_new;
+	a_thread->msg_count = 0;
 
 	return 0;
 err:
@@ -164,8 +310,15 @@ err:
 int zlog_thread_rebuild_event(zlog_thread_t * a_thread, int time_cache_count)
 {
 	zlog_event_t *event_new = NULL;
+	int i;
 	zc_assert(a_thread, -1);
 
+	/* same count, but an index may be of another time format now */
+	if (a_thread->event->time_cache_count == time_cache_count) {
+		for (i = 0; i < time_cache_count; i++) a_thread->event->time_caches[i].sec = 0;
+		return 0;
+	}
+
 	event_new = zlog_event_new(time_cache_count);
 	if (!event_new) {
 		zc_error("zlog_event_new fail");
@@ -14,8 +14,13 @@
 #include "buf.h"
 #include "mdc.h"
 
-typedef struct {
+#define ZLOG_THREAD_MSG_BUFS 4
+#define ZLOG_THREAD_WBUFS 8
+
+typedef struct zlog_thread_s {
 	int init_version;
+	/* of the snapshot entered, valid in epoch */
+	const struct zlog_conf_s *conf;
 	zlog_mdc_t *mdc;
 	zlog_event_t *event;
 
@@ -23,15 +28,76 @@ typedef struct {
 	zlog_buf_t *path_buf;
 	zlog_buf_t *archive_path_buf;
 	zlog_buf_t *pre_msg_buf;
-	zlog_buf_t *msg_buf;
+	zlog_buf_t *msg_buf; /* one of msg_bufs */
+
+	/* msgs made in this event, one for each format, rules of the same
+	 * format share it, see zlog_thread_msg_buf() */
+	zlog_buf_t *msg_bufs[ZLOG_THREAD_MSG_BUFS];
+	const struct zlog_format_s *msg_formats[ZLOG_THREAD_MSG_BUFS];
+	int msg_count;
+	int msg_slot;
+
+	/* output by zlog_category_output(), keeps the path of its rule */
+	struct zlog_category_call_s *call;
+
+	/* msgs of rules waiting to be written, see wbuf.h */
+	struct zlog_wbuf_s *wbufs[ZLOG_THREAD_WBUFS];
+
+	/* msgs written since the last sync request, see syncer.h */
+	size_t fsync_count;
+	/* msgs not yet added to the shared count of reload conf period */
+	size_t reload_conf_count;
+
+	struct zlog_async_ring_s *async_ring;
+	int async_writer;
+	struct zlog_args_s *args; /* for deferred format */
+
+	/* epoch the thread entered zlog in, 0 when outside */
+	volatile unsigned long epoch;
+	int epoch_nest;
+	struct zlog_thread_s *prev;
+	struct zlog_thread_s *next;
 } zlog_thread_t;
 
+extern volatile unsigned long zlog_thread_epoch;
+
+/* a logger holds the epoch while it reads the environment,
+ * writers wait in zlog_thread_synchronize() for it to leave */
+#define zlog_thread_epoch_enter(a_thread) do { \
+	if ((a_thread)->epoch_nest++ == 0) { \
+		(a_thread)->epoch = zc_load_acquire(&zlog_thread_epoch); \
+		zc_mb(); \
+	} \
+} while (0)
+
+#define zlog_thread_epoch_leave(a_thread) do { \
+	if (--(a_thread)->epoch_nest == 0) { \
+		zc_store_release(&(a_thread)->epoch, 0); \
+	} \
+} while (0)
+
+void zlog_thread_synchronize(void);
+int zlog_thread_atfork(void);
+
 
 void zlog_thread_del(zlog_thread_t * a_thread);
 void zlog_thread_profile(zlog_thread_t * a_thread, int flag);
 zlog_thread_t *zlog_thread_new(int init_version,
 			size_t buf_size_min, size_t buf_size_max, int time_cache_count);
 
+/* forget msgs of last event */
+#define zlog_thread_msg_restart(a_thread) ((a_thread)->msg_count = 0)
+
+/* point msg_buf to the msg of a_format in this event
+ * return 1	it is made already
+ * return 0	make it, then call zlog_thread_msg_done()
+ * return -1	fail
+ * a NULL a_format is never shared
+ */
+int zlog_thread_msg_buf(zlog_thread_t * a_thread, const struct zlog_format_s * a_format);
+#define zlog_thread_msg_done(a_thread, a_format) \
+	((a_thread)->msg_formats[(a_thread)->msg_slot] = (a_format))
+
 int zlog_thread_rebuild_msg_buf(zlog_thread_t * a_thread, size_t buf_size_min, size_t buf_size_max);
 int zlog_thread_rebuild_event(zlog_thread_t * a_thread, int time_cache_count);
 
@@ -0,0 +1,355 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#include "fmacros.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#ifdef ZLOG_HAVE_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#include "uring.h"
+#include "zc_defs.h"
+
+#ifdef ZLOG_HAVE_URING
+
+/*******************************************************************************/
+void zlog_uring_profile(zlog_uring_t * a_uring, int flag)
+{
+	zc_assert(a_uring,);
+	zc_profile(flag, "---uring[%p][%d],entries[%u],queued[%u],enters[%lu],ops[%lu]---",
+		a_uring, a_uring->fd, a_uring->sq_entries, a_uring->queued,
+		a_uring->enters, a_uring->ops);
+	return;
+}
+
+/*******************************************************************************/
+void zlog_uring_del(zlog_uring_t * a_uring)
+{
+	zc_assert(a_uring,);
+	if (a_uring->sqes && a_uring->sqes != MAP_FAILED) munmap(a_uring->sqes, a_uring->sqes_len);
+	if (a_uring->cq_ring && a_uring->cq_ring != MAP_FAILED && a_uring->cq_ring != a_uring->sq_ring) {
+		munmap(a_uring->cq_ring, a_uring->cq_ring_len);
+	}
+	if (a_uring->sq_ring && a_uring->sq_ring != MAP_FAILED) munmap(a_uring->sq_ring, a_uring->sq_ring_len);
+	if (a_uring->fd >= 0) close(a_uring->fd);
+	zc_debug("zlog_uring_del[%p]", a_uring);
+	free(a_uring);
+	return;
+}
+
+zlog_uring_t *zlog_uring_new(void)
+{
+	zlog_uring_t *a_uring;
+	struct io_uring_params params;
+	char *p;
+
+	a_uring = calloc(1, sizeof(zlog_uring_t));
+	if (!a_uring) {
+		zc_error("calloc fail, errno[%d]", errno);
+		return NULL;
+	}
+
+	memset(&params, 0x00, sizeof(params));
+	a_uring->fd = syscall(__NR_io_uring_setup, ZLOG_URING_ENTRIES, &params);
+	if (a_uring->fd < 0) {
+		/* ENOSYS, or EPERM if disabled by kernel.io_uring_disabled */
+		zc_warn("io_uring_setup fail, errno[%d], write as before", errno);
+		goto err;
+	}
+
+	/* writev at the end of O_APPEND files, by offset -1 */
+	if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+		zc_warn("io_uring is too old, write as before");
+		goto err;
+	}
+
+	a_uring->sq_ring_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	a_uring->cq_ring_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (a_uring->cq_ring_len > a_uring->sq_ring_len) a_uring->sq_ring_len = a_uring->cq_ring_len;
+		a_uring->cq_ring_len = a_uring->sq_ring_len;
+	}
+
+	a_uring->sq_ring = mmap(NULL, a_uring->sq_ring_len, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, a_uring->fd, IORING_OFF_SQ_RING);
+	if (a_uring->sq_ring == MAP_FAILED) {
+		zc_error("mmap sq ring fail, errno[%d]", errno);
+		goto err;
+	}
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		a_uring->cq_ring = a_uring->sq_ring;
+	} else {
+		a_uring->cq_ring = mmap(NULL, a_uring->cq_ring_len, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, a_uring->fd, IORING_OFF_CQ_RING);
+		if (a_uring->cq_ring == MAP_FAILED) {
+			zc_error("mmap cq ring fail, errno[%d]", errno);
+			goto err;
+		}
+	}
+
+	a_uring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+	a_uring->sqes = mmap(NULL, a_uring->sqes_len, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, a_uring->fd, IORING_OFF_SQES);
+	if (a_uring->sqes == MAP_FAILED) {
+		zc_error("mmap sqes fail, errno[%d]", errno);
+		goto err;
+	}
+
+	p = a_uring->sq_ring;
+	a_uring->sq_khead = (unsigned *)(p + params.sq_off.head);
+	a_uring->sq_ktail = (unsigned *)(p + params.sq_off.tail);
+	a_uring->sq_mask = *(unsigned *)(p + params.sq_off.ring_mask);
+	a_uring->sq_entries = *(unsigned *)(p + params.sq_off.ring_entries);
+	a_uring->sq_array = (unsigned *)(p + params.sq_off.array);
+	a_uring->sq_tail = *a_uring->sq_ktail;
+
+	p = a_uring->cq_ring;
+	a_uring->cq_khead = (unsigned *)(p + params.cq_off.head);
+	a_uring->cq_ktail = (unsigned *)(p + params.cq_off.tail);
+	a_uring->cq_mask = *(unsigned *)(p + params.cq_off.ring_mask);
+	a_uring->cqes = (struct io_uring_cqe *)(p + params.cq_off.cqes);
+
+	zlog_uring_profile(a_uring, ZC_DEBUG);
+	return a_uring;
+err:
+	zlog_uring_del(a_uring);
+	return NULL;
+}
+
+/*******************************************************************************/
+static struct io_uring_sqe *zlog_uring_get_sqe(zlog_uring_t * a_uring)
+{
+	unsigned idx;
+	struct io_uring_sqe *sqe;
+
+	idx = a_uring->sq_tail & a_uring->sq_mask;
+	a_uring->sq_array[idx] = idx;
+	a_uring->sq_tail++;
+
+	sqe = &a_uring->sqes[idx];
+	memset(sqe, 0x00, sizeof(*sqe));
+	return sqe;
+}
+
+int zlog_uring_writev(zlog_uring_t * a_uring, int fd,
+		const struct iovec *iov, int iovcnt, volatile int *done, void *arg)
+{
+	zlog_uring_write_t *a_write;
+
+	if (a_uring->queued + 1 > a_uring->sq_entries
+		|| a_uring->queued + 1 > ZLOG_URING_ENTRIES
+		|| a_uring->iov_used + iovcnt > ZLOG_URING_IOV_MAX) {
+		return 1;
+	}
+
+	memcpy(a_uring->iov + a_uring->iov_used, iov, iovcnt * sizeof(struct iovec));
+
+	a_write = &a_uring->writes[a_uring->queued++];
+	a_write->fd = fd;
+	a_write->iov_idx = a_uring->iov_used;
+	a_write->iovcnt = iovcnt;
+	a_write->state = ZLOG_URING_TODO;
+	a_write->done = done;
+	a_write->arg = arg;
+	a_uring->iov_used += iovcnt;
+	return 0;
+}
+
+/* sqes of writes to do, those of an fd in a chain in the order queued,
+ * a write punted to io-wq may be done after a later one of the same fd.
+ * order[] is the write of each sqe, return how many */
+static unsigned zlog_uring_prepare(zlog_uring_t * a_uring, unsigned *order)
+{
+	unsigned i;
+	unsigned j;
+	unsigned n = 0;
+	char picked[ZLOG_URING_ENTRIES];
+	zlog_uring_write_t *a_write;
+	struct io_uring_sqe *sqe;
+
+	memset(picked, 0x00, sizeof(picked));
+	for (i = 0; i < a_uring->queued; i++) {
+		if (picked[i] || a_uring->writes[i].state != ZLOG_URING_TODO) continue;
+
+		sqe = NULL;
+		for (j = i; j < a_uring->queued; j++) {
+			a_write = &a_uring->writes[j];
+			if (a_write->state != ZLOG_URING_TODO
+				|| a_write->fd != a_uring->writes[i].fd) continue;
+
+			if (sqe) sqe->flags |= IOSQE_IO_LINK;
+			sqe = zlog_uring_get_sqe(a_uring);
+			sqe->opcode = IORING_OP_WRITEV;
+			sqe->fd = a_write->fd;
+			sqe->off = (uint64_t)-1;
+			sqe->addr = (uint64_t)(uintptr_t)(a_uring->iov + a_write->iov_idx);
+			sqe->len = a_write->iovcnt;
+			sqe->user_data = j;
+
+			a_write->state = ZLOG_URING_SUBMITTED;
+			picked[j] = 1;
+			order[n++] = j;
+		}
+	}
+	return n;
+}
+
+/* move iov of a_write on by len written, return iov left */
+static int zlog_uring_consume(zlog_uring_t * a_uring, zlog_uring_write_t * a_write, size_t len)
+{
+	struct iovec *iov = a_uring->iov + a_write->iov_idx;
+
+	while (a_write->iovcnt && len >= iov->iov_len) {
+		len -= iov->iov_len;
+		iov++;
+		a_write->iov_idx++;
+		a_write->iovcnt--;
+	}
+	if (a_write->iovcnt) {
+		iov->iov_base = (char *)iov->iov_base + len;
+		iov->iov_len -= len;
+	}
+	return a_write->iovcnt;
+}
+
+static void zlog_uring_complete(zlog_uring_t * a_uring, struct io_uring_cqe *cqe)
+{
+	zlog_uring_write_t *a_write = &a_uring->writes[cqe->user_data];
+
+	if (cqe->res == -ECANCELED || cqe->res == -EAGAIN || cqe->res == -EINTR) {
+		/* one before it in the chain is short or failed, again in order */
+		a_write->state = ZLOG_URING_TODO;
+	} else if (cqe->res < 0) {
+		zc_error("io_uring writev[%d] fail, errno[%d]", a_write->fd, -cqe->res);
+		a_write->state = ZLOG_URING_DONE;
+	} else if (zlog_uring_consume(a_uring, a_write, cqe->res)) {
+		if (cqe->res) {
+			a_write->state = ZLOG_URING_TODO;
+		} else {
+			zc_error("io_uring writev[%d] writes nothing", a_write->fd);
+			a_write->state = ZLOG_URING_DONE;
+		}
+	} else {
+		a_write->state = ZLOG_URING_DONE;
+		if (a_write->done) *a_write->done = 1;
+	}
+	return;
+}
+
+/* submit n sqes prepared and reap them all */
+static int zlog_uring_enter(zlog_uring_t * a_uring, const unsigned *order, unsigned n)
+{
+	unsigned to_submit = n;
+	unsigned done = 0;
+	unsigned head;
+	unsigned i;
+	int nenter;
+
+	zc_store_release(a_uring->sq_ktail, a_uring->sq_tail);
+	while (done < n) {
+		nenter = syscall(__NR_io_uring_enter, a_uring->fd, to_submit,
+				n - done, IORING_ENTER_GETEVENTS, NULL, 0);
+		a_uring->enters++;
+		if (nenter < 0) {
+			if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+			zc_error("io_uring_enter fail, errno[%d]", errno);
+			/* sqes not taken by the kernel are left to the caller */
+			for (i = n - to_submit; i < n; i++) a_uring->writes[order[i]].state = ZLOG_URING_TODO;
+			return -1;
+		}
+		to_submit -= nenter;
+
+		head = *a_uring->cq_khead;
+		while (head != zc_load_acquire(a_uring->cq_ktail)) {
+			zlog_uring_complete(a_uring, &a_uring->cqes[head & a_uring->cq_mask]);
+			head++;
+			done++;
+		}
+		zc_store_release(a_uring->cq_khead, head);
+	}
+	a_uring->ops += n;
+	return 0;
+}
+
+int zlog_uring_submit(zlog_uring_t * a_uring)
+{
+	unsigned n;
+	unsigned order[ZLOG_URING_ENTRIES];
+
+	/* again till short and cancelled writes are all done */
+	while ((n = zlog_uring_prepare(a_uring, order))) {
+		if (zlog_uring_enter(a_uring, order, n)) return -1;
+	}
+
+	a_uring->queued = 0;
+	a_uring->iov_used = 0;
+	return 0;
+}
+
+void *zlog_uring_undone(zlog_uring_t * a_uring, unsigned *idx,
+		struct iovec **iov, int *iovcnt)
+{
+	zlog_uring_write_t *a_write;
+
+	for (; *idx < a_uring->queued; (*idx)++) {
+		a_write = &a_uring->writes[*idx];
+		if (a_write->state != ZLOG_URING_TODO) continue;
+		*iov = a_uring->iov + a_write->iov_idx;
+		*iovcnt = a_write->iovcnt;
+		(*idx)++;
+		return a_write->arg;
+	}
+	return NULL;
+}
+
+#else
+
+/*******************************************************************************/
+void zlog_uring_profile(zlog_uring_t * a_uring, int flag)
+{
+	return;
+}
+
+void zlog_uring_del(zlog_uring_t * a_uring)
+{
+	return;
+}
+
+zlog_uring_t *zlog_uring_new(void)
+{
+	zc_warn("built without io_uring, write as before");
+	return NULL;
+}
+
+int zlog_uring_writev(zlog_uring_t * a_uring, int fd,
+		const struct iovec *iov, int iovcnt, volatile int *done, void *arg)
+{
+	return 1;
+}
+
+int zlog_uring_submit(zlog_uring_t * a_uring)
+{
+	return -1;
+}
+
+void *zlog_uring_undone(zlog_uring_t * a_uring, unsigned *idx,
+		struct iovec **iov, int *iovcnt)
+{
+	return NULL;
+}
+
+#endif
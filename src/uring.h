@@ -0,0 +1,100 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#ifndef __zlog_uring_h
+#define __zlog_uring_h
+
+/* io_uring for async writers, "async io uring = true".
+ * a writer queues writev of its batches, then submits all and waits for
+ * them by one io_uring_enter(). files are synced by the sync thread.
+ * memory of iov must be kept till zlog_uring_submit().
+ * sqes are not ordered, so writes of an fd are linked in the order queued,
+ * and the rest of a short write is submitted again.
+ * built with ZLOG_HAVE_URING, zlog_uring_new() returns NULL if the kernel
+ * does not support it, and the writer writes by emitv as before.
+ */
+
+#include <sys/uio.h>
+
+#include "zc_defs.h"
+
+#define ZLOG_URING_ENTRIES 64
+#define ZLOG_URING_IOV_MAX 1024
+
+#define ZLOG_URING_TODO 0
+#define ZLOG_URING_SUBMITTED 1
+#define ZLOG_URING_DONE 2
+
+typedef struct {
+	int fd;
+	int iov_idx; /* moved on by short writes */
+	int iovcnt;
+	int state;
+	volatile int *done;
+	void *arg;
+} zlog_uring_write_t;
+
+typedef struct zlog_uring_s {
+	int fd;
+	unsigned queued;  /* sqes queued, not submitted */
+	unsigned sq_tail; /* local copy, published by submit */
+
+	void *sq_ring;
+	size_t sq_ring_len;
+	unsigned *sq_khead;
+	unsigned *sq_ktail;
+	unsigned sq_mask;
+	unsigned sq_entries;
+	unsigned *sq_array;
+	struct io_uring_sqe *sqes;
+	size_t sqes_len;
+
+	void *cq_ring; /* == sq_ring if single mmap */
+	size_t cq_ring_len;
+	unsigned *cq_khead;
+	unsigned *cq_ktail;
+	unsigned cq_mask;
+	struct io_uring_cqe *cqes;
+
+	/* iov of queued writev, sqes point to it */
+	struct iovec iov[ZLOG_URING_IOV_MAX];
+	int iov_used;
+	zlog_uring_write_t writes[ZLOG_URING_ENTRIES];
+
+	unsigned long enters;
+	unsigned long ops;
+} zlog_uring_t;
+
+zlog_uring_t *zlog_uring_new(void);
+void zlog_uring_del(zlog_uring_t * a_uring);
+
+/* *done is set to 1 when the write is done, if not NULL,
+ * arg is given back by zlog_uring_undone()
+ * return 0	queued
+ * return 1	no room, submit and queue again
+ */
+int zlog_uring_writev(zlog_uring_t * a_uring, int fd,
+		const struct iovec *iov, int iovcnt, volatile int *done, void *arg);
+
+/* return 0	all queued are done
+ * return -1	fail, write the undone ones, a_uring should not be used any more
+ */
+int zlog_uring_submit(zlog_uring_t * a_uring);
+
+/* after zlog_uring_submit() fails, the next write not taken by the kernel,
+ * from *idx on, in the order queued, its iov is what is left to write
+ * return arg of the write, NULL if no more
+ */
+void *zlog_uring_undone(zlog_uring_t * a_uring, unsigned *idx,
+		struct iovec **iov, int *iovcnt);
+
+#define zlog_uring_queued(a_uring) ((a_uring)->queued)
+
+void zlog_uring_profile(zlog_uring_t * a_uring, int flag);
+
+#endif
@@ -0,0 +1,312 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#include "fmacros.h"
+
+#include <pthread.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include "zc_defs.h"
+#include "watcher.h"
+
+/*******************************************************************************/
+static pthread_mutex_t zlog_watcher_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t zlog_watcher_once = PTHREAD_ONCE_INIT;
+static char zlog_watcher_path[MAXLEN_PATH + 1]; /* empty if not watching */
+static zlog_watcher_fn zlog_watcher_changed;
+static unsigned long zlog_watcher_seq; /* of path, the thread starts over when it changes */
+static int zlog_watcher_running; /* the thread is there, to be joined */
+static unsigned long zlog_watcher_gen; /* of the thread, others exit when they wake up */
+static pthread_t zlog_watcher_tid;
+static int zlog_watcher_inotify; /* the thread waits for inotify, or polls */
+static int zlog_watcher_fd = -1; /* opened when path is set, taken by the thread */
+static int zlog_watcher_pipe[2] = { -1, -1 }; /* wakes the thread up */
+
+void zlog_watcher_profile(int flag)
+{
+	pthread_mutex_lock(&zlog_watcher_mutex);
+	zc_profile(flag, "---watcher path[%s], running[%d], inotify[%d]---",
+		zlog_watcher_path, zlog_watcher_running, zlog_watcher_inotify);
+	pthread_mutex_unlock(&zlog_watcher_mutex);
+	return;
+}
+
+/*******************************************************************************/
+#ifdef __linux__
+/* inotify fd watching the directory of path, -1 if not supported */
+static int zlog_watcher_open(const char *path)
+{
+	int fd;
+	char dir[MAXLEN_PATH + 1];
+	char *p;
+
+	strcpy(dir, path);
+	p = strrchr(dir, '/');
+	if (!p) {
+		strcpy(dir, ".");
+	} else {
+		if (p == dir) p++;
+		*p = '\0';
+	}
+
+	fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+	if (fd < 0) {
+		zc_warn("inotify_init1 fail, errno[%d], poll conf file", errno);
+		return -1;
+	}
+
+	/* editors write it in place, or write another and move it here */
+	if (inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		zc_warn("inotify_add_watch[%s] fail, errno[%d], poll conf file", dir, errno);
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* 1 if any event is of name */
+static int zlog_watcher_read(int fd, const char *name)
+{
+	union {
+		struct inotify_event event;
+		char buf[4096];
+	} u;
+	struct inotify_event *event;
+	ssize_t nread;
+	char *p;
+	int hit = 0;
+
+	while ((nread = read(fd, u.buf, sizeof(u.buf))) > 0) {
+		for (p = u.buf; p < u.buf + nread; p += sizeof(*event) + event->len) {
+			event = (struct inotify_event *)p;
+			if (event->len && STRCMP(event->name, ==, name)) hit = 1;
+		}
+	}
+	return hit;
+}
+#else
+static int zlog_watcher_open(const char *path)
+{
+	return -1;
+}
+
+static int zlog_watcher_read(int fd, const char *name)
+{
+	return 0;
+}
+#endif
+
+static void *zlog_watcher_run(void *arg)
+{
+	int rc;
+	int fd = -1;
+	int nfds;
+	int timeout;
+	int busy = 0;
+	unsigned long seq = 0;
+	unsigned long gen = (uintptr_t)arg;
+	char path[MAXLEN_PATH + 1];
+	const char *name = NULL;
+	char drain[64];
+	struct pollfd fds[2];
+	zlog_watcher_fn changed = NULL;
+
+	path[0] = '\0';
+	while (1) {
+		pthread_mutex_lock(&zlog_watcher_mutex);
+		if (gen != zlog_watcher_gen) {
+			pthread_mutex_unlock(&zlog_watcher_mutex);
+			break;
+		}
+		if (seq != zlog_watcher_seq) {
+			seq = zlog_watcher_seq;
+			strcpy(path, zlog_watcher_path);
+			changed = zlog_watcher_changed;
+			if (fd >= 0) close(fd);
+			fd = zlog_watcher_fd;
+			zlog_watcher_fd = -1;
+			zlog_watcher_inotify = (fd >= 0);
+			name = strrchr(path, '/');
+			name = name ? name + 1 : path;
+			busy = 0;
+		}
+		pthread_mutex_unlock(&zlog_watcher_mutex);
+
+		fds[0].fd = zlog_watcher_pipe[0];
+		fds[0].events = POLLIN;
+		fds[0].revents = 0;
+		nfds = 1;
+		timeout = -1;
+		if (fd >= 0) {
+			fds[1].fd = fd;
+			fds[1].events = POLLIN;
+			fds[1].revents = 0;
+			nfds = 2;
+		} else if (path[0]) {
+			timeout = ZLOG_WATCHER_POLL_PERIOD;
+		}
+		if (busy) timeout = ZLOG_WATCHER_RETRY_PERIOD;
+
+		rc = poll(fds, nfds, timeout);
+		if (rc < 0) {
+			if (errno == EINTR) continue;
+			zc_error("poll fail, errno[%d]", errno);
+			sleep(1);
+			continue;
+		}
+
+		if (fds[0].revents) {
+			/* path is set again */
+			while (read(zlog_watcher_pipe[0], drain, sizeof(drain)) > 0);
+			continue;
+		}
+
+		if (rc == 0) {
+			busy = changed(busy);
+		} else if (nfds == 2 && fds[1].revents && zlog_watcher_read(fd, name)) {
+			busy = changed(1);
+		}
+	}
+
+	if (fd >= 0) close(fd);
+	return NULL;
+}
+
+/* under zlog_watcher_mutex */
+static int zlog_watcher_start(void)
+{
+	int rc;
+	pthread_t tid;
+
+	if (zlog_watcher_running) return 0;
+
+	if (zlog_watcher_pipe[0] < 0) {
+		if (pipe(zlog_watcher_pipe)) {
+			zc_error("pipe fail, errno[%d]", errno);
+			return -1;
+		}
+		fcntl(zlog_watcher_pipe[0], F_SETFL, O_NONBLOCK);
+		fcntl(zlog_watcher_pipe[1], F_SETFL, O_NONBLOCK);
+		fcntl(zlog_watcher_pipe[0], F_SETFD, FD_CLOEXEC);
+		fcntl(zlog_watcher_pipe[1], F_SETFD, FD_CLOEXEC);
+	}
+
+	rc = pthread_create(&tid, NULL, zlog_watcher_run, (void *)(uintptr_t)++zlog_watcher_gen);
+	if (rc) {
+		zc_error("pthread_create fail, rc[%d]", rc);
+		return -1;
+	}
+	zlog_watcher_tid = tid;
+	zlog_watcher_running = 1;
+	return 0;
+}
+
+/* under zlog_watcher_mutex, which is unlocked while the thread is joined */
+static void zlog_watcher_stop_thread(void)
+{
+	pthread_t tid;
+
+	if (!zlog_watcher_running) return;
+	zlog_watcher_gen++;
+	zlog_watcher_running = 0;
+	tid = zlog_watcher_tid;
+	if (write(zlog_watcher_pipe[1], "s", 1) < 0 && errno != EAGAIN) {
+		zc_error("write fail, errno[%d]", errno);
+	}
+
+	if (pthread_equal(tid, pthread_self())) {
+		/* by reload in the callback, it exits when the callback returns */
+		pthread_detach(tid);
+		return;
+	}
+
+	pthread_mutex_unlock(&zlog_watcher_mutex);
+	pthread_join(tid, NULL);
+	pthread_mutex_lock(&zlog_watcher_mutex);
+
+	close(zlog_watcher_pipe[0]);
+	close(zlog_watcher_pipe[1]);
+	zlog_watcher_pipe[0] = zlog_watcher_pipe[1] = -1;
+	return;
+}
+
+/*******************************************************************************/
+static void zlog_watcher_atfork_prepare(void)
+{
+	pthread_mutex_lock(&zlog_watcher_mutex);
+}
+
+static void zlog_watcher_atfork_parent(void)
+{
+	pthread_mutex_unlock(&zlog_watcher_mutex);
+}
+
+/* the thread is not in the child, nor is its inotify fd used */
+static void zlog_watcher_atfork_child(void)
+{
+	if (zlog_watcher_pipe[0] >= 0) {
+		close(zlog_watcher_pipe[0]);
+		close(zlog_watcher_pipe[1]);
+		zlog_watcher_pipe[0] = zlog_watcher_pipe[1] = -1;
+	}
+	if (zlog_watcher_fd >= 0) close(zlog_watcher_fd);
+	zlog_watcher_fd = -1;
+	zlog_watcher_running = 0;
+	zlog_watcher_inotify = 0;
+	zlog_watcher_path[0] = '\0';
+	zlog_watcher_seq++;
+	pthread_mutex_init(&zlog_watcher_mutex, NULL);
+}
+
+static void zlog_watcher_init_once(void)
+{
+	int rc;
+
+	rc = pthread_atfork(zlog_watcher_atfork_prepare,
+			zlog_watcher_atfork_parent, zlog_watcher_atfork_child);
+	if (rc) zc_error("pthread_atfork fail, rc[%d]", rc);
+}
+
+void zlog_watcher_set(const char *path, zlog_watcher_fn changed)
+{
+	pthread_once(&zlog_watcher_once, zlog_watcher_init_once);
+
+	pthread_mutex_lock(&zlog_watcher_mutex);
+	if (!path || path[0] == '\0') {
+		zlog_watcher_path[0] = '\0';
+		if (zlog_watcher_fd >= 0) close(zlog_watcher_fd);
+		zlog_watcher_fd = -1;
+		zlog_watcher_stop_thread();
+		goto exit;
+	} else {
+		if (STRCMP(zlog_watcher_path, ==, path) && zlog_watcher_running) goto exit;
+		if (zlog_watcher_start()) goto exit;
+		strcpy(zlog_watcher_path, path);
+		zlog_watcher_changed = changed;
+	}
+	/* watch before return, the thread may not run till the file is written */
+	if (zlog_watcher_fd >= 0) close(zlog_watcher_fd);
+	zlog_watcher_fd = zlog_watcher_path[0] ? zlog_watcher_open(zlog_watcher_path) : -1;
+	zlog_watcher_seq++;
+	if (zlog_watcher_pipe[1] >= 0 && write(zlog_watcher_pipe[1], "w", 1) < 0 && errno != EAGAIN) {
+		zc_error("write fail, errno[%d]", errno);
+	}
+
+exit:
+	pthread_mutex_unlock(&zlog_watcher_mutex);
+	return;
+}
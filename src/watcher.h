@@ -0,0 +1,37 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#ifndef __zlog_watcher_h
+#define __zlog_watcher_h
+
+/* watch the conf file, "reload conf watch = true".
+ * a thread waits for inotify events of the directory of the file, and
+ * calls back when the file is written or moved there. without inotify,
+ * it calls back every ZLOG_WATCHER_POLL_PERIOD, the callback looks at
+ * the file and reloads only when it is changed.
+ * a child after fork does not watch, till zlog_init() or zlog_reload().
+ * zlog_watcher_set() is called under zlog_env_lock, so calls never overlap.
+ */
+
+#include "zc_defs.h"
+
+#define ZLOG_WATCHER_POLL_PERIOD 1000 /* ms */
+#define ZLOG_WATCHER_RETRY_PERIOD 100 /* ms */
+
+/* force is 1 if the file is written, even if its stat looks the same.
+ * return 1 if it can not look now, it is called again with force 1
+ * after ZLOG_WATCHER_RETRY_PERIOD */
+typedef int (*zlog_watcher_fn) (int force);
+
+/* watch path, or stop the thread and wait for it to exit if path is NULL.
+ * the callback must not wait for locks the caller of it holds */
+void zlog_watcher_set(const char *path, zlog_watcher_fn changed);
+
+void zlog_watcher_profile(int flag);
+
+#endif
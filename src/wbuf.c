@@ -0,0 +1,340 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#include <pthread.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+
+#include "zc_defs.h"
+#include "wbuf.h"
+
+/*******************************************************************************/
+/* all wbufs, scanned by the flush thread, fork and exit */
+static pthread_mutex_t zlog_wbuf_list_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t zlog_wbuf_cond = PTHREAD_COND_INITIALIZER;
+static zlog_wbuf_t *zlog_wbuf_list;
+static long zlog_wbuf_period; /* ms, the flush thread exits when it is 0 */
+static int zlog_wbuf_running;
+static pthread_once_t zlog_wbuf_once = PTHREAD_ONCE_INIT;
+
+void zlog_wbuf_profile(int flag)
+{
+	zlog_wbuf_t *a_wbuf;
+
+	pthread_mutex_lock(&zlog_wbuf_list_mutex);
+	zc_profile(flag, "---wbuf period[%ld], running[%d]---", zlog_wbuf_period, zlog_wbuf_running);
+	for (a_wbuf = zlog_wbuf_list; a_wbuf; a_wbuf = a_wbuf->next) {
+		zc_profile(flag, "----wbuf[%p][%p][%ld/%ld]----",
+			a_wbuf, a_wbuf->rule, (long)a_wbuf->len, (long)a_wbuf->size);
+	}
+	pthread_mutex_unlock(&zlog_wbuf_list_mutex);
+	return;
+}
+
+/*******************************************************************************/
+/* under a_wbuf->mutex */
+static int zlog_wbuf_flush(zlog_wbuf_t * a_wbuf)
+{
+	struct iovec iov;
+
+	if (!a_wbuf->len) return 0;
+	iov.iov_base = a_wbuf->data;
+	iov.iov_len = a_wbuf->len;
+	a_wbuf->len = 0;
+	return a_wbuf->rule->emitv(a_wbuf->rule, &iov, 1);
+}
+
+/* under zlog_wbuf_list_mutex */
+static void zlog_wbuf_flush_all(void)
+{
+	zlog_wbuf_t *a_wbuf;
+
+	for (a_wbuf = zlog_wbuf_list; a_wbuf; a_wbuf = a_wbuf->next) {
+		pthread_mutex_lock(&a_wbuf->mutex);
+		zlog_wbuf_flush(a_wbuf);
+		pthread_mutex_unlock(&a_wbuf->mutex);
+	}
+	return;
+}
+
+static void *zlog_wbuf_run(void *arg)
+{
+	struct timeval now;
+	struct timespec deadline;
+
+	pthread_mutex_lock(&zlog_wbuf_list_mutex);
+	while (zlog_wbuf_period) {
+		gettimeofday(&now, NULL);
+		deadline.tv_sec = now.tv_sec + zlog_wbuf_period / 1000;
+		deadline.tv_nsec = now.tv_usec * 1000L + (zlog_wbuf_period % 1000) * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+		pthread_cond_timedwait(&zlog_wbuf_cond, &zlog_wbuf_list_mutex, &deadline);
+		zlog_wbuf_flush_all();
+	}
+	zlog_wbuf_running = 0;
+	pthread_mutex_unlock(&zlog_wbuf_list_mutex);
+	return NULL;
+}
+
+/* under zlog_wbuf_list_mutex */
+static void zlog_wbuf_start(void)
+{
+	int rc;
+	pthread_t tid;
+
+	if (zlog_wbuf_running || !zlog_wbuf_period) return;
+	rc = pthread_create(&tid, NULL, zlog_wbuf_run, NULL);
+	if (rc) {
+		zc_error("pthread_create fail, rc[%d]", rc);
+		return;
+	}
+	pthread_detach(tid);
+	zlog_wbuf_running = 1;
+	return;
+}
+
+void zlog_wbuf_set_period(long period)
+{
+	pthread_mutex_lock(&zlog_wbuf_list_mutex);
+	zlog_wbuf_period = period;
+	pthread_cond_signal(&zlog_wbuf_cond);
+	pthread_mutex_unlock(&zlog_wbuf_list_mutex);
+	return;
+}
+
+/*******************************************************************************/
+/* the child writes nothing of the parent twice, and starts its own flush thread */
+static void zlog_wbuf_atfork_prepare(void)
+{
+	zlog_wbuf_t *a_wbuf;
+
+	pthread_mutex_lock(&zlog_wbuf_list_mutex);
+	for (a_wbuf = zlog_wbuf_list; a_wbuf; a_wbuf = a_wbuf->next) {
+		pthread_mutex_lock(&a_wbuf->mutex);
+		zlog_wbuf_flush(a_wbuf);
+	}
+}
+
+static void zlog_wbuf_atfork_parent(void)
+{
+	zlog_wbuf_t *a_wbuf;
+
+	for (a_wbuf = zlog_wbuf_list; a_wbuf; a_wbuf = a_wbuf->next) {
+		pthread_mutex_unlock(&a_wbuf->mutex);
+	}
+	pthread_mutex_unlock(&zlog_wbuf_list_mutex);
+}
+
+static void zlog_wbuf_atfork_child(void)
+{
+	zlog_wbuf_t *a_wbuf;
+
+	for (a_wbuf = zlog_wbuf_list; a_wbuf; a_wbuf = a_wbuf->next) {
+		pthread_mutex_init(&a_wbuf->mutex, NULL);
+	}
+	zlog_wbuf_running = 0;
+	pthread_mutex_init(&zlog_wbuf_list_mutex, NULL);
+	pthread_cond_init(&zlog_wbuf_cond, NULL);
+}
+
+static void zlog_wbuf_atexit(void)
+{
+	pthread_mutex_lock(&zlog_wbuf_list_mutex);
+	zlog_wbuf_flush_all();
+	pthread_mutex_unlock(&zlog_wbuf_list_mutex);
+	return;
+}
+
+static void zlog_wbuf_init_once(void)
+{
+	int rc;
+
+	rc = pthread_atfork(zlog_wbuf_atfork_prepare,
+			zlog_wbuf_atfork_parent, zlog_wbuf_atfork_child);
+	if (rc) zc_error("pthread_atfork fail, rc[%d]", rc);
+
+	rc = atexit(zlog_wbuf_atexit);
+	if (rc) zc_error("atexit fail, rc[%d]", rc);
+}
+
+/*******************************************************************************/
+static void zlog_wbuf_del(zlog_wbuf_t * a_wbuf)
+{
+	pthread_mutex_destroy(&a_wbuf->mutex);
+	free(a_wbuf->data);
+	free(a_wbuf);
+	return;
+}
+
+static zlog_wbuf_t *zlog_wbuf_new(zlog_rule_t * a_rule)
+{
+	zlog_wbuf_t *a_wbuf;
+
+	pthread_once(&zlog_wbuf_once, zlog_wbuf_init_once);
+
+	a_wbuf = calloc(1, sizeof(zlog_wbuf_t));
+	if (!a_wbuf) {
+		zc_error("calloc fail, errno[%d]", errno);
+		return NULL;
+	}
+	a_wbuf->data = malloc(a_rule->write_buffer);
+	if (!a_wbuf->data) {
+		zc_error("malloc fail, errno[%d]", errno);
+		free(a_wbuf);
+		return NULL;
+	}
+	a_wbuf->size = a_rule->write_buffer;
+	a_wbuf->rule = a_rule;
+	pthread_mutex_init(&a_wbuf->mutex, NULL);
+
+	pthread_mutex_lock(&zlog_wbuf_list_mutex);
+	a_wbuf->prev = NULL;
+	a_wbuf->next = zlog_wbuf_list;
+	if (zlog_wbuf_list) zlog_wbuf_list->prev = a_wbuf;
+	zlog_wbuf_list = a_wbuf;
+	zlog_wbuf_start();
+	pthread_mutex_unlock(&zlog_wbuf_list_mutex);
+	return a_wbuf;
+}
+
+/* the wbuf of a_rule in a_thread, NULL if the thread has too many rules */
+static zlog_wbuf_t *zlog_wbuf_fetch(zlog_thread_t * a_thread, zlog_rule_t * a_rule)
+{
+	int i;
+	int empty = -1;
+	char *data;
+	zlog_wbuf_t *a_wbuf;
+	zlog_wbuf_t *a_unused = NULL;
+
+	/* rule is only changed by this thread, or when no one uses the rule */
+	for (i = 0; i < ZLOG_THREAD_WBUFS; i++) {
+		a_wbuf = a_thread->wbufs[i];
+		if (!a_wbuf) {
+			if (empty < 0) empty = i;
+		} else if (a_wbuf->rule == a_rule) {
+			return a_wbuf;
+		} else if (!a_wbuf->rule && !a_unused) {
+			a_unused = a_wbuf;
+		}
+	}
+
+	if (a_unused) {
+		/* left by a rule of an old conf */
+		pthread_mutex_lock(&a_unused->mutex);
+		if (a_unused->size != a_rule->write_buffer) {
+			data = realloc(a_unused->data, a_rule->write_buffer);
+			if (!data) {
+				zc_error("realloc fail, errno[%d]", errno);
+				pthread_mutex_unlock(&a_unused->mutex);
+				return NULL;
+			}
+			a_unused->data = data;
+			a_unused->size = a_rule->write_buffer;
+		}
+		a_unused->rule = a_rule;
+		pthread_mutex_unlock(&a_unused->mutex);
+		return a_unused;
+	}
+
+	if (empty < 0) return NULL;
+	a_thread->wbufs[empty] = zlog_wbuf_new(a_rule);
+	return a_thread->wbufs[empty];
+}
+
+int zlog_wbuf_write(zlog_thread_t * a_thread, zlog_rule_t * a_rule,
+		const char *msg, size_t len, int flush)
+{
+	int rc = 0;
+	struct iovec iov;
+	zlog_wbuf_t *a_wbuf;
+
+	a_wbuf = zlog_wbuf_fetch(a_thread, a_rule);
+	if (!a_wbuf) {
+		iov.iov_base = (void *)msg;
+		iov.iov_len = len;
+		return a_rule->emitv(a_rule, &iov, 1);
+	}
+
+	/* the child of fork starts its own flush thread */
+	if (!zlog_wbuf_running && zlog_wbuf_period) {
+		pthread_mutex_lock(&zlog_wbuf_list_mutex);
+		zlog_wbuf_start();
+		pthread_mutex_unlock(&zlog_wbuf_list_mutex);
+	}
+
+	pthread_mutex_lock(&a_wbuf->mutex);
+	if (a_wbuf->len + len > a_wbuf->size) {
+		if (zlog_wbuf_flush(a_wbuf)) rc = -1;
+	}
+
+	if (len > a_wbuf->size) {
+		iov.iov_base = (void *)msg;
+		iov.iov_len = len;
+		if (a_rule->emitv(a_rule, &iov, 1)) rc = -1;
+	} else {
+		memcpy(a_wbuf->data + a_wbuf->len, msg, len);
+		a_wbuf->len += len;
+		if (flush && zlog_wbuf_flush(a_wbuf)) rc = -1;
+	}
+	pthread_mutex_unlock(&a_wbuf->mutex);
+	return rc;
+}
+
+/*******************************************************************************/
+void zlog_wbuf_release(zlog_thread_t * a_thread)
+{
+	int i;
+	zlog_wbuf_t *a_wbuf;
+
+	for (i = 0; i < ZLOG_THREAD_WBUFS; i++) {
+		a_wbuf = a_thread->wbufs[i];
+		if (!a_wbuf) continue;
+		a_thread->wbufs[i] = NULL;
+
+		pthread_mutex_lock(&zlog_wbuf_list_mutex);
+		if (a_wbuf->prev) a_wbuf->prev->next = a_wbuf->next;
+		else zlog_wbuf_list = a_wbuf->next;
+		if (a_wbuf->next) a_wbuf->next->prev = a_wbuf->prev;
+		pthread_mutex_unlock(&zlog_wbuf_list_mutex);
+
+		pthread_mutex_lock(&a_wbuf->mutex);
+		if (a_wbuf->rule) zlog_wbuf_flush(a_wbuf);
+		pthread_mutex_unlock(&a_wbuf->mutex);
+		zlog_wbuf_del(a_wbuf);
+	}
+	return;
+}
+
+void zlog_wbuf_detach(zc_arraylist_t * rules)
+{
+	int i;
+	zlog_rule_t *a_rule;
+	zlog_wbuf_t *a_wbuf;
+
+	pthread_mutex_lock(&zlog_wbuf_list_mutex);
+	for (a_wbuf = zlog_wbuf_list; a_wbuf; a_wbuf = a_wbuf->next) {
+		pthread_mutex_lock(&a_wbuf->mutex);
+		if (a_wbuf->rule) {
+			zc_arraylist_foreach(rules, i, a_rule) {
+				if (a_rule != a_wbuf->rule) continue;
+				zlog_wbuf_flush(a_wbuf);
+				a_wbuf->rule = NULL;
+				break;
+			}
+		}
+		pthread_mutex_unlock(&a_wbuf->mutex);
+	}
+	pthread_mutex_unlock(&zlog_wbuf_list_mutex);
+	return;
+}
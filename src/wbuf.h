@@ -0,0 +1,57 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#ifndef __zlog_wbuf_h
+#define __zlog_wbuf_h
+
+/* write buffers, "write buffer = 64KB" and "write flush = 50ms".
+ * msgs of a rule made in a thread are gathered in a wbuf of the thread,
+ * and written out by a_rule->emitv() at once. only whole msgs are in it,
+ * so one write() is still whole lines for O_APPEND of other processes.
+ * a wbuf is written out
+ *	when the next msg does not fit in it
+ *	when the msg is ERROR or above
+ *	every flush period, by the flush thread
+ *	before fork, at exit, when the thread exits, and before its rule is freed
+ * the owner thread and the others share a wbuf by its mutex,
+ * the others seldom come, so it is almost never contended.
+ */
+
+#include <pthread.h>
+
+#include "zc_defs.h"
+#include "thread.h"
+#include "rule.h"
+
+typedef struct zlog_wbuf_s {
+	pthread_mutex_t mutex;
+	zlog_rule_t *rule; /* NULL if free to use for another rule */
+	char *data;
+	size_t len;
+	size_t size;
+
+	struct zlog_wbuf_s *prev; /* in the list of all wbufs */
+	struct zlog_wbuf_s *next;
+} zlog_wbuf_t;
+
+/* msg of a_rule goes into the wbuf of a_thread, written out now if flush */
+int zlog_wbuf_write(zlog_thread_t * a_thread, zlog_rule_t * a_rule,
+		const char *msg, size_t len, int flush);
+
+/* write out wbufs of a_thread and free them, when it exits */
+void zlog_wbuf_release(zlog_thread_t * a_thread);
+
+/* write out wbufs of rules, which are going to be freed */
+void zlog_wbuf_detach(zc_arraylist_t * rules);
+
+/* flush period in ms, 0 stops the flush thread */
+void zlog_wbuf_set_period(long period);
+
+void zlog_wbuf_profile(int flag);
+
+#endif
@@ -49,6 +49,13 @@
 #define zlog_stat stat
 #endif
 
+/* nanoseconds part of st_mtime, to tell changes in a second */
+#ifdef __APPLE__
+#define zlog_stat_mtime_nsec(info) ((long)(info)->st_mtimespec.tv_nsec)
+#else
+#define zlog_stat_mtime_nsec(info) ((long)(info)->st_mtim.tv_nsec)
+#endif
+
 /* Define zlog_fsync to fdatasync() in Linux and fsync() for all the rest */
 #ifdef __linux__
 #define zlog_fsync fdatasync
@@ -56,6 +63,19 @@
 #define zlog_fsync fsync
 #endif
 
+/* memory barriers for data shared without locks, gcc builtins */
+#define zc_mb() __sync_synchronize()
+#if defined(__ATOMIC_ACQUIRE)
+#define zc_load_acquire(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define zc_store_release(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define zc_atomic_add(p, v) __atomic_add_fetch((p), (v), __ATOMIC_RELAXED)
+#else
+#define zc_load_acquire(p) (*(p))
+#define zc_store_release(p, v) do { __sync_synchronize(); *(p) = (v); } while (0)
+#define zc_atomic_add(p, v) __sync_add_and_fetch((p), (v))
+#endif
+#define zc_cas(p, o, n) __sync_bool_compare_and_swap((p), (o), (n))
+
 
 
 #endif
@@ -0,0 +1,405 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#include "fmacros.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+
+#include "conf.h"
+#include "thread.h"
+#include "format.h"
+#include "event.h"
+#include "binary.h"
+#include "args.h"
+#include "zc_defs.h"
+#include "version.h"
+
+typedef struct {
+	long line;
+	char *file;
+	size_t file_len;
+	char *func;
+	size_t func_len;
+	char *format;
+} zlog_decode_callsite_t;
+
+typedef struct {
+	char **categories;
+	size_t category_count;
+	zlog_decode_callsite_t *callsites;
+	size_t callsite_count;
+	long long last_time;
+} zlog_decode_session_t;
+
+static void zlog_decode_session_clean(zlog_decode_session_t * a_session)
+{
+	size_t i;
+
+	for (i = 0; i < a_session->category_count; i++) {
+		free(a_session->categories[i]);
+	}
+	for (i = 0; i < a_session->callsite_count; i++) {
+		free(a_session->callsites[i].file);
+		free(a_session->callsites[i].func);
+		free(a_session->callsites[i].format);
+	}
+	free(a_session->categories);
+	free(a_session->callsites);
+	memset(a_session, 0x00, sizeof(*a_session));
+	return;
+}
+
+static char *zlog_decode_strndup(const char *str, size_t len)
+{
+	char *dup;
+
+	dup = malloc(len + 1);
+	if (!dup) return NULL;
+	memcpy(dup, str, len);
+	dup[len] = '\0';
+	return dup;
+}
+
+/* read a length prefixed string */
+static char *zlog_decode_get_str(const char **p, const char *end, size_t *len)
+{
+	unsigned long long v;
+
+	if (zlog_args_get_varint(p, end, &v) || v > (unsigned long long)(end - *p)) return NULL;
+	*len = v;
+	*p += v;
+	return zlog_decode_strndup(*p - v, v);
+}
+
+static int zlog_decode_head(zlog_decode_session_t * a_session, zlog_event_t * a_event,
+		const char *p, const char *end)
+{
+	unsigned long long version, sec, usec, pid;
+	char *host_name;
+	size_t host_name_len;
+
+	if (end - p < (long)sizeof(ZLOG_BINARY_MAGIC) - 1
+		|| memcmp(p, ZLOG_BINARY_MAGIC, sizeof(ZLOG_BINARY_MAGIC) - 1)) {
+		fprintf(stderr, "zlog-decode: bad magic\n");
+		return -1;
+	}
+	p += sizeof(ZLOG_BINARY_MAGIC) - 1;
+
+	if (zlog_args_get_varint(&p, end, &version)) return -1;
+	if (version != ZLOG_BINARY_VERSION) {
+		fprintf(stderr, "zlog-decode: version[%llu] not supported\n", version);
+		return -1;
+	}
+
+	if (zlog_args_get_varint(&p, end, &sec)
+		|| zlog_args_get_varint(&p, end, &usec)
+		|| zlog_args_get_varint(&p, end, &pid)) return -1;
+	host_name = zlog_decode_get_str(&p, end, &host_name_len);
+	if (!host_name) return -1;
+
+	zlog_decode_session_clean(a_session);
+	a_session->last_time = (long long)sec * 1000000 + usec;
+
+	if (host_name_len > sizeof(a_event->host_name) - 1) {
+		host_name_len = sizeof(a_event->host_name) - 1;
+	}
+	memcpy(a_event->host_name, host_name, host_name_len);
+	a_event->host_name[host_name_len] = '\0';
+	a_event->host_name_len = host_name_len;
+	free(host_name);
+
+	a_event->last_pid = (pid_t) pid;
+	a_event->pid_str_len = sprintf(a_event->pid_str, "%u", (unsigned int)pid);
+	return 0;
+}
+
+static int zlog_decode_category(zlog_decode_session_t * a_session, const char *p, const char *end)
+{
+	unsigned long long id;
+	char **categories;
+
+	if (zlog_args_get_varint(&p, end, &id) || id != a_session->category_count) return -1;
+
+	categories = realloc(a_session->categories, (id + 1) * sizeof(char *));
+	if (!categories) return -1;
+	a_session->categories = categories;
+
+	categories[id] = zlog_decode_strndup(p, end - p);
+	if (!categories[id]) return -1;
+	a_session->category_count++;
+	return 0;
+}
+
+static int zlog_decode_callsite(zlog_decode_session_t * a_session, const char *p, const char *end)
+{
+	unsigned long long id;
+	unsigned long long line;
+	zlog_decode_callsite_t *callsites;
+	zlog_decode_callsite_t a_callsite;
+
+	if (zlog_args_get_varint(&p, end, &id) || id != a_session->callsite_count) return -1;
+	if (zlog_args_get_varint(&p, end, &line)) return -1;
+
+	memset(&a_callsite, 0x00, sizeof(a_callsite));
+	a_callsite.line = (long)zlog_args_unzigzag(line);
+	a_callsite.file = zlog_decode_get_str(&p, end, &a_callsite.file_len);
+	a_callsite.func = zlog_decode_get_str(&p, end, &a_callsite.func_len);
+	a_callsite.format = zlog_decode_strndup(p, end - p);
+	if (!a_callsite.file || !a_callsite.func || !a_callsite.format) goto err;
+
+	callsites = realloc(a_session->callsites, (id + 1) * sizeof(zlog_decode_callsite_t));
+	if (!callsites) goto err;
+	a_session->callsites = callsites;
+	callsites[id] = a_callsite;
+	a_session->callsite_count++;
+	return 0;
+err:
+	free(a_callsite.file);
+	free(a_callsite.func);
+	free(a_callsite.format);
+	return -1;
+}
+
+static int zlog_decode_record(zlog_decode_session_t * a_session, zlog_thread_t * a_thread,
+		zlog_format_t * a_format, const char *p, const char *end)
+{
+	unsigned long long callsite_id, category_id, level, delta, tid;
+	zlog_decode_callsite_t *a_callsite;
+	char *category;
+	zlog_event_t *a_event = a_thread->event;
+	pid_t pid;
+
+	if (zlog_args_get_varint(&p, end, &callsite_id)
+		|| zlog_args_get_varint(&p, end, &category_id)
+		|| zlog_args_get_varint(&p, end, &level)
+		|| zlog_args_get_varint(&p, end, &delta)
+		|| zlog_args_get_varint(&p, end, &tid)) return -1;
+	if (callsite_id >= a_session->callsite_count
+		|| category_id >= a_session->category_count) return -1;
+
+	a_callsite = &a_session->callsites[callsite_id];
+	category = a_session->categories[category_id];
+	if (zlog_args_decode(a_thread->args, a_callsite->format, p, end - p)) return -1;
+
+	pid = a_event->last_pid;
+	zlog_event_set_args(a_event, category, strlen(category),
+		a_callsite->file, a_callsite->file_len,
+		a_callsite->func, a_callsite->func_len,
+		a_callsite->line, (int)level, a_callsite->format,
+		a_thread->args->start, a_thread->args->len);
+	a_event->pid = pid;
+
+	a_session->last_time += zlog_args_unzigzag(delta);
+	a_event->time_stamp.tv_sec = a_session->last_time / 1000000;
+	a_event->time_stamp.tv_usec = a_session->last_time % 1000000;
+	zlog_event_set_tid(a_event, (pthread_t) tid);
+
+	if (zlog_format_gen_msg(a_format, a_thread)) return -1;
+	fwrite(zlog_buf_str(a_thread->msg_buf), zlog_buf_len(a_thread->msg_buf), 1, stdout);
+	return 0;
+}
+
+static char *zlog_decode_read(FILE * fp, size_t *len)
+{
+	char *data = NULL;
+	char *new_data;
+	size_t size = 0;
+	size_t nread;
+
+	*len = 0;
+	do {
+		if (*len == size) {
+			size = size ? size * 2 : 64 * 1024;
+			new_data = realloc(data, size);
+			if (!new_data) {
+				free(data);
+				return NULL;
+			}
+			data = new_data;
+		}
+		nread = fread(data + *len, 1, size - *len, fp);
+		*len += nread;
+	} while (nread);
+
+	if (ferror(fp)) {
+		free(data);
+		return NULL;
+	}
+	return data;
+}
+
+static int zlog_decode_file(const char *path, zlog_thread_t * a_thread, zlog_format_t * a_format)
+{
+	int rc = 0;
+	FILE *fp;
+	char *data;
+	size_t len;
+	const char *p;
+	const char *end;
+	const char *frame;
+	unsigned long long frame_len;
+	char type;
+	zlog_decode_session_t a_session;
+
+	if (strcmp(path, "-") == 0) {
+		fp = stdin;
+	} else {
+		fp = fopen(path, "rb");
+		if (!fp) {
+			fprintf(stderr, "zlog-decode: open[%s] fail, errno[%d]\n", path, errno);
+			return -1;
+		}
+	}
+	data = zlog_decode_read(fp, &len);
+	if (fp != stdin) fclose(fp);
+	if (!data) {
+		fprintf(stderr, "zlog-decode: read[%s] fail, errno[%d]\n", path, errno);
+		return -1;
+	}
+
+	memset(&a_session, 0x00, sizeof(a_session));
+	p = data;
+	end = data + len;
+	while (p < end) {
+		frame = p;
+		type = *p++;
+		if (zlog_args_get_varint(&p, end, &frame_len)
+			|| frame_len > (unsigned long long)(end - p)) {
+			/* the writer was killed in the middle of a frame */
+			fprintf(stderr, "zlog-decode: [%s] truncated at offset[%ld]\n",
+				path, (long)(frame - data));
+			rc = -1;
+			break;
+		}
+
+		switch (type) {
+		case ZLOG_BINARY_HEAD:
+			rc = zlog_decode_head(&a_session, a_thread->event, p, p + frame_len);
+			break;
+		case ZLOG_BINARY_CATEGORY:
+			rc = zlog_decode_category(&a_session, p, p + frame_len);
+			break;
+		case ZLOG_BINARY_CALLSITE:
+			rc = zlog_decode_callsite(&a_session, p, p + frame_len);
+			break;
+		case ZLOG_BINARY_RECORD:
+			rc = zlog_decode_record(&a_session, a_thread, a_format, p, p + frame_len);
+			break;
+		default:
+			/* unknown frame, skip it */
+			break;
+		}
+		if (rc) {
+			fprintf(stderr, "zlog-decode: [%s] bad frame[%c] at offset[%ld]\n",
+				path, type, (long)(frame - data));
+			break;
+		}
+		p += frame_len;
+	}
+
+	zlog_decode_session_clean(&a_session);
+	free(data);
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	int rc = 0;
+	int op;
+	char *confpath = NULL;
+	char *format_name = NULL;
+	zlog_conf_t *a_conf;
+	zlog_format_t *a_format;
+	zlog_thread_t *a_thread;
+	static char *stdin_argv[] = { "-", NULL };
+	static const char *help =
+		"useage: zlog-decode [-c conf file] [-f format name] [binary files]...\n"
+		"\t-c,\tconf file which has the format, default is the built-in one\n"
+		"\t-f,\tformat name in [formats] of conf file, default is the default format\n"
+		"\t-h,\tshow help message\n"
+		"read stdin if no binary file is given\n"
+		"zlog version: " ZLOG_VERSION "\n";
+
+	while((op = getopt(argc, argv, "c:f:hv")) > 0) {
+		if (op == 'h') {
+			fputs(help, stdout);
+			return 0;
+		} else if (op == 'c') {
+			confpath = optarg;
+		} else if (op == 'f') {
+			format_name = optarg;
+		} else {
+			fputs(help, stdout);
+			return -1;
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if (argc == 0) {
+		argc = 1;
+		argv = stdin_argv;
+	}
+
+	setenv("ZLOG_PROFILE_ERROR", "/dev/stderr", 1);
+
+	a_conf = zlog_conf_new_without_rules(confpath);
+	if (!a_conf) {
+		fprintf(stderr, "zlog-decode: conf[%s] fail, see error message above\n",
+			confpath ? confpath : "");
+		exit(2);
+	}
+	a_format = a_conf->default_format;
+	if (format_name) {
+		int i;
+		zlog_format_t *a;
+
+		a_format = NULL;
+		zc_arraylist_foreach(a_conf->formats, i, a) {
+			if (STRCMP(a->name, ==, format_name)) {
+				a_format = a;
+				break;
+			}
+		}
+		if (!a_format) {
+			fprintf(stderr, "zlog-decode: format[%s] not found\n", format_name);
+			zlog_conf_del(a_conf);
+			exit(2);
+		}
+	}
+
+	a_thread = zlog_thread_new(0, a_conf->buf_size_min, a_conf->buf_size_max,
+			a_conf->time_cache_count);
+	if (a_thread) {
+		/* level names are read from it */
+		a_thread->conf = a_conf;
+		a_thread->args = zlog_args_new(1024);
+	}
+	if (!a_thread || !a_thread->args) {
+		fprintf(stderr, "zlog-decode: zlog_thread_new fail\n");
+		zlog_conf_del(a_conf);
+		exit(2);
+	}
+
+	while (argc > 0) {
+		if (zlog_decode_file(*argv, a_thread, a_format)) rc = 1;
+		argc--;
+		argv++;
+	}
+
+	fflush(stdout);
+	zlog_thread_del(a_thread);
+	zlog_conf_del(a_conf);
+	exit(rc);
+}
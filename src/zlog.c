@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <errno.h>
 #include <pthread.h>
 
 #include "conf.h"
@@ -20,20 +21,61 @@
 #include "mdc.h"
 #include "zc_defs.h"
 #include "rule.h"
+#include "async.h"
+#include "fd_cache.h"
+#include "wbuf.h"
+#include "syncer.h"
+#include "watcher.h"
 #include "version.h"
 
 /*******************************************************************************/
 extern char *zlog_git_sha1;
 /*******************************************************************************/
 static pthread_rwlock_t zlog_env_lock = PTHREAD_RWLOCK_INITIALIZER;
+/* held by zlog_reload() and zlog_fini(), before zlog_env_lock */
+static pthread_mutex_t zlog_env_reload_mutex = PTHREAD_MUTEX_INITIALIZER;
 zlog_conf_t *zlog_env_conf;
 static pthread_key_t zlog_thread_key;
 static zc_hashtable_t *zlog_env_categories;
 static zc_hashtable_t *zlog_env_records;
-static zlog_category_t *zlog_default_category;
+zlog_category_t *zlog_default_category;
 static size_t zlog_env_reload_conf_count;
 static int zlog_env_is_init = 0;
 static int zlog_env_init_version = 0;
+
+/* what loggers read, replaced as a whole under wrlock of zlog_env_lock,
+ * loggers read it in an epoch, without any lock, see thread.h */
+typedef struct {
+	zlog_conf_t *conf;
+	zlog_category_t *default_category;
+	int init_version;
+} zlog_env_snapshot_t;
+static zlog_env_snapshot_t *zlog_env_snapshot;
+
+static int zlog_reload_if_changed(int force);
+/*******************************************************************************/
+/* the old snapshot is returned in a_old,
+ * free it after zlog_thread_synchronize() */
+static int zlog_env_publish(zlog_conf_t *a_conf, zlog_category_t *a_default_category,
+		int init_version, zlog_env_snapshot_t **a_old)
+{
+	zlog_env_snapshot_t *a_snapshot = NULL;
+
+	if (a_conf) {
+		a_snapshot = calloc(1, sizeof(zlog_env_snapshot_t));
+		if (!a_snapshot) {
+			zc_error("calloc fail, errno[%d]", errno);
+			return -1;
+		}
+		a_snapshot->conf = a_conf;
+		a_snapshot->default_category = a_default_category;
+		a_snapshot->init_version = init_version;
+	}
+
+	*a_old = zlog_env_snapshot;
+	zc_store_release(&zlog_env_snapshot, a_snapshot);
+	return 0;
+}
 /*******************************************************************************/
 /* inner no need thread-safe */
 static void zlog_fini_inner(void)
@@ -44,14 +86,24 @@ static void zlog_fini_inner(void)
 	 * after one thread call pthread_key_delete
 	 * also key not init will cause a core dump
 	 */
-	
+
+	/* write out all msgs in async rings, before rules are freed */
+	zlog_async_stop();
+	zlog_wbuf_set_period(0);
+	zlog_syncer_stop();
+	zlog_watcher_set(NULL, NULL);
+
+	/* macros of dzlog read it without lock */
+	zlog_default_category = NULL;
 	if (zlog_env_categories) zlog_category_table_del(zlog_env_categories);
 	zlog_env_categories = NULL;
-	zlog_default_category = NULL;
 	if (zlog_env_records) zlog_record_table_del(zlog_env_records);
 	zlog_env_records = NULL;
 	if (zlog_env_conf) zlog_conf_del(zlog_env_conf);
 	zlog_env_conf = NULL;
+	zlog_fd_cache_clean();
+	/* archives are all there when zlog_fini() returns */
+	zlog_rotater_fini();
 	return;
 }
 
@@ -85,6 +137,11 @@ static int zlog_init_inner(const char *confpath)
 			zc_error("atexit fail, rc[%d]", rc);
 			goto err;
 		}
+
+		if (zlog_thread_atfork()) {
+			zc_error("zlog_thread_atfork fail");
+			goto err;
+		}
 		zlog_env_init_version++;
 	} /* else maybe after zlog_fini() and need not create pthread_key */
 
@@ -106,6 +163,17 @@ static int zlog_init_inner(const char *confpath)
 		goto err;
 	}
 
+	if (zlog_env_conf->async && zlog_async_start(zlog_env_conf->buf_size_min,
+			zlog_env_conf->buf_size_max, zlog_env_conf->time_cache_count,
+			zlog_env_conf->async_writers, zlog_env_conf->async_io_uring)) {
+		zc_error("zlog_async_start fail");
+		goto err;
+	}
+	zlog_wbuf_set_period(zlog_env_conf->write_buffer ? zlog_env_conf->write_flush : 0);
+	zlog_syncer_set_period(zlog_env_conf->fsync_interval);
+	zlog_watcher_set(zlog_env_conf->reload_conf_watch ? zlog_env_conf->file : NULL,
+			zlog_reload_if_changed);
+
 	return 0;
 err:
 	zlog_fini_inner();
@@ -116,6 +184,7 @@ err:
 int zlog_init(const char *confpath)
 {
 	int rc;
+	zlog_env_snapshot_t *old_snapshot = NULL;
 	zc_debug("------zlog_init start------");
 	zc_debug("------compile time[%s %s], version[%s]------", __DATE__, __TIME__, ZLOG_VERSION);
 
@@ -136,6 +205,13 @@ int zlog_init(const char *confpath)
 		goto err;
 	}
 
+	if (zlog_env_publish(zlog_env_conf, NULL, zlog_env_init_version + 1, &old_snapshot)) {
+		zc_error("zlog_env_publish fail");
+		zlog_fini_inner();
+		goto err;
+	}
+	free(old_snapshot); /* always NULL, as zlog_fini() has synchronized */
+
 	zlog_env_is_init = 1;
 	zlog_env_init_version++;
 
@@ -159,6 +235,7 @@ err:
 int dzlog_init(const char *confpath, const char *cname)
 {
 	int rc = 0;
+	zlog_env_snapshot_t *old_snapshot = NULL;
 	zc_debug("------dzlog_init start------");
 	zc_debug("------compile time[%s %s], version[%s]------",
 			__DATE__, __TIME__, ZLOG_VERSION);
@@ -185,8 +262,17 @@ int dzlog_init(const char *confpath, const char *cname)
 				zlog_env_conf->rules);
 	if (!zlog_default_category) {
 		zc_error("zlog_category_table_fetch_category[%s] fail", cname);
+		zlog_fini_inner();
+		goto err;
+	}
+
+	if (zlog_env_publish(zlog_env_conf, zlog_default_category,
+			zlog_env_init_version + 1, &old_snapshot)) {
+		zc_error("zlog_env_publish fail");
+		zlog_fini_inner();
 		goto err;
 	}
+	free(old_snapshot);
 
 	zlog_env_is_init = 1;
 	zlog_env_init_version++;
@@ -208,103 +294,211 @@ err:
 	return -1;
 }
 /*******************************************************************************/
-int zlog_reload(const char *confpath)
+/* writers of deferred format make msgs by formats of the conf */
+#define zlog_async_same(a_old, a_new) \
+	((a_old)->async && (a_new)->async \
+	 && !(a_old)->async_deferred_format && !(a_new)->async_deferred_format \
+	 && (a_old)->buf_size_min == (a_new)->buf_size_min \
+	 && (a_old)->buf_size_max == (a_new)->buf_size_max \
+	 && (a_old)->time_cache_count == (a_new)->time_cache_count \
+	 && (a_old)->async_writers == (a_new)->async_writers \
+	 && (a_old)->async_io_uring == (a_new)->async_io_uring)
+
+/* under zlog_env_reload_mutex, one reload at a time, and zlog_fini() does
+ * not free old_conf while new_conf is built from it without zlog_env_lock */
+static int zlog_reload_locked(const char *confpath)
 {
 	int rc = 0;
 	int i = 0;
+	int async_kept;
+	char file[MAXLEN_PATH + 1];
 	zlog_conf_t *new_conf = NULL;
+	zlog_conf_t *old_conf = NULL;
+	zlog_env_snapshot_t *old_snapshot = NULL;
 	zlog_rule_t *a_rule;
-	int c_up = 0;
 
 	zc_debug("------zlog_reload start------");
-	rc = pthread_rwlock_wrlock(&zlog_env_lock);
+	rc = pthread_rwlock_rdlock(&zlog_env_lock);
 	if (rc) {
-		zc_error("pthread_rwlock_wrlock fail, rc[%d]", rc);
+		zc_error("pthread_rwlock_rdlock fail, rc[%d]", rc);
+		return -1;
+	}
+	if (zlog_env_is_init) old_conf = zlog_env_conf;
+	rc = pthread_rwlock_unlock(&zlog_env_lock);
+	if (rc) {
+		zc_error("pthread_rwlock_unlock fail, rc=[%d]", rc);
 		return -1;
 	}
 
-	if (!zlog_env_is_init) {
+	if (!old_conf) {
 		zc_error("never call zlog_init() or dzlog_init() before");
 		goto quit;
 	}
 
 	/* use last conf file */
-	if (confpath == NULL) confpath = zlog_env_conf->file;
+	if (confpath == NULL) {
+		strcpy(file, old_conf->file);
+		confpath = file;
+	}
 
-	/* reach reload period */
+	/* reach reload period, or seen by watcher */
 	if (confpath == (char*)-1) {
-		/* test again, avoid other threads already reloaded */
-		if (zlog_env_reload_conf_count > zlog_env_conf->reload_conf_period) {
-			confpath = zlog_env_conf->file;
+		/* test again by reading it, avoid other threads already reloaded */
+		if (zlog_conf_changed(old_conf, 1)) {
+			strcpy(file, old_conf->file);
+			confpath = file;
 		} else {
 			/* do nothing, already done */
 			goto quit;
 		}
 	}
 
-	/* reset counter, whether automaticlly or mannually */
-	zlog_env_reload_conf_count = 0;
-
-	new_conf = zlog_conf_new(confpath);
+	/* reading, parsing and opening outputs is the slow part, loggers and
+	 * zlog_get_category() go on with old_conf meanwhile.
+	 * unchanged outputs keep their fds and pipes */
+	new_conf = zlog_conf_new_from(confpath, old_conf);
 	if (!new_conf) {
 		zc_error("zlog_conf_new fail");
-		goto err;
+		goto quit_fail;
+	}
+
+	rc = pthread_rwlock_wrlock(&zlog_env_lock);
+	if (rc) {
+		zc_error("pthread_rwlock_wrlock fail, rc[%d]", rc);
+		goto quit_fail;
 	}
 
+	/* reset counter, whether automaticlly or mannually */
+	zlog_env_reload_conf_count = 0;
+
 	zc_arraylist_foreach(new_conf->rules, i, a_rule) {
 		zlog_rule_set_record(a_rule, zlog_env_records);
 	}
 
 	if (zlog_category_table_update_rules(zlog_env_categories, new_conf->rules)) {
-		c_up = 0;
 		zc_error("zlog_category_table_update fail");
 		goto err;
-	} else {
-		c_up = 1;
 	}
 
-	zlog_env_init_version++;
+	if (zlog_env_publish(new_conf, zlog_default_category,
+			zlog_env_init_version + 1, &old_snapshot)) {
+		zc_error("zlog_env_publish fail");
+		goto err;
+	}
 
-	if (c_up) zlog_category_table_commit_rules(zlog_env_categories);
-	zlog_conf_del(zlog_env_conf);
 	zlog_env_conf = new_conf;
+	zlog_env_init_version++;
+
+	/* wait loggers leave old conf and old fit rules, then free them */
+	zlog_thread_synchronize();
+	/* old rules may still be in async rings, writers are kept if they
+	 * would be the same, as they only emit what loggers made */
+	async_kept = zlog_async_same(old_conf, new_conf);
+	if (async_kept) {
+		zlog_async_flush();
+	} else {
+		zlog_async_stop();
+	}
+	zlog_category_table_commit_rules(zlog_env_categories);
+	free(old_snapshot);
+
+	if (new_conf->async && !async_kept && zlog_async_start(new_conf->buf_size_min,
+			new_conf->buf_size_max, new_conf->time_cache_count,
+			new_conf->async_writers, new_conf->async_io_uring)) {
+		/* rules write out in caller thread then */
+		zc_error("zlog_async_start fail");
+	}
+	zlog_wbuf_set_period(new_conf->write_buffer ? new_conf->write_flush : 0);
+	zlog_syncer_set_period(new_conf->fsync_interval);
+	zlog_watcher_set(new_conf->reload_conf_watch ? new_conf->file : NULL,
+			zlog_reload_if_changed);
 	zc_debug("------zlog_reload success, total init verison[%d] ------", zlog_env_init_version);
 	rc = pthread_rwlock_unlock(&zlog_env_lock);
 	if (rc) {
 		zc_error("pthread_rwlock_unlock fail, rc=[%d]", rc);
-		return -1;
 	}
-	return 0;
+
+	/* nothing refers to old_conf now, closing its files and pipes
+	 * may wait, do it out of the lock */
+	zlog_conf_del_from(old_conf, new_conf);
+	return rc ? -1 : 0;
 err:
 	/* fail, roll back everything */
 	zc_warn("zlog_reload fail, use old conf file, still working");
-	if (new_conf) zlog_conf_del(new_conf);
-	if (c_up) zlog_category_table_rollback_rules(zlog_env_categories);
-	zc_error("------zlog_reload fail, total init version[%d] ------", zlog_env_init_version);
+	zlog_category_table_rollback_rules(zlog_env_categories);
+	zlog_thread_synchronize();
+	zlog_async_flush();
+	zlog_category_table_commit_rules(zlog_env_categories);
 	rc = pthread_rwlock_unlock(&zlog_env_lock);
 	if (rc) {
 		zc_error("pthread_rwlock_unlock fail, rc=[%d]", rc);
-		return -1;
 	}
+quit_fail:
+	if (new_conf) zlog_conf_del_from(new_conf, old_conf);
+	zc_error("------zlog_reload fail, total init version[%d] ------", zlog_env_init_version);
 	return -1;
 quit:
 	zc_debug("------zlog_reload do nothing------");
-	rc = pthread_rwlock_unlock(&zlog_env_lock);
+	return 0;
+}
+
+int zlog_reload(const char *confpath)
+{
+	int rc;
+
+	rc = pthread_mutex_lock(&zlog_env_reload_mutex);
 	if (rc) {
-		zc_error("pthread_rwlock_unlock fail, rc=[%d]", rc);
+		zc_error("pthread_mutex_lock fail, rc[%d]", rc);
 		return -1;
 	}
+	rc = zlog_reload_locked(confpath);
+	pthread_mutex_unlock(&zlog_env_reload_mutex);
+	return rc;
+}
+
+/* by loggers at reload conf period, or by the watcher.
+ * the file is looked at under rdlock, wrlock only if it is changed.
+ * locks are only tried, zlog_fini() holds them while it stops the watcher,
+ * return 1 if busy, the caller tries again later */
+static int zlog_reload_if_changed(int force)
+{
+	int changed = 0;
+
+	if (pthread_rwlock_tryrdlock(&zlog_env_lock)) return 1;
+	if (zlog_env_is_init) {
+		zlog_env_reload_conf_count = 0;
+		changed = zlog_conf_changed(zlog_env_conf, force);
+	}
+	if (pthread_rwlock_unlock(&zlog_env_lock)) {
+		zc_error("pthread_rwlock_unlock fail, errno[%d]", errno);
+		return 0;
+	}
+	if (!changed) return 0;
+
+	if (pthread_mutex_trylock(&zlog_env_reload_mutex)) return 1;
+	if (zlog_reload_locked((char *)-1)) {
+		zc_error("conf file changed but zlog_reload fail, zlog-chk-conf [file] see detail");
+	}
+	pthread_mutex_unlock(&zlog_env_reload_mutex);
 	return 0;
 }
 /*******************************************************************************/
 void zlog_fini(void)
 {
 	int rc = 0;
+	zlog_env_snapshot_t *old_snapshot = NULL;
 
 	zc_debug("------zlog_fini start------");
+	/* wait a reload building a conf from zlog_env_conf */
+	rc = pthread_mutex_lock(&zlog_env_reload_mutex);
+	if (rc) {
+		zc_error("pthread_mutex_lock fail, rc[%d]", rc);
+		return;
+	}
 	rc = pthread_rwlock_wrlock(&zlog_env_lock);
 	if (rc) {
 		zc_error("pthread_rwlock_wrlock fail, rc[%d]", rc);
+		pthread_mutex_unlock(&zlog_env_reload_mutex);
 		return;
 	}
 
@@ -313,6 +507,10 @@ void zlog_fini(void)
 		goto exit;
 	}
 
+	zlog_env_publish(NULL, NULL, 0, &old_snapshot);
+	zlog_thread_synchronize();
+	free(old_snapshot);
+
 	zlog_fini_inner();
 	zlog_env_is_init = 0;
 
@@ -321,11 +519,67 @@ exit:
 	rc = pthread_rwlock_unlock(&zlog_env_lock);
 	if (rc) {
 		zc_error("pthread_rwlock_unlock fail, rc=[%d]", rc);
-		return;
 	}
+	pthread_mutex_unlock(&zlog_env_reload_mutex);
 	return;
 }
 /*******************************************************************************/
+int zlog_flush(void)
+{
+	int rc = 0;
+
+	rc = pthread_rwlock_rdlock(&zlog_env_lock);
+	if (rc) {
+		zc_error("pthread_rwlock_rdlock fail, rc[%d]", rc);
+		return -1;
+	}
+
+	if (!zlog_env_is_init) {
+		zc_error("never call zlog_init() or dzlog_init() before");
+		rc = -1;
+		goto exit;
+	}
+
+	/* wait msgs logged before now in async rings are written */
+	zlog_async_flush();
+
+exit:
+	if (pthread_rwlock_unlock(&zlog_env_lock)) {
+		zc_error("pthread_rwlock_unlock fail, errno[%d]", errno);
+		return -1;
+	}
+	return rc;
+}
+
+int zlog_sync(void)
+{
+	int rc = 0;
+
+	rc = pthread_rwlock_rdlock(&zlog_env_lock);
+	if (rc) {
+		zc_error("pthread_rwlock_rdlock fail, rc[%d]", rc);
+		return -1;
+	}
+
+	if (!zlog_env_is_init) {
+		zc_error("never call zlog_init() or dzlog_init() before");
+		rc = -1;
+		goto exit;
+	}
+
+	/* msgs logged before now are written, then on disk,
+	 * in one round with other threads waiting */
+	zlog_async_flush();
+	zlog_syncer_wait();
+
+exit:
+	if (pthread_rwlock_unlock(&zlog_env_lock)) {
+		zc_error("pthread_rwlock_unlock fail, errno[%d]", errno);
+		return -1;
+	}
+	return rc;
+}
+/*******************************************************************************/
 zlog_category_t *zlog_get_category(const char *cname)
 {
 	int rc = 0;
@@ -374,6 +628,8 @@ err:
 int dzlog_set_category(const char *cname)
 {
 	int rc = 0;
+	zlog_category_t *a_category;
+	zlog_env_snapshot_t *old_snapshot = NULL;
 	zc_assert(cname, -1);
 
 	zc_debug("------dzlog_set_category[%s] start------", cname);
@@ -388,15 +644,24 @@ int dzlog_set_category(const char *cname)
 		goto err;
 	}
 
-	zlog_default_category = zlog_category_table_fetch_category(
+	a_category = zlog_category_table_fetch_category(
 				zlog_env_categories,
 				cname,
 				zlog_env_conf->rules);
-	if (!zlog_default_category) {
+	if (!a_category) {
 		zc_error("zlog_category_table_fetch_category[%s] fail", cname);
 		goto err;
 	}
 
+	if (zlog_env_publish(zlog_env_conf, a_category,
+			zlog_env_init_version, &old_snapshot)) {
+		zc_error("zlog_env_publish fail");
+		goto err;
+	}
+	zlog_default_category = a_category;
+	zlog_thread_synchronize();
+	free(old_snapshot);
+
 	zc_debug("------dzlog_set_category[%s] end, success------ ", cname);
 	rc = pthread_rwlock_unlock(&zlog_env_lock);
 	if (rc) {
@@ -414,42 +679,65 @@ err:
 	return -1;
 }
 /*******************************************************************************/
+/* slow path, the 1st log of a thread, caller holds zlog_env_lock */
+static zlog_thread_t *zlog_new_thread(void)
+{
+	int rc;
+	zlog_thread_t *a_thread;
+
+	if (!zlog_env_is_init) {
+		zc_error("never call zlog_init() or dzlog_init() before");
+		return NULL;
+	}
+
+	a_thread = zlog_thread_new(zlog_env_init_version,
+			zlog_env_conf->buf_size_min, zlog_env_conf->buf_size_max,
+			zlog_env_conf->time_cache_count);
+	if (!a_thread) {
+		zc_error("zlog_thread_new fail");
+		return NULL;
+	}
+	a_thread->async_writer = zlog_async_is_writer();
+
+	rc = pthread_setspecific(zlog_thread_key, a_thread);
+	if (rc) {
+		zlog_thread_del(a_thread);
+		zc_error("pthread_setspecific fail, rc[%d]", rc);
+		return NULL;
+	}
+	return a_thread;
+}
+
+/* zlog_thread_key is created at the 1st init, after that version is not 0 */
 #define zlog_fetch_thread(a_thread, fail_goto) do {  \
-	int rd = 0;  \
-	a_thread = pthread_getspecific(zlog_thread_key);  \
+	a_thread = zlog_env_init_version ? pthread_getspecific(zlog_thread_key) : NULL;  \
 	if (!a_thread) {  \
-		a_thread = zlog_thread_new(zlog_env_init_version,  \
-				zlog_env_conf->buf_size_min, zlog_env_conf->buf_size_max, \
-				zlog_env_conf->time_cache_count); \
-		if (!a_thread) {  \
-			zc_error("zlog_thread_new fail");  \
-			goto fail_goto;  \
-		}  \
-  \
-		rd = pthread_setspecific(zlog_thread_key, a_thread);  \
-		if (rd) {  \
-			zlog_thread_del(a_thread);  \
-			zc_error("pthread_setspecific fail, rd[%d]", rd);  \
-			goto fail_goto;  \
-		}  \
+		pthread_rwlock_rdlock(&zlog_env_lock);  \
+		a_thread = zlog_new_thread();  \
+		pthread_rwlock_unlock(&zlog_env_lock);  \
+		if (!a_thread) goto fail_goto;  \
 	}  \
-  \
-	if (a_thread->init_version != zlog_env_init_version) {  \
+} while (0)
+
+/* in epoch, a_snapshot->conf is alive */
+#define zlog_refresh_thread(a_thread, a_snapshot, fail_goto) do {  \
+	int rd = 0;  \
+	if (a_thread->init_version != a_snapshot->init_version) {  \
 		/* as mdc is still here, so can not easily del and new */ \
 		rd = zlog_thread_rebuild_msg_buf(a_thread, \
-				zlog_env_conf->buf_size_min, \
-				zlog_env_conf->buf_size_max);  \
+				a_snapshot->conf->buf_size_min, \
+				a_snapshot->conf->buf_size_max);  \
 		if (rd) {  \
 			zc_error("zlog_thread_resize_msg_buf fail, rd[%d]", rd);  \
 			goto fail_goto;  \
 		}  \
   \
-		rd = zlog_thread_rebuild_event(a_thread, zlog_env_conf->time_cache_count);  \
+		rd = zlog_thread_rebuild_event(a_thread, a_snapshot->conf->time_cache_count);  \
 		if (rd) {  \
 			zc_error("zlog_thread_resize_msg_buf fail, rd[%d]", rd);  \
 			goto fail_goto;  \
 		}  \
-		a_thread->init_version = zlog_env_init_version;  \
+		a_thread->init_version = a_snapshot->init_version;  \
 	}  \
 } while (0)
 
@@ -473,7 +761,11 @@ int zlog_put_mdc(const char *key, const char *value)
 		goto err;
 	}
 
-	zlog_fetch_thread(a_thread, err);
+	a_thread = pthread_getspecific(zlog_thread_key);
+	if (!a_thread) {
+		a_thread = zlog_new_thread();
+		if (!a_thread) goto err;
+	}
 
 	if (zlog_mdc_put(a_thread->mdc, key, value)) {
 		zc_error("zlog_mdc_put fail, key[%s], value[%s]", key, value);
@@ -610,6 +902,57 @@ exit:
 }
 
 /*******************************************************************************/
+/* loggers never take zlog_env_lock, they enter the epoch of the thread,
+ * read the snapshot, and leave after output.
+ * Writers publish a new snapshot and wait by zlog_thread_synchronize()
+ * before freeing the old one.
+ */
+#define zlog_enter_snapshot(a_thread, a_snapshot, fail_goto) do {  \
+	zlog_thread_epoch_enter(a_thread);  \
+	a_snapshot = zc_load_acquire(&zlog_env_snapshot);  \
+	if (!a_snapshot) {  \
+		zc_error("never call zlog_init() or dzlog_init() before");  \
+		goto fail_goto;  \
+	}  \
+	zlog_refresh_thread(a_thread, a_snapshot, fail_goto);  \
+	a_thread->conf = a_snapshot->conf;  \
+} while (0)
+
+/* msgs are counted in thread, and added to the shared counter in batches,
+ * so a logger does not write a cache line of other threads each time.
+ * the counter is not exactly, zlog_reload() test again under wrlock */
+#define ZLOG_RELOAD_CONF_BATCH 256
+
+static int zlog_count_reload_period(zlog_thread_t * a_thread, size_t period)
+{
+	size_t count;
+
+	if (++a_thread->reload_conf_count < ZLOG_RELOAD_CONF_BATCH
+		&& a_thread->reload_conf_count < period) return 0;
+
+	count = zc_atomic_add(&zlog_env_reload_conf_count, a_thread->reload_conf_count);
+	a_thread->reload_conf_count = 0;
+	return count > period;
+}
+
+#define zlog_reach_reload_period(a_snapshot, a_thread) \
+	(a_snapshot->conf->reload_conf_period && \
+	 zlog_count_reload_period(a_thread, a_snapshot->conf->reload_conf_period))
+
+#define zlog_leave_and_reload(a_thread) do {  \
+	zlog_thread_epoch_leave(a_thread);  \
+	/* may be wrlock, so after leave */  \
+	zlog_reload_if_changed(0);  \
+} while (0)
+
+/* with async deferred format, pack args for writer threads,
+ * return non-zero if the caller should format itself */
+#define zlog_defer(a_snapshot, a_category, a_thread, \
+		file, filelen, func, funclen, line, level, format, args) \
+	(!a_snapshot->conf->async_deferred_format || \
+	 zlog_async_defer(a_snapshot->conf, a_category, a_thread, \
+		file, filelen, func, funclen, line, level, format, args))
+
 void vzlog(zlog_category_t * category,
 	const char *file, size_t filelen,
 	const char *func, size_t funclen,
@@ -617,8 +960,9 @@ void vzlog(zlog_category_t * category,
 	const char *format, va_list args)
 {
 	zlog_thread_t *a_thread;
+	zlog_env_snapshot_t *a_snapshot;
 
-	/* The bitmap determination here is not under the protection of rdlock.
+	/* The bitmap determination here is not under the protection of epoch.
 	 * It may be changed by other CPU by zlog_reload() halfway.
 	 *
 	 * Old or strange value may be read here,
@@ -626,44 +970,38 @@ void vzlog(zlog_category_t * category,
 	 * And will be the right value after zlog_reload()
 	 *
 	 * For speed up, if one log will not be ouput,
-	 * There is no need to aquire rdlock.
+	 * There is no need to enter epoch.
 	 */
-	if (zlog_category_needless_level(category, level)) return;
-
-	pthread_rwlock_rdlock(&zlog_env_lock);
-
-	if (!zlog_env_is_init) {
-		zc_error("never call zlog_init() or dzlog_init() before");
-		goto exit;
+	if (!category) {
+		zc_error("category is null, srcfile[%s], srcline[%ld]", file, line);
+		return;
 	}
+	if (zlog_category_needless_level(category, level)) return;
 
-	zlog_fetch_thread(a_thread, exit);
+	zlog_fetch_thread(a_thread, exit_none);
+	zlog_enter_snapshot(a_thread, a_snapshot, exit);
 
-	zlog_event_set_fmt(a_thread->event,
-		category->name, category->name_len,
-		file, filelen, func, funclen, line, level,
-		format, args);
+	if (zlog_defer(a_snapshot, category, a_thread,
+			file, filelen, func, funclen, line, level, format, args)) {
+		zlog_event_set_fmt(a_thread->event,
+			category->name, category->name_len,
+			file, filelen, func, funclen, line, level,
+			format, args);
 
-	if (zlog_category_output(category, a_thread)) {
-		zc_error("zlog_output fail, srcfile[%s], srcline[%ld]", file, line);
-		goto exit;
+		if (zlog_category_output(category, a_thread)) {
+			zc_error("zlog_output fail, srcfile[%s], srcline[%ld]", file, line);
+			goto exit;
+		}
 	}
 
-	if (zlog_env_conf->reload_conf_period &&
-		++zlog_env_reload_conf_count > zlog_env_conf->reload_conf_period ) {
-		/* under the protection of lock read env conf */
-		goto reload;
-	}
+	if (zlog_reach_reload_period(a_snapshot, a_thread)) goto reload;
 
 exit:
-	pthread_rwlock_unlock(&zlog_env_lock);
+	zlog_thread_epoch_leave(a_thread);
+exit_none:
 	return;
 reload:
-	pthread_rwlock_unlock(&zlog_env_lock);
-	/* will be wrlock, so after unlock */
-	if (zlog_reload((char *)-1)) {
-		zc_error("reach reload-conf-period but zlog_reload fail, zlog-chk-conf [file] see detail");
-	}
+	zlog_leave_and_reload(a_thread);
 	return;
 }
 
@@ -674,17 +1012,16 @@ void hzlog(zlog_category_t *category,
 	const void *buf, size_t buflen)
 {
 	zlog_thread_t *a_thread;
+	zlog_env_snapshot_t *a_snapshot;
 
-	if (zlog_category_needless_level(category, level)) return;
-
-	pthread_rwlock_rdlock(&zlog_env_lock);
-
-	if (!zlog_env_is_init) {
-		zc_error("never call zlog_init() or dzlog_init() before");
-		goto exit;
+	if (!category) {
+		zc_error("category is null, srcfile[%s], srcline[%ld]", file, line);
+		return;
 	}
+	if (zlog_category_needless_level(category, level)) return;
 
-	zlog_fetch_thread(a_thread, exit);
+	zlog_fetch_thread(a_thread, exit_none);
+	zlog_enter_snapshot(a_thread, a_snapshot, exit);
 
 	zlog_event_set_hex(a_thread->event,
 		category->name, category->name_len,
@@ -696,21 +1033,14 @@ void hzlog(zlog_category_t *category,
 		goto exit;
 	}
 
-	if (zlog_env_conf->reload_conf_period &&
-		++zlog_env_reload_conf_count > zlog_env_conf->reload_conf_period ) {
-		/* under the protection of lock read env conf */
-		goto reload;
-	}
+	if (zlog_reach_reload_period(a_snapshot, a_thread)) goto reload;
 
 exit:
-	pthread_rwlock_unlock(&zlog_env_lock);
+	zlog_thread_epoch_leave(a_thread);
+exit_none:
 	return;
 reload:
-	pthread_rwlock_unlock(&zlog_env_lock);
-	/* will be wrlock, so after unlock */
-	if (zlog_reload((char *)-1)) {
-		zc_error("reach reload-conf-period but zlog_reload fail, zlog-chk-conf [file] see detail");
-	}
+	zlog_leave_and_reload(a_thread);
 	return;
 }
 
@@ -722,50 +1052,43 @@ void vdzlog(const char *file, size_t filelen,
 	const char *format, va_list args)
 {
 	zlog_thread_t *a_thread;
+	zlog_env_snapshot_t *a_snapshot;
+	zlog_category_t *a_category;
 
-	if (zlog_category_needless_level(zlog_default_category, level)) return;
+	zlog_fetch_thread(a_thread, exit_none);
+	zlog_enter_snapshot(a_thread, a_snapshot, exit);
 
-	pthread_rwlock_rdlock(&zlog_env_lock);
-
-	if (!zlog_env_is_init) {
-		zc_error("never call zlog_init() or dzlog_init() before");
-		goto exit;
-	}
-
-	/* that's the differnce, must judge default_category in lock */
-	if (!zlog_default_category) {
+	/* that's the differnce, must judge default_category in epoch */
+	a_category = a_snapshot->default_category;
+	if (!a_category) {
 		zc_error("zlog_default_category is null,"
 			"dzlog_init() or dzlog_set_cateogry() is not called above");
 		goto exit;
 	}
 
-	zlog_fetch_thread(a_thread, exit);
+	if (zlog_category_needless_level(a_category, level)) goto exit;
 
-	zlog_event_set_fmt(a_thread->event,
-		zlog_default_category->name, zlog_default_category->name_len,
-		file, filelen, func, funclen, line, level,
-		format, args);
+	if (zlog_defer(a_snapshot, a_category, a_thread,
+			file, filelen, func, funclen, line, level, format, args)) {
+		zlog_event_set_fmt(a_thread->event,
+			a_category->name, a_category->name_len,
+			file, filelen, func, funclen, line, level,
+			format, args);
 
-	if (zlog_category_output(zlog_default_category, a_thread)) {
-		zc_error("zlog_output fail, srcfile[%s], srcline[%ld]", file, line);
-		goto exit;
+		if (zlog_category_output(a_category, a_thread)) {
+			zc_error("zlog_output fail, srcfile[%s], srcline[%ld]", file, line);
+			goto exit;
+		}
 	}
 
-	if (zlog_env_conf->reload_conf_period &&
-		++zlog_env_reload_conf_count > zlog_env_conf->reload_conf_period ) {
-		/* under the protection of lock read env conf */
-		goto reload;
-	}
+	if (zlog_reach_reload_period(a_snapshot, a_thread)) goto reload;
 
 exit:
-	pthread_rwlock_unlock(&zlog_env_lock);
+	zlog_thread_epoch_leave(a_thread);
+exit_none:
 	return;
 reload:
-	pthread_rwlock_unlock(&zlog_env_lock);
-	/* will be wrlock, so after unlock */
-	if (zlog_reload((char *)-1)) {
-		zc_error("reach reload-conf-period but zlog_reload fail, zlog-chk-conf [file] see detail");
-	}
+	zlog_leave_and_reload(a_thread);
 	return;
 }
 
@@ -775,50 +1098,40 @@ void hdzlog(const char *file, size_t filelen,
 	const void *buf, size_t buflen)
 {
 	zlog_thread_t *a_thread;
+	zlog_env_snapshot_t *a_snapshot;
+	zlog_category_t *a_category;
 
-	if (zlog_category_needless_level(zlog_default_category, level)) return;
+	zlog_fetch_thread(a_thread, exit_none);
+	zlog_enter_snapshot(a_thread, a_snapshot, exit);
 
-	pthread_rwlock_rdlock(&zlog_env_lock);
-
-	if (!zlog_env_is_init) {
-		zc_error("never call zlog_init() or dzlog_init() before");
-		goto exit;
-	}
-
-	/* that's the differnce, must judge default_category in lock */
-	if (!zlog_default_category) {
+	/* that's the differnce, must judge default_category in epoch */
+	a_category = a_snapshot->default_category;
+	if (!a_category) {
 		zc_error("zlog_default_category is null,"
 			"dzlog_init() or dzlog_set_cateogry() is not called above");
 		goto exit;
 	}
 
-	zlog_fetch_thread(a_thread, exit);
+	if (zlog_category_needless_level(a_category, level)) goto exit;
 
 	zlog_event_set_hex(a_thread->event,
-		zlog_default_category->name, zlog_default_category->name_len,
+		a_category->name, a_category->name_len,
 		file, filelen, func, funclen, line, level,
 		buf, buflen);
 
-	if (zlog_category_output(zlog_default_category, a_thread)) {
+	if (zlog_category_output(a_category, a_thread)) {
 		zc_error("zlog_output fail, srcfile[%s], srcline[%ld]", file, line);
 		goto exit;
 	}
 
-	if (zlog_env_conf->reload_conf_period &&
-		++zlog_env_reload_conf_count > zlog_env_conf->reload_conf_period ) {
-		/* under the protection of lock read env conf */
-		goto reload;
-	}
+	if (zlog_reach_reload_period(a_snapshot, a_thread)) goto reload;
 
 exit:
-	pthread_rwlock_unlock(&zlog_env_lock);
+	zlog_thread_epoch_leave(a_thread);
+exit_none:
 	return;
 reload:
-	pthread_rwlock_unlock(&zlog_env_lock);
-	/* will be wrlock, so after unlock */
-	if (zlog_reload((char *)-1)) {
-		zc_error("reach reload-conf-period but zlog_reload fail, zlog-chk-conf [file] see detail");
-	}
+	zlog_leave_and_reload(a_thread);
 	return;
 }
 
@@ -829,102 +1142,193 @@ void zlog(zlog_category_t * category,
 	const char *format, ...)
 {
 	zlog_thread_t *a_thread;
+	zlog_env_snapshot_t *a_snapshot;
 	va_list args;
 
 	if (category && zlog_category_needless_level(category, level)) return;
 
-	pthread_rwlock_rdlock(&zlog_env_lock);
+	zlog_fetch_thread(a_thread, exit_none);
+	zlog_enter_snapshot(a_thread, a_snapshot, exit);
 
-	if (!zlog_env_is_init) {
-		zc_error("never call zlog_init() or dzlog_init() before");
+	va_start(args, format);
+	if (zlog_defer(a_snapshot, category, a_thread,
+			file, filelen, func, funclen, line, level, format, args)) {
+		zlog_event_set_fmt(a_thread->event, category->name, category->name_len,
+			file, filelen, func, funclen, line, level,
+			format, args);
+		if (zlog_category_output(category, a_thread)) {
+			zc_error("zlog_output fail, srcfile[%s], srcline[%ld]", file, line);
+			va_end(args);
+			goto exit;
+		}
+	}
+	va_end(args);
+
+	if (zlog_reach_reload_period(a_snapshot, a_thread)) goto reload;
+
+exit:
+	zlog_thread_epoch_leave(a_thread);
+exit_none:
+	return;
+reload:
+	zlog_leave_and_reload(a_thread);
+	return;
+}
+
+/*******************************************************************************/
+void dzlog(const char *file, size_t filelen, const char *func, size_t funclen, long line, int level,
+	const char *format, ...)
+{
+	zlog_thread_t *a_thread;
+	zlog_env_snapshot_t *a_snapshot;
+	zlog_category_t *a_category;
+	va_list args;
+
+	zlog_fetch_thread(a_thread, exit_none);
+	zlog_enter_snapshot(a_thread, a_snapshot, exit);
+
+	/* that's the differnce, must judge default_category in epoch */
+	a_category = a_snapshot->default_category;
+	if (!a_category) {
+		zc_error("zlog_default_category is null,"
+			"dzlog_init() or dzlog_set_cateogry() is not called above");
 		goto exit;
 	}
 
-	zlog_fetch_thread(a_thread, exit);
+	if (zlog_category_needless_level(a_category, level)) goto exit;
 
 	va_start(args, format);
-	zlog_event_set_fmt(a_thread->event, category->name, category->name_len,
-		file, filelen, func, funclen, line, level,
-		format, args);
-	if (zlog_category_output(category, a_thread)) {
-		zc_error("zlog_output fail, srcfile[%s], srcline[%ld]", file, line);
-		va_end(args);
-		goto exit;
+	if (zlog_defer(a_snapshot, a_category, a_thread,
+			file, filelen, func, funclen, line, level, format, args)) {
+		zlog_event_set_fmt(a_thread->event,
+			a_category->name, a_category->name_len,
+			file, filelen, func, funclen, line, level,
+			format, args);
+
+		if (zlog_category_output(a_category, a_thread)) {
+			zc_error("zlog_output fail, srcfile[%s], srcline[%ld]", file, line);
+			va_end(args);
+			goto exit;
+		}
 	}
 	va_end(args);
 
-	if (zlog_env_conf->reload_conf_period &&
-		++zlog_env_reload_conf_count > zlog_env_conf->reload_conf_period ) {
-		/* under the protection of lock read env conf */
-		goto reload;
-	}
+	if (zlog_reach_reload_period(a_snapshot, a_thread)) goto reload;
 
 exit:
-	pthread_rwlock_unlock(&zlog_env_lock);
+	zlog_thread_epoch_leave(a_thread);
+exit_none:
 	return;
 reload:
-	pthread_rwlock_unlock(&zlog_env_lock);
-	/* will be wrlock, so after unlock */
-	if (zlog_reload((char *)-1)) {
-		zc_error("reach reload-conf-period but zlog_reload fail, zlog-chk-conf [file] see detail");
-	}
+	zlog_leave_and_reload(a_thread);
 	return;
 }
 
 /*******************************************************************************/
-void dzlog(const char *file, size_t filelen, const char *func, size_t funclen, long line, int level,
+/* base name is found once, and shared by all calls of a callsite.
+ * threads at the 1st call race to store the same pointer, so atomically */
+#define zlog_callsite_prepare(a_callsite, a_file_base) do { \
+	(a_file_base) = zc_load_acquire(&(a_callsite)->file_base); \
+	if (!(a_file_base)) { \
+		const char *p = strrchr((a_callsite)->file, '/'); \
+		(a_file_base) = p ? p + 1 : (a_callsite)->file; \
+		zc_store_release(&(a_callsite)->file_base, (a_file_base)); \
+	} \
+} while (0)
+
+void czlog(zlog_category_t * category, zlog_callsite_t * callsite,
 	const char *format, ...)
 {
 	zlog_thread_t *a_thread;
+	zlog_env_snapshot_t *a_snapshot;
+	const char *file_base;
 	va_list args;
 
+	if (!category) {
+		zc_error("category is null, srcfile[%s], srcline[%ld]", callsite->file, callsite->line);
+		return;
+	}
+	if (zlog_category_needless_level(category, callsite->level)) return;
 
-	pthread_rwlock_rdlock(&zlog_env_lock);
+	zlog_fetch_thread(a_thread, exit_none);
+	zlog_enter_snapshot(a_thread, a_snapshot, exit);
+	zlog_callsite_prepare(callsite, file_base);
 
-	if (!zlog_env_is_init) {
-		zc_error("never call zlog_init() or dzlog_init() before");
-		goto exit;
+	va_start(args, format);
+	if (zlog_defer(a_snapshot, category, a_thread,
+			callsite->file, callsite->file_len, callsite->func, callsite->func_len,
+			callsite->line, callsite->level, format, args)) {
+		zlog_event_set_fmt(a_thread->event, category->name, category->name_len,
+			callsite->file, callsite->file_len, callsite->func, callsite->func_len,
+			callsite->line, callsite->level, format, args);
+		a_thread->event->file_base = file_base;
+		if (zlog_category_output(category, a_thread)) {
+			zc_error("zlog_output fail, srcfile[%s], srcline[%ld]",
+				callsite->file, callsite->line);
+			va_end(args);
+			goto exit;
+		}
 	}
+	va_end(args);
 
-	/* that's the differnce, must judge default_category in lock */
-	if (!zlog_default_category) {
+	if (zlog_reach_reload_period(a_snapshot, a_thread)) goto reload;
+
+exit:
+	zlog_thread_epoch_leave(a_thread);
+exit_none:
+	return;
+reload:
+	zlog_leave_and_reload(a_thread);
+	return;
+}
+
+void cdzlog(zlog_callsite_t * callsite, const char *format, ...)
+{
+	zlog_thread_t *a_thread;
+	zlog_env_snapshot_t *a_snapshot;
+	zlog_category_t *a_category;
+	const char *file_base;
+	va_list args;
+
+	zlog_fetch_thread(a_thread, exit_none);
+	zlog_enter_snapshot(a_thread, a_snapshot, exit);
+
+	/* that's the differnce, must judge default_category in epoch */
+	a_category = a_snapshot->default_category;
+	if (!a_category) {
 		zc_error("zlog_default_category is null,"
 			"dzlog_init() or dzlog_set_cateogry() is not called above");
 		goto exit;
 	}
 
-	if (zlog_category_needless_level(zlog_default_category, level)) goto exit;
-
-	zlog_fetch_thread(a_thread, exit);
+	if (zlog_category_needless_level(a_category, callsite->level)) goto exit;
+	zlog_callsite_prepare(callsite, file_base);
 
 	va_start(args, format);
-	zlog_event_set_fmt(a_thread->event,
-		zlog_default_category->name, zlog_default_category->name_len,
-		file, filelen, func, funclen, line, level,
-		format, args);
-
-	if (zlog_category_output(zlog_default_category, a_thread)) {
-		zc_error("zlog_output fail, srcfile[%s], srcline[%ld]", file, line);
-		va_end(args);
-		goto exit;
+	if (zlog_defer(a_snapshot, a_category, a_thread,
+			callsite->file, callsite->file_len, callsite->func, callsite->func_len,
+			callsite->line, callsite->level, format, args)) {
+		zlog_event_set_fmt(a_thread->event, a_category->name, a_category->name_len,
+			callsite->file, callsite->file_len, callsite->func, callsite->func_len,
+			callsite->line, callsite->level, format, args);
+		a_thread->event->file_base = file_base;
+		if (zlog_category_output(a_category, a_thread)) {
+			zc_error("zlog_output fail, srcfile[%s], srcline[%ld]",
+				callsite->file, callsite->line);
+			va_end(args);
+			goto exit;
+		}
 	}
 	va_end(args);
 
-	if (zlog_env_conf->reload_conf_period &&
-		++zlog_env_reload_conf_count > zlog_env_conf->reload_conf_period ) {
-		/* under the protection of lock read env conf */
-		goto reload;
-	}
+	if (zlog_reach_reload_period(a_snapshot, a_thread)) goto reload;
 
 exit:
-	pthread_rwlock_unlock(&zlog_env_lock);
+	zlog_thread_epoch_leave(a_thread);
+exit_none:
 	return;
 reload:
-	pthread_rwlock_unlock(&zlog_env_lock);
-	/* will be wrlock, so after unlock */
-	if (zlog_reload((char *)-1)) {
-		zc_error("reach reload-conf-period but zlog_reload fail, zlog-chk-conf [file] see detail");
-	}
+	zlog_leave_and_reload(a_thread);
 	return;
 }
 
@@ -943,6 +1347,9 @@ void zlog_profile(void)
 	zlog_conf_profile(zlog_env_conf, ZC_WARN);
 	zlog_record_table_profile(zlog_env_records, ZC_WARN);
 	zlog_category_table_profile(zlog_env_categories, ZC_WARN);
+	zlog_fd_cache_profile(ZC_WARN);
+	zlog_syncer_profile(ZC_WARN);
+	zlog_watcher_profile(ZC_WARN);
 	if (zlog_default_category) {
 		zc_warn("-default_category-");
 		zlog_category_profile(zlog_default_category, ZC_WARN);
@@ -27,6 +27,8 @@ typedef struct zlog_category_s zlog_category_t;
 int zlog_init(const char *confpath);
 int zlog_reload(const char *confpath);
 void zlog_fini(void);
+int zlog_flush(void);
+int zlog_sync(void);
 
 void zlog_profile(void);
 
@@ -53,6 +55,24 @@ void hzlog(zlog_category_t * category,
 	long line, int level,
 	const void *buf, size_t buflen);
 
+/* a log statement, the macros below keep one static for each of them,
+ * so src info and level are passed as one pointer */
+typedef struct zlog_callsite_s {
+	const char *file;
+	size_t file_len;
+	const char *func;
+	size_t func_len;
+	long line;
+	int level;
+	const char *file_base; /* after the last '/' of file, set at 1st call */
+} zlog_callsite_t;
+
+#define zlog_callsite_init(level) \
+	{ __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, level, NULL }
+
+void czlog(zlog_category_t * category, zlog_callsite_t * callsite,
+	const char *format, ...) ZLOG_CHECK_PRINTF(3,4);
+
 int dzlog_init(const char *confpath, const char *cname);
 int dzlog_set_category(const char *cname);
 
@@ -69,6 +89,9 @@ void hdzlog(const char *file, size_t filelen,
 	long line, int level,
 	const void *buf, size_t buflen);
 
+void cdzlog(zlog_callsite_t * callsite,
+	const char *format, ...) ZLOG_CHECK_PRINTF(2,3);
+
 typedef struct zlog_msg_s {
 	char *buf;
 	size_t len;
@@ -89,6 +112,23 @@ typedef enum {
 	ZLOG_LEVEL_FATAL = 120
 } zlog_level; 
 
+/* calls of macros below ZLOG_MIN_LEVEL are compiled out, args are not
+ * evaluated, set it before include, e.g. -DZLOG_MIN_LEVEL=ZLOG_LEVEL_INFO */
+#ifndef ZLOG_MIN_LEVEL
+#define ZLOG_MIN_LEVEL 0
+#endif
+
+/* category of dzlog, read only */
+extern zlog_category_t *zlog_default_category;
+
+/* level_bitmap is the first member of zlog_category_t, so macros check
+ * it before args are evaluated and zlog() is called.
+ * cat is evaluated twice, the macros below pass it once bound to a variable.
+ * a NULL cat goes on to czlog(), vzlog() or hzlog(), which report the error */
+#define zlog_level_enabled(cat, level) \
+	((level) >= ZLOG_MIN_LEVEL && (!(cat) \
+	|| ((((const unsigned char *)(cat))[(level) / 8] >> (7 - (level) % 8)) & 0x01)))
+
 #if !defined(__STDC_VERSION__) || __STDC_VERSION__ < 199901L
 # if defined __GNUC__ && __GNUC__ >= 2
 #  define __func__ __FUNCTION__
@@ -97,166 +137,275 @@ typedef enum {
 # endif
 #endif
 
+/* zlog and dzlog macros are statements, as they keep a static callsite */
 #if defined __STDC_VERSION__ && __STDC_VERSION__ >= 199901L
 /* zlog macros */
-#define zlog_fatal(cat, ...) \
-	zlog(cat, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_FATAL, __VA_ARGS__)
-#define zlog_error(cat, ...) \
-	zlog(cat, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_ERROR, __VA_ARGS__)
-#define zlog_warn(cat, ...) \
-	zlog(cat, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_WARN, __VA_ARGS__)
-#define zlog_notice(cat, ...) \
-	zlog(cat, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_NOTICE, __VA_ARGS__)
-#define zlog_info(cat, ...) \
-	zlog(cat, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_INFO, __VA_ARGS__)
-#define zlog_debug(cat, ...) \
-	zlog(cat, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_DEBUG, __VA_ARGS__)
+#define zlog_fatal(cat, ...) do { \
+	static zlog_callsite_t zlog_callsite_ = zlog_callsite_init(ZLOG_LEVEL_FATAL); \
+	zlog_category_t *zlog_cat_ = (cat); \
+	if (zlog_level_enabled(zlog_cat_, ZLOG_LEVEL_FATAL)) \
+		czlog(zlog_cat_, &zlog_callsite_, __VA_ARGS__); \
+} while (0)
+#define zlog_error(cat, ...) do { \
+	static zlog_callsite_t zlog_callsite_ = zlog_callsite_init(ZLOG_LEVEL_ERROR); \
+	zlog_category_t *zlog_cat_ = (cat); \
+	if (zlog_level_enabled(zlog_cat_, ZLOG_LEVEL_ERROR)) \
+		czlog(zlog_cat_, &zlog_callsite_, __VA_ARGS__); \
+} while (0)
+#define zlog_warn(cat, ...) do { \
+	static zlog_callsite_t zlog_callsite_ = zlog_callsite_init(ZLOG_LEVEL_WARN); \
+	zlog_category_t *zlog_cat_ = (cat); \
+	if (zlog_level_enabled(zlog_cat_, ZLOG_LEVEL_WARN)) \
+		czlog(zlog_cat_, &zlog_callsite_, __VA_ARGS__); \
+} while (0)
+#define zlog_notice(cat, ...) do { \
+	static zlog_callsite_t zlog_callsite_ = zlog_callsite_init(ZLOG_LEVEL_NOTICE); \
+	zlog_category_t *zlog_cat_ = (cat); \
+	if (zlog_level_enabled(zlog_cat_, ZLOG_LEVEL_NOTICE)) \
+		czlog(zlog_cat_, &zlog_callsite_, __VA_ARGS__); \
+} while (0)
+#define zlog_info(cat, ...) do { \
+	static zlog_callsite_t zlog_callsite_ = zlog_callsite_init(ZLOG_LEVEL_INFO); \
+	zlog_category_t *zlog_cat_ = (cat); \
+	if (zlog_level_enabled(zlog_cat_, ZLOG_LEVEL_INFO)) \
+		czlog(zlog_cat_, &zlog_callsite_, __VA_ARGS__); \
+} while (0)
+#define zlog_debug(cat, ...) do { \
+	static zlog_callsite_t zlog_callsite_ = zlog_callsite_init(ZLOG_LEVEL_DEBUG); \
+	zlog_category_t *zlog_cat_ = (cat); \
+	if (zlog_level_enabled(zlog_cat_, ZLOG_LEVEL_DEBUG)) \
+		czlog(zlog_cat_, &zlog_callsite_, __VA_ARGS__); \
+} while (0)
 /* dzlog macros */
-#define dzlog_fatal(...) \
-	dzlog(__FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_FATAL, __VA_ARGS__)
-#define dzlog_error(...) \
-	dzlog(__FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_ERROR, __VA_ARGS__)
-#define dzlog_warn(...) \
-	dzlog(__FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_WARN, __VA_ARGS__)
-#define dzlog_notice(...) \
-	dzlog(__FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_NOTICE, __VA_ARGS__)
-#define dzlog_info(...) \
-	dzlog(__FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_INFO, __VA_ARGS__)
-#define dzlog_debug(...) \
-	dzlog(__FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_DEBUG, __VA_ARGS__)
+#define dzlog_fatal(...) do { \
+	static zlog_callsite_t zlog_callsite_ = zlog_callsite_init(ZLOG_LEVEL_FATAL); \
+	if (zlog_level_enabled(zlog_default_category, ZLOG_LEVEL_FATAL)) \
+		cdzlog(&zlog_callsite_, __VA_ARGS__); \
+} while (0)
+#define dzlog_error(...) do { \
+	static zlog_callsite_t zlog_callsite_ = zlog_callsite_init(ZLOG_LEVEL_ERROR); \
+	if (zlog_level_enabled(zlog_default_category, ZLOG_LEVEL_ERROR)) \
+		cdzlog(&zlog_callsite_, __VA_ARGS__); \
+} while (0)
+#define dzlog_warn(...) do { \
+	static zlog_callsite_t zlog_callsite_ = zlog_callsite_init(ZLOG_LEVEL_WARN); \
+	if (zlog_level_enabled(zlog_default_category, ZLOG_LEVEL_WARN)) \
+		cdzlog(&zlog_callsite_, __VA_ARGS__); \
+} while (0)
+#define dzlog_notice(...) do { \
+	static zlog_callsite_t zlog_callsite_ = zlog_callsite_init(ZLOG_LEVEL_NOTICE); \
+	if (zlog_level_enabled(zlog_default_category, ZLOG_LEVEL_NOTICE)) \
+		cdzlog(&zlog_callsite_, __VA_ARGS__); \
+} while (0)
+#define dzlog_info(...) do { \
+	static zlog_callsite_t zlog_callsite_ = zlog_callsite_init(ZLOG_LEVEL_INFO); \
+	if (zlog_level_enabled(zlog_default_category, ZLOG_LEVEL_INFO)) \
+		cdzlog(&zlog_callsite_, __VA_ARGS__); \
+} while (0)
+#define dzlog_debug(...) do { \
+	static zlog_callsite_t zlog_callsite_ = zlog_callsite_init(ZLOG_LEVEL_DEBUG); \
+	if (zlog_level_enabled(zlog_default_category, ZLOG_LEVEL_DEBUG)) \
+		cdzlog(&zlog_callsite_, __VA_ARGS__); \
+} while (0)
 #elif defined __GNUC__
 /* zlog macros */
-#define zlog_fatal(cat, format, args...) \
-	zlog(cat, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_FATAL, format, ##args)
-#define zlog_error(cat, format, args...) \
-	zlog(cat, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_ERROR, format, ##args)
-#define zlog_warn(cat, format, args...) \
-	zlog(cat, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_WARN, format, ##args)
-#define zlog_notice(cat, format, args...) \
-	zlog(cat, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_NOTICE, format, ##args)
-#define zlog_info(cat, format, args...) \
-	zlog(cat, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_INFO, format, ##args)
-#define zlog_debug(cat, format, args...) \
-	zlog(cat, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_DEBUG, format, ##args)
+#define zlog_fatal(cat, format, args...) do { \
+	static zlog_callsite_t zlog_callsite_ = zlog_callsite_init(ZLOG_LEVEL_FATAL); \
+	zlog_category_t *zlog_cat_ = (cat); \
+	if (zlog_level_enabled(zlog_cat_, ZLOG_LEVEL_FATAL)) \
+		czlog(zlog_cat_, &zlog_callsite_, format, ##args); \
+} while (0)
+#define zlog_error(cat, format, args...) do { \
+	static zlog_callsite_t zlog_callsite_ = zlog_callsite_init(ZLOG_LEVEL_ERROR); \
+	zlog_category_t *zlog_cat_ = (cat); \
+	if (zlog_level_enabled(zlog_cat_, ZLOG_LEVEL_ERROR)) \
+		czlog(zlog_cat_, &zlog_callsite_, format, ##args); \
+} while (0)
+#define zlog_warn(cat, format, args...) do { \
+	static zlog_callsite_t zlog_callsite_ = zlog_callsite_init(ZLOG_LEVEL_WARN); \
+	zlog_category_t *zlog_cat_ = (cat); \
+	if (zlog_level_enabled(zlog_cat_, ZLOG_LEVEL_WARN)) \
+		czlog(zlog_cat_, &zlog_callsite_, format, ##args); \
+} while (0)
+#define zlog_notice(cat, format, args...) do { \
+	static zlog_callsite_t zlog_callsite_ = zlog_callsite_init(ZLOG_LEVEL_NOTICE); \
+	zlog_category_t *zlog_cat_ = (cat); \
+	if (zlog_level_enabled(zlog_cat_, ZLOG_LEVEL_NOTICE)) \
+		czlog(zlog_cat_, &zlog_callsite_, format, ##args); \
+} while (0)
+#define zlog_info(cat, format, args...) do { \
+	static zlog_callsite_t zlog_callsite_ = zlog_callsite_init(ZLOG_LEVEL_INFO); \
+	zlog_category_t *zlog_cat_ = (cat); \
+	if (zlog_level_enabled(zlog_cat_, ZLOG_LEVEL_INFO)) \
+		czlog(zlog_cat_, &zlog_callsite_, format, ##args); \
+} while (0)
+#define zlog_debug(cat, format, args...) do { \
+	static zlog_callsite_t zlog_callsite_ = zlog_callsite_init(ZLOG_LEVEL_DEBUG); \
+	zlog_category_t *zlog_cat_ = (cat); \
+	if (zlog_level_enabled(zlog_cat_, ZLOG_LEVEL_DEBUG)) \
+		czlog(zlog_cat_, &zlog_callsite_, format, ##args); \
+} while (0)
 /* dzlog macros */
-#define dzlog_fatal(format, args...) \
-	dzlog(__FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_FATAL, format, ##args)
-#define dzlog_error(format, args...) \
-	dzlog(__FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_ERROR, format, ##args)
-#define dzlog_warn(format, args...) \
-	dzlog(__FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_WARN, format, ##args)
-#define dzlog_notice(format, args...) \
-	dzlog(__FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_NOTICE, format, ##args)
-#define dzlog_info(format, args...) \
-	dzlog(__FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_INFO, format, ##args)
-#define dzlog_debug(format, args...) \
-	dzlog(__FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_DEBUG, format, ##args)
+#define dzlog_fatal(format, args...) do { \
+	static zlog_callsite_t zlog_callsite_ = zlog_callsite_init(ZLOG_LEVEL_FATAL); \
+	if (zlog_level_enabled(zlog_default_category, ZLOG_LEVEL_FATAL)) \
+		cdzlog(&zlog_callsite_, format, ##args); \
+} while (0)
+#define dzlog_error(format, args...) do { \
+	static zlog_callsite_t zlog_callsite_ = zlog_callsite_init(ZLOG_LEVEL_ERROR); \
+	if (zlog_level_enabled(zlog_default_category, ZLOG_LEVEL_ERROR)) \
+		cdzlog(&zlog_callsite_, format, ##args); \
+} while (0)
+#define dzlog_warn(format, args...) do { \
+	static zlog_callsite_t zlog_callsite_ = zlog_callsite_init(ZLOG_LEVEL_WARN); \
+	if (zlog_level_enabled(zlog_default_category, ZLOG_LEVEL_WARN)) \
+		cdzlog(&zlog_callsite_, format, ##args); \
+} while (0)
+#define dzlog_notice(format, args...) do { \
+	static zlog_callsite_t zlog_callsite_ = zlog_callsite_init(ZLOG_LEVEL_NOTICE); \
+	if (zlog_level_enabled(zlog_default_category, ZLOG_LEVEL_NOTICE)) \
+		cdzlog(&zlog_callsite_, format, ##args); \
+} while (0)
+#define dzlog_info(format, args...) do { \
+	static zlog_callsite_t zlog_callsite_ = zlog_callsite_init(ZLOG_LEVEL_INFO); \
+	if (zlog_level_enabled(zlog_default_category, ZLOG_LEVEL_INFO)) \
+		cdzlog(&zlog_callsite_, format, ##args); \
+} while (0)
+#define dzlog_debug(format, args...) do { \
+	static zlog_callsite_t zlog_callsite_ = zlog_callsite_init(ZLOG_LEVEL_DEBUG); \
+	if (zlog_level_enabled(zlog_default_category, ZLOG_LEVEL_DEBUG)) \
+		cdzlog(&zlog_callsite_, format, ##args); \
+} while (0)
 #endif
 
-/* vzlog macros */
-#define vzlog_fatal(cat, format, args) \
-	vzlog(cat, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_FATAL, format, args)
-#define vzlog_error(cat, format, args) \
-	vzlog(cat, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_ERROR, format, args)
-#define vzlog_warn(cat, format, args) \
-	vzlog(cat, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_WARN, format, args)
-#define vzlog_notice(cat, format, args) \
-	vzlog(cat, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_NOTICE, format, args)
-#define vzlog_info(cat, format, args) \
-	vzlog(cat, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_INFO, format, args)
-#define vzlog_debug(cat, format, args) \
-	vzlog(cat, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_DEBUG, format, args)
+/* vzlog and hzlog macros are statements too, to bind cat once */
+#define vzlog_fatal(cat, format, args) do { \
+	zlog_category_t *zlog_cat_ = (cat); \
+	if (zlog_level_enabled(zlog_cat_, ZLOG_LEVEL_FATAL)) \
+		vzlog(zlog_cat_, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
+		ZLOG_LEVEL_FATAL, format, args); \
+} while (0)
+#define vzlog_error(cat, format, args) do { \
+	zlog_category_t *zlog_cat_ = (cat); \
+	if (zlog_level_enabled(zlog_cat_, ZLOG_LEVEL_ERROR)) \
+		vzlog(zlog_cat_, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
+		ZLOG_LEVEL_ERROR, format, args); \
+} while (0)
+#define vzlog_warn(cat, format, args) do { \
+	zlog_category_t *zlog_cat_ = (cat); \
+	if (zlog_level_enabled(zlog_cat_, ZLOG_LEVEL_WARN)) \
+		vzlog(zlog_cat_, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
+		ZLOG_LEVEL_WARN, format, args); \
+} while (0)
+#define vzlog_notice(cat, format, args) do { \
+	zlog_category_t *zlog_cat_ = (cat); \
+	if (zlog_level_enabled(zlog_cat_, ZLOG_LEVEL_NOTICE)) \
+		vzlog(zlog_cat_, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
+		ZLOG_LEVEL_NOTICE, format, args); \
+} while (0)
+#define vzlog_info(cat, format, args) do { \
+	zlog_category_t *zlog_cat_ = (cat); \
+	if (zlog_level_enabled(zlog_cat_, ZLOG_LEVEL_INFO)) \
+		vzlog(zlog_cat_, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
+		ZLOG_LEVEL_INFO, format, args); \
+} while (0)
+#define vzlog_debug(cat, format, args) do { \
+	zlog_category_t *zlog_cat_ = (cat); \
+	if (zlog_level_enabled(zlog_cat_, ZLOG_LEVEL_DEBUG)) \
+		vzlog(zlog_cat_, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
+		ZLOG_LEVEL_DEBUG, format, args); \
+} while (0)
 
 /* hzlog macros */
-#define hzlog_fatal(cat, buf, buf_len) \
-	hzlog(cat, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_FATAL, buf, buf_len)
-#define hzlog_error(cat, buf, buf_len) \
-	hzlog(cat, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_ERROR, buf, buf_len)
-#define hzlog_warn(cat, buf, buf_len) \
-	hzlog(cat, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_WARN, buf, buf_len)
-#define hzlog_notice(cat, buf, buf_len) \
-	hzlog(cat, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_NOTICE, buf, buf_len)
-#define hzlog_info(cat, buf, buf_len) \
-	hzlog(cat, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_INFO, buf, buf_len)
-#define hzlog_debug(cat, buf, buf_len) \
-	hzlog(cat, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_DEBUG, buf, buf_len)
+#define hzlog_fatal(cat, buf, buf_len) do { \
+	zlog_category_t *zlog_cat_ = (cat); \
+	if (zlog_level_enabled(zlog_cat_, ZLOG_LEVEL_FATAL)) \
+		hzlog(zlog_cat_, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
+		ZLOG_LEVEL_FATAL, buf, buf_len); \
+} while (0)
+#define hzlog_error(cat, buf, buf_len) do { \
+	zlog_category_t *zlog_cat_ = (cat); \
+	if (zlog_level_enabled(zlog_cat_, ZLOG_LEVEL_ERROR)) \
+		hzlog(zlog_cat_, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
+		ZLOG_LEVEL_ERROR, buf, buf_len); \
+} while (0)
+#define hzlog_warn(cat, buf, buf_len) do { \
+	zlog_category_t *zlog_cat_ = (cat); \
+	if (zlog_level_enabled(zlog_cat_, ZLOG_LEVEL_WARN)) \
+		hzlog(zlog_cat_, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
+		ZLOG_LEVEL_WARN, buf, buf_len); \
+} while (0)
+#define hzlog_notice(cat, buf, buf_len) do { \
+	zlog_category_t *zlog_cat_ = (cat); \
+	if (zlog_level_enabled(zlog_cat_, ZLOG_LEVEL_NOTICE)) \
+		hzlog(zlog_cat_, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
+		ZLOG_LEVEL_NOTICE, buf, buf_len); \
+} while (0)
+#define hzlog_info(cat, buf, buf_len) do { \
+	zlog_category_t *zlog_cat_ = (cat); \
+	if (zlog_level_enabled(zlog_cat_, ZLOG_LEVEL_INFO)) \
+		hzlog(zlog_cat_, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
+		ZLOG_LEVEL_INFO, buf, buf_len); \
+} while (0)
+#define hzlog_debug(cat, buf, buf_len) do { \
+	zlog_category_t *zlog_cat_ = (cat); \
+	if (zlog_level_enabled(zlog_cat_, ZLOG_LEVEL_DEBUG)) \
+		hzlog(zlog_cat_, __FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
+		ZLOG_LEVEL_DEBUG, buf, buf_len); \
+} while (0)
 
 
 /* vdzlog macros */
 #define vdzlog_fatal(format, args) \
+	(zlog_level_enabled(zlog_default_category, ZLOG_LEVEL_FATAL) ? \
 	vdzlog(__FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_FATAL, format, args)
+	ZLOG_LEVEL_FATAL, format, args) : (void)0)
 #define vdzlog_error(format, args) \
+	(zlog_level_enabled(zlog_default_category, ZLOG_LEVEL_ERROR) ? \
 	vdzlog(__FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_ERROR, format, args)
+	ZLOG_LEVEL_ERROR, format, args) : (void)0)
 #define vdzlog_warn(format, args) \
+	(zlog_level_enabled(zlog_default_category, ZLOG_LEVEL_WARN) ? \
 	vdzlog(__FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_WARN, format, args)
+	ZLOG_LEVEL_WARN, format, args) : (void)0)
 #define vdzlog_notice(format, args) \
+	(zlog_level_enabled(zlog_default_category, ZLOG_LEVEL_NOTICE) ? \
 	vdzlog(__FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_NOTICE, format, args)
+	ZLOG_LEVEL_NOTICE, format, args) : (void)0)
 #define vdzlog_info(format, args) \
+	(zlog_level_enabled(zlog_default_category, ZLOG_LEVEL_INFO) ? \
 	vdzlog(__FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_INFO, format, args)
+	ZLOG_LEVEL_INFO, format, args) : (void)0)
 #define vdzlog_debug(format, args) \
+	(zlog_level_enabled(zlog_default_category, ZLOG_LEVEL_DEBUG) ? \
 	vdzlog(__FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_DEBUG, format, args)
+	ZLOG_LEVEL_DEBUG, format, args) : (void)0)
 
 /* hdzlog macros */
 #define hdzlog_fatal(buf, buf_len) \
+	(zlog_level_enabled(zlog_default_category, ZLOG_LEVEL_FATAL) ? \
 	hdzlog(__FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_FATAL, buf, buf_len)
+	ZLOG_LEVEL_FATAL, buf, buf_len) : (void)0)
 #define hdzlog_error(buf, buf_len) \
+	(zlog_level_enabled(zlog_default_category, ZLOG_LEVEL_ERROR) ? \
 	hdzlog(__FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_ERROR, buf, buf_len)
+	ZLOG_LEVEL_ERROR, buf, buf_len) : (void)0)
 #define hdzlog_warn(buf, buf_len) \
+	(zlog_level_enabled(zlog_default_category, ZLOG_LEVEL_WARN) ? \
 	hdzlog(__FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_WARN, buf, buf_len)
+	ZLOG_LEVEL_WARN, buf, buf_len) : (void)0)
 #define hdzlog_notice(buf, buf_len) \
+	(zlog_level_enabled(zlog_default_category, ZLOG_LEVEL_NOTICE) ? \
 	hdzlog(__FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_NOTICE, buf, buf_len)
+	ZLOG_LEVEL_NOTICE, buf, buf_len) : (void)0)
 #define hdzlog_info(buf, buf_len) \
+	(zlog_level_enabled(zlog_default_category, ZLOG_LEVEL_INFO) ? \
 	hdzlog(__FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_INFO, buf, buf_len)
+	ZLOG_LEVEL_INFO, buf, buf_len) : (void)0)
 #define hdzlog_debug(buf, buf_len) \
+	(zlog_level_enabled(zlog_default_category, ZLOG_LEVEL_DEBUG) ? \
 	hdzlog(__FILE__, sizeof(__FILE__)-1, __func__, sizeof(__func__)-1, __LINE__, \
-	ZLOG_LEVEL_DEBUG, buf, buf_len)
+	ZLOG_LEVEL_DEBUG, buf, buf_len) : (void)0)
 
 #ifdef __cplusplus
 }
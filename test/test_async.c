@@ -0,0 +1,273 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+/* msgs of many threads go through the rings to the writers, each of them
+ * once and in order of its thread. when the writer is held and the ring is
+ * full, drop loses the msgs after it and drop_below only those below the
+ * drop level.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#include <sys/uio.h>
+
+#include "zlog.h"
+
+#define DROP_LINES 1000
+
+static zlog_category_t *zc;
+static long loop_count;
+static pthread_t main_tid;
+static volatile int hold;
+
+/* the writer waits in write() and writev() while hold is set */
+static void wait_hold(void)
+{
+	while (hold && !pthread_equal(pthread_self(), main_tid)) usleep(1000);
+}
+
+ssize_t write(int fd, const void *buf, size_t count)
+{
+	static ssize_t (*real_write)(int, const void *, size_t);
+
+	if (!real_write) real_write = dlsym(RTLD_NEXT, "write");
+	wait_hold();
+	return real_write(fd, buf, count);
+}
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
+{
+	static ssize_t (*real_writev)(int, const struct iovec *, int);
+
+	if (!real_writev) real_writev = dlsym(RTLD_NEXT, "writev");
+	wait_hold();
+	return real_writev(fd, iov, iovcnt);
+}
+
+static void *work(void *arg)
+{
+	long id = (long)arg;
+	long j;
+
+	for (j = 0; j < loop_count; j++) {
+		zlog_info(zc, "%ld %ld", id, j);
+	}
+	return NULL;
+}
+
+static void *release(void *arg)
+{
+	usleep(200000);
+	hold = 0;
+	return NULL;
+}
+
+/* lines of async.log, -1 if a thread's lines are lost or out of order */
+static long check_async(long thread_count)
+{
+	FILE *fp;
+	char line[256];
+	long id;
+	long j;
+	long *next;
+	long n = 0;
+
+	next = calloc(thread_count, sizeof(long));
+	fp = fopen("async.log", "r");
+	if (!next || !fp) {
+		printf("fopen async.log failed\n");
+		free(next);
+		if (fp) fclose(fp);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), fp)) {
+		n++;
+		if (strcmp(line, "all threads done, flush\n") == 0) continue;
+		if (strcmp(line, "after flush\n") == 0) continue;
+		if (sscanf(line, "%ld %ld", &id, &j) != 2
+			|| id < 0 || id >= thread_count || j != next[id]) {
+			printf("async.log: line[%s]\n", line);
+			n = -1;
+			break;
+		}
+		next[id]++;
+	}
+	fclose(fp);
+	for (id = 0; n >= 0 && id < thread_count; id++) {
+		if (next[id] != loop_count) {
+			printf("async.log: thread[%ld] lines[%ld], expect[%ld]\n",
+				id, next[id], loop_count);
+			n = -1;
+		}
+	}
+	free(next);
+	return n;
+}
+
+/* lines of a level in async_drop.log, -1 if out of order */
+static int count_level(const char *level)
+{
+	FILE *fp;
+	char line[256];
+	char line_level[16];
+	int i;
+	int next = 0;
+	int n = 0;
+
+	fp = fopen("async_drop.log", "r");
+	if (!fp) return 0;
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "%15s %d", line_level, &i) != 2) {
+			printf("async_drop.log: line[%s]\n", line);
+			n = -1;
+			break;
+		}
+		if (strcmp(line_level, level)) continue;
+		if (i < next || i >= DROP_LINES) {
+			printf("async_drop.log: line[%s]\n", line);
+			n = -1;
+			break;
+		}
+		next = i + 1;
+		n++;
+	}
+	fclose(fp);
+	return n;
+}
+
+/* the ring is full while the writer is held */
+static int test_drop(void)
+{
+	int rc = 0;
+	int i;
+	int n;
+
+	remove("async_drop.log");
+	hold = 1;
+	if (zlog_init("test_async_drop.conf")) {
+		printf("init drop failed\n");
+		return 10;
+	}
+	zc = zlog_get_category("my_cat");
+	for (i = 0; i < DROP_LINES; i++) zlog_info(zc, "%d", i);
+	hold = 0;
+	zlog_fini();
+
+	n = count_level("INFO");
+	if (n <= 0 || n >= DROP_LINES) {
+		printf("drop: info lines[%d], expect some dropped\n", n);
+		rc = 11;
+	}
+	remove("async_drop.log");
+	return rc;
+}
+
+/* info is dropped, warn waits for the writer */
+static int test_drop_below(void)
+{
+	int rc = 0;
+	int i;
+	int n;
+	pthread_t tid;
+
+	remove("async_drop.log");
+	hold = 1;
+	if (zlog_init("test_async_drop_below.conf")) {
+		printf("init drop_below failed\n");
+		return 20;
+	}
+	zc = zlog_get_category("my_cat");
+	pthread_create(&tid, NULL, release, NULL);
+	for (i = 0; i < DROP_LINES; i++) zlog_info(zc, "%d", i);
+	for (i = 0; i < DROP_LINES; i++) zlog_warn(zc, "%d", i);
+	pthread_join(tid, NULL);
+	zlog_fini();
+
+	n = count_level("INFO");
+	if (n <= 0 || n >= DROP_LINES) {
+		printf("drop_below: info lines[%d], expect some dropped\n", n);
+		rc = 21;
+	}
+	n = count_level("WARN");
+	if (n != DROP_LINES) {
+		printf("drop_below: warn lines[%d], expect[%d]\n", n, DROP_LINES);
+		rc = 22;
+	}
+	remove("async_drop.log");
+	return rc;
+}
+
+int main(int argc, char** argv)
+{
+	int rc;
+	long i;
+	long n;
+	long thread_count;
+	pthread_t *tid;
+
+	if (argc != 3) {
+		fprintf(stderr, "test nthreads nloop\n");
+		exit(1);
+	}
+
+	main_tid = pthread_self();
+	remove("async.log");
+	rc = zlog_init("test_async.conf");
+	if (rc) {
+		printf("init failed\n");
+		return 2;
+	}
+
+	zc = zlog_get_category("my_cat");
+	if (!zc) {
+		printf("get cat failed\n");
+		zlog_fini();
+		return 3;
+	}
+
+	thread_count = atol(argv[1]);
+	loop_count = atol(argv[2]);
+	tid = calloc(thread_count, sizeof(pthread_t));
+
+	for (i = 0; i < thread_count; i++) {
+		pthread_create(&(tid[i]), NULL, work, (void *)i);
+	}
+	for (i = 0; i < thread_count; i++) {
+		pthread_join(tid[i], NULL);
+	}
+
+	rc = 0;
+	/* msgs before zlog_flush() are in the file when it returns */
+	zlog_info(zc, "all threads done, flush");
+	zlog_flush();
+	n = check_async(thread_count);
+	if (n != thread_count * loop_count + 1) {
+		printf("lines[%ld] after flush, expect[%ld]\n", n, thread_count * loop_count + 1);
+		rc = 4;
+	}
+
+	/* msgs left in rings are written out by zlog_fini() */
+	zlog_info(zc, "after flush");
+	zlog_fini();
+	n = check_async(thread_count);
+	if (n != thread_count * loop_count + 2) {
+		printf("lines[%ld] after fini, expect[%ld]\n", n, thread_count * loop_count + 2);
+		rc = 5;
+	}
+	free(tid);
+
+	if (!rc) rc = test_drop();
+	if (!rc) rc = test_drop_below();
+
+	printf("%s\n", rc ? "async fail" : "async ok");
+	return rc;
+}
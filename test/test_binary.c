@@ -0,0 +1,100 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "zlog.h"
+
+static int compare(const char *a, const char *b)
+{
+	FILE *fa, *fb;
+	int ca, cb;
+	long offset = 0;
+
+	fa = fopen(a, "r");
+	fb = fopen(b, "r");
+	if (!fa || !fb) {
+		printf("open %s or %s failed\n", a, b);
+		return -1;
+	}
+	do {
+		ca = getc(fa);
+		cb = getc(fb);
+		offset++;
+	} while (ca == cb && ca != EOF);
+	fclose(fa);
+	fclose(fb);
+	if (ca != cb) {
+		printf("%s and %s differ at offset %ld\n", a, b, offset);
+		return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	int rc;
+	int i;
+	struct stat text, binary;
+	zlog_category_t *zc;
+	zlog_category_t *other;
+	char hex[] = "binary\0data\x01\x02\xff";
+
+	remove("binary.log");
+	remove("binary.txt");
+	remove("binary.out");
+
+	rc = zlog_init("test_binary.conf");
+	if (rc) {
+		printf("init failed\n");
+		return 1;
+	}
+
+	zc = zlog_get_category("my_cat");
+	other = zlog_get_category("other");
+	if (!zc || !other) {
+		printf("get cat failed\n");
+		zlog_fini();
+		return 2;
+	}
+
+	zlog_info(zc, "plain text");
+	zlog_debug(zc, "int[%d] neg[%i] unsigned[%u] hex[%#x] ll[%lld] star[%*d]",
+		42, -7, 3000000000u, 255, -123456789012LL, 6, 3);
+	zlog_notice(zc, "float[%f] exp[%e] ld[%Lf] str[%s] prec[%.3s] char[%c] ptr[%p]",
+		1.5, 12345.678, 2.5L, "abc", "truncated", 'z', (void *)0x1234);
+	errno = ENOENT;
+	zlog_error(zc, "errno[%m]");
+	hzlog_warn(zc, hex, sizeof(hex));
+	zlog_debug(other, "below the level of other");
+	zlog_info(other, "in other category");
+	for (i = 0; i < 1000; i++) {
+		zlog_info(zc, "loop[%d] of [%s] at [%.2f]", i, "test_binary", i / 3.0);
+	}
+
+	zlog_fini();
+
+	rc = system("LD_LIBRARY_PATH=../src ../src/zlog-decode -c test_binary.conf -f simple"
+		" binary.log > binary.out");
+	if (rc) {
+		printf("zlog-decode failed\n");
+		return 3;
+	}
+
+	rc = compare("binary.out", "binary.txt");
+	if (rc == 0 && stat("binary.log", &binary) == 0 && stat("binary.txt", &text) == 0) {
+		printf("binary[%ld] text[%ld]\n", (long)binary.st_size, (long)text.st_size);
+	}
+
+	printf("%s\n", rc ? "binary fail" : "binary ok");
+	return rc ? 4 : 0;
+}
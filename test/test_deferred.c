@@ -0,0 +1,97 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "zlog.h"
+
+static char expect[100][256];
+static int expect_count;
+
+#define check(fmt, ...) do { \
+	snprintf(expect[expect_count++], sizeof(expect[0]), fmt, __VA_ARGS__); \
+	zlog_info(zc, fmt, __VA_ARGS__); \
+} while (0)
+
+int main(int argc, char** argv)
+{
+	int rc;
+	int i;
+	FILE *fp;
+	char line[256];
+	char *s;
+	char fmt[64];
+	zlog_category_t *zc;
+
+	remove("deferred.log");
+
+	rc = zlog_init("test_deferred.conf");
+	if (rc) {
+		printf("init failed\n");
+		return 1;
+	}
+
+	zc = zlog_get_category("my_cat");
+	if (!zc) {
+		printf("get cat failed\n");
+		zlog_fini();
+		return 2;
+	}
+
+	check("plain text, %s", "no format in it");
+	check("int[%d] neg[%i] unsigned[%u] hex[%x] HEX[%#X] oct[%o]", 42, -7, 3000000000u, 255, 255, 8);
+	check("char[%hhd] short[%hd] long[%ld] ll[%lld] size[%zu] max[%jd]",
+		(char)-3, (short)-300, -100000L, 123456789012LL, (size_t)77, (intmax_t)-1);
+	check("width[%5d] left[%-5d|] zero[%05d] star[%*d] prec[%.*d]", 1, 2, 3, 6, 4, 3, 5);
+	check("float[%f] exp[%e] g[%g] prec[%.3f] ld[%Lf] hexfloat[%a]", 1.5, 12345.678, 0.0001, 3.14159, 2.5L, 1.0);
+	check("str[%s] width[%10s] left[%-6s|] prec[%.3s] star[%.*s]",
+		"abc", "right", "left", "truncated", 2, "xyz");
+	check("char[%c] percent[%%] ptr[%p]", 'z', (void *)0x1234);
+
+	/* format and strings are copied at the call */
+	s = strdup("heap string");
+	strcpy(fmt, "copied format[%s][%d]");
+	check(fmt, s, 9);
+	strcpy(s, "overwritten");
+	strcpy(fmt, "overwritten format");
+	free(s);
+
+	/* %m is errno of the caller, formatted in place */
+	errno = ENOENT;
+	snprintf(expect[expect_count++], sizeof(expect[0]), "errno[%s]", strerror(ENOENT));
+	errno = ENOENT;
+	zlog_info(zc, "errno[%m]");
+
+	zlog_fini();
+
+	fp = fopen("deferred.log", "r");
+	if (!fp) {
+		printf("open deferred.log failed\n");
+		return 3;
+	}
+	rc = 0;
+	for (i = 0; fgets(line, sizeof(line), fp); i++) {
+		line[strcspn(line, "\n")] = '\0';
+		if (i >= expect_count || strcmp(line, expect[i])) {
+			printf("line %d: got[%s] expect[%s]\n", i, line, i < expect_count ? expect[i] : "");
+			rc = 4;
+		}
+	}
+	fclose(fp);
+	if (i != expect_count) {
+		printf("got %d lines, expect %d\n", i, expect_count);
+		rc = 5;
+	}
+
+	printf("%s\n", rc ? "deferred format fail" : "deferred format ok");
+	return rc;
+}
@@ -0,0 +1,118 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <sys/time.h>
+
+/* debug is compiled out */
+#define ZLOG_MIN_LEVEL ZLOG_LEVEL_INFO
+#include "zlog.h"
+
+static int evaluated;
+
+static int count(void)
+{
+	return ++evaluated;
+}
+
+static int cat_evaluated;
+static zlog_category_t *cat;
+
+static zlog_category_t *get_cat(void)
+{
+	cat_evaluated++;
+	return cat;
+}
+
+static void vlog_notice(const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	vzlog_notice(get_cat(), format, args);
+	va_end(args);
+}
+
+int main(int argc, char** argv)
+{
+	int rc;
+	int i;
+	long n = 10000000;
+	struct timeval start, end;
+	zlog_category_t *zc;
+
+	remove("enabled.log");
+
+	rc = zlog_init("test_enabled.conf");
+	if (rc) {
+		printf("init failed\n");
+		return 1;
+	}
+
+	zc = zlog_get_category("my_cat");
+	if (!zc) {
+		printf("get cat failed\n");
+		zlog_fini();
+		return 2;
+	}
+	dzlog_set_category("my_cat");
+
+	/* below ZLOG_MIN_LEVEL */
+	zlog_debug(zc, "debug %d", count());
+	dzlog_debug("debug %d", count());
+	if (evaluated != 0) {
+		printf("debug args evaluated\n");
+		rc = 3;
+	}
+
+	/* below the level of rule */
+	zlog_info(zc, "info %d", count());
+	dzlog_info("info %d", count());
+	if (evaluated != 0) {
+		printf("info args evaluated\n");
+		rc = 4;
+	}
+
+	zlog_notice(zc, "notice %d", count());
+	dzlog_error("error %d", count());
+	if (evaluated != 2) {
+		printf("notice args not evaluated\n");
+		rc = 5;
+	}
+
+	/* cat is evaluated once, as a function call was */
+	cat = zc;
+	zlog_info(get_cat(), "info");
+	zlog_notice(get_cat(), "notice");
+	hzlog_notice(get_cat(), "hex", 3);
+	vlog_notice("%s", "vzlog");
+	if (cat_evaluated != 4) {
+		printf("cat evaluated %d times\n", cat_evaluated);
+		rc = 6;
+	}
+
+	/* reported, not crashed */
+	zlog_notice(NULL, "null");
+	hzlog_notice(NULL, "null", 4);
+	cat = NULL;
+	vlog_notice("%s", "null");
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < n; i++) {
+		zlog_info(zc, "loop %d", i);
+	}
+	gettimeofday(&end, NULL);
+	printf("disabled info %.2fns\n", ((end.tv_sec - start.tv_sec) * 1e9
+		+ (end.tv_usec - start.tv_usec) * 1e3) / n);
+
+	zlog_fini();
+
+	printf("%s\n", rc ? "level check fail" : "level check ok");
+	return rc;
+}
@@ -0,0 +1,107 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "zlog.h"
+
+static char *read_file(const char *path, size_t *len)
+{
+	FILE *fp;
+	struct stat st;
+	char *data;
+
+	if (stat(path, &st)) return NULL;
+	data = malloc(st.st_size + 1);
+	fp = fopen(path, "r");
+	if (!data || !fp) return NULL;
+	*len = fread(data, 1, st.st_size, fp);
+	data[*len] = '\0';
+	fclose(fp);
+	return data;
+}
+
+int main(int argc, char** argv)
+{
+	int rc;
+	zlog_category_t *zc;
+	char *big;
+	char *data;
+	char *p;
+	size_t len;
+	size_t len2;
+	char *data2;
+
+	remove("gather.log");
+	remove("gather2.log");
+
+	rc = zlog_init("test_gather.conf");
+	if (rc) {
+		printf("init failed\n");
+		return -1;
+	}
+
+	zc = zlog_get_category("my_cat");
+	if (!zc) {
+		printf("get cat fail\n");
+		zlog_fini();
+		return -2;
+	}
+
+	/* in place by "%s" and by a format without conversion */
+	big = malloc(16 * 1024 + 1);
+	memset(big, 'a', 16 * 1024);
+	big[16 * 1024] = '\0';
+	zlog_info(zc, "%s", big);
+	big[0] = 'b';
+	zlog_info(zc, big);
+
+	/* short and converted ones are copied */
+	zlog_info(zc, "short %d", 1);
+	zlog_info(zc, "%s-%s", "x", "y");
+
+	zlog_fini();
+
+	data = read_file("gather.log", &len);
+	data2 = read_file("gather2.log", &len2);
+	if (!data || !data2 || len != len2 || memcmp(data, data2, len)) {
+		printf("gather.log and gather2.log differ\n");
+		return -1;
+	}
+
+	p = data;
+	if (strncmp(p, "[INFO] ", 7) || strspn(p + 7, "a") != 16 * 1024
+		|| strncmp(p + 7 + 16 * 1024, " <my_cat>\n", 10)) {
+		printf("msg 1 wrong\n");
+		return -1;
+	}
+	p += 7 + 16 * 1024 + 10;
+	if (strncmp(p, "[INFO] b", 8) || strspn(p + 8, "a") != 16 * 1024 - 1
+		|| strncmp(p + 7 + 16 * 1024, " <my_cat>\n", 10)) {
+		printf("msg 2 wrong\n");
+		return -1;
+	}
+	p += 7 + 16 * 1024 + 10;
+	if (strncmp(p, "[INFO] short 1 <my_cat>\n[INFO] x-y <my_cat>\n", 44)) {
+		printf("msg 3 wrong\n");
+		return -1;
+	}
+	if (p + 44 != data + len) {
+		printf("more than 4 msgs\n");
+		return -1;
+	}
+
+	free(big);
+	free(data);
+	free(data2);
+	printf("gather ok\n");
+	return 0;
+}
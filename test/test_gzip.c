@@ -0,0 +1,103 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+
+#include "zlog.h"
+
+#define LINES 2000
+
+/* archives from the oldest, then gzip.log */
+static const char *files[] = { "gzip.3.log.gz", "gzip.2.log.gz", "gzip.1.log.gz", "gzip.0.log.gz", "gzip.log" };
+
+static void clean(void)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(files) / sizeof(files[0]); i++) remove(files[i]);
+}
+
+int main(int argc, char** argv)
+{
+	int rc;
+	int i;
+	int n;
+	int last = -1;
+	size_t f;
+	FILE *fp;
+	char line[256];
+	DIR *dir;
+	struct dirent *ent;
+	zlog_category_t *zc;
+
+	clean();
+
+	rc = zlog_init("test_gzip.conf");
+	if (rc) {
+		printf("init failed\n");
+		return 1;
+	}
+
+	zc = zlog_get_category("my_cat");
+	if (!zc) {
+		printf("get cat failed\n");
+		zlog_fini();
+		return 2;
+	}
+
+	for (i = 0; i < LINES; i++) {
+		zlog_info(zc, "%d xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx", i);
+	}
+
+	/* waits for the rotate thread */
+	zlog_fini();
+
+	rc = 0;
+	dir = opendir(".");
+	while (dir && (ent = readdir(dir))) {
+		if (strncmp(ent->d_name, ".gzip.log.", sizeof(".gzip.log.") - 1) == 0) {
+			printf("staged file[%s] is left\n", ent->d_name);
+			rc = 3;
+		}
+	}
+	if (dir) closedir(dir);
+
+	/* lines go on from file to file */
+	for (f = 0; f < sizeof(files) / sizeof(files[0]); f++) {
+		snprintf(line, sizeof(line), "%s %s",
+			strstr(files[f], ".gz") ? "gzip -dc" : "cat", files[f]);
+		fp = popen(line, "r");
+		if (!fp) {
+			printf("popen %s failed\n", line);
+			rc = 4;
+			continue;
+		}
+		while (fgets(line, sizeof(line), fp)) {
+			if (sscanf(line, "%d", &n) != 1 || (last >= 0 && n != last + 1)) {
+				printf("%s: got[%d] after[%d]\n", files[f], n, last);
+				rc = 5;
+				break;
+			}
+			last = n;
+		}
+		if (pclose(fp)) {
+			printf("%s is not gzip\n", files[f]);
+			rc = 6;
+		}
+	}
+	if (last != LINES - 1) {
+		printf("last line[%d], expect[%d]\n", last, LINES - 1);
+		rc = 7;
+	}
+
+	clean();
+	printf("%s\n", rc ? "gzip fail" : "gzip ok");
+	return rc;
+}
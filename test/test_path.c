@@ -0,0 +1,209 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+/* dynamic paths by minute, logged from many threads of many categories
+ * while the clock goes over minutes and a DST change. the leading part
+ * of a path is kept per category till its minute passes, and more paths
+ * are open than the fd cache keeps, each line should still be in the file
+ * of its category and minute.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#include <sys/time.h>
+
+#include "zlog.h"
+
+#define THREADS 10
+#define CATS 10
+#define LINES 4000
+#define STEP 20000 /* us, the clock of loggers goes on by each call */
+
+static __thread int is_logger;
+static time_t fake_base;
+static long fake_usec;
+
+/* loggers see a clock going on by STEP from fake_base */
+int gettimeofday(struct timeval *tv, void *tz)
+{
+	static int (*real_gettimeofday)(struct timeval *, void *);
+	long usec;
+
+	if (!is_logger) {
+		if (!real_gettimeofday) real_gettimeofday = dlsym(RTLD_NEXT, "gettimeofday");
+		return real_gettimeofday(tv, tz);
+	}
+	usec = __sync_fetch_and_add(&fake_usec, STEP);
+	tv->tv_sec = fake_base + usec / 1000000;
+	tv->tv_usec = usec % 1000000;
+	return 0;
+}
+
+static void clean(void)
+{
+	DIR *dir;
+	struct dirent *ent;
+
+	dir = opendir(".");
+	while (dir && (ent = readdir(dir))) {
+		if (strncmp(ent->d_name, "path.", sizeof("path.") - 1) == 0) remove(ent->d_name);
+	}
+	if (dir) closedir(dir);
+}
+
+static void *work(void *arg)
+{
+	long id = (long)arg;
+	char cname[16];
+	zlog_category_t *zc;
+	int i;
+
+	sprintf(cname, "c%ld", id % CATS);
+	zc = zlog_get_category(cname);
+	is_logger = 1;
+	for (i = 0; i < LINES; i++) {
+		zlog_info(zc, "%ld %d", id, i);
+	}
+	return NULL;
+}
+
+/* lines of path.cat.minute.log are of that cat and minute */
+static int check_file(const char *name, int *lines)
+{
+	FILE *fp;
+	char cat[16];
+	char minute[16];
+	char line_minute[16];
+	char line_cat[16];
+	char line[256];
+	long id;
+	int seq;
+
+	if (sscanf(name, "path.%15[^.].%15[0-9].log", cat, minute) != 2) {
+		printf("unknown file[%s]\n", name);
+		return -1;
+	}
+	fp = fopen(name, "r");
+	if (!fp) {
+		printf("fopen %s failed\n", name);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "%15s %15s %ld %d", line_minute, line_cat, &id, &seq) != 4
+			|| strcmp(line_minute, minute) || strcmp(line_cat, cat)) {
+			printf("%s: line[%s]\n", name, line);
+			fclose(fp);
+			return -1;
+		}
+		(*lines)++;
+	}
+	fclose(fp);
+	return 0;
+}
+
+/* every line once, those of a thread in order */
+static int check_all(void)
+{
+	FILE *fp;
+	char line[256];
+	long id;
+	int seq;
+	int next[THREADS];
+	int lines = 0;
+
+	memset(next, 0x00, sizeof(next));
+	fp = fopen("path.all.log", "r");
+	if (!fp) {
+		printf("fopen path.all.log failed\n");
+		return -1;
+	}
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "%*s %*s %ld %d", &id, &seq) != 2
+			|| id < 0 || id >= THREADS || seq != next[id]) {
+			printf("path.all.log: line[%s]\n", line);
+			fclose(fp);
+			return -1;
+		}
+		next[id]++;
+		lines++;
+	}
+	fclose(fp);
+	if (lines != THREADS * LINES) {
+		printf("path.all.log: lines[%d], expect[%d]\n", lines, THREADS * LINES);
+		return -1;
+	}
+	return 0;
+}
+
+static int run(time_t base)
+{
+	int rc = 0;
+	long i;
+	int lines = 0;
+	int files = 0;
+	pthread_t tid[THREADS];
+	DIR *dir;
+	struct dirent *ent;
+
+	clean();
+	fake_base = base;
+	fake_usec = 0;
+
+	if (zlog_init("test_path.conf")) {
+		printf("init failed\n");
+		return 1;
+	}
+	for (i = 0; i < THREADS; i++) pthread_create(&tid[i], NULL, work, (void *)i);
+	for (i = 0; i < THREADS; i++) pthread_join(tid[i], NULL);
+	zlog_fini();
+
+	dir = opendir(".");
+	while (dir && (ent = readdir(dir))) {
+		if (strncmp(ent->d_name, "path.", sizeof("path.") - 1)
+			|| strcmp(ent->d_name, "path.all.log") == 0) continue;
+		files++;
+		if (check_file(ent->d_name, &lines)) rc = 3;
+	}
+	if (dir) closedir(dir);
+
+	if (lines != THREADS * LINES) {
+		printf("lines[%d], expect[%d]\n", lines, THREADS * LINES);
+		rc = 4;
+	}
+	if (check_all()) rc = 5;
+	/* more than the fd cache keeps */
+	if (files <= 64) {
+		printf("files[%d], expect more than 64\n", files);
+		rc = 6;
+	}
+	return rc;
+}
+
+int main(int argc, char** argv)
+{
+	int rc;
+
+	/* fixed rules, no tzdata needed */
+	setenv("TZ", "CET-1CEST,M3.5.0,M10.5.0/3", 1);
+	tzset();
+
+	/* 2026-03-29 00:58 UTC, 01:58 CET, 03:00 CEST comes after 01:59 */
+	rc = run(1774745880);
+	/* 2026-10-25 00:58 UTC, 02:58 CEST, 02:00 CET comes after 02:59 */
+	if (!rc) rc = run(1792889880);
+
+	clean();
+	printf("%s\n", rc ? "path fail" : "path ok");
+	return rc;
+}
@@ -0,0 +1,122 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include "zlog.h"
+
+#define LINES 45
+
+static void clean(void)
+{
+	DIR *dir;
+	struct dirent *ent;
+
+	dir = opendir(".");
+	while (dir && (ent = readdir(dir))) {
+		if (strncmp(ent->d_name, "period.", sizeof("period.") - 1) == 0) remove(ent->d_name);
+	}
+	if (dir) closedir(dir);
+}
+
+/* lines of a 2sec period are in seconds sec - 1 and sec, sec is odd.
+ * sec is -1 for period.log, the one now */
+static int check_file(const char *path, int sec, int *lines)
+{
+	FILE *fp;
+	char line[256];
+	int s;
+	int n;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		printf("fopen %s failed\n", path);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "%d %d", &s, &n) != 2) {
+			printf("%s: bad line[%s]\n", path, line);
+			fclose(fp);
+			return -1;
+		}
+		if (sec >= 0 && (sec % 2 != 1 || (s != sec && s != sec - 1))) {
+			printf("%s: line of second[%d]\n", path, s);
+			fclose(fp);
+			return -1;
+		}
+		(*lines)++;
+	}
+	fclose(fp);
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	int rc;
+	int i;
+	int sec;
+	int lines = 0;
+	int archives = 0;
+	DIR *dir;
+	struct dirent *ent;
+	zlog_category_t *zc;
+
+	clean();
+
+	rc = zlog_init("test_period.conf");
+	if (rc) {
+		printf("init failed\n");
+		return 1;
+	}
+
+	zc = zlog_get_category("my_cat");
+	if (!zc) {
+		printf("get cat failed\n");
+		zlog_fini();
+		return 2;
+	}
+
+	for (i = 0; i < LINES; i++) {
+		zlog_info(zc, "%d", i);
+		usleep(100000);
+	}
+
+	zlog_fini();
+
+	rc = 0;
+	dir = opendir(".");
+	while (dir && (ent = readdir(dir))) {
+		if (strncmp(ent->d_name, "period.", sizeof("period.") - 1)) continue;
+		if (strcmp(ent->d_name, "period.log") == 0) {
+			if (check_file(ent->d_name, -1, &lines)) rc = 3;
+		} else if (sscanf(ent->d_name, "period.%d.0.log", &sec) == 1) {
+			archives++;
+			if (check_file(ent->d_name, sec, &lines)) rc = 4;
+		} else {
+			printf("unknown file[%s]\n", ent->d_name);
+			rc = 5;
+		}
+	}
+	if (dir) closedir(dir);
+
+	if (archives < 2) {
+		printf("archives[%d], expect 2 at least\n", archives);
+		rc = 6;
+	}
+	if (lines != LINES) {
+		printf("lines[%d], expect[%d]\n", lines, LINES);
+		rc = 7;
+	}
+
+	clean();
+	printf("%s\n", rc ? "period fail" : "period ok");
+	return rc;
+}
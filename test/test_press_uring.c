@@ -0,0 +1,159 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+/* compare syscalls and throughput of async writers, with or without
+ * "async io uring", against plain write() of test_press_write2.
+ * write(), writev(), fsync(), fdatasync() and syscall() are counted
+ * by wrapping them here.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+
+#include "zlog.h"
+
+static long loop_count;
+static zlog_category_t *zc;
+static long syscall_count;
+
+ssize_t write(int fd, const void *buf, size_t count)
+{
+	static ssize_t (*real_write)(int, const void *, size_t);
+
+	if (!real_write) real_write = dlsym(RTLD_NEXT, "write");
+	__sync_fetch_and_add(&syscall_count, 1);
+	return real_write(fd, buf, count);
+}
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
+{
+	static ssize_t (*real_writev)(int, const struct iovec *, int);
+
+	if (!real_writev) real_writev = dlsym(RTLD_NEXT, "writev");
+	__sync_fetch_and_add(&syscall_count, 1);
+	return real_writev(fd, iov, iovcnt);
+}
+
+int fsync(int fd)
+{
+	static int (*real_fsync)(int);
+
+	if (!real_fsync) real_fsync = dlsym(RTLD_NEXT, "fsync");
+	__sync_fetch_and_add(&syscall_count, 1);
+	return real_fsync(fd);
+}
+
+/* zlog_fsync() is fdatasync() on linux */
+int fdatasync(int fd)
+{
+	static int (*real_fdatasync)(int);
+
+	if (!real_fdatasync) real_fdatasync = dlsym(RTLD_NEXT, "fdatasync");
+	__sync_fetch_and_add(&syscall_count, 1);
+	return real_fdatasync(fd);
+}
+
+/* io_uring_enter() is called by syscall(), with at most 6 args */
+long syscall(long number, ...)
+{
+	static long (*real_syscall)(long, ...);
+	va_list ap;
+	long a[6];
+	int i;
+
+	if (!real_syscall) real_syscall = dlsym(RTLD_NEXT, "syscall");
+	va_start(ap, number);
+	for (i = 0; i < 6; i++) a[i] = va_arg(ap, long);
+	va_end(ap);
+	__sync_fetch_and_add(&syscall_count, 1);
+	return real_syscall(number, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+static void *work_write(void *ptr)
+{
+	long j = loop_count;
+	int fd;
+	static char log[] = "2012-06-14 20:30:38.481187 INFO   24536:140716226213632:test_press_zlog.c:36 loglog\n";
+
+	fd = open("press.log", O_CREAT | O_WRONLY | O_APPEND, 0644);
+	while (j-- > 0) {
+		if (write(fd, log, sizeof(log) - 1) < 0) break;
+	}
+	close(fd);
+	return NULL;
+}
+
+static void *work_zlog(void *ptr)
+{
+	long j = loop_count;
+
+	while (j-- > 0) {
+		zlog_info(zc, "loglog");
+	}
+	return NULL;
+}
+
+int main(int argc, char** argv)
+{
+	long i;
+	long thread_count;
+	long msgs;
+	long calls;
+	double elapsed;
+	struct timeval start, end;
+	pthread_t *tid;
+	int plain;
+
+	if (argc != 4) {
+		fprintf(stderr, "test_press_uring [write|conf] nthreads nloop\n");
+		exit(1);
+	}
+
+	plain = (strcmp(argv[1], "write") == 0);
+	thread_count = atol(argv[2]);
+	loop_count = atol(argv[3]);
+	tid = calloc(thread_count, sizeof(pthread_t));
+	unlink("press.log");
+
+	if (!plain) {
+		if (zlog_init(argv[1])) {
+			printf("init fail\n");
+			return -1;
+		}
+		zc = zlog_get_category("my_cat");
+	}
+
+	calls = syscall_count;
+	gettimeofday(&start, NULL);
+	for (i = 0; i < thread_count; i++) {
+		pthread_create(&tid[i], NULL, plain ? work_write : work_zlog, NULL);
+	}
+	for (i = 0; i < thread_count; i++) {
+		pthread_join(tid[i], NULL);
+	}
+	if (!plain) zlog_fini();
+	gettimeofday(&end, NULL);
+	calls = syscall_count - calls;
+
+	msgs = thread_count * loop_count;
+	elapsed = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+	printf("%s: msgs[%ld] time[%.3fs] msgs/s[%.0f] syscalls[%ld] per msg[%.4f]\n",
+		argv[1], msgs, elapsed, msgs / elapsed, calls, (double)calls / msgs);
+
+	free(tid);
+	return 0;
+}
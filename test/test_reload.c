@@ -0,0 +1,143 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "zlog.h"
+
+/* the conf is written here, as the test changes it */
+static int write_conf(const char *path, const char *format)
+{
+	FILE *fp;
+
+	fp = fopen(path, "w");
+	if (!fp) return -1;
+	fprintf(fp, "[formats]\n"
+		"simple = \"%s %%m%%n\"\n"
+		"[rules]\n"
+		"my_cat.*\t\"reload.log\"; simple\n"
+		"my_cat.*\t| cat >> reload.pipe.log; simple\n", format);
+	fclose(fp);
+	return 0;
+}
+
+/* the lowest fd of the file, or of a pipe if path is NULL, -1 if none */
+static int find_fd(const char *path)
+{
+	int fd;
+	struct stat stb;
+	struct stat fstb;
+
+	if (path && stat(path, &stb)) return -1;
+	for (fd = 3; fd < 1024; fd++) {
+		if (fstat(fd, &fstb)) continue;
+		if (path) {
+			if (fstb.st_dev == stb.st_dev && fstb.st_ino == stb.st_ino) return fd;
+		} else {
+			if (S_ISFIFO(fstb.st_mode)) return fd;
+		}
+	}
+	return -1;
+}
+
+/* lines of path, -1 if not there */
+static int count_lines(const char *path)
+{
+	FILE *fp;
+	char line[256];
+	int n = 0;
+
+	fp = fopen(path, "r");
+	if (!fp) return -1;
+	while (fgets(line, sizeof(line), fp)) n++;
+	fclose(fp);
+	return n;
+}
+
+int main(int argc, char** argv)
+{
+	int rc;
+	int file_fd;
+	int pipe_fd;
+	FILE *fp;
+	zlog_category_t *zc;
+
+	remove("reload.log");
+	remove("reload.pipe.log");
+	if (write_conf("reload.conf", "A")) {
+		printf("write conf failed\n");
+		return 1;
+	}
+
+	rc = zlog_init("reload.conf");
+	if (rc) {
+		printf("init failed\n");
+		return 1;
+	}
+
+	zc = zlog_get_category("my_cat");
+	if (!zc) {
+		printf("get cat failed\n");
+		zlog_fini();
+		return 2;
+	}
+
+	rc = 0;
+	zlog_info(zc, "1");
+	file_fd = find_fd("reload.log");
+	pipe_fd = find_fd(NULL);
+
+	/* only the format changes, the file and the pipe stay open */
+	write_conf("reload.conf", "B");
+	if (zlog_reload("reload.conf")) {
+		printf("reload failed\n");
+		rc = 3;
+	}
+	zlog_info(zc, "2");
+	if (find_fd("reload.log") != file_fd) {
+		printf("file fd[%d] is not [%d]\n", find_fd("reload.log"), file_fd);
+		rc = 4;
+	}
+	if (find_fd(NULL) != pipe_fd) {
+		printf("pipe fd[%d] is not [%d]\n", find_fd(NULL), pipe_fd);
+		rc = 5;
+	}
+
+	/* a wrong one rolls back, still on the same fds */
+	fp = fopen("reload.conf", "w");
+	fprintf(fp, "[wrong]\n");
+	fclose(fp);
+	if (zlog_reload("reload.conf") == 0) {
+		printf("wrong conf reloaded\n");
+		rc = 6;
+	}
+	zlog_info(zc, "3");
+	if (find_fd("reload.log") != file_fd) {
+		printf("file fd[%d] is not [%d] after rollback\n", find_fd("reload.log"), file_fd);
+		rc = 7;
+	}
+
+	zlog_fini();
+
+	/* the pipe is closed by fini, cat has exited */
+	if (count_lines("reload.log") != 3 || count_lines("reload.pipe.log") != 3) {
+		printf("lines[%d][%d], expect 3\n",
+			count_lines("reload.log"), count_lines("reload.pipe.log"));
+		rc = 8;
+	}
+
+	remove("reload.log");
+	remove("reload.pipe.log");
+	remove("reload.conf");
+	printf("%s\n", rc ? "reload fail" : "reload ok");
+	return rc;
+}
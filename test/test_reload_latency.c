@@ -0,0 +1,169 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+/* tail latency of loggers while another thread reloads in a loop.
+ * each logger gets its category and logs, as code looking up categories
+ * by name does, the conf has nrules rules to make a reload slow.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "zlog.h"
+
+#define BUCKETS 40 /* log2 of ns */
+
+static long loop_count;
+static volatile int loggers_done;
+static long hist[BUCKETS];
+static long max_ns;
+static pthread_mutex_t hist_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static int write_conf(const char *path, long nrules)
+{
+	FILE *fp;
+	long i;
+
+	fp = fopen(path, "w");
+	if (!fp) return -1;
+	fprintf(fp, "[formats]\n"
+		"simple = \"%%d.%%us %%-6V %%c %%m%%n\"\n"
+		"[rules]\n"
+		"my_cat.*\t\"reload_latency.log\"; simple\n");
+	for (i = 0; i < nrules; i++) {
+		fprintf(fp, "cat_%ld.*\t\"reload_latency.log\", 10MB * 2 ~ \"reload_latency.log.#r\"; simple\n", i);
+	}
+	fclose(fp);
+	return 0;
+}
+
+static void *work_log(void *ptr)
+{
+	long j = loop_count;
+	long start, ns;
+	int b;
+	long my_hist[BUCKETS];
+	long my_max = 0;
+	zlog_category_t *zc;
+
+	memset(my_hist, 0x00, sizeof(my_hist));
+	while (j-- > 0) {
+		start = now_ns();
+		zc = zlog_get_category("my_cat");
+		zlog_info(zc, "loglog");
+		ns = now_ns() - start;
+
+		for (b = 0; b < BUCKETS - 1 && (1L << (b + 1)) <= ns; b++);
+		my_hist[b]++;
+		if (ns > my_max) my_max = ns;
+	}
+
+	pthread_mutex_lock(&hist_mutex);
+	for (b = 0; b < BUCKETS; b++) hist[b] += my_hist[b];
+	if (my_max > max_ns) max_ns = my_max;
+	pthread_mutex_unlock(&hist_mutex);
+	return NULL;
+}
+
+static void *work_reload(void *ptr)
+{
+	long *reloads = ptr;
+
+	while (!loggers_done) {
+		if (zlog_reload(NULL)) {
+			fprintf(stderr, "reload fail\n");
+			break;
+		}
+		(*reloads)++;
+	}
+	return NULL;
+}
+
+/* upper bound of the bucket holding the pct percentile, in ns */
+static long percentile(long total, double pct)
+{
+	int b;
+	long n = 0;
+
+	for (b = 0; b < BUCKETS; b++) {
+		n += hist[b];
+		if (n >= total * pct) return 1L << (b + 1);
+	}
+	return max_ns;
+}
+
+int main(int argc, char** argv)
+{
+	long i;
+	long thread_count;
+	long nrules;
+	long reloads = 0;
+	long total;
+	long start, end;
+	pthread_t *tid;
+	pthread_t reloader;
+
+	if (argc != 4) {
+		fprintf(stderr, "test_reload_latency nthreads nloop nrules\n");
+		exit(1);
+	}
+
+	thread_count = atol(argv[1]);
+	loop_count = atol(argv[2]);
+	nrules = atol(argv[3]);
+	tid = calloc(thread_count, sizeof(pthread_t));
+
+	if (write_conf("reload_latency.conf", nrules)) {
+		fprintf(stderr, "write conf fail\n");
+		exit(1);
+	}
+	remove("reload_latency.log");
+
+	if (zlog_init("reload_latency.conf")) {
+		fprintf(stderr, "init fail\n");
+		exit(1);
+	}
+
+	start = now_ns();
+	pthread_create(&reloader, NULL, work_reload, &reloads);
+	for (i = 0; i < thread_count; i++) {
+		pthread_create(tid + i, NULL, work_log, NULL);
+	}
+	for (i = 0; i < thread_count; i++) {
+		pthread_join(tid[i], NULL);
+	}
+	loggers_done = 1;
+	pthread_join(reloader, NULL);
+	end = now_ns();
+
+	zlog_fini();
+
+	total = thread_count * loop_count;
+	printf("%ld msgs, %ld reloads of %ld rules in %.3fs\n",
+		total, reloads, nrules + 1, (end - start) / 1e9);
+	printf("latency p50 < %ldns, p99 < %ldns, p99.9 < %ldns, p99.99 < %ldns, max %ldns\n",
+		percentile(total, 0.5), percentile(total, 0.99),
+		percentile(total, 0.999), percentile(total, 0.9999), max_ns);
+
+	free(tid);
+	remove("reload_latency.conf");
+	remove("reload_latency.log");
+	return 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+
+#include "zlog.h"
+
+#define LINES 2000
+
+/* archives from the oldest, then rotate.log */
+static const char *files[] = { "rotate.3.log", "rotate.2.log", "rotate.1.log", "rotate.0.log", "rotate.log" };
+#define ARCHIVES 4
+
+static void clean(void)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(files) / sizeof(files[0]); i++) remove(files[i]);
+	remove(".rotate.log.index");
+}
+
+int main(int argc, char** argv)
+{
+	int rc;
+	int i;
+	int n;
+	int last = -1;
+	size_t f;
+	FILE *fp;
+	char line[256];
+	DIR *dir;
+	struct dirent *ent;
+	zlog_category_t *zc;
+
+	clean();
+
+	rc = zlog_init("test_rotate.conf");
+	if (rc) {
+		printf("init failed\n");
+		return 1;
+	}
+
+	zc = zlog_get_category("my_cat");
+	if (!zc) {
+		printf("get cat failed\n");
+		zlog_fini();
+		return 2;
+	}
+
+	for (i = 0; i < LINES; i++) {
+		zlog_info(zc, "%d xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx", i);
+	}
+
+	/* waits for the rotate thread */
+	zlog_fini();
+
+	rc = 0;
+	dir = opendir(".");
+	while (dir && (ent = readdir(dir))) {
+		if (strncmp(ent->d_name, ".rotate.log.", sizeof(".rotate.log.") - 1) == 0
+			&& strcmp(ent->d_name, ".rotate.log.index") != 0) {
+			printf("staged file[%s] is left\n", ent->d_name);
+			rc = 3;
+		}
+	}
+	if (dir) closedir(dir);
+
+	/* lines go on from file to file */
+	for (f = 0; f < sizeof(files) / sizeof(files[0]); f++) {
+		fp = fopen(files[f], "r");
+		if (!fp) {
+			printf("open %s failed\n", files[f]);
+			rc = 4;
+			continue;
+		}
+		while (fgets(line, sizeof(line), fp)) {
+			if (sscanf(line, "%d", &n) != 1 || (last >= 0 && n != last + 1)) {
+				printf("%s: got[%d] after[%d]\n", files[f], n, last);
+				rc = 5;
+				break;
+			}
+			last = n;
+		}
+		fclose(fp);
+	}
+	if (last != LINES - 1) {
+		printf("last line[%d], expect[%d]\n", last, LINES - 1);
+		rc = 6;
+	}
+
+	/* index file has the archives, newest first */
+	fp = fopen(".rotate.log.index", "r");
+	if (!fp) {
+		printf("open .rotate.log.index failed\n");
+		rc = 7;
+	} else {
+		i = 0;
+		f = ARCHIVES;
+		while (fgets(line, sizeof(line), fp)) {
+			if (++i <= 3) continue; /* head, glob, mtime */
+			if (f == 0 || sscanf(line, "%d", &n) != 1 || n != i - 4
+				|| strstr(line, files[--f]) == NULL) {
+				printf("index file: %s", line);
+				rc = 8;
+			}
+		}
+		if (f != 0) {
+			printf("index file has %d archives\n", i - 3);
+			rc = 8;
+		}
+		fclose(fp);
+	}
+
+	clean();
+	printf("%s\n", rc ? "rotate fail" : "rotate ok");
+	return rc;
+}
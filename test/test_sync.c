@@ -0,0 +1,156 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <pthread.h>
+
+#include "zlog.h"
+
+#define THREADS 4
+#define LINES 1000
+
+static zlog_category_t *zc;
+static long sync_count;
+static long sync_in_logger;
+static __thread int is_logger;
+
+/* all syncs are counted, none should be made by a logging thread */
+int fdatasync(int fd)
+{
+	static int (*real_fdatasync)(int);
+
+	if (!real_fdatasync) real_fdatasync = dlsym(RTLD_NEXT, "fdatasync");
+	__sync_fetch_and_add(&sync_count, 1);
+	if (is_logger) __sync_fetch_and_add(&sync_in_logger, 1);
+	return real_fdatasync(fd);
+}
+
+static void *work(void *arg)
+{
+	long id = (long)arg;
+	int i;
+
+	is_logger = 1;
+	for (i = 0; i < LINES; i++) {
+		zlog_info(zc, "%ld %d", id, i);
+	}
+	return NULL;
+}
+
+static int count_lines(const char *path)
+{
+	FILE *fp;
+	char line[256];
+	int n = 0;
+
+	fp = fopen(path, "r");
+	if (!fp) return 0;
+	while (fgets(line, sizeof(line), fp)) n++;
+	fclose(fp);
+	return n;
+}
+
+/* threads of this process, -1 if not known */
+static int count_threads(void)
+{
+	FILE *fp;
+	char line[256];
+	int n = -1;
+
+	fp = fopen("/proc/self/status", "r");
+	if (!fp) return -1;
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "Threads: %d", &n) == 1) break;
+	}
+	fclose(fp);
+	return n;
+}
+
+int main(int argc, char** argv)
+{
+	int rc;
+	int n;
+	long i;
+	long count;
+	pthread_t tid[THREADS];
+
+	remove("sync.log");
+	remove("my_cat.sync.log");
+
+	rc = zlog_init("test_sync.conf");
+	if (rc) {
+		printf("init failed\n");
+		return 1;
+	}
+
+	zc = zlog_get_category("my_cat");
+	if (!zc) {
+		printf("get cat failed\n");
+		zlog_fini();
+		return 2;
+	}
+
+	rc = 0;
+	/* loggers only write, the sync thread syncs every period */
+	for (i = 0; i < THREADS; i++) pthread_create(&tid[i], NULL, work, (void *)i);
+	for (i = 0; i < THREADS; i++) pthread_join(tid[i], NULL);
+	usleep(300000);
+	if (sync_in_logger) {
+		printf("loggers synced[%ld] times\n", sync_in_logger);
+		rc = 3;
+	}
+	if (sync_count < 2) {
+		printf("files synced[%ld] times after period, expect 2\n", sync_count);
+		rc = 4;
+	}
+
+	/* nothing written, nothing synced */
+	count = sync_count;
+	usleep(300000);
+	if (sync_count != count) {
+		printf("clean files synced[%ld] times\n", sync_count - count);
+		rc = 5;
+	}
+
+	/* ERROR returns after both files are synced */
+	zlog_error(zc, "error");
+	if (sync_count - count != 2) {
+		printf("files synced[%ld] times at error, expect 2\n", sync_count - count);
+		rc = 6;
+	}
+
+	count = sync_count;
+	zlog_info(zc, "info");
+	if (zlog_sync() || sync_count - count != 2) {
+		printf("files synced[%ld] times by zlog_sync, expect 2\n", sync_count - count);
+		rc = 7;
+	}
+
+	n = count_lines("sync.log");
+	if (n != THREADS * LINES + 2 || count_lines("my_cat.sync.log") != n) {
+		printf("lines[%d], expect[%d]\n", n, THREADS * LINES + 2);
+		rc = 8;
+	}
+
+	zlog_fini();
+
+	/* the sync thread is joined by fini */
+	if (count_threads() > 1) {
+		printf("threads[%d] after fini\n", count_threads());
+		rc = 9;
+	}
+
+	remove("sync.log");
+	remove("my_cat.sync.log");
+	printf("%s\n", rc ? "sync fail" : "sync ok");
+	return rc;
+}
@@ -0,0 +1,130 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "zlog.h"
+
+/* the conf is written here, as the test changes it */
+static int write_conf(const char *path, const char *format)
+{
+	FILE *fp;
+
+	fp = fopen(path, "w");
+	if (!fp) return -1;
+	fprintf(fp, "[global]\n"
+		"reload conf watch = true\n"
+		"[formats]\n"
+		"simple = \"%s %%m%%n\"\n"
+		"[rules]\n"
+		"my_cat.*\t\"watch.log\"; simple\n", format);
+	fclose(fp);
+	return 0;
+}
+
+/* 0 if the last line of watch.log is expect */
+static int check_last(const char *expect)
+{
+	FILE *fp;
+	char line[256];
+	char last[256];
+
+	last[0] = '\0';
+	fp = fopen("watch.log", "r");
+	if (!fp) return -1;
+	while (fgets(line, sizeof(line), fp)) strcpy(last, line);
+	fclose(fp);
+	if (strcmp(last, expect)) {
+		printf("last line[%s], expect[%s]\n", last, expect);
+		return -1;
+	}
+	return 0;
+}
+
+/* threads of this process, -1 if not known */
+static int count_threads(void)
+{
+	FILE *fp;
+	char line[256];
+	int n = -1;
+
+	fp = fopen("/proc/self/status", "r");
+	if (!fp) return -1;
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "Threads: %d", &n) == 1) break;
+	}
+	fclose(fp);
+	return n;
+}
+
+int main(int argc, char** argv)
+{
+	int rc;
+	FILE *fp;
+	zlog_category_t *zc;
+
+	remove("watch.log");
+	if (write_conf("watch.conf", "A")) {
+		printf("write conf failed\n");
+		return 1;
+	}
+
+	rc = zlog_init("watch.conf");
+	if (rc) {
+		printf("init failed\n");
+		return 1;
+	}
+
+	zc = zlog_get_category("my_cat");
+	if (!zc) {
+		printf("get cat failed\n");
+		zlog_fini();
+		return 2;
+	}
+
+	rc = 0;
+	zlog_info(zc, "1");
+	if (check_last("A 1\n")) rc = 3;
+
+	/* written in place, same size in the same second */
+	write_conf("watch.conf", "B");
+	usleep(200000);
+	zlog_info(zc, "2");
+	if (check_last("B 2\n")) rc = 4;
+
+	/* written aside and moved */
+	write_conf("watch.conf.tmp", "CC");
+	rename("watch.conf.tmp", "watch.conf");
+	usleep(200000);
+	zlog_info(zc, "3");
+	if (check_last("CC 3\n")) rc = 5;
+
+	/* a wrong one is not used */
+	fp = fopen("watch.conf", "w");
+	fprintf(fp, "[wrong]\n");
+	fclose(fp);
+	usleep(200000);
+	zlog_info(zc, "4");
+	if (check_last("CC 4\n")) rc = 6;
+
+	zlog_fini();
+
+	/* the watcher thread is gone */
+	if (count_threads() > 1) {
+		printf("threads[%d] after fini\n", count_threads());
+		rc = 7;
+	}
+
+	remove("watch.log");
+	remove("watch.conf");
+	printf("%s\n", rc ? "watch fail" : "watch ok");
+	return rc;
+}
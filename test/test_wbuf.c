@@ -0,0 +1,130 @@
+/*
+ * This file is part of the zlog Library.
+ *
+ * Copyright (C) 2011 by Hardy Simpson <HardySimpson1984@gmail.com>
+ *
+ * Licensed under the LGPL v2.1, see the file COPYING in base directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#include "zlog.h"
+
+#define THREADS 4
+#define LINES 1000
+
+static zlog_category_t *zc;
+
+static void *work(void *arg)
+{
+	long id = (long)arg;
+	int i;
+
+	for (i = 0; i < LINES; i++) {
+		zlog_info(zc, "%ld %d xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx", id, i);
+	}
+	return NULL;
+}
+
+/* lines of the file, -1 if any of them is broken */
+static int count_lines(void)
+{
+	FILE *fp;
+	char line[256];
+	long id;
+	int i;
+	int n = 0;
+
+	fp = fopen("wbuf.log", "r");
+	if (!fp) return 0;
+	while (fgets(line, sizeof(line), fp)) {
+		if (strstr(line, "error") || strstr(line, "child")) {
+			n++;
+			continue;
+		}
+		if (sscanf(line, "%ld %d", &id, &i) != 2 || id < 0 || id > THREADS
+			|| !strstr(line, "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\n")) {
+			printf("broken line[%s]\n", line);
+			n = -1;
+			break;
+		}
+		n++;
+	}
+	fclose(fp);
+	return n;
+}
+
+int main(int argc, char** argv)
+{
+	int rc;
+	int n;
+	long i;
+	pid_t pid;
+	pthread_t tid[THREADS];
+
+	remove("wbuf.log");
+
+	rc = zlog_init("test_wbuf.conf");
+	if (rc) {
+		printf("init failed\n");
+		return 1;
+	}
+
+	zc = zlog_get_category("my_cat");
+	if (!zc) {
+		printf("get cat failed\n");
+		zlog_fini();
+		return 2;
+	}
+
+	rc = 0;
+	/* the last one is kept in the buffer, ERROR writes it out with itself */
+	zlog_info(zc, "%d %d xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx", THREADS, 0);
+	n = count_lines();
+	if (n != 0) {
+		printf("info is written at once, lines[%d]\n", n);
+		rc = 3;
+	}
+	zlog_error(zc, "error");
+	n = count_lines();
+	if (n != 2) {
+		printf("error is not written at once, lines[%d]\n", n);
+		rc = 4;
+	}
+
+	/* the flush thread writes them out in time */
+	for (i = 0; i < THREADS; i++) pthread_create(&tid[i], NULL, work, (void *)i);
+	for (i = 0; i < THREADS; i++) pthread_join(tid[i], NULL);
+	zlog_info(zc, "%d %d xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx", THREADS, 1);
+	usleep(200000);
+	n = count_lines();
+	if (n != 2 + THREADS * LINES + 1) {
+		printf("lines[%d] after flush period, expect[%d]\n", n, 2 + THREADS * LINES + 1);
+		rc = 5;
+	}
+
+	/* msgs of parent are written before fork, of child at its exit */
+	zlog_info(zc, "%d %d xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx", THREADS, 2);
+	pid = fork();
+	if (pid == 0) {
+		zlog_info(zc, "child");
+		exit(0);
+	}
+	waitpid(pid, NULL, 0);
+	n = count_lines();
+	if (n != 2 + THREADS * LINES + 3) {
+		printf("lines[%d] after fork, expect[%d]\n", n, 2 + THREADS * LINES + 3);
+		rc = 6;
+	}
+
+	zlog_fini();
+
+	remove("wbuf.log");
+	printf("%s\n", rc ? "wbuf fail" : "wbuf ok");
+	return rc;
+}